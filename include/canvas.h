@@ -8,12 +8,272 @@
 #ifndef CANVAS_H
 #define CANVAS_H
 
+#ifdef __EMSCRIPTEN__
 #include <emscripten.h>
+#endif
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 typedef struct HTMLCanvasElement HTMLCanvasElement;
 typedef struct CanvasRenderingContext2D CanvasRenderingContext2D;
+typedef struct CanvasState CanvasState;
+typedef struct ImageData ImageData;
+typedef struct Path2D Path2D;
+typedef struct SoftwareSurface SoftwareSurface;
+typedef struct SoftwareRenderer SoftwareRenderer;
+typedef struct CanvasPath CanvasPath;
+typedef struct CanvasEdgeList CanvasEdgeList;
+typedef struct CanvasShapeRegistry CanvasShapeRegistry;
+typedef struct CanvasTraceTarget CanvasTraceTarget;
+
+/** Maximum number of separate dirty rectangles an ImageData tracks before they are merged. */
+#define IMAGE_DATA_MAX_DIRTY_RECTS 16
+
+/**
+ * Legal values of CanvasRenderingContext2D lineCap, for use with setLineCapEnum() and
+ * getLineCapEnum(). Passing these across to JavaScript costs a small integer rather than a string.
+ */
+typedef enum CanvasLineCap
+{
+    LINE_CAP_BUTT,
+    LINE_CAP_ROUND,
+    LINE_CAP_SQUARE
+} CanvasLineCap;
+
+/** Legal values of CanvasRenderingContext2D lineJoin, for use with setLineJoinEnum() and getLineJoinEnum(). */
+typedef enum CanvasLineJoin
+{
+    LINE_JOIN_ROUND,
+    LINE_JOIN_BEVEL,
+    LINE_JOIN_MITER
+} CanvasLineJoin;
+
+/** Legal values of CanvasRenderingContext2D textAlign, for use with setTextAlignEnum() and getTextAlignEnum(). */
+typedef enum CanvasTextAlign
+{
+    TEXT_ALIGN_START,
+    TEXT_ALIGN_END,
+    TEXT_ALIGN_LEFT,
+    TEXT_ALIGN_RIGHT,
+    TEXT_ALIGN_CENTER
+} CanvasTextAlign;
+
+/**
+ * Legal values of CanvasRenderingContext2D globalCompositeOperation, for use with
+ * setGlobalCompositeOperationEnum() and getGlobalCompositeOperationEnum().
+ */
+typedef enum CanvasCompositeOperation
+{
+    COMPOSITE_SOURCE_OVER,
+    COMPOSITE_SOURCE_IN,
+    COMPOSITE_SOURCE_OUT,
+    COMPOSITE_SOURCE_ATOP,
+    COMPOSITE_DESTINATION_OVER,
+    COMPOSITE_DESTINATION_IN,
+    COMPOSITE_DESTINATION_OUT,
+    COMPOSITE_DESTINATION_ATOP,
+    COMPOSITE_LIGHTER,
+    COMPOSITE_COPY,
+    COMPOSITE_XOR,
+    COMPOSITE_MULTIPLY,
+    COMPOSITE_SCREEN,
+    COMPOSITE_OVERLAY,
+    COMPOSITE_DARKEN,
+    COMPOSITE_LIGHTEN,
+    COMPOSITE_COLOR_DODGE,
+    COMPOSITE_COLOR_BURN,
+    COMPOSITE_HARD_LIGHT,
+    COMPOSITE_SOFT_LIGHT,
+    COMPOSITE_DIFFERENCE,
+    COMPOSITE_EXCLUSION,
+    COMPOSITE_HUE,
+    COMPOSITE_SATURATION,
+    COMPOSITE_COLOR,
+    COMPOSITE_LUMINOSITY
+} CanvasCompositeOperation;
+
+/** Rules deciding which points lie inside a path, for isPointInPathFillRule() and isPointInPath2D(). */
+typedef enum CanvasFillRule
+{
+    FILL_RULE_NONZERO,
+    FILL_RULE_EVENODD
+} CanvasFillRule;
+
+/**
+ * An affine transform as in CanvasRenderingContext2D.setTransform(): a point (x, y) maps to
+ * (a * x + c * y + e, b * x + d * y + f).
+ */
+typedef struct CanvasMatrix
+{
+    double a, b, c, d, e, f;
+} CanvasMatrix;
+
+/**
+ * Canonical strings of the keyword-valued properties, indexed by the matching enum values above
+ * and terminated by NULL. For example, canvasLineCapKeywords[LINE_CAP_ROUND] is "round".
+ */
+extern const char *const canvasLineCapKeywords[];
+extern const char *const canvasLineJoinKeywords[];
+extern const char *const canvasTextAlignKeywords[];
+extern const char *const canvasCompositeOperationKeywords[];
+
+/** Returns the index of value in one of the NULL-terminated keyword tables above, or -1 if it isn't listed. */
+int canvasKeywordIndex(const char *const *keywords, const char *value);
+
+/**
+ * Capacity in bytes, including the terminator, of each string buffer in a CanvasState. Values
+ * longer than this are still passed to JavaScript intact, but are truncated when read back by
+ * a getter and never used to elide a redundant setter call.
+ */
+#define CANVAS_STATE_STRING_CAPACITY 128
+
+/**
+ * Shadow copy of the drawing state of a CanvasRenderingContext2D. The context keeps the
+ * state in effect on the JavaScript side mirrored here, so getters can be answered without
+ * leaving C and setters given the value already in effect can be skipped. save() and restore()
+ * push and pop copies of this struct.
+ *
+ * Keyword-valued properties are stored as their enum values (CanvasLineCap, ...), which double as
+ * indices into the canonical keyword tables in canvas.c.
+ * String-valued properties are held in fixed-capacity buffers, so neither getters nor save()
+ * and restore() allocate. They keep both the value as the browser serializes it (returned by the
+ * getters) and the value most recently requested by the user (so repeated requests are elided
+ * even when the browser normalizes them, e.g. "red" becoming "#ff0000").
+ */
+struct CanvasState
+{
+    double lineWidth;
+    double globalAlpha;
+    CanvasLineCap lineCap;
+    CanvasLineJoin lineJoin;
+    CanvasTextAlign textAlign;
+    CanvasCompositeOperation globalCompositeOperation;
+    char font[CANVAS_STATE_STRING_CAPACITY];
+    char fontRequested[CANVAS_STATE_STRING_CAPACITY];
+    char fillStyle[CANVAS_STATE_STRING_CAPACITY];
+    char fillStyleRequested[CANVAS_STATE_STRING_CAPACITY];
+    char strokeStyle[CANVAS_STATE_STRING_CAPACITY];
+    char strokeStyleRequested[CANVAS_STATE_STRING_CAPACITY];
+    /* packed colors last set by setFillColor()/setStrokeColor(), meaningful while the flags are set */
+    uint32_t fillColor;
+    uint32_t strokeColor;
+    int fillIsColor;
+    int strokeIsColor;
+    /** current transform, so paths can be kept in device space for hit testing */
+    CanvasMatrix transform;
+};
+
+/**
+ * Struct describing a block of pixels, like the ImageData object in JavaScript, whose storage lives
+ * in the wasm heap. This struct should be instantiated using the createImageData() function, and,
+ * when you're done using it, should be freed using the freeImageData() function.
+ *
+ * Pixels are stored row by row, top to bottom, as non-premultiplied RGBA with one byte per channel,
+ * so data holds width * height * 4 bytes. Write to data directly, then hand the struct to a
+ * context's putImageData(); the browser reads the pixels in place, without copying them first.
+ *
+ *     ImageData *image = createImageData(256, 256);
+ *     memset(image->data, 255, 256 * 256 * 4); // opaque white
+ *     ctx->putImageData(ctx, image, 0, 0);
+ *     freeImageData(image);
+ *
+ * When only parts of the pixels change from frame to frame, report the changed areas with
+ * markDirty() and upload them with a context's putImageDataDirty(), which sends only the damaged
+ * regions to the canvas. Overlapping or nearby dirty rectangles are coalesced as they are marked.
+ *
+ *     drawCursor(image->data, x, y);
+ *     image->markDirty(image, x, y, 16, 16);
+ *     ctx->putImageDataDirty(ctx, image, 0, 0);
+ */
+struct ImageData
+{
+    /**
+     * This anonymous struct holds the index of the JavaScript ImageData object wrapping this struct's
+     * pixels, which is reused across putImageData() calls as long as wasm memory hasn't grown, and
+     * the dirty rectangles accumulated since the last putImageDataDirty() as (x, y, width, height).
+     */
+    struct
+    {
+        int handle;
+        int damage[4 * IMAGE_DATA_MAX_DIRTY_RECTS];
+        int damageCount;
+        double coalescing;
+    } private;
+    int width;
+    int height;
+    unsigned char *data;
+    /** Records that the pixels in the given rectangle changed. The rectangle is clipped to the image. */
+    void (*markDirty)(ImageData *this, int x, int y, int width, int height);
+    /**
+     * Sets how eagerly dirty rectangles are merged. Two rectangles are merged when the area of
+     * their bounding box is at most factor times the sum of their areas; 1.0 merges only when
+     * nothing is gained by keeping them apart, larger values trade uploading some clean pixels for
+     * fewer putImageData() calls. The default is 1.5. Once IMAGE_DATA_MAX_DIRTY_RECTS rectangles
+     * are tracked, new ones are merged into whichever existing rectangle grows the least.
+     */
+    void (*setDirtyCoalescing)(ImageData *this, double factor);
+    /** Discards all dirty rectangles without uploading them. */
+    void (*clearDirty)(ImageData *this);
+};
+
+/**
+ * A reusable path, like Path2D in JavaScript. Build it once with the same calls as a context's
+ * current path, then draw it any number of times with a context's fillPath(), strokePath() and
+ * clipPath(), or hit test it with isPointInPath2D() and isPointInStroke2D().
+ *
+ * Segments are buffered in wasm memory as they're added. The first time the path is used with a
+ * DOM canvas, the whole buffer is turned into a JavaScript Path2D in a single call, which is kept
+ * and referenced by handle from then on; segments added later are appended to it on next use. So a
+ * static outline costs one call into JavaScript per draw instead of one per segment. As with any
+ * Path2D, coordinates are transformed by the transform in effect when the path is drawn. Draws
+ * recorded by a context in recording mode use the path as it was when they were recorded, even if
+ * it is changed or freed before they're flushed.
+ *
+ *     Path2D *outline = createPath2D();
+ *     outline->polyline(outline, xy, count, 1);
+ *     ctx->fillPath(ctx, outline); // each frame
+ *     freePath2D(outline);
+ */
+struct Path2D
+{
+    struct
+    {
+        /** index of the JavaScript Path2D in the path table, or -1 before it is first used */
+        int handle;
+        /** segments, encoded as the opcodes of the context's command buffer */
+        double *commands;
+        size_t commandsLength;
+        size_t commandsCapacity;
+        /** length of the prefix of commands already added to the JavaScript Path2D */
+        size_t builtLength;
+        /**
+         * the path flattened for hit testing, under the identity transform shape registries use and
+         * under the last other transform, so neither evicts the other
+         */
+        struct
+        {
+            /** the path flattened with transform, valid while length is commandsLength */
+            CanvasPath *flattened;
+            CanvasMatrix transform;
+            size_t length;
+            /** edges of the flattened path, filled and stroked as last hit tested */
+            CanvasEdgeList *fillEdges;
+            CanvasEdgeList *strokeEdges;
+        } hitCaches[2];
+    } private;
+    void (*closePath)(Path2D *this);
+    void (*moveTo)(Path2D *this, double x, double y);
+    void (*lineTo)(Path2D *this, double x, double y);
+    void (*bezierCurveTo)(Path2D *this, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y);
+    void (*quadraticCurveTo)(Path2D *this, double cpx, double cpy, double x, double y);
+    void (*arc)(Path2D *this, double x, double y, double radius, double startAngle, double endAngle);
+    void (*arcTo)(Path2D *this, double x1, double y1, double x2, double y2, double radius);
+    void (*ellipse)(Path2D *this, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle);
+    void (*rect)(Path2D *this, double x, double y, double width, double height);
+    /** Adds a polyline through count (x, y) float pairs, as CanvasRenderingContext2D polyline() does. */
+    void (*polyline)(Path2D *this, const float *xy, size_t count, int closed);
+};
 
 /**
  * Struct containing state and OO-like behavior of a CanvasRenderingContext2D structured similarly
@@ -41,38 +301,94 @@ typedef struct CanvasRenderingContext2D CanvasRenderingContext2D;
  *     ctx->fillRect(ctx, 50, 75, 100, 200);
  *     freeCanvas(canvas);
  * 
- * Some state is pseudo-encapsulated in the 'private' member struct, such as pointers to dynamically
- * allocated strings that will need to be freed when the HTMLCanvas is freed. Typically these
- * are from JavaScript calls, allocated to return them to the user. Alternatively, functions
- * with canonical string return types could be pigeon-holed into returning enum types, or
- * we could make the user responsible for buffer allocation and expect an additional by-reference
- * parameter to copy the string into. The in-JavaScript allocated string would need to be
- * freed after returning its contents to the user, and the user would not know how large the buffer
- * should be. So, when a string is exposed to the user, this struct keeps track of the pointers in
- * order to free them when the HTMLCanvas parent struct is freed.
+ * Some state is pseudo-encapsulated in the 'private' member struct. Most notably, the context keeps
+ * a shadow of its drawing state (line width, styles, font, ...) in C. Getters answer from the shadow
+ * without calling into JavaScript, and setters given the value already in effect do nothing. Strings
+ * returned by getters point either to canonical keyword strings or to fixed buffers owned by the
+ * context, so getters never allocate. The contents remain valid until the property changes or the
+ * HTMLCanvas parent struct is freed; don't free them yourself. Since the shadow is only updated
+ * through this struct, changing the context's state directly from JavaScript is not supported.
  */
 struct CanvasRenderingContext2D
 {
     /**
      * This anonymous struct encapsulates fields of the CanvasRenderingContext2D struct
-     * intended to be private. These are primarily pointers to memory allocated from
-     * JavaScript calls so that they can be freed when the canvas is no longer in use.
+     * intended to be private. These are primarily the C-side shadow of the drawing state
+     * (see CanvasState) and buffers that need to be freed when the canvas is no longer in use.
      */
     struct
     {
         HTMLCanvasElement *canvas;
         char contextType[19];
-        char *font;
-        char *textAlign;
-        char *fillStyle;
-        char *strokeStyle;
-        char *lineCap;
-        char *lineJoin;
-        char *globalCompositeOperation;
+        CanvasState state;
+        CanvasState *stateStack;
+        size_t stateStackLength;
+        size_t stateStackCapacity;
+        double *commands;
+        size_t commandsLength;
+        size_t commandsCapacity;
+        int recording;
+        /** the current path, flattened into device space so hit tests needn't call into JavaScript */
+        CanvasPath *path;
+        /** edges of path, filled or stroked as last hit tested */
+        CanvasEdgeList *hitEdges;
+        /** corners of the rectangles drawn by fillRectsTransformed(), transformed into device space */
+        float *quads;
+        size_t quadsCapacity;
+        /** state of the software backend (see raster.h), or NULL for contexts drawing to a DOM canvas */
+        SoftwareRenderer *renderer;
+        /** the trace timing this context's calls (see trace.h), or NULL */
+        CanvasTraceTarget *trace;
+        /** handles of the JavaScript Path2D objects drawn by commands, kept as they are until it's flushed */
+        int *pathHandles;
+        size_t pathHandlesLength;
+        size_t pathHandlesCapacity;
     } private;
     void (*clearRect)(CanvasRenderingContext2D *this, double x, double y, double width, double height);
     void (*fillRect)(CanvasRenderingContext2D *this, double x, double y, double width, double height);
     void (*strokeRect)(CanvasRenderingContext2D *this, double x, double y, double width, double height);
+    /**
+     * Clears count rectangles in one call into JavaScript. The rectangles are read straight out of
+     * wasm memory as consecutive (x, y, width, height) quadruples, so xywh holds 4 * count floats.
+     */
+    void (*clearRects)(CanvasRenderingContext2D *this, const float *xywh, size_t count);
+    /** Fills count rectangles in one call into JavaScript. See clearRects() for the layout of xywh. */
+    void (*fillRects)(CanvasRenderingContext2D *this, const float *xywh, size_t count);
+    /** Strokes count rectangles in one call into JavaScript. See clearRects() for the layout of xywh. */
+    void (*strokeRects)(CanvasRenderingContext2D *this, const float *xywh, size_t count);
+    /**
+     * Fills count rectangles in one call into JavaScript, each in its own color packed as 0xRRGGBBAA
+     * (see setFillColor()). The fill style in effect before the call is left unchanged.
+     */
+    void (*fillRectsColored)(CanvasRenderingContext2D *this, const float *xywh, const uint32_t *rgba, size_t count);
+    /**
+     * Fills count rectangles, rectangle i transformed by the current transform multiplied by the
+     * 6 floats (a, b, c, d, e, f) at matrices + 6 * i, as transform() would. This suits sprites with
+     * a rotation or scale of their own. The corners are transformed in wasm, so JavaScript draws the
+     * rectangles under an identity transform without any save(), transform() or restore() per
+     * rectangle, though gradients and patterns are then positioned in canvas coordinates. Pass NULL
+     * for matrices to apply only the current transform. The rectangles are filled as one path, so
+     * where they overlap they're painted once. The current path is left untouched. See clearRects()
+     * for the layout of xywh.
+     */
+    void (*fillRectsTransformed)(CanvasRenderingContext2D *this, const float *xywh, const float *matrices, size_t count);
+    /**
+     * Paints the pixels of image onto the canvas with its top left corner at (dx, dy). The pixels
+     * are viewed directly in wasm memory rather than copied into a fresh JavaScript array. As in
+     * JavaScript, the transform, global alpha and composite operation don't apply.
+     */
+    void (*putImageData)(CanvasRenderingContext2D *this, ImageData *image, int dx, int dy);
+    /**
+     * Copies the pixels of the canvas in the rectangle with its top left corner at (sx, sy) and the
+     * dimensions of dest into dest->data. Nothing is allocated on the wasm heap.
+     */
+    void (*getImageData)(CanvasRenderingContext2D *this, ImageData *dest, int sx, int sy);
+    /**
+     * Paints only the regions of image marked with its markDirty() since the last call, as
+     * putImageData() with dirty rectangle arguments, in a single call into JavaScript. The image's
+     * dirty rectangles are cleared afterwards.
+     */
+    void (*putImageDataDirty)(CanvasRenderingContext2D *this, ImageData *image, int dx, int dy);
     /** @param maxWidth optional parameter. provide a value < 0.0 to ignore this parameter. */
     void (*fillText)(CanvasRenderingContext2D *this, char *text, double x, double y, double maxWidth);
     /** @param maxWidth optional parameter. provide a value < 0.0 to ignore this parameter. */
@@ -82,16 +398,33 @@ struct CanvasRenderingContext2D
     double (*getLineWidth)(CanvasRenderingContext2D *this);
     void (*setLineCap)(CanvasRenderingContext2D *this, char *type);
     char *(*getLineCap)(CanvasRenderingContext2D *this);
+    /** Like setLineCap(), but without marshaling a string. Values outside the enum are ignored. */
+    void (*setLineCapEnum)(CanvasRenderingContext2D *this, CanvasLineCap type);
+    CanvasLineCap (*getLineCapEnum)(CanvasRenderingContext2D *this);
     void (*setLineJoin)(CanvasRenderingContext2D *this, char *type);
     char *(*getLineJoin)(CanvasRenderingContext2D *this);
+    /** Like setLineJoin(), but without marshaling a string. Values outside the enum are ignored. */
+    void (*setLineJoinEnum)(CanvasRenderingContext2D *this, CanvasLineJoin type);
+    CanvasLineJoin (*getLineJoinEnum)(CanvasRenderingContext2D *this);
     char *(*getFont)(CanvasRenderingContext2D *this);
     void (*setFont)(CanvasRenderingContext2D *this, char *value);
     void (*setTextAlign)(CanvasRenderingContext2D *this, char *value);
     char *(*getTextAlign)(CanvasRenderingContext2D *this);
+    /** Like setTextAlign(), but without marshaling a string. Values outside the enum are ignored. */
+    void (*setTextAlignEnum)(CanvasRenderingContext2D *this, CanvasTextAlign value);
+    CanvasTextAlign (*getTextAlignEnum)(CanvasRenderingContext2D *this);
     void (*setFillStyle)(CanvasRenderingContext2D *this, char *value);
     char *(*getFillStyle)(CanvasRenderingContext2D *this);
     void (*setStrokeStyle)(CanvasRenderingContext2D *this, char *value);
     char *(*getStrokeStyle)(CanvasRenderingContext2D *this);
+    /**
+     * Sets the fill style to a color packed as 0xRRGGBBAA, e.g. 0xFF000080 for half-transparent red.
+     * The color crosses into JavaScript as an integer and is mapped to a cached CSS string there,
+     * so repeated colors reach the browser as identical strings and need no formatting in C.
+     */
+    void (*setFillColor)(CanvasRenderingContext2D *this, uint32_t rgba);
+    /** Sets the stroke style to a color packed as 0xRRGGBBAA. See setFillColor(). */
+    void (*setStrokeColor)(CanvasRenderingContext2D *this, uint32_t rgba);
     void (*beginPath)(CanvasRenderingContext2D *this);
     void (*closePath)(CanvasRenderingContext2D *this);
     void (*moveTo)(CanvasRenderingContext2D *this, double x, double y);
@@ -102,23 +435,73 @@ struct CanvasRenderingContext2D
     void (*arcTo)(CanvasRenderingContext2D *this, double x1, double y1, double x2, double y2, double radius);
     void (*ellipse)(CanvasRenderingContext2D *this, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle);
     void (*rect)(CanvasRenderingContext2D *this, double x, double y, double width, double height);
+    /**
+     * Adds a polyline through count vertices to the current path in one call into JavaScript:
+     * a moveTo() to the first vertex, lineTo() the rest, and a closePath() if closed is non-zero.
+     * The vertices are read straight out of wasm memory as consecutive (x, y) float pairs.
+     */
+    void (*polyline)(CanvasRenderingContext2D *this, const float *xy, size_t count, int closed);
+    /**
+     * Adds polylineCount polylines to the current path in one call into JavaScript, as if by
+     * polyline(). All vertices are stored back to back in xy; polyline i spans vertices
+     * offsets[i] up to (not including) offsets[i + 1], so offsets holds polylineCount + 1 entries.
+     */
+    void (*polylines)(CanvasRenderingContext2D *this, const float *xy, const uint32_t *offsets, size_t polylineCount, int closed);
     void (*fill)(CanvasRenderingContext2D *this);
     void (*stroke)(CanvasRenderingContext2D *this);
     void (*clip)(CanvasRenderingContext2D *this);
+    /**
+     * Returns non-zero if (x, y), in canvas coordinates unaffected by the current transform, lies
+     * within the current path under the nonzero rule. The path is kept flattened in wasm memory as it is built,
+     * so neither this nor the other hit tests call into JavaScript or flush a recording context.
+     * Points outside the path's bounding box are rejected before any edge is examined.
+     */
     int (*isPointInPath)(CanvasRenderingContext2D *this, double x, double y);
+    /** Like isPointInPath(), but with the given fill rule. */
+    int (*isPointInPathFillRule)(CanvasRenderingContext2D *this, double x, double y, CanvasFillRule fillRule);
+    /**
+     * Returns non-zero if (x, y) lies within the area stroking the current path would cover, with
+     * the current line width, cap and join. Dashes and the miter limit aren't taken into account.
+     */
     int (*isPointInStroke)(CanvasRenderingContext2D *this, double x, double y);
+    /** Fills path (see Path2D) with the current fill style. The current path is left untouched. */
+    void (*fillPath)(CanvasRenderingContext2D *this, Path2D *path);
+    /** Strokes path with the current stroke style. The current path is left untouched. */
+    void (*strokePath)(CanvasRenderingContext2D *this, Path2D *path);
+    /** Intersects the clipping region with path. The current path is left untouched. */
+    void (*clipPath)(CanvasRenderingContext2D *this, Path2D *path);
+    /** Like isPointInPathFillRule(), but tests path, with the current transform, rather than the current path. */
+    int (*isPointInPath2D)(CanvasRenderingContext2D *this, Path2D *path, double x, double y, CanvasFillRule fillRule);
+    /** Like isPointInStroke(), but tests path rather than the current path. */
+    int (*isPointInStroke2D)(CanvasRenderingContext2D *this, Path2D *path, double x, double y);
     void (*rotate)(CanvasRenderingContext2D *this, double angle);
     void (*scale)(CanvasRenderingContext2D *this, double x, double y);
     void (*translate)(CanvasRenderingContext2D *this, double x, double y);
     void (*transform)(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f);
     void (*setTransform)(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f);
     void (*resetTransform)(CanvasRenderingContext2D *this);
+    /** Returns the current transform. It's kept in C, saved and restored with the rest of the state, so this doesn't call into JavaScript. */
+    CanvasMatrix (*getTransform)(CanvasRenderingContext2D *this);
     void (*setGlobalAlpha)(CanvasRenderingContext2D *this, double value);
     double (*getGlobalAlpha)(CanvasRenderingContext2D *this);
     void (*setGlobalCompositeOperation)(CanvasRenderingContext2D *this, char *value);
     char *(*getGlobalCompositeOperation)(CanvasRenderingContext2D *this);
+    /** Like setGlobalCompositeOperation(), but without marshaling a string. Values outside the enum are ignored. */
+    void (*setGlobalCompositeOperationEnum)(CanvasRenderingContext2D *this, CanvasCompositeOperation value);
+    CanvasCompositeOperation (*getGlobalCompositeOperationEnum)(CanvasRenderingContext2D *this);
     void (*save)(CanvasRenderingContext2D *this);
     void (*restore)(CanvasRenderingContext2D *this);
+    /**
+     * Switches the context into recording mode. Drawing, path, transform and numeric state calls
+     * are appended to a command buffer in wasm memory instead of each crossing into JavaScript.
+     * The buffer is replayed by flush(). Calls which read state, take strings or otherwise can't
+     * be deferred flush the buffer first, so ordering is always preserved.
+     */
+    void (*beginRecording)(CanvasRenderingContext2D *this);
+    /** Flushes any recorded commands and switches the context back to immediate mode. */
+    void (*endRecording)(CanvasRenderingContext2D *this);
+    /** Replays all recorded commands in a single call into JavaScript and empties the buffer. */
+    void (*flush)(CanvasRenderingContext2D *this);
     HTMLCanvasElement *(*getCanvas)(CanvasRenderingContext2D *this);
 };
 
@@ -150,6 +533,14 @@ struct HTMLCanvasElement
     {
         CanvasRenderingContext2D *ctx;
         char *id;
+        /** index of this canvas' element and 2d context in the JavaScript-side handle table */
+        int handle;
+        /** pixels of a canvas created by the software backend (see raster.h), or NULL for DOM canvases */
+        SoftwareSurface *surface;
+        /** frees this struct and everything it owns; differs between backends */
+        void (*release)(HTMLCanvasElement *this);
+        /** shapes registered with addShape() and the grid indexing them (see shapes.h) */
+        CanvasShapeRegistry *shapes;
     } private;
     /** 
      * Returns a positive integer reflecting the height HTML attribute of the <canvas> element
@@ -178,6 +569,35 @@ struct HTMLCanvasElement
      * The field retrieved by this getter function behaves like a singleton. 
      */
     CanvasRenderingContext2D *(*getContext)(HTMLCanvasElement *this, char *contextType);
+    /**
+     * Registers a shape for getShapeAt() and getShapesAt(): path drawn with the given transform (NULL
+     * for the identity), hit wherever filling it with fillRule would paint and, if strokeWidth is
+     * positive, within strokeWidth / 2 of its outline too. Returns the shape's id, a small
+     * non-negative integer which may be reused once the shape is removed.
+     *
+     * Shapes are indexed by bounding box in a uniform grid, so a query only tests the few shapes near
+     * the point exactly, however many are registered. Registering shapes in bulk is cheap: the grid
+     * is built, or rebuilt once it no longer fits the shapes, by the next query. One Path2D can back
+     * any number of shapes, and must outlive them. The canvas' own size and context don't matter.
+     *
+     *     for (int i = 0; i < nodeCount; i++)
+     *         nodes[i].shape = canvas->addShape(canvas, nodeOutline, &nodes[i].placement, FILL_RULE_NONZERO, 0);
+     *     int hovered = canvas->getShapeAt(canvas, mouseX, mouseY);
+     */
+    int (*addShape)(HTMLCanvasElement *this, Path2D *path, const CanvasMatrix *transform, CanvasFillRule fillRule, double strokeWidth);
+    /**
+     * Moves shape to the given transform, or keeps its transform if that is NULL. Call this too after
+     * adding segments to the shape's path, so its bounding box is brought up to date.
+     */
+    void (*updateShape)(HTMLCanvasElement *this, int shape, const CanvasMatrix *transform);
+    void (*removeShape)(HTMLCanvasElement *this, int shape);
+    /** Returns the id of the topmost (most recently added) shape containing (x, y), or -1 if there is none. */
+    int (*getShapeAt)(HTMLCanvasElement *this, double x, double y);
+    /**
+     * Stores the ids of up to capacity shapes containing (x, y) in shapes, topmost first, and returns
+     * how many shapes contain the point in all.
+     */
+    size_t (*getShapesAt)(HTMLCanvasElement *this, double x, double y, int *shapes, size_t capacity);
 };
 
 /**
@@ -202,14 +622,198 @@ struct HTMLCanvasElement
  *     HTMLCanvas *sameOldCanvas = createCanvas("myCanvas");
  *     int width = sameOldCanvas->getWidth(sameOldCanvas);
  *     freeCanvas(sameOldCanvas);
+ *
+ * When compiled natively rather than with Emscripten, there is no DOM; this function then returns
+ * a 300x150 canvas drawn by the software backend instead, as if by createSoftwareCanvas() in raster.h.
  */
 HTMLCanvasElement *createCanvas(char *name);
 
 /**
  * Frees the dynamically allocated HTMLCanvasElement and any dynamically allocated
- * state as necessary. The DOM canvas element will still exist in HTML after freeing
+ * state as necessary, for canvases of either backend. The DOM canvas element will still exist in HTML after freeing
  * the struct.
  */
 void freeCanvas(HTMLCanvasElement *canvas);
 
+/**
+ * Creates an ImageData struct of the given dimensions, with its pixel storage allocated on the
+ * wasm heap and initialized to transparent black. It starts with no dirty rectangles. Free it with freeImageData() when done.
+ */
+ImageData *createImageData(int width, int height);
+
+/** Frees an ImageData struct and its pixel storage. */
+void freeImageData(ImageData *image);
+
+/** Creates an empty Path2D. Free it with freePath2D() when done. */
+Path2D *createPath2D(void);
+
+/**
+ * Frees a Path2D and the JavaScript Path2D made from it. Draws of the path still waiting in a
+ * recording context's command buffer must be flushed first.
+ */
+void freePath2D(Path2D *path);
+
+/**
+ * Adds the segments of path to the current path of ctx, as if each had been added with the
+ * context's own moveTo(), lineTo(), ... calls.
+ */
+void tracePath2D(CanvasRenderingContext2D *ctx, Path2D *path);
+
+#ifdef CANVAS_STATS
+/**
+ * Methods whose calls are counted in CanvasStats, as X(ENUM_SUFFIX, name) for each. The first few
+ * are of HTMLCanvasElement (and the functions creating and freeing one), the rest of
+ * CanvasRenderingContext2D, in the order they're declared.
+ */
+#define CANVAS_STATS_METHODS(X) \
+    X(CREATE_CANVAS, createCanvas) \
+    X(FREE_CANVAS, freeCanvas) \
+    X(GET_WIDTH, getWidth) \
+    X(GET_HEIGHT, getHeight) \
+    X(SET_WIDTH, setWidth) \
+    X(SET_HEIGHT, setHeight) \
+    X(GET_CONTEXT, getContext) \
+    X(CLEAR_RECT, clearRect) \
+    X(FILL_RECT, fillRect) \
+    X(STROKE_RECT, strokeRect) \
+    X(CLEAR_RECTS, clearRects) \
+    X(FILL_RECTS, fillRects) \
+    X(STROKE_RECTS, strokeRects) \
+    X(FILL_RECTS_COLORED, fillRectsColored) \
+    X(FILL_RECTS_TRANSFORMED, fillRectsTransformed) \
+    X(PUT_IMAGE_DATA, putImageData) \
+    X(GET_IMAGE_DATA, getImageData) \
+    X(PUT_IMAGE_DATA_DIRTY, putImageDataDirty) \
+    X(FILL_TEXT, fillText) \
+    X(STROKE_TEXT, strokeText) \
+    X(SET_LINE_WIDTH, setLineWidth) \
+    X(GET_LINE_WIDTH, getLineWidth) \
+    X(SET_LINE_CAP, setLineCap) \
+    X(GET_LINE_CAP, getLineCap) \
+    X(SET_LINE_CAP_ENUM, setLineCapEnum) \
+    X(GET_LINE_CAP_ENUM, getLineCapEnum) \
+    X(SET_LINE_JOIN, setLineJoin) \
+    X(GET_LINE_JOIN, getLineJoin) \
+    X(SET_LINE_JOIN_ENUM, setLineJoinEnum) \
+    X(GET_LINE_JOIN_ENUM, getLineJoinEnum) \
+    X(GET_FONT, getFont) \
+    X(SET_FONT, setFont) \
+    X(SET_TEXT_ALIGN, setTextAlign) \
+    X(GET_TEXT_ALIGN, getTextAlign) \
+    X(SET_TEXT_ALIGN_ENUM, setTextAlignEnum) \
+    X(GET_TEXT_ALIGN_ENUM, getTextAlignEnum) \
+    X(SET_FILL_STYLE, setFillStyle) \
+    X(GET_FILL_STYLE, getFillStyle) \
+    X(SET_STROKE_STYLE, setStrokeStyle) \
+    X(GET_STROKE_STYLE, getStrokeStyle) \
+    X(SET_FILL_COLOR, setFillColor) \
+    X(SET_STROKE_COLOR, setStrokeColor) \
+    X(BEGIN_PATH, beginPath) \
+    X(CLOSE_PATH, closePath) \
+    X(MOVE_TO, moveTo) \
+    X(LINE_TO, lineTo) \
+    X(BEZIER_CURVE_TO, bezierCurveTo) \
+    X(QUADRATIC_CURVE_TO, quadraticCurveTo) \
+    X(ARC, arc) \
+    X(ARC_TO, arcTo) \
+    X(ELLIPSE, ellipse) \
+    X(RECT, rect) \
+    X(POLYLINE, polyline) \
+    X(POLYLINES, polylines) \
+    X(FILL, fill) \
+    X(STROKE, stroke) \
+    X(CLIP, clip) \
+    X(IS_POINT_IN_PATH, isPointInPath) \
+    X(IS_POINT_IN_PATH_FILL_RULE, isPointInPathFillRule) \
+    X(IS_POINT_IN_STROKE, isPointInStroke) \
+    X(FILL_PATH, fillPath) \
+    X(STROKE_PATH, strokePath) \
+    X(CLIP_PATH, clipPath) \
+    X(IS_POINT_IN_PATH_2D, isPointInPath2D) \
+    X(IS_POINT_IN_STROKE_2D, isPointInStroke2D) \
+    X(ROTATE, rotate) \
+    X(SCALE, scale) \
+    X(TRANSLATE, translate) \
+    X(TRANSFORM, transform) \
+    X(SET_TRANSFORM, setTransform) \
+    X(RESET_TRANSFORM, resetTransform) \
+    X(GET_TRANSFORM, getTransform) \
+    X(SET_GLOBAL_ALPHA, setGlobalAlpha) \
+    X(GET_GLOBAL_ALPHA, getGlobalAlpha) \
+    X(SET_GLOBAL_COMPOSITE_OPERATION, setGlobalCompositeOperation) \
+    X(GET_GLOBAL_COMPOSITE_OPERATION, getGlobalCompositeOperation) \
+    X(SET_GLOBAL_COMPOSITE_OPERATION_ENUM, setGlobalCompositeOperationEnum) \
+    X(GET_GLOBAL_COMPOSITE_OPERATION_ENUM, getGlobalCompositeOperationEnum) \
+    X(SAVE, save) \
+    X(RESTORE, restore) \
+    X(BEGIN_RECORDING, beginRecording) \
+    X(END_RECORDING, endRecording) \
+    X(FLUSH, flush) \
+    X(GET_CANVAS, getCanvas)
+
+/** Indices into CanvasStats.calls, such as CANVAS_METHOD_FILL_RECT. */
+typedef enum CanvasMethod
+{
+#define CANVAS_STATS_ENUM(id, name) CANVAS_METHOD_##id,
+    CANVAS_STATS_METHODS(CANVAS_STATS_ENUM)
+#undef CANVAS_STATS_ENUM
+    CANVAS_METHOD_COUNT
+} CanvasMethod;
+
+/** Names of the methods, indexed by CanvasMethod. For example, canvasMethodNames[CANVAS_METHOD_FILL_RECT] is "fillRect". */
+extern const char *const canvasMethodNames[];
+
+/**
+ * Counters of the work done by DOM canvases, kept only when the library is compiled with
+ * -DCANVAS_STATS; otherwise neither they nor the code updating them exist. They're shared by all
+ * canvases, and are meant to be read once per frame to attribute its cost:
+ *
+ *     CanvasStats before, after;
+ *     canvasStatsSnapshot(&before);
+ *     drawFrame(ctx);
+ *     canvasStatsSnapshot(&after);
+ *     printf("%d calls into JavaScript\n", (int)(after.crossings - before.crossings));
+ *
+ * Software canvases never call into JavaScript, so only the allocations they make building paths
+ * are counted.
+ */
+typedef struct CanvasStats
+{
+    /**
+     * calls of each method made on DOM canvases and their contexts. Methods implemented by calling
+     * others count both, as setLineCap() does setLineCapEnum(). flush() only counts calls with
+     * commands to replay, including those other methods make before they run.
+     */
+    uint64_t calls[CANVAS_METHOD_COUNT];
+    /** calls from wasm into JavaScript, one per EM_ASM block run */
+    uint64_t crossings;
+    /** bytes of strings converted to or from UTF-8 as they cross, including terminators */
+    uint64_t utf8Bytes;
+    /**
+     * heap blocks allocated or grown, including the buffers of paths kept for hit testing. Getters
+     * answer from the context's shadow state, so they should never add to this.
+     */
+    uint64_t allocations;
+} CanvasStats;
+
+/** The counters themselves; prefer canvasStatsSnapshot() to reading them as they change. */
+extern CanvasStats canvasStats;
+
+/** Copies the counters into stats. */
+void canvasStatsSnapshot(CanvasStats *stats);
+
+/** Zeroes every counter. */
+void canvasStatsReset(void);
+
+#define CANVAS_STATS_CALL(id) (canvasStats.calls[CANVAS_METHOD_##id]++)
+#define CANVAS_STATS_CROSSING() (canvasStats.crossings++)
+#define CANVAS_STATS_UTF8(bytes) (canvasStats.utf8Bytes += (bytes))
+#define CANVAS_STATS_ALLOCATIONS(count) (canvasStats.allocations += (count))
+#else
+#define CANVAS_STATS_CALL(id) ((void)0)
+#define CANVAS_STATS_CROSSING() ((void)0)
+#define CANVAS_STATS_UTF8(bytes) ((void)0)
+#define CANVAS_STATS_ALLOCATIONS(count) ((void)0)
 #endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,168 @@
+/**
+ * Display files: frames recorded into display lists, saved in a compact binary format which can be
+ * played back straight from memory, such as a file mapped with mmap(). Frames captured in the
+ * browser can so be replayed natively, on a software canvas, to profile or compare them.
+ * @brief Writing and playing back recorded frames
+ * @file displayfile.h
+ * @author Alex Tyner
+ */
+#ifndef DISPLAYFILE_H
+#define DISPLAYFILE_H
+
+#include "displaylist.h"
+#include <stdio.h>
+
+/**
+ * Version of the format written, stored in every file's header. Players refuse files of other
+ * versions.
+ *
+ * A file starts with a 16-byte header: the magic "WCDL", the version and a reserved 0 as 16-bit
+ * integers, then the canvas width and height as 32-bit integers. Records follow, each 8-byte
+ * aligned and starting with an 8-byte header: a 16-bit opcode, the number of numeric arguments and
+ * a flags byte, then the size of the payload after the header as a 32-bit integer, a multiple of 8.
+ * All integers and floats are little-endian.
+ *
+ * Opcodes below 256 are DisplayOp calls. Their payload starts with their numeric arguments as
+ * doubles, or, when flag 1 is set, as floats padded to 8 bytes, for calls whose arguments are all
+ * exact as floats; arguments left out are 0. Batched calls are followed by their bulk arguments,
+ * laid out as in a DisplayList. Text, font and style calls are followed instead by the file offset
+ * of a string definition, and calls drawing a Path2D or ImageData by the offset of its definition,
+ * as a 32-bit integer padded to 8 bytes. Definitions precede the calls using them:
+ *
+ * - DISPLAY_FILE_STRING: a NUL-terminated string, padded with NULs.
+ * - DISPLAY_FILE_PATH: the records of the path's calls, from DISPLAY_CLOSE_PATH to DISPLAY_POLYLINE.
+ * - DISPLAY_FILE_IMAGE: width and height as 32-bit integers, then the pixels as RGBA.
+ *
+ * Each string, path and image is defined once per file, however many frames use it. A
+ * DISPLAY_FILE_END_FRAME record ends every frame. Records with unknown opcodes are skipped.
+ */
+#define DISPLAY_FILE_VERSION 1
+
+/** Opcodes of the records which aren't calls. */
+#define DISPLAY_FILE_STRING 256
+#define DISPLAY_FILE_PATH 257
+#define DISPLAY_FILE_IMAGE 258
+#define DISPLAY_FILE_END_FRAME 259
+
+typedef struct DisplayFileWriter DisplayFileWriter;
+typedef struct DisplayFilePlayer DisplayFilePlayer;
+typedef struct DisplayFileDefinition DisplayFileDefinition;
+typedef struct DisplayFileObject DisplayFileObject;
+
+/**
+ * Destination of a writer's bytes, called with each piece of the file in order. Returns non-zero
+ * if the bytes were taken, or 0 to fail the write.
+ */
+typedef int (*DisplayFileSink)(void *user, const void *bytes, size_t length);
+
+/** A DisplayFileSink writing to the FILE * passed as user. */
+int displayFileSinkStdio(void *user, const void *bytes, size_t length);
+
+/**
+ * Struct writing display lists to a display file, one frame each. This struct should be
+ * instantiated using the createDisplayFileWriter() function, and, when you're done using it,
+ * should be freed using the freeDisplayFileWriter() function.
+ *
+ * Frames are written as they're handed over, so a capture can be streamed out for as long as it
+ * runs. Only the strings, paths and images not already in the file are written along with each.
+ *
+ *     FILE *file = fopen("capture.wcdl", "wb");
+ *     DisplayFileWriter *writer = createDisplayFileWriter(displayFileSinkStdio, file, width, height);
+ *     // each frame, after recording into list
+ *     writer->writeFrame(writer, list);
+ *     freeDisplayFileWriter(writer);
+ *     fclose(file);
+ */
+struct DisplayFileWriter
+{
+    /**
+     * This anonymous struct encapsulates fields of the DisplayFileWriter struct intended to be
+     * private: the sink, how much has been written, and what's already defined in the file.
+     */
+    struct
+    {
+        DisplayFileSink sink;
+        void *user;
+        size_t offset;
+        int failed;
+        /** definitions written so far, sorted by hash */
+        DisplayFileDefinition *definitions;
+        size_t definitionsLength;
+        size_t definitionsCapacity;
+        /** list the calls of a Path2D are traced into before it's defined */
+        DisplayList *scratch;
+    } private;
+    /**
+     * Appends the calls recorded in list to the file as one frame. Returns non-zero if the frame
+     * was written; once the sink has failed, nothing more is written.
+     */
+    int (*writeFrame)(DisplayFileWriter *this, DisplayList *list);
+};
+
+/**
+ * Struct playing back the frames of a display file held in memory. This struct should be
+ * instantiated using the createDisplayFilePlayer() function, and, when you're done using it,
+ * should be freed using the freeDisplayFilePlayer() function.
+ *
+ * Calls are made straight from the file's bytes: numeric arguments are read from their records,
+ * and bulk arguments and strings are passed to the context in place. Only the Path2D and ImageData
+ * objects the calls need are created, once each, the first time they're drawn.
+ *
+ *     DisplayFilePlayer *player = createDisplayFilePlayer(bytes, length);
+ *     HTMLCanvasElement *canvas = createSoftwareCanvas("playback", player->width, player->height);
+ *     CanvasRenderingContext2D *ctx = canvas->getContext(canvas, "2d");
+ *     while (player->playFrame(player, ctx) > 0)
+ *         ; // each frame is drawn on ctx
+ *     freeDisplayFilePlayer(player);
+ */
+struct DisplayFilePlayer
+{
+    /**
+     * This anonymous struct encapsulates fields of the DisplayFilePlayer struct intended to be
+     * private: the file, the position of the next frame in it, and the objects made from its
+     * definitions.
+     */
+    struct
+    {
+        const unsigned char *bytes;
+        size_t length;
+        size_t position;
+        /** objects created so far, sorted by the offset of their definitions */
+        DisplayFileObject *objects;
+        size_t objectsLength;
+        size_t objectsCapacity;
+    } private;
+    /** the canvas size and format version from the file's header */
+    int width;
+    int height;
+    int version;
+    /**
+     * Draws the next frame on ctx. The frame is drawn with the state ctx has, and save() calls it
+     * leaves unbalanced are restored. Returns 1 if a frame was drawn, 0 at the end of the file, or
+     * -1 if the file is malformed, in which case the frame may have been partly drawn.
+     */
+    int (*playFrame)(DisplayFilePlayer *this, CanvasRenderingContext2D *ctx);
+    /** Goes back to the first frame. Objects already created are kept. */
+    void (*rewind)(DisplayFilePlayer *this);
+};
+
+/**
+ * Creates a writer and writes the file's header, for a canvas of the given size, to sink. Free
+ * it with freeDisplayFileWriter() when done.
+ */
+DisplayFileWriter *createDisplayFileWriter(DisplayFileSink sink, void *user, int width, int height);
+
+/** Frees a writer. The sink is left as it is. */
+void freeDisplayFileWriter(DisplayFileWriter *writer);
+
+/**
+ * Creates a player for the length bytes of a display file, which must stay in place, unchanged
+ * and 8-byte aligned, as mmap() and malloc() leave them, until the player is freed. Returns NULL if
+ * they don't start with the header of a file of DISPLAY_FILE_VERSION.
+ */
+DisplayFilePlayer *createDisplayFilePlayer(const void *bytes, size_t length);
+
+/** Frees a player and the Path2D and ImageData objects it created. */
+void freeDisplayFilePlayer(DisplayFilePlayer *player);
+
+#endif
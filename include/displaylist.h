@@ -0,0 +1,201 @@
+/**
+ * Retained display lists. A display list records the calls made on a CanvasRenderingContext2D of
+ * its own, which can then be replayed against any context, DOM or software, any number of times.
+ * Comparing the list recorded for a frame with the one recorded for the previous frame yields the
+ * rectangles of the canvas which changed, so a mostly static scene is only cleared and redrawn
+ * where something moved.
+ * @brief Recording, replaying and diffing CanvasRenderingContext2D calls
+ * @file displaylist.h
+ * @author Alex Tyner
+ */
+#ifndef DISPLAYLIST_H
+#define DISPLAYLIST_H
+
+#include "canvas.h"
+
+/** Maximum number of separate rectangles diff() reports before they are merged. */
+#define DISPLAY_LIST_MAX_DAMAGE_RECTS 16
+
+typedef struct DisplayList DisplayList;
+typedef struct DisplayCommand DisplayCommand;
+typedef struct DisplayState DisplayState;
+
+/**
+ * The calls a display list records, one per CanvasRenderingContext2D method; the enum and string
+ * variants of a setter share one. The values are also the opcodes of display files (see
+ * displayfile.h), so changing them means changing DISPLAY_FILE_VERSION.
+ */
+typedef enum DisplayOp
+{
+    DISPLAY_CLEAR_RECT = 0,
+    DISPLAY_FILL_RECT = 1,
+    DISPLAY_STROKE_RECT = 2,
+    DISPLAY_CLEAR_RECTS = 3,
+    DISPLAY_FILL_RECTS = 4,
+    DISPLAY_STROKE_RECTS = 5,
+    DISPLAY_FILL_RECTS_COLORED = 6,
+    DISPLAY_FILL_RECTS_TRANSFORMED = 7,
+    DISPLAY_PUT_IMAGE_DATA = 8,
+    DISPLAY_FILL_TEXT = 9,
+    DISPLAY_STROKE_TEXT = 10,
+    DISPLAY_FILL = 11,
+    DISPLAY_STROKE = 12,
+    DISPLAY_FILL_PATH = 13,
+    DISPLAY_STROKE_PATH = 14,
+    /* everything from here on changes state rather than drawing */
+    DISPLAY_CLIP = 15,
+    DISPLAY_CLIP_PATH = 16,
+    DISPLAY_SET_LINE_WIDTH = 17,
+    DISPLAY_SET_LINE_CAP = 18,
+    DISPLAY_SET_LINE_JOIN = 19,
+    DISPLAY_SET_FONT = 20,
+    DISPLAY_SET_TEXT_ALIGN = 21,
+    DISPLAY_SET_FILL_STYLE = 22,
+    DISPLAY_SET_STROKE_STYLE = 23,
+    DISPLAY_SET_FILL_COLOR = 24,
+    DISPLAY_SET_STROKE_COLOR = 25,
+    DISPLAY_SET_GLOBAL_ALPHA = 26,
+    DISPLAY_SET_GLOBAL_COMPOSITE_OPERATION = 27,
+    DISPLAY_ROTATE = 28,
+    DISPLAY_SCALE = 29,
+    DISPLAY_TRANSLATE = 30,
+    DISPLAY_TRANSFORM = 31,
+    DISPLAY_SET_TRANSFORM = 32,
+    DISPLAY_RESET_TRANSFORM = 33,
+    DISPLAY_SAVE = 34,
+    DISPLAY_RESTORE = 35,
+    /* and these build the current path */
+    DISPLAY_BEGIN_PATH = 36,
+    DISPLAY_CLOSE_PATH = 37,
+    DISPLAY_MOVE_TO = 38,
+    DISPLAY_LINE_TO = 39,
+    DISPLAY_BEZIER_CURVE_TO = 40,
+    DISPLAY_QUADRATIC_CURVE_TO = 41,
+    DISPLAY_ARC = 42,
+    DISPLAY_ARC_TO = 43,
+    DISPLAY_ELLIPSE = 44,
+    DISPLAY_RECT = 45,
+    DISPLAY_POLYLINE = 46,
+    DISPLAY_POLYLINES = 47
+} DisplayOp;
+
+/**
+ * One recorded call. Its bulk arguments (vertices, rectangles, colors, matrices or a NUL-terminated
+ * string) are kept in the list's data, 8-byte aligned, and run up to the next command's.
+ */
+struct DisplayCommand
+{
+    DisplayOp op;
+    /** numeric arguments of the call, counts and flags of the bulk calls included; unused ones are 0 */
+    double args[7];
+    /** offset of the call's bulk arguments in the list's data */
+    size_t data;
+    /** the Path2D or ImageData the call draws */
+    void *object;
+    /** for drawing calls, a hash of everything deciding their pixels and their bounding box */
+    uint64_t hash;
+    double left, top, right, bottom;
+};
+
+/**
+ * Struct holding a recorded sequence of CanvasRenderingContext2D calls. This struct should be
+ * instantiated using the createDisplayList() function, and, when you're done using it, should be
+ * freed using the freeDisplayList() function.
+ *
+ * Record into a list by drawing with the context returned by its getContext(). Recording starts
+ * from the default drawing state, an identity transform and an empty path, just like a freshly
+ * created canvas. Along with each drawing call, the list keeps a hash of everything that decides
+ * its pixels and its bounding box in canvas coordinates; diff() compares those.
+ *
+ * A typical frame of a dashboard redrawn from scratch in C, but painted only where it changed:
+ *
+ *     DisplayList *frames[2] = {createDisplayList(), createDisplayList()};
+ *     // each frame
+ *     DisplayList *current = frames[frame & 1], *previous = frames[~frame & 1];
+ *     current->clear(current);
+ *     drawDashboard(current->getContext(current));
+ *     int damage[4 * DISPLAY_LIST_MAX_DAMAGE_RECTS];
+ *     int count = current->diff(current, frame ? previous : NULL, width, height, damage);
+ *     current->replayDamage(current, ctx, damage, count);
+ *
+ * Path2D and ImageData objects drawn into a list are referenced rather than copied, so they must
+ * outlive it. Pixels of an ImageData are hashed when it is recorded, so changing them between
+ * frames is seen by diff().
+ */
+struct DisplayList
+{
+    /**
+     * This anonymous struct encapsulates fields of the DisplayList struct intended to be private:
+     * the recording context, the commands and the bulk arguments copied out of the calls, and the
+     * drawing state stack kept while recording.
+     */
+    struct
+    {
+        /** the context returned by getContext(), whose methods append to this list */
+        CanvasRenderingContext2D context;
+        DisplayCommand *commands;
+        size_t commandsLength;
+        size_t commandsCapacity;
+        /** vertices, rectangles, colors and text passed to the recorded calls */
+        unsigned char *data;
+        size_t dataLength;
+        size_t dataCapacity;
+        /** states[depth] is the current drawing state; those below it were pushed by save() */
+        DisplayState *states;
+        size_t depth;
+        size_t statesCapacity;
+        /** scratch geometry for measuring rectangles and strokes */
+        CanvasPath *scratch;
+        CanvasEdgeList *edges;
+        /** scratch flags marking the commands replayDamage() replays */
+        unsigned char *live;
+        size_t liveCapacity;
+    } private;
+    /**
+     * Returns the context recording into this list. Its methods behave as on a canvas, getters and
+     * hit tests included, except that nothing is drawn: getImageData() reads transparent black and
+     * getCanvas() returns NULL. putImageDataDirty() is recorded as putImageData(). The same context
+     * is returned every time.
+     */
+    CanvasRenderingContext2D *(*getContext)(DisplayList *this);
+    /** Empties the list and resets its recording context, so a new frame can be recorded into it. */
+    void (*clear)(DisplayList *this);
+    /**
+     * Makes every recorded call on ctx, in order. Nothing is reset first, so the list is drawn with
+     * the state and transform ctx has at the time.
+     */
+    void (*replay)(DisplayList *this, CanvasRenderingContext2D *ctx);
+    /**
+     * Computes which parts of a width by height canvas showing previous must be repainted to show
+     * this list instead. Stores the rectangles as (x, y, width, height) in damage, which must have
+     * room for DISPLAY_LIST_MAX_DAMAGE_RECTS of them, and returns how many there are.
+     *
+     * Drawing calls are matched between the lists in order by their hashes; the bounding boxes of
+     * the calls left unmatched in either list, rounded out to whole pixels, make up the damage.
+     * Nearby rectangles are merged as ImageData.markDirty() merges them. If previous is NULL, the
+     * whole canvas is damaged.
+     */
+    int (*diff)(DisplayList *this, DisplayList *previous, int width, int height, int *damage);
+    /**
+     * Repaints the damage computed by diff() on ctx: clears the rectangles, then replays the list
+     * clipped to them, from the default drawing state and an identity transform. Drawing calls
+     * which lie entirely outside the rectangles are skipped, as are the paths only they use.
+     * The state of ctx is left as it was.
+     */
+    void (*replayDamage)(DisplayList *this, CanvasRenderingContext2D *ctx, const int *damage, int damageCount);
+};
+
+/** Creates an empty display list. Free it with freeDisplayList() when done. */
+DisplayList *createDisplayList(void);
+
+/** Frees a display list. The Path2D and ImageData objects drawn into it are left alone. */
+void freeDisplayList(DisplayList *list);
+
+/**
+ * Makes one recorded call on ctx, as replay() does: op with its numeric arguments, the bulk
+ * arguments laid out as a DisplayCommand's data, and the Path2D or ImageData it draws. save() and
+ * restore() are passed through like any other call.
+ */
+void displayCommandReplay(CanvasRenderingContext2D *ctx, DisplayOp op, const double *args, const unsigned char *data, void *object);
+
+#endif
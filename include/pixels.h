@@ -0,0 +1,43 @@
+/**
+ * Pixel kernels for RGBA framebuffers in wasm memory: solid span fills, source-over blending and
+ * premultiplied alpha conversion. The software backend composites with these, and they work just
+ * as well on an ImageData or any other buffer of 8-bit RGBA pixels.
+ *
+ * The implementation is chosen at build time: wasm SIMD128 when compiled with -msimd128, AVX2 or
+ * SSE2 natively, and portable scalar code otherwise or when PIXELS_NO_SIMD is defined. Every
+ * implementation produces bit-identical results.
+ * @brief Vectorized RGBA span kernels
+ * @file pixels.h
+ * @author Alex Tyner
+ */
+#ifndef PIXELS_H
+#define PIXELS_H
+
+#include <stddef.h>
+
+/** Name of the implementation compiled in: "simd128", "avx2", "sse2" or "scalar". */
+extern const char *const pixelsImplementation;
+
+/** Sets count pixels starting at dst to the RGBA color rgba. */
+void pixelsFillSpan(unsigned char *dst, const unsigned char rgba[4], size_t count);
+
+/**
+ * Blends count premultiplied pixels from src over those at dst, with the source's opacity scaled by
+ * alpha (0 to 255), as drawing with "source-over" and globalAlpha does.
+ */
+void pixelsSourceOver(unsigned char *dst, const unsigned char *src, unsigned alpha, size_t count);
+
+/**
+ * Blends the premultiplied RGBA color rgba over count pixels at dst, the color's opacity at each
+ * pixel scaled by the matching coverage byte in mask (0 to 255). This is how the software backend
+ * paints anti-aliased fills and strokes.
+ */
+void pixelsSourceOverMask(unsigned char *dst, const unsigned char rgba[4], const unsigned char *mask, size_t count);
+
+/** Converts count non-premultiplied pixels, as in ImageData, to premultiplied alpha. dst may be src. */
+void pixelsPremultiply(unsigned char *dst, const unsigned char *src, size_t count);
+
+/** Converts count premultiplied pixels back to non-premultiplied alpha. dst may be src. */
+void pixelsUnpremultiply(unsigned char *dst, const unsigned char *src, size_t count);
+
+#endif
@@ -0,0 +1,392 @@
+/**
+ * Shape registry and spatial index for hit testing shapes on a canvas.
+ * @file shapes.c
+ * @author Alex Tyner
+ */
+
+#include "shapes.h"
+#include "geometry.h"
+#include <math.h>
+
+/** nextFree of a shape which is registered; removed shapes hold the next free slot instead. */
+#define SHAPE_LIVE -2
+
+typedef struct CanvasShape
+{
+    Path2D *path;
+    CanvasMatrix transform;
+    /** maps canvas coordinates back into the path's, so one Path2D can back many shapes */
+    CanvasMatrix inverse;
+    CanvasFillRule fillRule;
+    double strokeWidth;
+    /** bounding box in canvas coordinates, empty (left > right) if the shape can't be hit */
+    double left, top, right, bottom;
+    /** z-order; shapes registered later are on top */
+    unsigned long order;
+    int nextFree;
+    /** set while the shape is kept in the list of shapes too large for the grid */
+    int large;
+} CanvasShape;
+
+typedef struct ShapeCell
+{
+    int *shapes;
+    int length;
+    int capacity;
+} ShapeCell;
+
+struct CanvasShapeRegistry
+{
+    CanvasShape *shapes;
+    size_t length;
+    size_t capacity;
+    int firstFree;
+    size_t live;
+    unsigned long order;
+    /* the grid, valid unless stale */
+    ShapeCell *cells;
+    int columns, rows;
+    double left, top, cellSize;
+    int *large;
+    size_t largeLength;
+    size_t largeCapacity;
+    /** shapes registered when the grid was built, and those added since which stick out of it */
+    size_t indexed;
+    size_t outside;
+    int stale;
+};
+
+/* Begin: shape geometry */
+static void shape_strokeState(const CanvasShape *shape, CanvasState *state)
+{
+    memset(state, 0, sizeof(CanvasState));
+    state->lineWidth = shape->strokeWidth;
+    state->lineCap = LINE_CAP_ROUND;
+    state->lineJoin = LINE_JOIN_ROUND;
+    state->transform = canvasIdentityMatrix;
+}
+
+/** Computes the bounding box of shape in canvas coordinates from its path and transform. */
+static void shape_measure(CanvasShape *shape)
+{
+    shape->left = shape->top = INFINITY;
+    shape->right = shape->bottom = -INFINITY;
+    if (!canvasMatrixInvert(&shape->transform, &shape->inverse))
+        return;
+    const CanvasEdgeList *edges = canvasPath2DFillEdges(shape->path, &canvasIdentityMatrix);
+    double left = edges->left, top = edges->top, right = edges->right, bottom = edges->bottom;
+    if (shape->strokeWidth > 0.0)
+    {
+        CanvasState state;
+        shape_strokeState(shape, &state);
+        edges = canvasPath2DStrokeEdges(shape->path, &state);
+        left = fmin(left, edges->left), top = fmin(top, edges->top);
+        right = fmax(right, edges->right), bottom = fmax(bottom, edges->bottom);
+    }
+    if (!(left <= right && top <= bottom))
+        return;
+    double corners[] = {left, top, right, top, right, bottom, left, bottom};
+    for (int i = 0; i < 4; i++)
+    {
+        double x, y;
+        canvasMatrixApply(&shape->transform, corners[2 * i], corners[2 * i + 1], &x, &y);
+        shape->left = fmin(shape->left, x), shape->top = fmin(shape->top, y);
+        shape->right = fmax(shape->right, x), shape->bottom = fmax(shape->bottom, y);
+    }
+}
+
+static int shape_contains(const CanvasShape *shape, double x, double y)
+{
+    if (x < shape->left || x > shape->right || y < shape->top || y > shape->bottom)
+        return 0;
+    double px, py;
+    canvasMatrixApply(&shape->inverse, x, y, &px, &py);
+    if (canvasPath2DContains(shape->path, &canvasIdentityMatrix, px, py, shape->fillRule))
+        return 1;
+    if (shape->strokeWidth > 0.0)
+    {
+        CanvasState state;
+        shape_strokeState(shape, &state);
+        return canvasPath2DStrokeContains(shape->path, &state, px, py);
+    }
+    return 0;
+}
+/* End: shape geometry */
+
+/* Begin: grid */
+static int clampCell(double value, int count)
+{
+    return value < 0.0 ? 0 : value >= count ? count - 1 : (int)value;
+}
+
+/** Finds the range of cells overlapped by shape, clamped to the grid. Returns the number of cells. */
+static size_t grid_range(const CanvasShapeRegistry *r, const CanvasShape *shape, int range[4])
+{
+    range[0] = clampCell((shape->left - r->left) / r->cellSize, r->columns);
+    range[1] = clampCell((shape->top - r->top) / r->cellSize, r->rows);
+    range[2] = clampCell((shape->right - r->left) / r->cellSize, r->columns);
+    range[3] = clampCell((shape->bottom - r->top) / r->cellSize, r->rows);
+    return (size_t)(range[2] - range[0] + 1) * (range[3] - range[1] + 1);
+}
+
+static void grid_insert(CanvasShapeRegistry *r, int id)
+{
+    CanvasShape *shape = &r->shapes[id];
+    int range[4];
+    if (!(shape->left <= shape->right) || !r->columns)
+        return;
+    if (shape->left < r->left || shape->top < r->top ||
+        shape->right > r->left + r->columns * r->cellSize || shape->bottom > r->top + r->rows * r->cellSize)
+        r->outside++;
+    if (grid_range(r, shape, range) > SHAPES_MAX_CELLS_PER_SHAPE)
+    {
+        if (r->largeLength == r->largeCapacity)
+        {
+            r->largeCapacity = r->largeCapacity ? r->largeCapacity * 2 : 16;
+            r->large = (int *)realloc(r->large, r->largeCapacity * sizeof(int));
+        }
+        r->large[r->largeLength++] = id;
+        shape->large = 1;
+        return;
+    }
+    for (int row = range[1]; row <= range[3]; row++)
+        for (int column = range[0]; column <= range[2]; column++)
+        {
+            ShapeCell *cell = &r->cells[row * r->columns + column];
+            if (cell->length == cell->capacity)
+            {
+                cell->capacity = cell->capacity ? cell->capacity * 2 : 4;
+                cell->shapes = (int *)realloc(cell->shapes, cell->capacity * sizeof(int));
+            }
+            cell->shapes[cell->length++] = id;
+        }
+}
+
+static void removeId(int *ids, int *length, int id)
+{
+    for (int i = 0; i < *length; i++)
+        if (ids[i] == id)
+        {
+            ids[i] = ids[--*length];
+            return;
+        }
+}
+
+/** Takes shape id out of the grid, using the bounding box it was inserted with. */
+static void grid_remove(CanvasShapeRegistry *r, int id)
+{
+    CanvasShape *shape = &r->shapes[id];
+    int range[4];
+    if (shape->large)
+    {
+        int length = (int)r->largeLength;
+        removeId(r->large, &length, id);
+        r->largeLength = length;
+        shape->large = 0;
+        return;
+    }
+    if (!(shape->left <= shape->right) || !r->columns)
+        return;
+    grid_range(r, shape, range);
+    for (int row = range[1]; row <= range[3]; row++)
+        for (int column = range[0]; column <= range[2]; column++)
+        {
+            ShapeCell *cell = &r->cells[row * r->columns + column];
+            removeId(cell->shapes, &cell->length, id);
+        }
+}
+
+static void grid_free(CanvasShapeRegistry *r)
+{
+    for (int i = 0; i < r->columns * r->rows; i++)
+        free(r->cells[i].shapes);
+    free(r->cells);
+    r->cells = NULL;
+    r->columns = r->rows = 0;
+    r->largeLength = 0;
+}
+
+/**
+ * Rebuilds the grid over all registered shapes at once. Cells are sized so that there are about as
+ * many as there are shapes, but no smaller than the average shape, so most shapes land in one to
+ * four cells and most cells hold a handful of shapes.
+ */
+static void grid_build(CanvasShapeRegistry *r)
+{
+    double left = INFINITY, top = INFINITY, right = -INFINITY, bottom = -INFINITY, size = 0.0;
+    size_t count = 0;
+    grid_free(r);
+    r->stale = 0;
+    r->indexed = r->live;
+    r->outside = 0;
+    for (size_t i = 0; i < r->length; i++)
+    {
+        CanvasShape *shape = &r->shapes[i];
+        shape->large = 0;
+        if (shape->nextFree != SHAPE_LIVE || !(shape->left <= shape->right))
+            continue;
+        left = fmin(left, shape->left), top = fmin(top, shape->top);
+        right = fmax(right, shape->right), bottom = fmax(bottom, shape->bottom);
+        size += fmax(shape->right - shape->left, shape->bottom - shape->top);
+        count++;
+    }
+    if (!count)
+        return;
+    double width = fmax(right - left, 1.0), height = fmax(bottom - top, 1.0);
+    double cellSize = fmax(sqrt(width * height / count), size / count);
+    while ((width / cellSize + 1.0) * (height / cellSize + 1.0) > 4.0 * count + 16.0)
+        cellSize *= 2.0;
+    r->left = left;
+    r->top = top;
+    r->cellSize = cellSize;
+    r->columns = (int)ceil(width / cellSize);
+    r->rows = (int)ceil(height / cellSize);
+    r->columns = r->columns < 1 ? 1 : r->columns;
+    r->rows = r->rows < 1 ? 1 : r->rows;
+    r->cells = (ShapeCell *)calloc((size_t)r->columns * r->rows, sizeof(ShapeCell));
+    for (size_t i = 0; i < r->length; i++)
+        if (r->shapes[i].nextFree == SHAPE_LIVE)
+            grid_insert(r, (int)i);
+    r->outside = 0;
+}
+
+/** Adds shape id to the grid, or marks the grid for rebuilding once it no longer fits the shapes. */
+static void registry_index(CanvasShapeRegistry *r, int id)
+{
+    if (r->stale)
+        return;
+    /* a grid built with no shapes to place has no cells to add this one to */
+    if (!r->columns)
+    {
+        r->stale = 1;
+        return;
+    }
+    grid_insert(r, id);
+    if (r->live > 2 * r->indexed + 64 || r->outside > r->live / 4 + 16)
+        r->stale = 1;
+}
+/* End: grid */
+
+static CanvasShape *registry_shape(CanvasShapeRegistry *r, int id)
+{
+    if (id < 0 || (size_t)id >= r->length || r->shapes[id].nextFree != SHAPE_LIVE)
+        return NULL;
+    return &r->shapes[id];
+}
+
+/** Tests the shapes near (x, y), keeping the ids of the topmost capacity hits in shapes, topmost first. */
+static size_t registry_query(CanvasShapeRegistry *r, double x, double y, int *shapes, size_t capacity)
+{
+    size_t hits = 0;
+    if (r->stale)
+        grid_build(r);
+    if (!r->columns)
+        return 0;
+    ShapeCell *cell = &r->cells[clampCell((y - r->top) / r->cellSize, r->rows) * r->columns + clampCell((x - r->left) / r->cellSize, r->columns)];
+    for (size_t i = 0; i < (size_t)cell->length + r->largeLength; i++)
+    {
+        int id = i < (size_t)cell->length ? cell->shapes[i] : r->large[i - cell->length];
+        if (!shape_contains(&r->shapes[id], x, y))
+            continue;
+        size_t kept = hits < capacity ? hits : capacity;
+        size_t j = kept;
+        for (; j > 0 && r->shapes[shapes[j - 1]].order < r->shapes[id].order; j--)
+            if (j < capacity)
+                shapes[j] = shapes[j - 1];
+        if (j < capacity)
+            shapes[j] = id;
+        hits++;
+    }
+    return hits;
+}
+
+/* Begin: HTMLCanvasElement shape methods */
+static int canvasShapes_addShape(HTMLCanvasElement *this, Path2D *path, const CanvasMatrix *transform, CanvasFillRule fillRule, double strokeWidth)
+{
+    CanvasShapeRegistry *r = this->private.shapes;
+    int id;
+    if (r->firstFree >= 0)
+    {
+        id = r->firstFree;
+        r->firstFree = r->shapes[id].nextFree;
+    }
+    else
+    {
+        if (r->length == r->capacity)
+        {
+            r->capacity = r->capacity ? r->capacity * 2 : 64;
+            r->shapes = (CanvasShape *)realloc(r->shapes, r->capacity * sizeof(CanvasShape));
+        }
+        id = (int)r->length++;
+    }
+    CanvasShape *shape = &r->shapes[id];
+    shape->path = path;
+    shape->transform = transform ? *transform : canvasIdentityMatrix;
+    shape->fillRule = fillRule;
+    shape->strokeWidth = strokeWidth;
+    shape->order = r->order++;
+    shape->nextFree = SHAPE_LIVE;
+    shape->large = 0;
+    shape_measure(shape);
+    r->live++;
+    registry_index(r, id);
+    return id;
+}
+static void canvasShapes_updateShape(HTMLCanvasElement *this, int id, const CanvasMatrix *transform)
+{
+    CanvasShapeRegistry *r = this->private.shapes;
+    CanvasShape *shape = registry_shape(r, id);
+    if (!shape)
+        return;
+    if (!r->stale)
+        grid_remove(r, id);
+    if (transform)
+        shape->transform = *transform;
+    shape_measure(shape);
+    registry_index(r, id);
+}
+static void canvasShapes_removeShape(HTMLCanvasElement *this, int id)
+{
+    CanvasShapeRegistry *r = this->private.shapes;
+    CanvasShape *shape = registry_shape(r, id);
+    if (!shape)
+        return;
+    if (!r->stale)
+        grid_remove(r, id);
+    shape->path = NULL;
+    shape->nextFree = r->firstFree;
+    r->firstFree = id;
+    r->live--;
+}
+static int canvasShapes_getShapeAt(HTMLCanvasElement *this, double x, double y)
+{
+    int id;
+    return registry_query(this->private.shapes, x, y, &id, 1) ? id : -1;
+}
+static size_t canvasShapes_getShapesAt(HTMLCanvasElement *this, double x, double y, int *shapes, size_t capacity)
+{
+    return registry_query(this->private.shapes, x, y, shapes, capacity);
+}
+/* End: HTMLCanvasElement shape methods */
+
+void canvasShapesAttach(HTMLCanvasElement *canvas)
+{
+    CanvasShapeRegistry *r = (CanvasShapeRegistry *)calloc(1, sizeof(CanvasShapeRegistry));
+    r->firstFree = -1;
+    r->stale = 1;
+    canvas->private.shapes = r;
+    canvas->addShape = canvasShapes_addShape;
+    canvas->updateShape = canvasShapes_updateShape;
+    canvas->removeShape = canvasShapes_removeShape;
+    canvas->getShapeAt = canvasShapes_getShapeAt;
+    canvas->getShapesAt = canvasShapes_getShapesAt;
+}
+
+void canvasShapesRelease(HTMLCanvasElement *canvas)
+{
+    CanvasShapeRegistry *r = canvas->private.shapes;
+    grid_free(r);
+    free(r->large);
+    free(r->shapes);
+    free(r);
+}
@@ -0,0 +1,23 @@
+/**
+ * The shape registry behind HTMLCanvasElement addShape(), getShapeAt() and friends: a uniform grid
+ * over the bounding boxes of registered shapes, which narrows a point query down to the few shapes
+ * near it before any of them is tested exactly.
+ * @brief Spatial index for hit testing shapes on a canvas
+ * @file shapes.h
+ * @author Alex Tyner
+ */
+#ifndef SHAPES_H
+#define SHAPES_H
+
+#include "canvas.h"
+
+/** A shape is kept out of the grid cells, and tested on every query, if it would span more cells than this. */
+#define SHAPES_MAX_CELLS_PER_SHAPE 64
+
+/** Allocates an empty shape registry for canvas and sets its shape methods. Both backends call this. */
+void canvasShapesAttach(HTMLCanvasElement *canvas);
+
+/** Frees the shape registry of canvas. The registered Path2D objects are left alone. */
+void canvasShapesRelease(HTMLCanvasElement *canvas);
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * Tracing: timelines of the work canvas contexts do inside each frame, kept in a fixed-size ring
+ * buffer and exported as Chrome trace event JSON, to be opened in chrome://tracing or Perfetto.
+ * @brief Recording where the time inside a frame goes
+ * @file trace.h
+ * @author Alex Tyner
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "canvas.h"
+#include <stdio.h>
+
+/** Number of contexts a trace can be attached to at once. */
+#define CANVAS_TRACE_MAX_CONTEXTS 8
+
+/** Ring buffer capacity, in events, of a trace created with a capacity of 0. */
+#define CANVAS_TRACE_DEFAULT_CAPACITY 16384
+
+/**
+ * Longest pause, in milliseconds, between two calls of the same group which are still merged into
+ * one event. Longer pauses, such as the application doing work of its own, start a new event.
+ */
+#define CANVAS_TRACE_MERGE_GAP 0.05
+
+typedef struct CanvasTrace CanvasTrace;
+typedef struct CanvasTraceEvent CanvasTraceEvent;
+
+/** What the calls merged into an event were doing, shown as the event's name. */
+typedef enum CanvasTraceGroup
+{
+    /** building the current path, from beginPath() to polylines() */
+    TRACE_PATH,
+    /** filling, stroking and clipping paths and rectangles */
+    TRACE_FILL,
+    /** fillText(), strokeText() and setFont() */
+    TRACE_TEXT,
+    /** putImageData(), putImageDataDirty() and getImageData() */
+    TRACE_IMAGE,
+    /** the other setters, transforms, save() and restore() */
+    TRACE_STATE,
+    /** flush() and endRecording() */
+    TRACE_FLUSH,
+    /** a frame, from one markFrame() to the next, the first starting when the trace was created or cleared */
+    TRACE_FRAME
+} CanvasTraceGroup;
+
+/** A span of time in a trace, in milliseconds as measured by emscripten_get_now(). */
+struct CanvasTraceEvent
+{
+    double start;
+    double end;
+    /** time spent inside the calls themselves, which excludes the pauses between them */
+    double self;
+    uint32_t calls;
+    uint16_t group;
+    /** 1 + the index of the context among those attached, or 0 for frames */
+    uint16_t context;
+};
+
+/** Destination of the JSON, called with each piece in order. Returns non-zero if the bytes were taken. */
+typedef int (*CanvasTraceSink)(void *user, const void *bytes, size_t length);
+
+/** A CanvasTraceSink writing to the FILE * passed as user. */
+int canvasTraceSinkStdio(void *user, const void *bytes, size_t length);
+
+/**
+ * Struct recording the calls made on canvas contexts as a timeline. This struct should be
+ * instantiated using the createCanvasTrace() function, and, when you're done using it, should be
+ * freed using the freeCanvasTrace() function.
+ *
+ * Attaching a context swaps its function pointers for ones which time each call before passing it
+ * on; detaching it swaps them back, so contexts not attached to a trace cost nothing extra.
+ * Consecutive calls of the same group are merged into a single event, counting the calls, so a
+ * frame typically makes a few dozen events however many calls it makes. Once the ring buffer is
+ * full, the oldest events are overwritten; its size is fixed when the trace is created.
+ *
+ *     CanvasTrace *trace = createCanvasTrace(0);
+ *     trace->attach(trace, ctx);
+ *     // each frame
+ *     drawFrame(ctx);
+ *     trace->markFrame(trace);
+ *     // when jank is noticed
+ *     trace->writeJSON(trace, canvasTraceSinkStdio, file);
+ *     trace->detach(trace, ctx);
+ *     freeCanvasTrace(trace);
+ *
+ * Timing a call costs two reads of the clock, each a call into JavaScript in the browser.
+ */
+struct CanvasTrace
+{
+    /**
+     * This anonymous struct encapsulates fields of the CanvasTrace struct intended to be private:
+     * the ring buffer, the contexts attached and when the current frame started.
+     */
+    struct
+    {
+        CanvasTraceEvent *events;
+        size_t capacity;
+        /** index of the oldest event, and how many there are */
+        size_t head;
+        size_t length;
+        size_t dropped;
+        CanvasTraceTarget *targets;
+        double frameStart;
+    } private;
+    /**
+     * Starts timing the calls made on ctx. Returns non-zero if it's attached, or 0 if
+     * CANVAS_TRACE_MAX_CONTEXTS contexts already are. A context can be attached to one trace at a
+     * time, and must be detached before its canvas is freed.
+     */
+    int (*attach)(CanvasTrace *this, CanvasRenderingContext2D *ctx);
+    /** Stops timing the calls made on ctx and gives it back its own function pointers. */
+    void (*detach)(CanvasTrace *this, CanvasRenderingContext2D *ctx);
+    /**
+     * Ends the current frame, and any events still open. Events of the next frame start after
+     * this call.
+     */
+    void (*markFrame)(CanvasTrace *this);
+    /**
+     * Writes the events in the ring buffer to sink as a JSON object in the Chrome trace event
+     * format, oldest first. Each attached context gets a row of its own, named after its canvas,
+     * and frames a row above them. Returns non-zero if the sink took every piece.
+     */
+    int (*writeJSON)(CanvasTrace *this, CanvasTraceSink sink, void *user);
+    /** Discards every event. */
+    void (*clear)(CanvasTrace *this);
+};
+
+/**
+ * Creates a trace whose ring buffer holds capacity events, or CANVAS_TRACE_DEFAULT_CAPACITY if
+ * capacity is 0. All of its memory is allocated here. Free it with freeCanvasTrace() when done.
+ */
+CanvasTrace *createCanvasTrace(size_t capacity);
+
+/** Detaches every context still attached to a trace, and frees it. */
+void freeCanvasTrace(CanvasTrace *trace);
+
+#endif
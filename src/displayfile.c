@@ -0,0 +1,658 @@
+/**
+ * Display files: writing display lists to, and playing them back from, a binary format.
+ * @file displayfile.c
+ * @author Alex Tyner
+ */
+
+#include "displayfile.h"
+#include <math.h>
+#include <stdint.h>
+
+/*
+ * Integers and floats are copied to and from the file in the host's byte order, which is
+ * little-endian in wasm and on every platform the native player is built for.
+ */
+
+#define DISPLAY_FILE_HEADER_SIZE 16
+#define DISPLAY_FILE_RECORD_SIZE 8
+/** flag of call records whose arguments are stored as floats */
+#define DISPLAY_FILE_FLOATS 1
+
+struct DisplayFileDefinition
+{
+    uint64_t hash;
+    size_t length;
+    int kind;
+    /** offset of the definition's payload in the file */
+    uint32_t offset;
+};
+
+struct DisplayFileObject
+{
+    uint32_t offset;
+    int kind;
+    void *object;
+};
+
+static size_t align8(size_t length)
+{
+    return (length + 7) & ~(size_t)7;
+}
+
+static uint64_t hash_bytes(uint64_t h, const void *bytes, size_t length)
+{
+    const unsigned char *p = (const unsigned char *)bytes;
+    uint64_t word;
+    for (; length >= 8; p += 8, length -= 8)
+    {
+        memcpy(&word, p, 8);
+        h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    word = (uint64_t)length << 56;
+    if (length)
+    {
+        uint64_t tail = 0;
+        memcpy(&tail, p, length);
+        word ^= tail;
+    }
+    h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+/** Returns how a call refers to data outside its record: by a string, by an object, or neither. */
+static int op_reference(int op)
+{
+    switch (op)
+    {
+    case DISPLAY_FILL_TEXT:
+    case DISPLAY_STROKE_TEXT:
+    case DISPLAY_SET_FONT:
+    case DISPLAY_SET_FILL_STYLE:
+    case DISPLAY_SET_STROKE_STYLE:
+        return DISPLAY_FILE_STRING;
+    case DISPLAY_FILL_PATH:
+    case DISPLAY_STROKE_PATH:
+    case DISPLAY_CLIP_PATH:
+        return DISPLAY_FILE_PATH;
+    case DISPLAY_PUT_IMAGE_DATA:
+        return DISPLAY_FILE_IMAGE;
+    default:
+        return 0;
+    }
+}
+
+/** Returns non-zero for the batched calls, whose bulk arguments are copied into their records. */
+static int op_bulk(int op)
+{
+    switch (op)
+    {
+    case DISPLAY_CLEAR_RECTS:
+    case DISPLAY_FILL_RECTS:
+    case DISPLAY_STROKE_RECTS:
+    case DISPLAY_FILL_RECTS_COLORED:
+    case DISPLAY_FILL_RECTS_TRANSFORMED:
+    case DISPLAY_POLYLINE:
+    case DISPLAY_POLYLINES:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Begin: writing */
+int displayFileSinkStdio(void *user, const void *bytes, size_t length)
+{
+    return fwrite(bytes, 1, length, (FILE *)user) == length;
+}
+
+static void writer_write(DisplayFileWriter *this, const void *bytes, size_t length)
+{
+    if (!this->private.failed && length && !this->private.sink(this->private.user, bytes, length))
+        this->private.failed = 1;
+    this->private.offset += length;
+}
+
+static void writer_pad(DisplayFileWriter *this)
+{
+    static const unsigned char zeros[8];
+    writer_write(this, zeros, align8(this->private.offset) - this->private.offset);
+}
+
+static void writer_record(DisplayFileWriter *this, int op, int argc, int flags, size_t size)
+{
+    unsigned char header[DISPLAY_FILE_RECORD_SIZE];
+    uint16_t code = (uint16_t)op;
+    uint32_t length = (uint32_t)size;
+    memcpy(header, &code, 2);
+    header[2] = (unsigned char)argc;
+    header[3] = (unsigned char)flags;
+    memcpy(header + 4, &length, 4);
+    writer_write(this, header, sizeof(header));
+}
+
+/** Returns where the definition of the given kind, hash and length is in the sorted definitions, or where it belongs. */
+static size_t writer_search(DisplayFileWriter *this, int kind, uint64_t hash, size_t length)
+{
+    size_t lo = 0, hi = this->private.definitionsLength;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        const DisplayFileDefinition *d = this->private.definitions + mid;
+        if (d->hash < hash || (d->hash == hash && (d->kind < kind || (d->kind == kind && d->length < length))))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Looks up a string, path or image already defined in the file, by a hash of its contents. Returns
+ * the offset of its payload, or 0 if it hasn't been defined, in which case it's remembered as
+ * defined by the record about to be written.
+ */
+static uint32_t writer_define(DisplayFileWriter *this, int kind, uint64_t hash, size_t length)
+{
+    size_t i = writer_search(this, kind, hash, length);
+    DisplayFileDefinition *d = this->private.definitions + i;
+    if (i < this->private.definitionsLength && d->hash == hash && d->kind == kind && d->length == length)
+        return d->offset;
+    if (this->private.definitionsLength == this->private.definitionsCapacity)
+    {
+        this->private.definitionsCapacity = this->private.definitionsCapacity ? 2 * this->private.definitionsCapacity : 64;
+        this->private.definitions = (DisplayFileDefinition *)realloc(this->private.definitions, this->private.definitionsCapacity * sizeof(DisplayFileDefinition));
+        d = this->private.definitions + i;
+    }
+    memmove(d + 1, d, (this->private.definitionsLength - i) * sizeof(DisplayFileDefinition));
+    this->private.definitionsLength++;
+    d->hash = hash;
+    d->length = length;
+    d->kind = kind;
+    d->offset = (uint32_t)(this->private.offset + DISPLAY_FILE_RECORD_SIZE);
+    return 0;
+}
+
+static uint32_t writer_string(DisplayFileWriter *this, const char *value)
+{
+    size_t length = strlen(value) + 1;
+    uint32_t offset = writer_define(this, DISPLAY_FILE_STRING, hash_bytes(0, value, length), length);
+    if (offset)
+        return offset;
+    offset = (uint32_t)(this->private.offset + DISPLAY_FILE_RECORD_SIZE);
+    writer_record(this, DISPLAY_FILE_STRING, 0, 0, align8(length));
+    writer_write(this, value, length);
+    writer_pad(this);
+    return offset;
+}
+
+static uint32_t writer_image(DisplayFileWriter *this, const ImageData *image)
+{
+    uint32_t size[2] = {(uint32_t)image->width, (uint32_t)image->height};
+    size_t length = (size_t)image->width * image->height * 4;
+    uint32_t offset = writer_define(this, DISPLAY_FILE_IMAGE, hash_bytes(hash_bytes(0, size, sizeof(size)), image->data, length), length);
+    if (offset)
+        return offset;
+    offset = (uint32_t)(this->private.offset + DISPLAY_FILE_RECORD_SIZE);
+    writer_record(this, DISPLAY_FILE_IMAGE, 0, 0, sizeof(size) + align8(length));
+    writer_write(this, size, sizeof(size));
+    writer_write(this, image->data, length);
+    writer_pad(this);
+    return offset;
+}
+
+/** Returns the length of the bulk arguments of a list's command i. */
+static size_t command_dataLength(const DisplayList *list, size_t i)
+{
+    size_t end = i + 1 < list->private.commandsLength ? list->private.commands[i + 1].data : list->private.dataLength;
+    return end - list->private.commands[i].data;
+}
+
+/** Returns the number of arguments worth writing, those after the last non-zero one being 0, and whether all are exact as floats. */
+static int command_args(const DisplayCommand *c, int *floats)
+{
+    int argc = 7;
+    while (argc && c->args[argc - 1] == 0.0 && !signbit(c->args[argc - 1]))
+        argc--;
+    *floats = 1;
+    for (int i = 0; i < argc; i++)
+        if ((double)(float)c->args[i] != c->args[i])
+            *floats = 0;
+    return argc;
+}
+
+static size_t args_size(int argc, int floats)
+{
+    return floats ? align8(argc * sizeof(float)) : argc * sizeof(double);
+}
+
+/** Returns the size of the record of a list's command i, with the reference, if any, it makes. */
+static size_t command_recordSize(const DisplayList *list, size_t i)
+{
+    const DisplayCommand *c = list->private.commands + i;
+    int floats;
+    int argc = command_args(c, &floats);
+    size_t size = DISPLAY_FILE_RECORD_SIZE + args_size(argc, floats);
+    if (op_reference(c->op))
+        size += 8;
+    else if (op_bulk(c->op))
+        size += command_dataLength(list, i);
+    return size;
+}
+
+/** Writes the record of a list's command i, which refers to the definition at reference, if any. */
+static void writer_command(DisplayFileWriter *this, const DisplayList *list, size_t i, uint32_t reference)
+{
+    const DisplayCommand *c = list->private.commands + i;
+    int floats;
+    int argc = command_args(c, &floats);
+    writer_record(this, c->op, argc, floats ? DISPLAY_FILE_FLOATS : 0, command_recordSize(list, i) - DISPLAY_FILE_RECORD_SIZE);
+    if (floats)
+    {
+        float args[7];
+        for (int j = 0; j < argc; j++)
+            args[j] = (float)c->args[j];
+        writer_write(this, args, argc * sizeof(float));
+        writer_pad(this);
+    }
+    else
+        writer_write(this, c->args, argc * sizeof(double));
+    if (op_reference(c->op))
+    {
+        uint32_t words[2] = {reference, 0};
+        writer_write(this, words, sizeof(words));
+    }
+    else if (op_bulk(c->op))
+        writer_write(this, list->private.data + c->data, command_dataLength(list, i));
+}
+
+static uint32_t writer_path(DisplayFileWriter *this, Path2D *path)
+{
+    size_t length = path->private.commandsLength * sizeof(double);
+    uint32_t offset = writer_define(this, DISPLAY_FILE_PATH, hash_bytes(0, path->private.commands, length), length);
+    if (offset)
+        return offset;
+    offset = (uint32_t)(this->private.offset + DISPLAY_FILE_RECORD_SIZE);
+    DisplayList *scratch = this->private.scratch;
+    scratch->clear(scratch);
+    tracePath2D(scratch->getContext(scratch), path);
+    size_t size = 0;
+    for (size_t i = 0; i < scratch->private.commandsLength; i++)
+        size += command_recordSize(scratch, i);
+    writer_record(this, DISPLAY_FILE_PATH, 0, 0, size);
+    for (size_t i = 0; i < scratch->private.commandsLength; i++)
+        writer_command(this, scratch, i, 0);
+    return offset;
+}
+/* End: writing */
+
+/* Begin: DisplayFileWriter static methods */
+static int displayFileWriter_writeFrame(DisplayFileWriter *this, DisplayList *list)
+{
+    for (size_t i = 0; i < list->private.commandsLength && !this->private.failed; i++)
+    {
+        const DisplayCommand *c = list->private.commands + i;
+        uint32_t reference = 0;
+        switch (op_reference(c->op))
+        {
+        case DISPLAY_FILE_STRING: reference = writer_string(this, (const char *)list->private.data + c->data); break;
+        case DISPLAY_FILE_PATH: reference = writer_path(this, (Path2D *)c->object); break;
+        case DISPLAY_FILE_IMAGE: reference = writer_image(this, (const ImageData *)c->object); break;
+        }
+        writer_command(this, list, i, reference);
+    }
+    writer_record(this, DISPLAY_FILE_END_FRAME, 0, 0, 0);
+    return !this->private.failed;
+}
+/* End: DisplayFileWriter static methods */
+
+DisplayFileWriter *createDisplayFileWriter(DisplayFileSink sink, void *user, int width, int height)
+{
+    DisplayFileWriter *writer = (DisplayFileWriter *)calloc(1, sizeof(DisplayFileWriter));
+    /* Begin: set pseudo-private fields */
+    writer->private.sink = sink;
+    writer->private.user = user;
+    writer->private.scratch = createDisplayList();
+    /* End: set pseudo-private fields */
+    writer->writeFrame = displayFileWriter_writeFrame;
+    unsigned char header[DISPLAY_FILE_HEADER_SIZE] = {'W', 'C', 'D', 'L'};
+    uint16_t version = DISPLAY_FILE_VERSION;
+    uint32_t size[2] = {(uint32_t)width, (uint32_t)height};
+    memcpy(header + 4, &version, 2);
+    memcpy(header + 8, size, sizeof(size));
+    writer_write(writer, header, sizeof(header));
+    return writer;
+}
+
+void freeDisplayFileWriter(DisplayFileWriter *writer)
+{
+    freeDisplayList(writer->private.scratch);
+    free(writer->private.definitions);
+    free(writer);
+}
+
+/* Begin: playing */
+typedef struct DisplayFileRecord
+{
+    int op;
+    int argc;
+    int flags;
+    /** the payload, inside the file */
+    const unsigned char *payload;
+    size_t size;
+} DisplayFileRecord;
+
+/** Reads the header of the record at position of bytes, which must lie entirely before end. Returns 0 if it doesn't. */
+static int record_read(DisplayFileRecord *r, const unsigned char *bytes, size_t position, size_t end)
+{
+    if (position + DISPLAY_FILE_RECORD_SIZE > end || position % 8)
+        return 0;
+    uint16_t code;
+    uint32_t size;
+    memcpy(&code, bytes + position, 2);
+    memcpy(&size, bytes + position + 4, 4);
+    if (size % 8 || size > end - position - DISPLAY_FILE_RECORD_SIZE)
+        return 0;
+    r->op = code;
+    r->argc = bytes[position + 2];
+    r->flags = bytes[position + 3];
+    r->payload = bytes + position + DISPLAY_FILE_RECORD_SIZE;
+    r->size = size;
+    return 1;
+}
+
+/** Reads a call's arguments into args, unused ones set to 0, and the size they take into size. Returns 0 if they don't fit. */
+static int record_args(const DisplayFileRecord *r, double *args, size_t *size)
+{
+    memset(args, 0, 7 * sizeof(double));
+    int floats = r->flags & DISPLAY_FILE_FLOATS;
+    if (r->argc > 7 || (*size = args_size(r->argc, floats)) > r->size)
+        return 0;
+    if (floats)
+    {
+        float values[7];
+        memcpy(values, r->payload, r->argc * sizeof(float));
+        for (int i = 0; i < r->argc; i++)
+            args[i] = values[i];
+    }
+    else if (r->argc)
+        memcpy(args, r->payload, r->argc * sizeof(double));
+    return 1;
+}
+
+/** Returns non-zero if a batched call's bulk arguments, data of length bytes, hold everything args says they do. */
+static int bulk_fits(int op, const double *args, const unsigned char *data, size_t length)
+{
+    if (!(args[0] >= 0.0 && args[0] <= (double)length))
+        return 0;
+    size_t count = (size_t)args[0];
+    switch (op)
+    {
+    case DISPLAY_CLEAR_RECTS:
+    case DISPLAY_FILL_RECTS:
+    case DISPLAY_STROKE_RECTS:
+        return 4 * sizeof(float) * count <= length;
+    case DISPLAY_FILL_RECTS_COLORED:
+        return align8(4 * sizeof(float) * count) + sizeof(uint32_t) * count <= length;
+    case DISPLAY_FILL_RECTS_TRANSFORMED:
+        return (args[1] ? align8(4 * sizeof(float) * count) + 6 * sizeof(float) * count : 4 * sizeof(float) * count) <= length;
+    case DISPLAY_POLYLINE:
+        return 2 * sizeof(float) * count <= length;
+    case DISPLAY_POLYLINES:
+    {
+        size_t offsets = align8((count + 1) * sizeof(uint32_t));
+        if (offsets > length)
+            return 0;
+        const uint32_t *o = (const uint32_t *)data;
+        for (size_t i = 0; i < count; i++)
+            if (o[i] > o[i + 1])
+                return 0;
+        return o[count] <= (length - offsets) / (2 * sizeof(float));
+    }
+    default:
+        return 1;
+    }
+}
+
+/** Returns non-zero if the arguments a call converts to integers fit them. */
+static int args_fit(int op, const double *args)
+{
+    switch (op)
+    {
+    case DISPLAY_SET_FILL_COLOR:
+    case DISPLAY_SET_STROKE_COLOR:
+        return args[0] >= 0.0 && args[0] <= 4294967295.0;
+    case DISPLAY_SET_LINE_CAP:
+    case DISPLAY_SET_LINE_JOIN:
+    case DISPLAY_SET_TEXT_ALIGN:
+    case DISPLAY_SET_GLOBAL_COMPOSITE_OPERATION:
+        return args[0] >= 0.0 && args[0] <= 255.0;
+    case DISPLAY_PUT_IMAGE_DATA:
+        /* far enough from INT_MAX that adding the image's size can't overflow */
+        return fabs(args[0]) < 1073741824.0 && fabs(args[1]) < 1073741824.0;
+    case DISPLAY_POLYLINE:
+    case DISPLAY_POLYLINES:
+        return fabs(args[1]) <= 1.0;
+    default:
+        return 1;
+    }
+}
+
+/** Returns the index of the object made from the definition at offset in the sorted objects, or where it belongs. */
+static size_t player_search(DisplayFilePlayer *this, uint32_t offset)
+{
+    size_t lo = 0, hi = this->private.objectsLength;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (this->private.objects[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/** Returns the definition of the given kind whose payload is at offset, which must come before the record at position. */
+static int player_definition(DisplayFilePlayer *this, DisplayFileRecord *r, int kind, uint32_t offset, size_t position)
+{
+    return offset >= DISPLAY_FILE_HEADER_SIZE + DISPLAY_FILE_RECORD_SIZE && offset <= position &&
+           record_read(r, this->private.bytes, offset - DISPLAY_FILE_RECORD_SIZE, position) && r->op == kind;
+}
+
+static Path2D *player_path(const DisplayFileRecord *definition)
+{
+    Path2D *path = createPath2D();
+    size_t position = 0;
+    DisplayFileRecord r;
+    double a[7];
+    while (position < definition->size)
+    {
+        size_t argsSize;
+        if (!record_read(&r, definition->payload, position, definition->size) || !record_args(&r, a, &argsSize))
+        {
+            freePath2D(path);
+            return NULL;
+        }
+        position += DISPLAY_FILE_RECORD_SIZE + r.size;
+        switch (r.op)
+        {
+        case DISPLAY_CLOSE_PATH: path->closePath(path); break;
+        case DISPLAY_MOVE_TO: path->moveTo(path, a[0], a[1]); break;
+        case DISPLAY_LINE_TO: path->lineTo(path, a[0], a[1]); break;
+        case DISPLAY_BEZIER_CURVE_TO: path->bezierCurveTo(path, a[0], a[1], a[2], a[3], a[4], a[5]); break;
+        case DISPLAY_QUADRATIC_CURVE_TO: path->quadraticCurveTo(path, a[0], a[1], a[2], a[3]); break;
+        case DISPLAY_ARC: path->arc(path, a[0], a[1], a[2], a[3], a[4]); break;
+        case DISPLAY_ARC_TO: path->arcTo(path, a[0], a[1], a[2], a[3], a[4]); break;
+        case DISPLAY_ELLIPSE: path->ellipse(path, a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+        case DISPLAY_RECT: path->rect(path, a[0], a[1], a[2], a[3]); break;
+        case DISPLAY_POLYLINE:
+        {
+            const unsigned char *data = r.payload + argsSize;
+            if (!args_fit(r.op, a) || !bulk_fits(r.op, a, data, r.size - argsSize))
+            {
+                freePath2D(path);
+                return NULL;
+            }
+            path->polyline(path, (const float *)data, (size_t)a[0], (int)a[1]);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return path;
+}
+
+static ImageData *player_image(const DisplayFileRecord *definition)
+{
+    uint32_t size[2];
+    if (definition->size < sizeof(size))
+        return NULL;
+    memcpy(size, definition->payload, sizeof(size));
+    uint64_t length = (uint64_t)size[0] * size[1] * 4;
+    if (!size[0] || !size[1] || size[0] > 1073741824 || size[1] > 1073741824 || length > definition->size - sizeof(size))
+        return NULL;
+    ImageData *image = createImageData((int)size[0], (int)size[1]);
+    memcpy(image->data, definition->payload + sizeof(size), (size_t)length);
+    return image;
+}
+
+/** Returns the Path2D or ImageData defined at offset, creating it the first time, or NULL if the definition is malformed. */
+static void *player_object(DisplayFilePlayer *this, int kind, uint32_t offset, size_t position)
+{
+    size_t i = player_search(this, offset);
+    if (i < this->private.objectsLength && this->private.objects[i].offset == offset)
+        return this->private.objects[i].kind == kind ? this->private.objects[i].object : NULL;
+    DisplayFileRecord definition;
+    if (!player_definition(this, &definition, kind, offset, position))
+        return NULL;
+    void *object = kind == DISPLAY_FILE_PATH ? (void *)player_path(&definition) : (void *)player_image(&definition);
+    if (!object)
+        return NULL;
+    if (this->private.objectsLength == this->private.objectsCapacity)
+    {
+        this->private.objectsCapacity = this->private.objectsCapacity ? 2 * this->private.objectsCapacity : 16;
+        this->private.objects = (DisplayFileObject *)realloc(this->private.objects, this->private.objectsCapacity * sizeof(DisplayFileObject));
+    }
+    DisplayFileObject *o = this->private.objects + i;
+    memmove(o + 1, o, (this->private.objectsLength - i) * sizeof(DisplayFileObject));
+    this->private.objectsLength++;
+    o->offset = offset;
+    o->kind = kind;
+    o->object = object;
+    return object;
+}
+
+/** Returns the string defined at offset, or NULL if the definition is malformed. */
+static const char *player_string(DisplayFilePlayer *this, uint32_t offset, size_t position)
+{
+    DisplayFileRecord definition;
+    if (!player_definition(this, &definition, DISPLAY_FILE_STRING, offset, position) || !definition.size || definition.payload[definition.size - 1])
+        return NULL;
+    return (const char *)definition.payload;
+}
+/* End: playing */
+
+/* Begin: DisplayFilePlayer static methods */
+static int displayFilePlayer_playFrame(DisplayFilePlayer *this, CanvasRenderingContext2D *ctx)
+{
+    if (this->private.position >= this->private.length)
+        return 0;
+    size_t depth = 0;
+    int result = -1;
+    DisplayFileRecord r;
+    double a[7];
+    while (record_read(&r, this->private.bytes, this->private.position, this->private.length))
+    {
+        size_t position = this->private.position;
+        this->private.position += DISPLAY_FILE_RECORD_SIZE + r.size;
+        if (r.op == DISPLAY_FILE_END_FRAME)
+        {
+            result = 1;
+            break;
+        }
+        if (r.op > DISPLAY_POLYLINES)
+            continue;
+        size_t argsSize;
+        if (!record_args(&r, a, &argsSize) || !args_fit(r.op, a))
+            break;
+        const unsigned char *data = r.payload + argsSize;
+        size_t dataLength = r.size - argsSize;
+        void *object = NULL;
+        int reference = op_reference(r.op);
+        if (reference)
+        {
+            uint32_t offset;
+            if (dataLength < sizeof(offset))
+                break;
+            memcpy(&offset, data, sizeof(offset));
+            if (reference == DISPLAY_FILE_STRING)
+                data = (const unsigned char *)player_string(this, offset, position);
+            else
+                data = (const unsigned char *)(object = player_object(this, reference, offset, position));
+            if (!data)
+                break;
+        }
+        else if (op_bulk(r.op) && !bulk_fits(r.op, a, data, dataLength))
+            break;
+        if (r.op == DISPLAY_SAVE)
+            depth++;
+        else if (r.op == DISPLAY_RESTORE)
+        {
+            /* never pop a state saved before the frame */
+            if (!depth)
+                continue;
+            depth--;
+        }
+        displayCommandReplay(ctx, (DisplayOp)r.op, a, data, object);
+    }
+    for (; depth; depth--)
+        ctx->restore(ctx);
+    if (result < 0)
+        this->private.position = this->private.length;
+    return result;
+}
+static void displayFilePlayer_rewind(DisplayFilePlayer *this)
+{
+    this->private.position = DISPLAY_FILE_HEADER_SIZE;
+}
+/* End: DisplayFilePlayer static methods */
+
+DisplayFilePlayer *createDisplayFilePlayer(const void *bytes, size_t length)
+{
+    const unsigned char *header = (const unsigned char *)bytes;
+    uint16_t version;
+    uint32_t size[2];
+    if (length < DISPLAY_FILE_HEADER_SIZE || (uintptr_t)bytes % 8 || memcmp(header, "WCDL", 4))
+        return NULL;
+    memcpy(&version, header + 4, 2);
+    memcpy(size, header + 8, sizeof(size));
+    if (version != DISPLAY_FILE_VERSION || size[0] > INT32_MAX || size[1] > INT32_MAX)
+        return NULL;
+    DisplayFilePlayer *player = (DisplayFilePlayer *)calloc(1, sizeof(DisplayFilePlayer));
+    /* Begin: set pseudo-private fields */
+    player->private.bytes = header;
+    player->private.length = length;
+    player->private.position = DISPLAY_FILE_HEADER_SIZE;
+    /* End: set pseudo-private fields */
+    player->width = (int)size[0];
+    player->height = (int)size[1];
+    player->version = version;
+    player->playFrame = displayFilePlayer_playFrame;
+    player->rewind = displayFilePlayer_rewind;
+    return player;
+}
+
+void freeDisplayFilePlayer(DisplayFilePlayer *player)
+{
+    for (size_t i = 0; i < player->private.objectsLength; i++)
+    {
+        if (player->private.objects[i].kind == DISPLAY_FILE_PATH)
+            freePath2D((Path2D *)player->private.objects[i].object);
+        else
+            freeImageData((ImageData *)player->private.objects[i].object);
+    }
+    free(player->private.objects);
+    free(player);
+}
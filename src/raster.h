@@ -0,0 +1,54 @@
+/**
+ * Software rendering backend for HTMLCanvasElement and CanvasRenderingContext2D. Canvases created
+ * here implement the same function pointers as those bound to DOM canvases, but draw into an RGBA
+ * framebuffer in memory with a scanline rasterizer instead of calling into JavaScript. This works
+ * both in the browser and when compiled natively, e.g. to render thumbnails on a server with the
+ * exact drawing code used by a web client.
+ * @brief Software rasterizer backend for HTMLCanvasElement and CanvasRenderingContext2D
+ * @file raster.h
+ * @author Alex Tyner
+ */
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "canvas.h"
+
+/**
+ * The pixels of a canvas created by createSoftwareCanvas(). The surface is owned by its canvas,
+ * and is reallocated (and cleared) whenever the canvas is resized.
+ *
+ * Unlike ImageData, pixels are stored with premultiplied alpha, which is what the rasterizer blends
+ * in. A context's getImageData() converts them to the non-premultiplied form for you.
+ */
+struct SoftwareSurface
+{
+    int width;
+    int height;
+    /** width * height premultiplied RGBA pixels, row by row, top to bottom, one byte per channel */
+    unsigned char *pixels;
+};
+
+/**
+ * Creates a canvas drawn by the software backend, with the given dimensions and all pixels
+ * transparent black. Use and free it exactly as one returned by createCanvas(). No DOM element is
+ * created; the id is only kept for reference.
+ *
+ * The software backend rasterizes paths with anti-aliasing, transforms, clipping, global alpha,
+ * and the "source-over", "copy" and "destination-out" composite operations; other composite
+ * operations draw as "source-over". Strokes are widened by the current transform's average scale.
+ * Styles must be CSS colors: hex notation, rgb()/rgba() or a basic named color. Text isn't drawn.
+ *
+ *     HTMLCanvasElement *canvas = createSoftwareCanvas("thumbnail", 128, 128);
+ *     CanvasRenderingContext2D *ctx = canvas->getContext(canvas, "2d");
+ *     ctx->setFillStyle(ctx, "#336699");
+ *     ctx->fillRect(ctx, 0, 0, 64, 64);
+ *     SoftwareSurface *surface = getSoftwareSurface(canvas);
+ *     // ... encode surface->pixels ...
+ *     freeCanvas(canvas);
+ */
+HTMLCanvasElement *createSoftwareCanvas(char *id, int width, int height);
+
+/** Returns the pixels of a canvas created by the software backend, or NULL for a DOM canvas. */
+SoftwareSurface *getSoftwareSurface(HTMLCanvasElement *canvas);
+
+#endif
@@ -0,0 +1,346 @@
+/**
+ * Timing of the calls made on canvas contexts, by wrapping their function pointers, and the export
+ * of the resulting timeline as Chrome trace event JSON.
+ * @file trace.c
+ * @author Alex Tyner
+ */
+#ifndef __EMSCRIPTEN__
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "trace.h"
+#include <time.h>
+
+/**
+ * The methods a trace times, as X(group, name, parameters, arguments). All of them return nothing;
+ * getters and hit tests are answered in C and aren't worth a read of the clock.
+ */
+#define TRACED_METHODS(X)                                                                                                                                                                               \
+    X(TRACE_PATH, beginPath, (CanvasRenderingContext2D * this), (this))                                                                                                                                 \
+    X(TRACE_PATH, closePath, (CanvasRenderingContext2D * this), (this))                                                                                                                                 \
+    X(TRACE_PATH, moveTo, (CanvasRenderingContext2D * this, double x, double y), (this, x, y))                                                                                                          \
+    X(TRACE_PATH, lineTo, (CanvasRenderingContext2D * this, double x, double y), (this, x, y))                                                                                                          \
+    X(TRACE_PATH, bezierCurveTo, (CanvasRenderingContext2D * this, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y), (this, cp1x, cp1y, cp2x, cp2y, x, y))                        \
+    X(TRACE_PATH, quadraticCurveTo, (CanvasRenderingContext2D * this, double cpx, double cpy, double x, double y), (this, cpx, cpy, x, y))                                                              \
+    X(TRACE_PATH, arc, (CanvasRenderingContext2D * this, double x, double y, double radius, double startAngle, double endAngle), (this, x, y, radius, startAngle, endAngle))                             \
+    X(TRACE_PATH, arcTo, (CanvasRenderingContext2D * this, double x1, double y1, double x2, double y2, double radius), (this, x1, y1, x2, y2, radius))                                                   \
+    X(TRACE_PATH, ellipse, (CanvasRenderingContext2D * this, double x, double y, double rx, double ry, double rotation, double startAngle, double endAngle), (this, x, y, rx, ry, rotation, startAngle, endAngle)) \
+    X(TRACE_PATH, rect, (CanvasRenderingContext2D * this, double x, double y, double width, double height), (this, x, y, width, height))                                                                 \
+    X(TRACE_PATH, polyline, (CanvasRenderingContext2D * this, const float *xy, size_t count, int closed), (this, xy, count, closed))                                                                     \
+    X(TRACE_PATH, polylines, (CanvasRenderingContext2D * this, const float *xy, const uint32_t *offsets, size_t polylineCount, int closed), (this, xy, offsets, polylineCount, closed))                  \
+    X(TRACE_FILL, clearRect, (CanvasRenderingContext2D * this, double x, double y, double width, double height), (this, x, y, width, height))                                                            \
+    X(TRACE_FILL, fillRect, (CanvasRenderingContext2D * this, double x, double y, double width, double height), (this, x, y, width, height))                                                             \
+    X(TRACE_FILL, strokeRect, (CanvasRenderingContext2D * this, double x, double y, double width, double height), (this, x, y, width, height))                                                           \
+    X(TRACE_FILL, clearRects, (CanvasRenderingContext2D * this, const float *xywh, size_t count), (this, xywh, count))                                                                                  \
+    X(TRACE_FILL, fillRects, (CanvasRenderingContext2D * this, const float *xywh, size_t count), (this, xywh, count))                                                                                   \
+    X(TRACE_FILL, strokeRects, (CanvasRenderingContext2D * this, const float *xywh, size_t count), (this, xywh, count))                                                                                 \
+    X(TRACE_FILL, fillRectsColored, (CanvasRenderingContext2D * this, const float *xywh, const uint32_t *rgba, size_t count), (this, xywh, rgba, count))                                                \
+    X(TRACE_FILL, fillRectsTransformed, (CanvasRenderingContext2D * this, const float *xywh, const float *matrices, size_t count), (this, xywh, matrices, count))                                        \
+    X(TRACE_FILL, fill, (CanvasRenderingContext2D * this), (this))                                                                                                                                      \
+    X(TRACE_FILL, stroke, (CanvasRenderingContext2D * this), (this))                                                                                                                                    \
+    X(TRACE_FILL, clip, (CanvasRenderingContext2D * this), (this))                                                                                                                                      \
+    X(TRACE_FILL, fillPath, (CanvasRenderingContext2D * this, Path2D *path), (this, path))                                                                                                              \
+    X(TRACE_FILL, strokePath, (CanvasRenderingContext2D * this, Path2D *path), (this, path))                                                                                                            \
+    X(TRACE_FILL, clipPath, (CanvasRenderingContext2D * this, Path2D *path), (this, path))                                                                                                              \
+    X(TRACE_TEXT, fillText, (CanvasRenderingContext2D * this, char *text, double x, double y, double maxWidth), (this, text, x, y, maxWidth))                                                            \
+    X(TRACE_TEXT, strokeText, (CanvasRenderingContext2D * this, char *text, double x, double y, double maxWidth), (this, text, x, y, maxWidth))                                                          \
+    X(TRACE_TEXT, setFont, (CanvasRenderingContext2D * this, char *value), (this, value))                                                                                                               \
+    X(TRACE_IMAGE, putImageData, (CanvasRenderingContext2D * this, ImageData *image, int dx, int dy), (this, image, dx, dy))                                                                            \
+    X(TRACE_IMAGE, putImageDataDirty, (CanvasRenderingContext2D * this, ImageData *image, int dx, int dy), (this, image, dx, dy))                                                                       \
+    X(TRACE_IMAGE, getImageData, (CanvasRenderingContext2D * this, ImageData *dest, int sx, int sy), (this, dest, sx, sy))                                                                              \
+    X(TRACE_STATE, setLineWidth, (CanvasRenderingContext2D * this, double value), (this, value))                                                                                                        \
+    X(TRACE_STATE, setLineCap, (CanvasRenderingContext2D * this, char *type), (this, type))                                                                                                             \
+    X(TRACE_STATE, setLineCapEnum, (CanvasRenderingContext2D * this, CanvasLineCap type), (this, type))                                                                                                 \
+    X(TRACE_STATE, setLineJoin, (CanvasRenderingContext2D * this, char *type), (this, type))                                                                                                            \
+    X(TRACE_STATE, setLineJoinEnum, (CanvasRenderingContext2D * this, CanvasLineJoin type), (this, type))                                                                                               \
+    X(TRACE_STATE, setTextAlign, (CanvasRenderingContext2D * this, char *value), (this, value))                                                                                                         \
+    X(TRACE_STATE, setTextAlignEnum, (CanvasRenderingContext2D * this, CanvasTextAlign value), (this, value))                                                                                           \
+    X(TRACE_STATE, setFillStyle, (CanvasRenderingContext2D * this, char *value), (this, value))                                                                                                         \
+    X(TRACE_STATE, setStrokeStyle, (CanvasRenderingContext2D * this, char *value), (this, value))                                                                                                       \
+    X(TRACE_STATE, setFillColor, (CanvasRenderingContext2D * this, uint32_t rgba), (this, rgba))                                                                                                        \
+    X(TRACE_STATE, setStrokeColor, (CanvasRenderingContext2D * this, uint32_t rgba), (this, rgba))                                                                                                      \
+    X(TRACE_STATE, rotate, (CanvasRenderingContext2D * this, double angle), (this, angle))                                                                                                              \
+    X(TRACE_STATE, scale, (CanvasRenderingContext2D * this, double x, double y), (this, x, y))                                                                                                          \
+    X(TRACE_STATE, translate, (CanvasRenderingContext2D * this, double x, double y), (this, x, y))                                                                                                      \
+    X(TRACE_STATE, transform, (CanvasRenderingContext2D * this, double a, double b, double c, double d, double e, double f), (this, a, b, c, d, e, f))                                                   \
+    X(TRACE_STATE, setTransform, (CanvasRenderingContext2D * this, double a, double b, double c, double d, double e, double f), (this, a, b, c, d, e, f))                                                \
+    X(TRACE_STATE, resetTransform, (CanvasRenderingContext2D * this), (this))                                                                                                                           \
+    X(TRACE_STATE, setGlobalAlpha, (CanvasRenderingContext2D * this, double value), (this, value))                                                                                                      \
+    X(TRACE_STATE, setGlobalCompositeOperation, (CanvasRenderingContext2D * this, char *value), (this, value))                                                                                          \
+    X(TRACE_STATE, setGlobalCompositeOperationEnum, (CanvasRenderingContext2D * this, CanvasCompositeOperation value), (this, value))                                                                   \
+    X(TRACE_STATE, save, (CanvasRenderingContext2D * this), (this))                                                                                                                                     \
+    X(TRACE_STATE, restore, (CanvasRenderingContext2D * this), (this))                                                                                                                                  \
+    X(TRACE_FLUSH, flush, (CanvasRenderingContext2D * this), (this))
+
+/** The methods which swap the context's function pointers, which are wrapped again after each call. */
+#define TRACED_RECORDING_METHODS(X)                                                   \
+    X(TRACE_STATE, beginRecording, (CanvasRenderingContext2D * this), (this))         \
+    X(TRACE_FLUSH, endRecording, (CanvasRenderingContext2D * this), (this))
+
+/** Names of the events of each CanvasTraceGroup. */
+static const char *const groupNames[] = {"path", "fill", "text", "image", "state", "flush", "frame"};
+
+/** A context attached to a trace. */
+struct CanvasTraceTarget
+{
+    CanvasTrace *trace;
+    /** the context, or NULL once detached */
+    CanvasRenderingContext2D *ctx;
+    /** the context's own function pointers, which the wrapped ones pass calls on to */
+    CanvasRenderingContext2D methods;
+    /** calls in progress, so calls made by other methods, as setLineCap() makes, are timed once */
+    int depth;
+    /** the event the context's calls are being merged into, if open */
+    int open;
+    CanvasTraceEvent event;
+    /** the row's name, kept after the context is detached for the events it left */
+    char name[64];
+};
+
+static double trace_now(void)
+{
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_now();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+#endif
+}
+
+static void trace_push(CanvasTrace *this, const CanvasTraceEvent *event)
+{
+    if (this->private.length < this->private.capacity)
+    {
+        this->private.events[(this->private.head + this->private.length++) % this->private.capacity] = *event;
+        return;
+    }
+    /* full: the oldest event makes way */
+    this->private.events[this->private.head] = *event;
+    this->private.head = (this->private.head + 1) % this->private.capacity;
+    this->private.dropped++;
+}
+
+static void target_close(CanvasTraceTarget *t)
+{
+    if (!t->open)
+        return;
+    t->open = 0;
+    trace_push(t->trace, &t->event);
+}
+
+/** Starts timing a call, unless it's made from inside another. Returns the time it started. */
+static double target_begin(CanvasTraceTarget *t, CanvasTraceGroup group)
+{
+    if (t->depth++)
+        return 0.0;
+    double now = trace_now();
+    if (!t->open || t->event.group != group || now - t->event.end > CANVAS_TRACE_MERGE_GAP)
+    {
+        target_close(t);
+        t->event = (CanvasTraceEvent){now, now, 0.0, 0, (uint16_t)group, (uint16_t)(1 + (t - t->trace->private.targets))};
+        t->open = 1;
+    }
+    return now;
+}
+
+static void target_end(CanvasTraceTarget *t, double start)
+{
+    if (--t->depth)
+        return;
+    double now = trace_now();
+    t->event.end = now;
+    t->event.self += now - start;
+    t->event.calls++;
+}
+
+/* Begin: wrapped methods */
+#define TRACED_WRAPPER(group, name, params, args)                  \
+    static void traced_##name params                               \
+    {                                                              \
+        CanvasTraceTarget *t = this->private.trace;                \
+        double start = target_begin(t, group);                     \
+        t->methods.name args;                                      \
+        target_end(t, start);                                      \
+    }
+TRACED_METHODS(TRACED_WRAPPER)
+#undef TRACED_WRAPPER
+
+static void target_wrap(CanvasTraceTarget *t);
+
+#define TRACED_RECORDING_WRAPPER(group, name, params, args) \
+    static void traced_##name params                        \
+    {                                                       \
+        CanvasTraceTarget *t = this->private.trace;         \
+        double start = target_begin(t, group);              \
+        t->methods.name args;                               \
+        target_wrap(t);                                     \
+        target_end(t, start);                               \
+    }
+TRACED_RECORDING_METHODS(TRACED_RECORDING_WRAPPER)
+#undef TRACED_RECORDING_WRAPPER
+
+/**
+ * Wraps each of the context's function pointers which isn't wrapped already. Recording mode swaps
+ * a batch of them in and out, so this runs again after beginRecording() and endRecording().
+ */
+static void target_wrap(CanvasTraceTarget *t)
+{
+    CanvasRenderingContext2D *ctx = t->ctx;
+#define TRACED_WRAP(group, name, params, args) \
+    if (ctx->name != traced_##name)            \
+    {                                          \
+        t->methods.name = ctx->name;           \
+        ctx->name = traced_##name;             \
+    }
+    TRACED_METHODS(TRACED_WRAP)
+    TRACED_RECORDING_METHODS(TRACED_WRAP)
+#undef TRACED_WRAP
+}
+
+static void target_unwrap(CanvasTraceTarget *t)
+{
+    CanvasRenderingContext2D *ctx = t->ctx;
+#define TRACED_UNWRAP(group, name, params, args) \
+    if (ctx->name == traced_##name)              \
+        ctx->name = t->methods.name;
+    TRACED_METHODS(TRACED_UNWRAP)
+    TRACED_RECORDING_METHODS(TRACED_UNWRAP)
+#undef TRACED_UNWRAP
+}
+/* End: wrapped methods */
+
+/* Begin: CanvasTrace static methods */
+static int trace_attach(CanvasTrace *this, CanvasRenderingContext2D *ctx)
+{
+    if (ctx->private.trace)
+        return ctx->private.trace->trace == this;
+    CanvasTraceTarget *t = NULL;
+    for (int i = 0; i < CANVAS_TRACE_MAX_CONTEXTS && !t; i++)
+        if (!this->private.targets[i].ctx)
+            t = &this->private.targets[i];
+    if (!t)
+        return 0;
+    t->ctx = ctx;
+    t->depth = 0;
+    t->open = 0;
+    HTMLCanvasElement *canvas = ctx->private.canvas;
+    if (canvas && canvas->private.id)
+        snprintf(t->name, sizeof(t->name), "%s", canvas->private.id);
+    else
+        snprintf(t->name, sizeof(t->name), "context %d", (int)(1 + (t - this->private.targets)));
+    ctx->private.trace = t;
+    target_wrap(t);
+    return 1;
+}
+static void trace_detach(CanvasTrace *this, CanvasRenderingContext2D *ctx)
+{
+    CanvasTraceTarget *t = ctx->private.trace;
+    if (!t || t->trace != this)
+        return;
+    target_close(t);
+    target_unwrap(t);
+    ctx->private.trace = NULL;
+    t->ctx = NULL;
+}
+static void trace_markFrame(CanvasTrace *this)
+{
+    for (int i = 0; i < CANVAS_TRACE_MAX_CONTEXTS; i++)
+        target_close(&this->private.targets[i]);
+    double now = trace_now();
+    CanvasTraceEvent frame = {this->private.frameStart, now, now - this->private.frameStart, 1, TRACE_FRAME, 0};
+    trace_push(this, &frame);
+    this->private.frameStart = now;
+}
+static void trace_clear(CanvasTrace *this)
+{
+    for (int i = 0; i < CANVAS_TRACE_MAX_CONTEXTS; i++)
+        this->private.targets[i].open = 0;
+    this->private.head = 0;
+    this->private.length = 0;
+    this->private.dropped = 0;
+    this->private.frameStart = trace_now();
+}
+
+/** Writes a JSON string holding text, escaped as needed. */
+static int json_string(CanvasTraceSink sink, void *user, const char *text)
+{
+    char buffer[2 * 64 + 8];
+    size_t n = 0;
+    buffer[n++] = '"';
+    for (const unsigned char *c = (const unsigned char *)text; *c && n < sizeof(buffer) - 8; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            buffer[n++] = '\\';
+        if (*c < 0x20)
+            n += snprintf(buffer + n, 7, "\\u%04x", *c);
+        else
+            buffer[n++] = (char)*c;
+    }
+    buffer[n++] = '"';
+    return sink(user, buffer, n);
+}
+
+static int trace_writeJSON(CanvasTrace *this, CanvasTraceSink sink, void *user)
+{
+    char line[256];
+    int ok = 1;
+    int n = snprintf(line, sizeof(line), "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%lu},\"traceEvents\":[\n"
+                                         "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"frames\"}}",
+                     (unsigned long)this->private.dropped);
+    ok = ok && sink(user, line, (size_t)n);
+    for (int i = 0; i < CANVAS_TRACE_MAX_CONTEXTS; i++)
+    {
+        const CanvasTraceTarget *t = &this->private.targets[i];
+        if (!t->name[0])
+            continue;
+        n = snprintf(line, sizeof(line), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", i + 1);
+        ok = ok && sink(user, line, (size_t)n) && json_string(sink, user, t->name) && sink(user, "}}", 2);
+    }
+    /* timestamps are in microseconds */
+    for (size_t i = 0; i < this->private.length && ok; i++)
+    {
+        const CanvasTraceEvent *e = &this->private.events[(this->private.head + i) % this->private.capacity];
+        n = snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"cat\":\"canvas\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"calls\":%lu,\"self_us\":%.3f}}",
+                     groupNames[e->group], e->context, e->start * 1e3, (e->end - e->start) * 1e3, (unsigned long)e->calls, e->self * 1e3);
+        ok = sink(user, line, (size_t)n);
+    }
+    return ok && sink(user, "\n]}\n", 4);
+}
+/* End: CanvasTrace static methods */
+
+int canvasTraceSinkStdio(void *user, const void *bytes, size_t length)
+{
+    return fwrite(bytes, 1, length, (FILE *)user) == length;
+}
+
+CanvasTrace *createCanvasTrace(size_t capacity)
+{
+    CanvasTrace *trace = (CanvasTrace *)malloc(sizeof(CanvasTrace));
+    /* Begin: set pseudo-private fields */
+    trace->private.capacity = capacity ? capacity : CANVAS_TRACE_DEFAULT_CAPACITY;
+    trace->private.events = (CanvasTraceEvent *)malloc(trace->private.capacity * sizeof(CanvasTraceEvent));
+    trace->private.targets = (CanvasTraceTarget *)calloc(CANVAS_TRACE_MAX_CONTEXTS, sizeof(CanvasTraceTarget));
+    for (int i = 0; i < CANVAS_TRACE_MAX_CONTEXTS; i++)
+        trace->private.targets[i].trace = trace;
+    /* End: set pseudo-private fields */
+    trace->attach = trace_attach;
+    trace->detach = trace_detach;
+    trace->markFrame = trace_markFrame;
+    trace->writeJSON = trace_writeJSON;
+    trace->clear = trace_clear;
+    trace_clear(trace);
+    return trace;
+}
+
+void freeCanvasTrace(CanvasTrace *trace)
+{
+    if (trace)
+    {
+        for (int i = 0; i < CANVAS_TRACE_MAX_CONTEXTS; i++)
+            if (trace->private.targets[i].ctx)
+                trace_detach(trace, trace->private.targets[i].ctx);
+        free(trace->private.targets);
+        free(trace->private.events);
+        free(trace);
+    }
+}
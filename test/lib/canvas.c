@@ -1,45 +1,179 @@
 /**
  * Facilitates interaction with HTML5 Canvas elements in a similar
  * manner to JavaScript via the DOM, but from C to be compiled with Emscripten.
+ * When compiled natively, createCanvas() falls back to the software backend in raster.c.
  * @file canvas.c
  * @author Alex Tyner
  */
 
 #include "canvas.h"
+#include "raster.h"
+#include "geometry.h"
+#include "shapes.h"
+#include <math.h>
 
+/* Begin: canonical keyword tables */
+const char *const canvasLineCapKeywords[] = {"butt", "round", "square", NULL};
+const char *const canvasLineJoinKeywords[] = {"round", "bevel", "miter", NULL};
+const char *const canvasTextAlignKeywords[] = {"start", "end", "left", "right", "center", NULL};
+const char *const canvasCompositeOperationKeywords[] = {
+    "source-over", "source-in", "source-out", "source-atop",
+    "destination-over", "destination-in", "destination-out", "destination-atop",
+    "lighter", "copy", "xor", "multiply", "screen", "overlay", "darken", "lighten",
+    "color-dodge", "color-burn", "hard-light", "soft-light", "difference", "exclusion",
+    "hue", "saturation", "color", "luminosity", NULL};
+
+int canvasKeywordIndex(const char *const *keywords, const char *value)
+{
+    for (int i = 0; keywords[i]; i++)
+        if (strcmp(keywords[i], value) == 0)
+            return i;
+    return -1;
+}
+/* End: canonical keyword tables */
+
+#ifdef CANVAS_STATS
+/* Begin: instrumentation counters */
+#define CANVAS_STATS_NAME(id, name) #name,
+const char *const canvasMethodNames[] = {CANVAS_STATS_METHODS(CANVAS_STATS_NAME) NULL};
+#undef CANVAS_STATS_NAME
+
+CanvasStats canvasStats;
+
+void canvasStatsSnapshot(CanvasStats *stats)
+{
+    *stats = canvasStats;
+}
+
+void canvasStatsReset(void)
+{
+    memset(&canvasStats, 0, sizeof(canvasStats));
+}
+/* End: instrumentation counters */
+#endif
+
+/*
+ * Opcodes for the recording command buffer. Each command is stored as its opcode followed by its
+ * arguments, all as doubles. Path2D buffers its segments with the same opcodes. These values are
+ * mirrored by the decoders in context2d_flush() and path2d_build(), so keep them in sync.
+ */
+enum
+{
+    OP_CLEAR_RECT = 1,
+    OP_FILL_RECT = 2,
+    OP_STROKE_RECT = 3,
+    OP_SET_LINE_WIDTH = 4,
+    OP_BEGIN_PATH = 5,
+    OP_CLOSE_PATH = 6,
+    OP_MOVE_TO = 7,
+    OP_LINE_TO = 8,
+    OP_BEZIER_CURVE_TO = 9,
+    OP_QUADRATIC_CURVE_TO = 10,
+    OP_ARC = 11,
+    OP_ARC_TO = 12,
+    OP_ELLIPSE = 13,
+    OP_RECT = 14,
+    OP_FILL = 15,
+    OP_STROKE = 16,
+    OP_CLIP = 17,
+    OP_ROTATE = 18,
+    OP_SCALE = 19,
+    OP_TRANSLATE = 20,
+    OP_TRANSFORM = 21,
+    OP_SET_TRANSFORM = 22,
+    OP_RESET_TRANSFORM = 23,
+    OP_SET_GLOBAL_ALPHA = 24,
+    OP_SAVE = 25,
+    OP_RESTORE = 26,
+    OP_SET_LINE_CAP = 27,
+    OP_SET_LINE_JOIN = 28,
+    OP_SET_TEXT_ALIGN = 29,
+    OP_SET_GLOBAL_COMPOSITE_OPERATION = 30,
+    OP_SET_FILL_COLOR = 31,
+    OP_SET_STROKE_COLOR = 32,
+    OP_FILL_PATH = 33,
+    OP_STROKE_PATH = 34,
+    OP_CLIP_PATH = 35
+};
+
+#define COMMANDS_INITIAL_CAPACITY 1024
+#define PATH2D_INITIAL_CAPACITY 64
+
+/** Appends a command to a growable command buffer, which starts out with room for initialCapacity doubles. */
+static void commands_append(double **commands, size_t *length, size_t *capacity, size_t initialCapacity, int op, int argc, const double *argv)
+{
+    size_t needed = *length + 1 + argc;
+    if (needed > *capacity)
+    {
+        size_t newCapacity = *capacity ? *capacity : initialCapacity;
+        while (newCapacity < needed)
+            newCapacity *= 2;
+        *commands = (double *)realloc(*commands, newCapacity * sizeof(double));
+        CANVAS_STATS_ALLOCATIONS(1);
+        *capacity = newCapacity;
+    }
+    double *cmd = *commands + *length;
+    cmd[0] = op;
+    for (int i = 0; i < argc; i++)
+        cmd[1 + i] = argv[i];
+    *length = needed;
+}
+
+#ifdef __EMSCRIPTEN__
 static CanvasRenderingContext2D *createContext(HTMLCanvasElement *canvas, char *contextType);
+static void context2d_flush(CanvasRenderingContext2D *this);
+static void context2d_pullState(CanvasRenderingContext2D *this);
+static void canvas_release(HTMLCanvasElement *this);
+static int path2d_build(Path2D *path);
 
 /* Begin: HTMLCanvasElement static methods */
 static int canvas_getWidth(HTMLCanvasElement *this)
 {
+    CANVAS_STATS_CALL(GET_WIDTH);
+    CANVAS_STATS_CROSSING();
     return EM_ASM_INT({
-        return document.getElementById(UTF8ToString($0)).width;
+        return Module['canvasElements'][$0].width;
     },
-                      this->private.id);
+                      this->private.handle);
 }
 static int canvas_getHeight(HTMLCanvasElement *this)
 {
+    CANVAS_STATS_CALL(GET_HEIGHT);
+    CANVAS_STATS_CROSSING();
     return EM_ASM_INT({
-        return document.getElementById(UTF8ToString($0)).height;
+        return Module['canvasElements'][$0].height;
     },
-                      this->private.id);
+                      this->private.handle);
 }
 static void canvas_setWidth(HTMLCanvasElement *this, int width)
 {
+    CANVAS_STATS_CALL(SET_WIDTH);
+    if (this->private.ctx)
+        context2d_flush(this->private.ctx);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).width = $1;
+        Module['canvasElements'][$0].width = $1;
     },
-           this->private.id, width);
+           this->private.handle, width);
+    if (this->private.ctx)
+        context2d_pullState(this->private.ctx); // resizing resets the context's state
 }
 static void canvas_setHeight(HTMLCanvasElement *this, int height)
 {
+    CANVAS_STATS_CALL(SET_HEIGHT);
+    if (this->private.ctx)
+        context2d_flush(this->private.ctx);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).height = $1;
+        Module['canvasElements'][$0].height = $1;
     },
-           this->private.id, height);
+           this->private.handle, height);
+    if (this->private.ctx)
+        context2d_pullState(this->private.ctx); // resizing resets the context's state
 }
 static CanvasRenderingContext2D *canvas_getContext(HTMLCanvasElement *this, char *contextType)
 {
+    CANVAS_STATS_CALL(GET_CONTEXT);
     if (!this->private.ctx)
         this->private.ctx = createContext(this, contextType);
     return this->private.ctx;
@@ -48,16 +182,36 @@ static CanvasRenderingContext2D *canvas_getContext(HTMLCanvasElement *this, char
 
 HTMLCanvasElement *createCanvas(char *id)
 {
-    EM_ASM(
+    CANVAS_STATS_CALL(CREATE_CANVAS);
+    CANVAS_STATS_CROSSING();
+    CANVAS_STATS_UTF8(strlen(id) + 1);
+    /* the element is looked up once here and referred to by its index in the handle table after */
+    int handle = EM_ASM_INT(
         {
-            if (!document.getElementById(UTF8ToString($0)))
-                document.body.appendChild(document.createElement("canvas")).setAttribute("id", UTF8ToString($0));
+            var id = UTF8ToString($0);
+            var element = document.getElementById(id);
+            if (!element)
+            {
+                element = document.createElement("canvas");
+                element.setAttribute("id", id);
+                document.body.appendChild(element);
+            }
+            var elements = Module['canvasElements'] || (Module['canvasElements'] = []);
+            var contexts = Module['canvasContexts'] || (Module['canvasContexts'] = []);
+            var handle = elements.indexOf(null);
+            if (handle < 0)
+                handle = elements.length;
+            elements[handle] = element;
+            contexts[handle] = null;
+            return handle;
         },
         id);
     HTMLCanvasElement *c = (HTMLCanvasElement *)malloc(sizeof(HTMLCanvasElement));
     /* Begin: set pseudo-private fields */
     c->private.id = (char *)malloc(strlen(id) + 1);
+    CANVAS_STATS_ALLOCATIONS(2);
     strcpy(c->private.id, id);
+    c->private.handle = handle;
     c->private.ctx = NULL; // we'll lazy-load the context when it's asked for
     /* End: set pseudo-private fields */
     c->getWidth = canvas_getWidth;
@@ -65,442 +219,1542 @@ HTMLCanvasElement *createCanvas(char *id)
     c->setHeight = canvas_setHeight;
     c->setWidth = canvas_setWidth;
     c->getContext = canvas_getContext;
+    c->private.release = canvas_release;
+    c->private.surface = NULL;
+    canvasShapesAttach(c);
     return c;
 }
 
+/* Begin: CanvasRenderingContext2D drawing state shadow */
+/* identifiers of the keyword tables as cached on the JavaScript side; mirrored by context2d_flush() */
+enum
+{
+    KEYWORDS_LINE_CAP,
+    KEYWORDS_LINE_JOIN,
+    KEYWORDS_TEXT_ALIGN,
+    KEYWORDS_COMPOSITE_OPERATION
+};
+
+/**
+ * Caches the keyword tables as JavaScript strings, once, so that keyword-valued properties can be
+ * assigned by passing an index rather than decoding a string on every call.
+ */
+static void registerKeywords(void)
+{
+    static int registered = 0;
+    static const char *const *const tables[] = {canvasLineCapKeywords, canvasLineJoinKeywords, canvasTextAlignKeywords, canvasCompositeOperationKeywords};
+    if (registered)
+        return;
+    registered = 1;
+    for (int table = 0; table < (int)(sizeof(tables) / sizeof(*tables)); table++)
+        for (int i = 0; tables[table][i]; i++)
+        {
+            CANVAS_STATS_CROSSING();
+            CANVAS_STATS_UTF8(strlen(tables[table][i]) + 1);
+            EM_ASM({
+                var keywords = Module['canvasKeywords'] || (Module['canvasKeywords'] = []);
+                (keywords[$0] || (keywords[$0] = []))[$1] = UTF8ToString($2);
+            },
+                   table, i, tables[table][i]);
+        }
+}
+
+/**
+ * Installs a JavaScript function mapping packed 0xRRGGBBAA colors to CSS strings, backed by a cache
+ * so that each distinct color is formatted once and the browser is handed the same string for it
+ * every time. The cache is bounded; it is simply emptied when it fills up.
+ */
+static void registerColorCache(void)
+{
+    static int registered = 0;
+    if (registered)
+        return;
+    registered = 1;
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var colors = new Map();
+        Module['canvasColor'] = function(rgba) {
+            rgba = rgba >>> 0;
+            var css = colors.get(rgba);
+            if (css === undefined)
+            {
+                if (colors.size >= 4096)
+                    colors.clear();
+                css = 'rgba(' + (rgba >>> 24) + ',' + (rgba >>> 16 & 255) + ',' + (rgba >>> 8 & 255) + ',' + (rgba & 255) / 255 + ')';
+                colors.set(rgba, css);
+            }
+            return css;
+        };
+    });
+}
+
+
+/**
+ * Optionally assigns a string-valued property of the JavaScript context, then copies the property
+ * as the browser serializes it into buffer, truncating it to CANVAS_STATE_STRING_CAPACITY bytes.
+ * Provide a NULL value to only read it.
+ */
+static void context2d_exchangeString(CanvasRenderingContext2D *this, const char *property, const char *value, char *buffer)
+{
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var property = UTF8ToString($1);
+        if ($2)
+            ctx[property] = UTF8ToString($2);
+        stringToUTF8(String(ctx[property]), $3, $4);
+    },
+           this->private.canvas->private.handle, property, value, buffer, CANVAS_STATE_STRING_CAPACITY);
+    CANVAS_STATS_UTF8(strlen(property) + 1 + (value ? strlen(value) + 1 : 0) + strlen(buffer) + 1);
+}
+
+static int context2d_pullKeyword(CanvasRenderingContext2D *this, const char *property, const char *const *keywords)
+{
+    char value[CANVAS_STATE_STRING_CAPACITY];
+    context2d_exchangeString(this, property, NULL, value);
+    int index = canvasKeywordIndex(keywords, value);
+    return index < 0 ? 0 : index;
+}
+
+static void state_clearStack(CanvasRenderingContext2D *this)
+{
+    this->private.stateStackLength = 0;
+}
+
+/**
+ * Discards the shadow state and reads it back from JavaScript. Used when the context is created
+ * and whenever the browser resets the context's state, such as when the canvas is resized.
+ */
+static void context2d_pullState(CanvasRenderingContext2D *this)
+{
+    CanvasState *state = &this->private.state;
+    state_clearStack(this);
+    CANVAS_STATS_CROSSING();
+    state->lineWidth = EM_ASM_DOUBLE({
+        return Module['canvasContexts'][$0].lineWidth;
+    },
+                                     this->private.canvas->private.handle);
+    CANVAS_STATS_CROSSING();
+    state->globalAlpha = EM_ASM_DOUBLE({
+        return Module['canvasContexts'][$0].globalAlpha;
+    },
+                                       this->private.canvas->private.handle);
+    state->lineCap = context2d_pullKeyword(this, "lineCap", canvasLineCapKeywords);
+    state->lineJoin = context2d_pullKeyword(this, "lineJoin", canvasLineJoinKeywords);
+    state->textAlign = context2d_pullKeyword(this, "textAlign", canvasTextAlignKeywords);
+    state->globalCompositeOperation = context2d_pullKeyword(this, "globalCompositeOperation", canvasCompositeOperationKeywords);
+    context2d_exchangeString(this, "font", NULL, state->font);
+    state->fontRequested[0] = '\0';
+    context2d_exchangeString(this, "fillStyle", NULL, state->fillStyle);
+    state->fillStyleRequested[0] = '\0';
+    context2d_exchangeString(this, "strokeStyle", NULL, state->strokeStyle);
+    state->strokeStyleRequested[0] = '\0';
+    state->fillIsColor = 0;
+    state->strokeIsColor = 0;
+    state->transform = canvasIdentityMatrix;
+    canvasPathClear(this->private.path);
+}
+
+/** Returns non-zero if value is a legal line width which differs from the one in effect, and records it. */
+static int state_updateLineWidth(CanvasState *state, double value)
+{
+    /* like the browser, ignore zero, negative, infinite and NaN values */
+    if (!(value > 0.0 && isfinite(value)) || value == state->lineWidth)
+        return 0;
+    state->lineWidth = value;
+    return 1;
+}
+
+/** Returns non-zero if value is a legal global alpha which differs from the one in effect, and records it. */
+static int state_updateGlobalAlpha(CanvasState *state, double value)
+{
+    /* like the browser, ignore values outside [0.0, 1.0] and NaN */
+    if (!(value >= 0.0 && value <= 1.0) || value == state->globalAlpha)
+        return 0;
+    state->globalAlpha = value;
+    return 1;
+}
+
+/** Returns non-zero if value is a legal keyword index which differs from the one in effect. */
+static int state_keywordChanged(int current, int value, int count)
+{
+    return value >= 0 && value < count && value != current;
+}
+
+/**
+ * Returns non-zero after assigning a string-valued property, unless the value was already requested or is already in effect,
+ * keeping the shadow copies of the serialized and requested values up to date.
+ */
+static int context2d_updateString(CanvasRenderingContext2D *this, const char *property, char *serialized, char *requested, const char *value)
+{
+    if (!value)
+        return 0;
+    /* a buffer filled to capacity may hold a truncated value, so it's never trusted for comparison */
+    if ((requested[0] && strcmp(requested, value) == 0) ||
+        (strlen(serialized) < CANVAS_STATE_STRING_CAPACITY - 1 && strcmp(serialized, value) == 0))
+        return 0;
+    context2d_flush(this);
+    context2d_exchangeString(this, property, value, serialized);
+    if (strlen(value) < CANVAS_STATE_STRING_CAPACITY - 1)
+        strcpy(requested, value);
+    else
+        requested[0] = '\0';
+    return 1;
+}
+
+/**
+ * Returns non-zero if a packed color differs from the style in effect, and records it. The serialized
+ * style is left empty, to be read back from JavaScript only if a getter asks for it.
+ */
+static int state_updateColor(uint32_t *color, int *isColor, char *serialized, char *requested, uint32_t rgba)
+{
+    if (*isColor && *color == rgba)
+        return 0;
+    *color = rgba;
+    *isColor = 1;
+    serialized[0] = '\0';
+    requested[0] = '\0';
+    return 1;
+}
+
+/** Reads back a string-valued property whose shadow was left empty by a packed color setter. */
+static char *context2d_serializedString(CanvasRenderingContext2D *this, const char *property, char *serialized)
+{
+    if (!serialized[0])
+    {
+        context2d_flush(this);
+        context2d_exchangeString(this, property, NULL, serialized);
+    }
+    return serialized;
+}
+
+static void state_save(CanvasRenderingContext2D *this)
+{
+    if (this->private.stateStackLength == this->private.stateStackCapacity)
+    {
+        this->private.stateStackCapacity = this->private.stateStackCapacity ? this->private.stateStackCapacity * 2 : 8;
+        this->private.stateStack = (CanvasState *)realloc(this->private.stateStack, this->private.stateStackCapacity * sizeof(CanvasState));
+        CANVAS_STATS_ALLOCATIONS(1);
+    }
+    this->private.stateStack[this->private.stateStackLength++] = this->private.state;
+}
+
+/** Returns zero if there was no saved state to restore, in which case the browser would do nothing either. */
+static int state_restore(CanvasRenderingContext2D *this)
+{
+    if (!this->private.stateStackLength)
+        return 0;
+    this->private.state = this->private.stateStack[--this->private.stateStackLength];
+    return 1;
+}
+/* End: CanvasRenderingContext2D drawing state shadow */
+
 /* Begin: CanvasRenderingContext2D static methods */
 static void context2d_clearRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
 {
+    CANVAS_STATS_CALL(CLEAR_RECT);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').clearRect($1, $2, $3, $4);
+        Module['canvasContexts'][$0].clearRect($1, $2, $3, $4);
     },
-           this->private.canvas->private.id, x, y, width, height);
+           this->private.canvas->private.handle, x, y, width, height);
 }
 static void context2d_fillRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
 {
+    CANVAS_STATS_CALL(FILL_RECT);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').fillRect($1, $2, $3, $4);
+        Module['canvasContexts'][$0].fillRect($1, $2, $3, $4);
     },
-           this->private.canvas->private.id, x, y, width, height);
+           this->private.canvas->private.handle, x, y, width, height);
 }
 static void context2d_strokeRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
 {
+    CANVAS_STATS_CALL(STROKE_RECT);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        Module['canvasContexts'][$0].strokeRect($1, $2, $3, $4);
+    },
+           this->private.canvas->private.handle, x, y, width, height);
+}
+static void context2d_clearRects(CanvasRenderingContext2D *this, const float *xywh, size_t count)
+{
+    CANVAS_STATS_CALL(CLEAR_RECTS);
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var f = HEAPF32;
+        for (var i = $1 >> 2, end = i + $2 * 4; i < end; i += 4)
+            ctx.clearRect(f[i], f[i + 1], f[i + 2], f[i + 3]);
+    },
+           this->private.canvas->private.handle, xywh, count);
+}
+static void context2d_fillRects(CanvasRenderingContext2D *this, const float *xywh, size_t count)
+{
+    CANVAS_STATS_CALL(FILL_RECTS);
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var f = HEAPF32;
+        for (var i = $1 >> 2, end = i + $2 * 4; i < end; i += 4)
+            ctx.fillRect(f[i], f[i + 1], f[i + 2], f[i + 3]);
+    },
+           this->private.canvas->private.handle, xywh, count);
+}
+static void context2d_strokeRects(CanvasRenderingContext2D *this, const float *xywh, size_t count)
+{
+    CANVAS_STATS_CALL(STROKE_RECTS);
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var f = HEAPF32;
+        for (var i = $1 >> 2, end = i + $2 * 4; i < end; i += 4)
+            ctx.strokeRect(f[i], f[i + 1], f[i + 2], f[i + 3]);
+    },
+           this->private.canvas->private.handle, xywh, count);
+}
+static void context2d_fillRectsColored(CanvasRenderingContext2D *this, const float *xywh, const uint32_t *rgba, size_t count)
+{
+    CANVAS_STATS_CALL(FILL_RECTS_COLORED);
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var f = HEAPF32;
+        var u = HEAPU32;
+        var color = Module['canvasColor'];
+        var style = ctx.fillStyle;
+        for (var i = $1 >> 2, c = $2 >> 2, end = i + $3 * 4; i < end; i += 4, c++)
+        {
+            ctx.fillStyle = color(u[c]);
+            ctx.fillRect(f[i], f[i + 1], f[i + 2], f[i + 3]);
+        }
+        ctx.fillStyle = style;
+    },
+           this->private.canvas->private.handle, xywh, rgba, count);
+}
+static void context2d_fillRectsTransformed(CanvasRenderingContext2D *this, const float *xywh, const float *matrices, size_t count)
+{
+    CANVAS_STATS_CALL(FILL_RECTS_TRANSFORMED);
+    if (count > this->private.quadsCapacity)
+    {
+        this->private.quadsCapacity = count;
+        this->private.quads = (float *)realloc(this->private.quads, 8 * count * sizeof(float));
+        CANVAS_STATS_ALLOCATIONS(1);
+    }
+    const CanvasMatrix *m = &this->private.state.transform;
+    canvasMatrixApplyRects(m, xywh, matrices, count, this->private.quads);
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var f = HEAPF32;
+        var path = new Path2D();
+        for (var i = $1 >> 2, end = i + $2 * 8; i < end; i += 8)
+        {
+            path.moveTo(f[i], f[i + 1]);
+            path.lineTo(f[i + 2], f[i + 3]);
+            path.lineTo(f[i + 4], f[i + 5]);
+            path.lineTo(f[i + 6], f[i + 7]);
+            path.closePath();
+        }
+        ctx.setTransform(1, 0, 0, 1, 0, 0);
+        ctx.fill(path);
+        ctx.setTransform($3, $4, $5, $6, $7, $8);
+    },
+           this->private.canvas->private.handle, this->private.quads, count, m->a, m->b, m->c, m->d, m->e, m->f);
+}
+/**
+ * Returns the index of the JavaScript ImageData wrapping image's pixels, creating the wrapper on first
+ * use and again whenever memory growth has replaced the heap buffer the old one was a view of.
+ */
+static int imageData_wrap(ImageData *image)
+{
+    CANVAS_STATS_CROSSING();
+    image->private.handle = EM_ASM_INT({
+        var images = Module['canvasImages'] || (Module['canvasImages'] = []);
+        var handle = $0;
+        if (handle < 0)
+        {
+            handle = images.indexOf(null);
+            if (handle < 0)
+                handle = images.length;
+            images[handle] = null;
+        }
+        var entry = images[handle];
+        if (!entry || entry.buffer !== HEAPU8.buffer)
+        {
+            images[handle] = {
+                buffer : HEAPU8.buffer,
+                image : new ImageData(new Uint8ClampedArray(HEAPU8.buffer, $1, $2 * $3 * 4), $2, $3)
+            };
+        }
+        return handle;
+    },
+                                         image->private.handle, image->data, image->width, image->height);
+    return image->private.handle;
+}
+/*
+ * Draws of a Path2D recorded in a command buffer refer to its JavaScript Path2D by handle until the
+ * buffer is flushed, so the Path2D must neither change nor be let go of before then. Per handle,
+ * pathPending counts the recorded draws not yet flushed, and pathReleased marks handles to be let
+ * go of once none are left; a Path2D with draws pending gets a copy to append its new segments to.
+ */
+static int *pathPending;
+static unsigned char *pathReleased;
+static size_t pathHandlesCapacity;
+
+/** Lets go of the JavaScript Path2D at handle, now or, if draws of it are pending, once they're flushed. */
+static void path2d_release(int handle)
+{
+    if ((size_t)handle < pathHandlesCapacity && pathPending[handle])
+    {
+        pathReleased[handle] = 1;
+        return;
+    }
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        Module['canvasPaths'][$0] = null;
+    },
+           handle);
+}
+
+/** Notes a draw of the JavaScript Path2D at handle recorded in this context's command buffer. */
+static void path2d_retain(CanvasRenderingContext2D *this, int handle)
+{
+    if ((size_t)handle >= pathHandlesCapacity)
+    {
+        size_t newCapacity = pathHandlesCapacity ? pathHandlesCapacity : 64;
+        while (newCapacity <= (size_t)handle)
+            newCapacity *= 2;
+        pathPending = (int *)realloc(pathPending, newCapacity * sizeof(int));
+        pathReleased = (unsigned char *)realloc(pathReleased, newCapacity);
+        CANVAS_STATS_ALLOCATIONS(2);
+        memset(pathPending + pathHandlesCapacity, 0, (newCapacity - pathHandlesCapacity) * sizeof(int));
+        memset(pathReleased + pathHandlesCapacity, 0, newCapacity - pathHandlesCapacity);
+        pathHandlesCapacity = newCapacity;
+    }
+    pathPending[handle]++;
+    if (this->private.pathHandlesLength == this->private.pathHandlesCapacity)
+    {
+        this->private.pathHandlesCapacity = this->private.pathHandlesCapacity ? 2 * this->private.pathHandlesCapacity : 16;
+        this->private.pathHandles = (int *)realloc(this->private.pathHandles, this->private.pathHandlesCapacity * sizeof(int));
+        CANVAS_STATS_ALLOCATIONS(1);
+    }
+    this->private.pathHandles[this->private.pathHandlesLength++] = handle;
+}
+
+/**
+ * Returns the index of the JavaScript Path2D made from path, creating it on first use and adding
+ * any segments buffered since the last call, all in a single call into JavaScript. If recorded draws
+ * of the JavaScript Path2D are pending, the segments are added to a copy of it instead.
+ */
+static int path2d_build(Path2D *path)
+{
+    if (path->private.handle >= 0 && path->private.builtLength == path->private.commandsLength)
+        return path->private.handle;
+    int previous = path->private.handle;
+    int copy = previous >= 0 && (size_t)previous < pathHandlesCapacity && pathPending[previous];
+    CANVAS_STATS_CROSSING();
+    path->private.handle = EM_ASM_INT({
+        var paths = Module['canvasPaths'] || (Module['canvasPaths'] = []);
+        var handle = $0;
+        if (handle < 0 || $3)
+        {
+            var source = handle < 0 ? null : paths[handle];
+            handle = paths.indexOf(null);
+            if (handle < 0)
+                handle = paths.length;
+            paths[handle] = source ? new Path2D(source) : new Path2D();
+        }
+        var p = paths[handle];
+        var b = HEAPF64;
+        var i = $1 >> 3;
+        var end = i + $2;
+        while (i < end)
+        {
+            switch (b[i++])
+            {
+            case 6: p.closePath(); break;
+            case 7: p.moveTo(b[i], b[i + 1]); i += 2; break;
+            case 8: p.lineTo(b[i], b[i + 1]); i += 2; break;
+            case 9: p.bezierCurveTo(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5]); i += 6; break;
+            case 10: p.quadraticCurveTo(b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+            case 11: p.arc(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4]); i += 5; break;
+            case 12: p.arcTo(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4]); i += 5; break;
+            case 13: p.ellipse(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5], b[i + 6]); i += 7; break;
+            case 14: p.rect(b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+            }
+        }
+        return handle;
+    },
+                                        path->private.handle, path->private.commands + path->private.builtLength,
+                                        path->private.commandsLength - path->private.builtLength, copy);
+    path->private.builtLength = path->private.commandsLength;
+    if (copy)
+        path2d_release(previous);
+    return path->private.handle;
+}
+static void context2d_putImageData(CanvasRenderingContext2D *this, ImageData *image, int dx, int dy)
+{
+    CANVAS_STATS_CALL(PUT_IMAGE_DATA);
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').strokeRect($1, $2, $3, $4);
+        Module['canvasContexts'][$0].putImageData(Module['canvasImages'][$1].image, $2, $3);
     },
-           this->private.canvas->private.id, x, y, width, height);
+           this->private.canvas->private.handle, imageData_wrap(image), dx, dy);
+}
+static void context2d_putImageDataDirty(CanvasRenderingContext2D *this, ImageData *image, int dx, int dy)
+{
+    CANVAS_STATS_CALL(PUT_IMAGE_DATA_DIRTY);
+    if (!image->private.damageCount)
+        return;
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var image = Module['canvasImages'][$1].image;
+        var d = HEAP32;
+        for (var i = $4 >> 2, end = i + $5 * 4; i < end; i += 4)
+            ctx.putImageData(image, $2, $3, d[i], d[i + 1], d[i + 2], d[i + 3]);
+    },
+           this->private.canvas->private.handle, imageData_wrap(image), dx, dy, image->private.damage, image->private.damageCount);
+    image->private.damageCount = 0;
+}
+static void context2d_getImageData(CanvasRenderingContext2D *this, ImageData *dest, int sx, int sy)
+{
+    CANVAS_STATS_CALL(GET_IMAGE_DATA);
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        HEAPU8.set(Module['canvasContexts'][$0].getImageData($2, $3, $4, $5).data, $1);
+    },
+           this->private.canvas->private.handle, dest->data, sx, sy, dest->width, dest->height);
 }
 static void context2d_fillText(CanvasRenderingContext2D *this, char *text, double x, double y, double maxWidth)
 {
+    CANVAS_STATS_CALL(FILL_TEXT);
+    context2d_flush(this);
+    CANVAS_STATS_UTF8(strlen(text) + 1);
     if (maxWidth < 0.0)
     {
+        CANVAS_STATS_CROSSING();
         EM_ASM({
-            document.getElementById(UTF8ToString($0)).getContext('2d').fillText(UTF8ToString($1), $2, $3);
+            Module['canvasContexts'][$0].fillText(UTF8ToString($1), $2, $3);
         },
-               this->private.canvas->private.id, text, x, y);
+               this->private.canvas->private.handle, text, x, y);
     }
     else
     {
+        CANVAS_STATS_CROSSING();
         EM_ASM({
-            document.getElementById(UTF8ToString($0)).getContext('2d').fillText(UTF8ToString($1), $2, $3, $4);
+            Module['canvasContexts'][$0].fillText(UTF8ToString($1), $2, $3, $4);
         },
-               this->private.canvas->private.id, text, x, y, maxWidth);
+               this->private.canvas->private.handle, text, x, y, maxWidth);
     }
 }
 static void context2d_strokeText(CanvasRenderingContext2D *this, char *text, double x, double y, double maxWidth)
 {
+    CANVAS_STATS_CALL(STROKE_TEXT);
+    context2d_flush(this);
+    CANVAS_STATS_UTF8(strlen(text) + 1);
     if (maxWidth < 0.0)
     {
+        CANVAS_STATS_CROSSING();
         EM_ASM({
-            document.getElementById(UTF8ToString($0)).getContext('2d').strokeText(UTF8ToString($1), $2, $3);
+            Module['canvasContexts'][$0].strokeText(UTF8ToString($1), $2, $3);
         },
-               this->private.canvas->private.id, text, x, y);
+               this->private.canvas->private.handle, text, x, y);
     }
     else
     {
+        CANVAS_STATS_CROSSING();
         EM_ASM({
-            document.getElementById(UTF8ToString($0)).getContext('2d').strokeText(UTF8ToString($1), $2, $3, $4);
+            Module['canvasContexts'][$0].strokeText(UTF8ToString($1), $2, $3, $4);
         },
-               this->private.canvas->private.id, text, x, y, maxWidth);
+               this->private.canvas->private.handle, text, x, y, maxWidth);
     }
 }
 static void context2d_setLineWidth(CanvasRenderingContext2D *this, double value)
 {
+    CANVAS_STATS_CALL(SET_LINE_WIDTH);
+    if (!state_updateLineWidth(&this->private.state, value))
+        return;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').lineWidth = ($1);
+        Module['canvasContexts'][$0].lineWidth = ($1);
     },
-           this->private.canvas->private.id, value);
+           this->private.canvas->private.handle, value);
 }
 static double context2d_getLineWidth(CanvasRenderingContext2D *this)
 {
-    return EM_ASM_DOUBLE({
-        return document.getElementById(UTF8ToString($0)).getContext('2d').lineWidth;
-    },
-                         this->private.canvas->private.id);
+    CANVAS_STATS_CALL(GET_LINE_WIDTH);
+    return this->private.state.lineWidth;
 }
 static void context2d_setLineCap(CanvasRenderingContext2D *this, char *type)
 {
+    CANVAS_STATS_CALL(SET_LINE_CAP);
+    int index = type ? canvasKeywordIndex(canvasLineCapKeywords, type) : -1;
+    if (index >= 0)
+        this->setLineCapEnum(this, (CanvasLineCap)index);
+}
+static void context2d_setLineCapEnum(CanvasRenderingContext2D *this, CanvasLineCap type)
+{
+    CANVAS_STATS_CALL(SET_LINE_CAP_ENUM);
+    if (!state_keywordChanged(this->private.state.lineCap, type, (LINE_CAP_SQUARE + 1)))
+        return;
+    this->private.state.lineCap = type;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').lineCap = UTF8ToString($1);
+        Module['canvasContexts'][$0].lineCap = Module['canvasKeywords'][$1][$2];
     },
-           this->private.canvas->private.id, type);
+           this->private.canvas->private.handle, KEYWORDS_LINE_CAP, type);
 }
 static char *context2d_getLineCap(CanvasRenderingContext2D *this)
 {
-    if (this->private.lineCap)
-        free(this->private.lineCap);
-    this->private.lineCap = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').lineCap;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                               this->private.canvas->private.id);
-    return this->private.lineCap;
+    CANVAS_STATS_CALL(GET_LINE_CAP);
+    return (char *)canvasLineCapKeywords[this->private.state.lineCap];
+}
+static CanvasLineCap context2d_getLineCapEnum(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(GET_LINE_CAP_ENUM);
+    return this->private.state.lineCap;
 }
 static void context2d_setLineJoin(CanvasRenderingContext2D *this, char *type)
 {
+    CANVAS_STATS_CALL(SET_LINE_JOIN);
+    int index = type ? canvasKeywordIndex(canvasLineJoinKeywords, type) : -1;
+    if (index >= 0)
+        this->setLineJoinEnum(this, (CanvasLineJoin)index);
+}
+static void context2d_setLineJoinEnum(CanvasRenderingContext2D *this, CanvasLineJoin type)
+{
+    CANVAS_STATS_CALL(SET_LINE_JOIN_ENUM);
+    if (!state_keywordChanged(this->private.state.lineJoin, type, (LINE_JOIN_MITER + 1)))
+        return;
+    this->private.state.lineJoin = type;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').lineJoin = UTF8ToString($1);
+        Module['canvasContexts'][$0].lineJoin = Module['canvasKeywords'][$1][$2];
     },
-           this->private.canvas->private.id, type);
+           this->private.canvas->private.handle, KEYWORDS_LINE_JOIN, type);
 }
 static char *context2d_getLineJoin(CanvasRenderingContext2D *this)
 {
-    if (this->private.lineJoin)
-        free(this->private.lineJoin);
-    this->private.lineJoin = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').lineJoin;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                this->private.canvas->private.id);
-    return this->private.lineJoin;
+    CANVAS_STATS_CALL(GET_LINE_JOIN);
+    return (char *)canvasLineJoinKeywords[this->private.state.lineJoin];
+}
+static CanvasLineJoin context2d_getLineJoinEnum(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(GET_LINE_JOIN_ENUM);
+    return this->private.state.lineJoin;
 }
 static char *context2d_getFont(CanvasRenderingContext2D *this)
 {
-    if (this->private.font)
-        free(this->private.font); // this field could be reused, but we won't just in case it changes from the JS side
-    this->private.font = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').font;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                            this->private.canvas->private.id);
-    return this->private.font;
+    CANVAS_STATS_CALL(GET_FONT);
+    return this->private.state.font;
 }
 static void context2d_setFont(CanvasRenderingContext2D *this, char *value)
 {
-    EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').font = UTF8ToString($1);
-    },
-           this->private.canvas->private.id, value);
+    CANVAS_STATS_CALL(SET_FONT);
+    context2d_updateString(this, "font", this->private.state.font, this->private.state.fontRequested, value);
 }
 static char *context2d_getTextAlign(CanvasRenderingContext2D *this)
 {
-    if (this->private.textAlign)
-        free(this->private.textAlign);
-    this->private.textAlign = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').textAlign;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                 this->private.canvas->private.id);
-    return this->private.textAlign;
+    CANVAS_STATS_CALL(GET_TEXT_ALIGN);
+    return (char *)canvasTextAlignKeywords[this->private.state.textAlign];
+}
+static CanvasTextAlign context2d_getTextAlignEnum(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(GET_TEXT_ALIGN_ENUM);
+    return this->private.state.textAlign;
 }
 static void context2d_setTextAlign(CanvasRenderingContext2D *this, char *value)
 {
+    CANVAS_STATS_CALL(SET_TEXT_ALIGN);
+    int index = value ? canvasKeywordIndex(canvasTextAlignKeywords, value) : -1;
+    if (index >= 0)
+        this->setTextAlignEnum(this, (CanvasTextAlign)index);
+}
+static void context2d_setTextAlignEnum(CanvasRenderingContext2D *this, CanvasTextAlign value)
+{
+    CANVAS_STATS_CALL(SET_TEXT_ALIGN_ENUM);
+    if (!state_keywordChanged(this->private.state.textAlign, value, (TEXT_ALIGN_CENTER + 1)))
+        return;
+    this->private.state.textAlign = value;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').textAlign = UTF8ToString($1);
+        Module['canvasContexts'][$0].textAlign = Module['canvasKeywords'][$1][$2];
     },
-           this->private.canvas->private.id, value);
+           this->private.canvas->private.handle, KEYWORDS_TEXT_ALIGN, value);
 }
 static char *context2d_getFillStyle(CanvasRenderingContext2D *this)
 {
-    if (this->private.fillStyle)
-        free(this->private.fillStyle);
-    this->private.fillStyle = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').fillStyle;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                 this->private.canvas->private.id);
-    return this->private.fillStyle;
+    CANVAS_STATS_CALL(GET_FILL_STYLE);
+    return context2d_serializedString(this, "fillStyle", this->private.state.fillStyle);
 }
 static void context2d_setFillStyle(CanvasRenderingContext2D *this, char *value)
 {
+    CANVAS_STATS_CALL(SET_FILL_STYLE);
+    if (context2d_updateString(this, "fillStyle", this->private.state.fillStyle, this->private.state.fillStyleRequested, value))
+        this->private.state.fillIsColor = 0;
+}
+static void context2d_setFillColor(CanvasRenderingContext2D *this, uint32_t rgba)
+{
+    CANVAS_STATS_CALL(SET_FILL_COLOR);
+    CanvasState *state = &this->private.state;
+    if (!state_updateColor(&state->fillColor, &state->fillIsColor, state->fillStyle, state->fillStyleRequested, rgba))
+        return;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').fillStyle = UTF8ToString($1);
+        Module['canvasContexts'][$0].fillStyle = Module['canvasColor']($1);
     },
-           this->private.canvas->private.id, value);
+           this->private.canvas->private.handle, rgba);
 }
 static char *context2d_getStrokeStyle(CanvasRenderingContext2D *this)
 {
-    if (this->private.strokeStyle)
-        free(this->private.strokeStyle);
-    this->private.strokeStyle = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').strokeStyle;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                   this->private.canvas->private.id);
-    return this->private.strokeStyle;
+    CANVAS_STATS_CALL(GET_STROKE_STYLE);
+    return context2d_serializedString(this, "strokeStyle", this->private.state.strokeStyle);
 }
 static void context2d_setStrokeStyle(CanvasRenderingContext2D *this, char *value)
 {
+    CANVAS_STATS_CALL(SET_STROKE_STYLE);
+    if (context2d_updateString(this, "strokeStyle", this->private.state.strokeStyle, this->private.state.strokeStyleRequested, value))
+        this->private.state.strokeIsColor = 0;
+}
+static void context2d_setStrokeColor(CanvasRenderingContext2D *this, uint32_t rgba)
+{
+    CANVAS_STATS_CALL(SET_STROKE_COLOR);
+    CanvasState *state = &this->private.state;
+    if (!state_updateColor(&state->strokeColor, &state->strokeIsColor, state->strokeStyle, state->strokeStyleRequested, rgba))
+        return;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').strokeStyle = UTF8ToString($1);
+        Module['canvasContexts'][$0].strokeStyle = Module['canvasColor']($1);
     },
-           this->private.canvas->private.id, value);
+           this->private.canvas->private.handle, rgba);
 }
 static void context2d_beginPath(CanvasRenderingContext2D *this)
 {
+    CANVAS_STATS_CALL(BEGIN_PATH);
+    canvasPathClear(this->private.path);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').beginPath();
+        Module['canvasContexts'][$0].beginPath();
     },
-           this->private.canvas->private.id);
+           this->private.canvas->private.handle);
 }
 static void context2d_closePath(CanvasRenderingContext2D *this)
 {
+    CANVAS_STATS_CALL(CLOSE_PATH);
+    canvasPathClose(this->private.path);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').closePath();
+        Module['canvasContexts'][$0].closePath();
     },
-           this->private.canvas->private.id);
+           this->private.canvas->private.handle);
 }
 static void context2d_moveTo(CanvasRenderingContext2D *this, double x, double y)
 {
+    CANVAS_STATS_CALL(MOVE_TO);
+    canvasPathMoveTo(this->private.path, &this->private.state.transform, x, y);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').moveTo($1, $2);
+        Module['canvasContexts'][$0].moveTo($1, $2);
     },
-           this->private.canvas->private.id, x, y);
+           this->private.canvas->private.handle, x, y);
 }
 static void context2d_lineTo(CanvasRenderingContext2D *this, double x, double y)
 {
+    CANVAS_STATS_CALL(LINE_TO);
+    canvasPathLineTo(this->private.path, &this->private.state.transform, x, y);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').lineTo($1, $2);
+        Module['canvasContexts'][$0].lineTo($1, $2);
     },
-           this->private.canvas->private.id, x, y);
+           this->private.canvas->private.handle, x, y);
 }
 static void context2d_bezierCurveTo(CanvasRenderingContext2D *this, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y)
 {
+    CANVAS_STATS_CALL(BEZIER_CURVE_TO);
+    canvasPathBezierCurveTo(this->private.path, &this->private.state.transform, cp1x, cp1y, cp2x, cp2y, x, y);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').bezierCurveTo($1, $2, $3, $4, $5, $6);
+        Module['canvasContexts'][$0].bezierCurveTo($1, $2, $3, $4, $5, $6);
     },
-           this->private.canvas->private.id, cp1x, cp1y, cp2x, cp2y, x, y);
+           this->private.canvas->private.handle, cp1x, cp1y, cp2x, cp2y, x, y);
 }
 static void context2d_quadraticCurveTo(CanvasRenderingContext2D *this, double cpx, double cpy, double x, double y)
 {
+    CANVAS_STATS_CALL(QUADRATIC_CURVE_TO);
+    canvasPathQuadraticCurveTo(this->private.path, &this->private.state.transform, cpx, cpy, x, y);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').quadraticCurveTo($1, $2, $3, $4);
+        Module['canvasContexts'][$0].quadraticCurveTo($1, $2, $3, $4);
     },
-           this->private.canvas->private.id, cpx, cpy, x, y);
+           this->private.canvas->private.handle, cpx, cpy, x, y);
 }
 static void context2d_arc(CanvasRenderingContext2D *this, double x, double y, double radius, double startAngle, double endAngle)
 {
+    CANVAS_STATS_CALL(ARC);
+    canvasPathArc(this->private.path, &this->private.state.transform, x, y, radius, startAngle, endAngle);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').arc($1, $2, $3, $4, $5);
+        Module['canvasContexts'][$0].arc($1, $2, $3, $4, $5);
     },
-           this->private.canvas->private.id, x, y, radius, startAngle, endAngle);
+           this->private.canvas->private.handle, x, y, radius, startAngle, endAngle);
 }
 static void context2d_arcTo(CanvasRenderingContext2D *this, double x1, double y1, double x2, double y2, double radius)
 {
+    CANVAS_STATS_CALL(ARC_TO);
+    canvasPathArcTo(this->private.path, &this->private.state.transform, x1, y1, x2, y2, radius);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').arcTo($1, $2, $3, $4, $5);
+        Module['canvasContexts'][$0].arcTo($1, $2, $3, $4, $5);
     },
-           this->private.canvas->private.id, x1, y1, x2, y2, radius);
+           this->private.canvas->private.handle, x1, y1, x2, y2, radius);
 }
 static void context2d_ellipse(CanvasRenderingContext2D *this, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle)
 {
+    CANVAS_STATS_CALL(ELLIPSE);
+    canvasPathEllipse(this->private.path, &this->private.state.transform, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').ellipse($1, $2, $3, $4, $5, $6, $7);
+        Module['canvasContexts'][$0].ellipse($1, $2, $3, $4, $5, $6, $7);
     },
-           this->private.canvas->private.id, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
+           this->private.canvas->private.handle, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
 }
 static void context2d_rect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
 {
+    CANVAS_STATS_CALL(RECT);
+    canvasPathRect(this->private.path, &this->private.state.transform, x, y, width, height);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').rect($1, $2, $3, $4);
+        Module['canvasContexts'][$0].rect($1, $2, $3, $4);
     },
-           this->private.canvas->private.id, x, y, width, height);
+           this->private.canvas->private.handle, x, y, width, height);
+}
+static void context2d_polyline(CanvasRenderingContext2D *this, const float *xy, size_t count, int closed)
+{
+    CANVAS_STATS_CALL(POLYLINE);
+    if (!count)
+        return;
+    canvasPathPolyline(this->private.path, &this->private.state.transform, xy, count, closed);
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var f = HEAPF32;
+        var i = $1 >> 2;
+        var end = i + $2 * 2;
+        ctx.moveTo(f[i], f[i + 1]);
+        for (i += 2; i < end; i += 2)
+            ctx.lineTo(f[i], f[i + 1]);
+        if ($3)
+            ctx.closePath();
+    },
+           this->private.canvas->private.handle, xy, count, closed);
+}
+static void context2d_polylines(CanvasRenderingContext2D *this, const float *xy, const uint32_t *offsets, size_t polylineCount, int closed)
+{
+    CANVAS_STATS_CALL(POLYLINES);
+    if (!polylineCount)
+        return;
+    for (size_t i = 0; i < polylineCount; i++)
+        if (offsets[i + 1] > offsets[i])
+            canvasPathPolyline(this->private.path, &this->private.state.transform, xy + 2 * offsets[i], offsets[i + 1] - offsets[i], closed);
+    context2d_flush(this);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var f = HEAPF32;
+        var u = HEAPU32;
+        var base = $1 >> 2;
+        for (var p = $2 >> 2, last = p + $3; p < last; p++)
+        {
+            var i = base + u[p] * 2;
+            var end = base + u[p + 1] * 2;
+            if (i >= end)
+                continue;
+            ctx.moveTo(f[i], f[i + 1]);
+            for (i += 2; i < end; i += 2)
+                ctx.lineTo(f[i], f[i + 1]);
+            if ($4)
+                ctx.closePath();
+        }
+    },
+           this->private.canvas->private.handle, xy, offsets, polylineCount, closed);
 }
 static void context2d_fill(CanvasRenderingContext2D *this)
 {
+    CANVAS_STATS_CALL(FILL);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').fill();
+        Module['canvasContexts'][$0].fill();
     },
-           this->private.canvas->private.id);
+           this->private.canvas->private.handle);
 }
 static void context2d_stroke(CanvasRenderingContext2D *this)
 {
+    CANVAS_STATS_CALL(STROKE);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').stroke();
+        Module['canvasContexts'][$0].stroke();
     },
-           this->private.canvas->private.id);
+           this->private.canvas->private.handle);
 }
 static void context2d_clip(CanvasRenderingContext2D *this)
 {
+    CANVAS_STATS_CALL(CLIP);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').clip();
+        Module['canvasContexts'][$0].clip();
     },
-           this->private.canvas->private.id);
+           this->private.canvas->private.handle);
+}
+static int context2d_isPointInPathFillRule(CanvasRenderingContext2D *this, double x, double y, CanvasFillRule fillRule)
+{
+    CANVAS_STATS_CALL(IS_POINT_IN_PATH_FILL_RULE);
+    canvasEdgesFill(this->private.hitEdges, this->private.path);
+    return canvasEdgesContain(this->private.hitEdges, x, y, fillRule);
 }
 static int context2d_isPointInPath(CanvasRenderingContext2D *this, double x, double y)
 {
-    return EM_ASM_INT({
-        return document.getElementById(UTF8ToString($0)).getContext('2d').isPointInPath($1, $2);
-    },
-                      this->private.canvas->private.id, x, y);
+    CANVAS_STATS_CALL(IS_POINT_IN_PATH);
+    return context2d_isPointInPathFillRule(this, x, y, FILL_RULE_NONZERO);
 }
 static int context2d_isPointInStroke(CanvasRenderingContext2D *this, double x, double y)
 {
-    return EM_ASM_INT({
-        return document.getElementById(UTF8ToString($0)).getContext('2d').isPointInStroke($1, $2);
+    CANVAS_STATS_CALL(IS_POINT_IN_STROKE);
+    canvasEdgesStroke(this->private.hitEdges, this->private.path, &this->private.state);
+    return canvasEdgesContain(this->private.hitEdges, x, y, FILL_RULE_NONZERO);
+}
+static void context2d_fillPath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    CANVAS_STATS_CALL(FILL_PATH);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        Module['canvasContexts'][$0].fill(Module['canvasPaths'][$1]);
+    },
+           this->private.canvas->private.handle, path2d_build(path));
+}
+static void context2d_strokePath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    CANVAS_STATS_CALL(STROKE_PATH);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        Module['canvasContexts'][$0].stroke(Module['canvasPaths'][$1]);
+    },
+           this->private.canvas->private.handle, path2d_build(path));
+}
+static void context2d_clipPath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    CANVAS_STATS_CALL(CLIP_PATH);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        Module['canvasContexts'][$0].clip(Module['canvasPaths'][$1]);
     },
-                      this->private.canvas->private.id, x, y);
+           this->private.canvas->private.handle, path2d_build(path));
+}
+static int context2d_isPointInPath2D(CanvasRenderingContext2D *this, Path2D *path, double x, double y, CanvasFillRule fillRule)
+{
+    CANVAS_STATS_CALL(IS_POINT_IN_PATH_2D);
+    return canvasPath2DContains(path, &this->private.state.transform, x, y, fillRule);
+}
+static int context2d_isPointInStroke2D(CanvasRenderingContext2D *this, Path2D *path, double x, double y)
+{
+    CANVAS_STATS_CALL(IS_POINT_IN_STROKE_2D);
+    return canvasPath2DStrokeContains(path, &this->private.state, x, y);
 }
 static void context2d_rotate(CanvasRenderingContext2D *this, double angle)
 {
+    CANVAS_STATS_CALL(ROTATE);
+    canvasMatrixMultiply(&this->private.state.transform, cos(angle), sin(angle), -sin(angle), cos(angle), 0.0, 0.0);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').rotate($1);
+        Module['canvasContexts'][$0].rotate($1);
     },
-           this->private.canvas->private.id, angle);
+           this->private.canvas->private.handle, angle);
 }
 static void context2d_scale(CanvasRenderingContext2D *this, double x, double y)
 {
+    CANVAS_STATS_CALL(SCALE);
+    canvasMatrixMultiply(&this->private.state.transform, x, 0.0, 0.0, y, 0.0, 0.0);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').scale($1, $2);
+        Module['canvasContexts'][$0].scale($1, $2);
     },
-           this->private.canvas->private.id, x, y);
+           this->private.canvas->private.handle, x, y);
 }
 static void context2d_translate(CanvasRenderingContext2D *this, double x, double y)
 {
+    CANVAS_STATS_CALL(TRANSLATE);
+    canvasMatrixMultiply(&this->private.state.transform, 1.0, 0.0, 0.0, 1.0, x, y);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').translate($1, $2);
+        Module['canvasContexts'][$0].translate($1, $2);
     },
-           this->private.canvas->private.id, x, y);
+           this->private.canvas->private.handle, x, y);
 }
 static void context2d_transform(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f)
 {
+    CANVAS_STATS_CALL(TRANSFORM);
+    canvasMatrixMultiply(&this->private.state.transform, a, b, c, d, e, f);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').transform($1, $2, $3, $4, $5, $6);
+        Module['canvasContexts'][$0].transform($1, $2, $3, $4, $5, $6);
     },
-           this->private.canvas->private.id, a, b, c, d, e, f);
+           this->private.canvas->private.handle, a, b, c, d, e, f);
 }
 static void context2d_setTransform(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f)
 {
+    CANVAS_STATS_CALL(SET_TRANSFORM);
+    this->private.state.transform = (CanvasMatrix){a, b, c, d, e, f};
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').setTransform($1, $2, $3, $4, $5, $6);
+        Module['canvasContexts'][$0].setTransform($1, $2, $3, $4, $5, $6);
     },
-           this->private.canvas->private.id, a, b, c, d, e, f);
+           this->private.canvas->private.handle, a, b, c, d, e, f);
 }
 static void context2d_resetTransform(CanvasRenderingContext2D *this)
 {
+    CANVAS_STATS_CALL(RESET_TRANSFORM);
+    this->private.state.transform = canvasIdentityMatrix;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').resetTransform();
+        Module['canvasContexts'][$0].resetTransform();
     },
-           this->private.canvas->private.id);
+           this->private.canvas->private.handle);
+}
+static CanvasMatrix context2d_getTransform(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(GET_TRANSFORM);
+    return this->private.state.transform;
 }
 static void context2d_setGlobalAlpha(CanvasRenderingContext2D *this, double value)
 {
+    CANVAS_STATS_CALL(SET_GLOBAL_ALPHA);
+    if (!state_updateGlobalAlpha(&this->private.state, value))
+        return;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').globalAlpha = $1;
+        Module['canvasContexts'][$0].globalAlpha = $1;
     },
-           this->private.canvas->private.id, value);
+           this->private.canvas->private.handle, value);
 }
 static double context2d_getGlobalAlpha(CanvasRenderingContext2D *this)
 {
-    return EM_ASM_DOUBLE({
-        return document.getElementById(UTF8ToString($0)).getContext('2d').globalAlpha;
-    },
-                         this->private.canvas->private.id);
+    CANVAS_STATS_CALL(GET_GLOBAL_ALPHA);
+    return this->private.state.globalAlpha;
 }
 static void context2d_setGlobalCompositeOperation(CanvasRenderingContext2D *this, char *value)
 {
+    CANVAS_STATS_CALL(SET_GLOBAL_COMPOSITE_OPERATION);
+    int index = value ? canvasKeywordIndex(canvasCompositeOperationKeywords, value) : -1;
+    if (index >= 0)
+        this->setGlobalCompositeOperationEnum(this, (CanvasCompositeOperation)index);
+}
+static void context2d_setGlobalCompositeOperationEnum(CanvasRenderingContext2D *this, CanvasCompositeOperation value)
+{
+    CANVAS_STATS_CALL(SET_GLOBAL_COMPOSITE_OPERATION_ENUM);
+    if (!state_keywordChanged(this->private.state.globalCompositeOperation, value, (COMPOSITE_LUMINOSITY + 1)))
+        return;
+    this->private.state.globalCompositeOperation = value;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').globalCompositeOperation = $1;
+        Module['canvasContexts'][$0].globalCompositeOperation = Module['canvasKeywords'][$1][$2];
     },
-           this->private.canvas->private.id, value);
+           this->private.canvas->private.handle, KEYWORDS_COMPOSITE_OPERATION, value);
 }
 static char *context2d_getGlobalCompositeOperation(CanvasRenderingContext2D *this)
 {
-    if (this->private.globalCompositeOperation)
-        free(this->private.globalCompositeOperation);
-    this->private.globalCompositeOperation = (char *)EM_ASM_INT({
-        var string = document.getElementById(UTF8ToString($0)).getContext('2d').globalCompositeOperation;
-        var strlen = lengthBytesUTF8(string) + 1;
-        var strptr = _malloc(strlen);
-        stringToUTF8(string, strptr, strlen);
-        return strptr;
-    },
-                                                                this->private.canvas->private.id);
-    return this->private.globalCompositeOperation;
+    CANVAS_STATS_CALL(GET_GLOBAL_COMPOSITE_OPERATION);
+    return (char *)canvasCompositeOperationKeywords[this->private.state.globalCompositeOperation];
+}
+static CanvasCompositeOperation context2d_getGlobalCompositeOperationEnum(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(GET_GLOBAL_COMPOSITE_OPERATION_ENUM);
+    return this->private.state.globalCompositeOperation;
 }
 static void context2d_save(CanvasRenderingContext2D *this)
 {
+    CANVAS_STATS_CALL(SAVE);
+    state_save(this);
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').save();
+        Module['canvasContexts'][$0].save();
     },
-           this->private.canvas->private.id);
+           this->private.canvas->private.handle);
 }
 static void context2d_restore(CanvasRenderingContext2D *this)
 {
+    CANVAS_STATS_CALL(RESTORE);
+    if (!state_restore(this))
+        return;
+    CANVAS_STATS_CROSSING();
     EM_ASM({
-        document.getElementById(UTF8ToString($0)).getContext('2d').restore();
+        Module['canvasContexts'][$0].restore();
     },
-           this->private.canvas->private.id);
+           this->private.canvas->private.handle);
 }
 static HTMLCanvasElement *context2d_getCanvas(CanvasRenderingContext2D *this)
 {
+    CANVAS_STATS_CALL(GET_CANVAS);
     return this->private.canvas;
 }
 /* End: CanvasRenderingContext2D static methods */
 
+static void context2d_record(CanvasRenderingContext2D *this, int op, int argc, const double *argv)
+{
+    commands_append(&this->private.commands, &this->private.commandsLength, &this->private.commandsCapacity, COMMANDS_INITIAL_CAPACITY, op, argc, argv);
+}
+
+/* Begin: CanvasRenderingContext2D recording methods */
+static void recording_clearRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    CANVAS_STATS_CALL(CLEAR_RECT);
+    context2d_record(this, OP_CLEAR_RECT, 4, (double[]){x, y, width, height});
+}
+static void recording_fillRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    CANVAS_STATS_CALL(FILL_RECT);
+    context2d_record(this, OP_FILL_RECT, 4, (double[]){x, y, width, height});
+}
+static void recording_strokeRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    CANVAS_STATS_CALL(STROKE_RECT);
+    context2d_record(this, OP_STROKE_RECT, 4, (double[]){x, y, width, height});
+}
+static void recording_setLineWidth(CanvasRenderingContext2D *this, double value)
+{
+    CANVAS_STATS_CALL(SET_LINE_WIDTH);
+    if (state_updateLineWidth(&this->private.state, value))
+        context2d_record(this, OP_SET_LINE_WIDTH, 1, (double[]){value});
+}
+static void recording_beginPath(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(BEGIN_PATH);
+    canvasPathClear(this->private.path);
+    context2d_record(this, OP_BEGIN_PATH, 0, NULL);
+}
+static void recording_closePath(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(CLOSE_PATH);
+    canvasPathClose(this->private.path);
+    context2d_record(this, OP_CLOSE_PATH, 0, NULL);
+}
+static void recording_moveTo(CanvasRenderingContext2D *this, double x, double y)
+{
+    CANVAS_STATS_CALL(MOVE_TO);
+    canvasPathMoveTo(this->private.path, &this->private.state.transform, x, y);
+    context2d_record(this, OP_MOVE_TO, 2, (double[]){x, y});
+}
+static void recording_lineTo(CanvasRenderingContext2D *this, double x, double y)
+{
+    CANVAS_STATS_CALL(LINE_TO);
+    canvasPathLineTo(this->private.path, &this->private.state.transform, x, y);
+    context2d_record(this, OP_LINE_TO, 2, (double[]){x, y});
+}
+static void recording_bezierCurveTo(CanvasRenderingContext2D *this, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y)
+{
+    CANVAS_STATS_CALL(BEZIER_CURVE_TO);
+    canvasPathBezierCurveTo(this->private.path, &this->private.state.transform, cp1x, cp1y, cp2x, cp2y, x, y);
+    context2d_record(this, OP_BEZIER_CURVE_TO, 6, (double[]){cp1x, cp1y, cp2x, cp2y, x, y});
+}
+static void recording_quadraticCurveTo(CanvasRenderingContext2D *this, double cpx, double cpy, double x, double y)
+{
+    CANVAS_STATS_CALL(QUADRATIC_CURVE_TO);
+    canvasPathQuadraticCurveTo(this->private.path, &this->private.state.transform, cpx, cpy, x, y);
+    context2d_record(this, OP_QUADRATIC_CURVE_TO, 4, (double[]){cpx, cpy, x, y});
+}
+static void recording_arc(CanvasRenderingContext2D *this, double x, double y, double radius, double startAngle, double endAngle)
+{
+    CANVAS_STATS_CALL(ARC);
+    canvasPathArc(this->private.path, &this->private.state.transform, x, y, radius, startAngle, endAngle);
+    context2d_record(this, OP_ARC, 5, (double[]){x, y, radius, startAngle, endAngle});
+}
+static void recording_arcTo(CanvasRenderingContext2D *this, double x1, double y1, double x2, double y2, double radius)
+{
+    CANVAS_STATS_CALL(ARC_TO);
+    canvasPathArcTo(this->private.path, &this->private.state.transform, x1, y1, x2, y2, radius);
+    context2d_record(this, OP_ARC_TO, 5, (double[]){x1, y1, x2, y2, radius});
+}
+static void recording_ellipse(CanvasRenderingContext2D *this, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle)
+{
+    CANVAS_STATS_CALL(ELLIPSE);
+    canvasPathEllipse(this->private.path, &this->private.state.transform, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
+    context2d_record(this, OP_ELLIPSE, 7, (double[]){x, y, radiusX, radiusY, rotation, startAngle, endAngle});
+}
+static void recording_rect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    CANVAS_STATS_CALL(RECT);
+    canvasPathRect(this->private.path, &this->private.state.transform, x, y, width, height);
+    context2d_record(this, OP_RECT, 4, (double[]){x, y, width, height});
+}
+static void recording_fill(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(FILL);
+    context2d_record(this, OP_FILL, 0, NULL);
+}
+static void recording_stroke(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(STROKE);
+    context2d_record(this, OP_STROKE, 0, NULL);
+}
+static void recording_clip(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(CLIP);
+    context2d_record(this, OP_CLIP, 0, NULL);
+}
+static void recording_fillPath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    CANVAS_STATS_CALL(FILL_PATH);
+    int handle = path2d_build(path);
+    context2d_record(this, OP_FILL_PATH, 1, (double[]){handle});
+    path2d_retain(this, handle);
+}
+static void recording_strokePath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    CANVAS_STATS_CALL(STROKE_PATH);
+    int handle = path2d_build(path);
+    context2d_record(this, OP_STROKE_PATH, 1, (double[]){handle});
+    path2d_retain(this, handle);
+}
+static void recording_clipPath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    CANVAS_STATS_CALL(CLIP_PATH);
+    int handle = path2d_build(path);
+    context2d_record(this, OP_CLIP_PATH, 1, (double[]){handle});
+    path2d_retain(this, handle);
+}
+static void recording_rotate(CanvasRenderingContext2D *this, double angle)
+{
+    CANVAS_STATS_CALL(ROTATE);
+    canvasMatrixMultiply(&this->private.state.transform, cos(angle), sin(angle), -sin(angle), cos(angle), 0.0, 0.0);
+    context2d_record(this, OP_ROTATE, 1, (double[]){angle});
+}
+static void recording_scale(CanvasRenderingContext2D *this, double x, double y)
+{
+    CANVAS_STATS_CALL(SCALE);
+    canvasMatrixMultiply(&this->private.state.transform, x, 0.0, 0.0, y, 0.0, 0.0);
+    context2d_record(this, OP_SCALE, 2, (double[]){x, y});
+}
+static void recording_translate(CanvasRenderingContext2D *this, double x, double y)
+{
+    CANVAS_STATS_CALL(TRANSLATE);
+    canvasMatrixMultiply(&this->private.state.transform, 1.0, 0.0, 0.0, 1.0, x, y);
+    context2d_record(this, OP_TRANSLATE, 2, (double[]){x, y});
+}
+static void recording_transform(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f)
+{
+    CANVAS_STATS_CALL(TRANSFORM);
+    canvasMatrixMultiply(&this->private.state.transform, a, b, c, d, e, f);
+    context2d_record(this, OP_TRANSFORM, 6, (double[]){a, b, c, d, e, f});
+}
+static void recording_setTransform(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f)
+{
+    CANVAS_STATS_CALL(SET_TRANSFORM);
+    this->private.state.transform = (CanvasMatrix){a, b, c, d, e, f};
+    context2d_record(this, OP_SET_TRANSFORM, 6, (double[]){a, b, c, d, e, f});
+}
+static void recording_resetTransform(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(RESET_TRANSFORM);
+    this->private.state.transform = canvasIdentityMatrix;
+    context2d_record(this, OP_RESET_TRANSFORM, 0, NULL);
+}
+static void recording_setGlobalAlpha(CanvasRenderingContext2D *this, double value)
+{
+    CANVAS_STATS_CALL(SET_GLOBAL_ALPHA);
+    if (state_updateGlobalAlpha(&this->private.state, value))
+        context2d_record(this, OP_SET_GLOBAL_ALPHA, 1, (double[]){value});
+}
+static void recording_setLineCapEnum(CanvasRenderingContext2D *this, CanvasLineCap type)
+{
+    CANVAS_STATS_CALL(SET_LINE_CAP_ENUM);
+    if (!state_keywordChanged(this->private.state.lineCap, type, (LINE_CAP_SQUARE + 1)))
+        return;
+    this->private.state.lineCap = type;
+    context2d_record(this, OP_SET_LINE_CAP, 1, (double[]){type});
+}
+static void recording_setLineJoinEnum(CanvasRenderingContext2D *this, CanvasLineJoin type)
+{
+    CANVAS_STATS_CALL(SET_LINE_JOIN_ENUM);
+    if (!state_keywordChanged(this->private.state.lineJoin, type, (LINE_JOIN_MITER + 1)))
+        return;
+    this->private.state.lineJoin = type;
+    context2d_record(this, OP_SET_LINE_JOIN, 1, (double[]){type});
+}
+static void recording_setTextAlignEnum(CanvasRenderingContext2D *this, CanvasTextAlign value)
+{
+    CANVAS_STATS_CALL(SET_TEXT_ALIGN_ENUM);
+    if (!state_keywordChanged(this->private.state.textAlign, value, (TEXT_ALIGN_CENTER + 1)))
+        return;
+    this->private.state.textAlign = value;
+    context2d_record(this, OP_SET_TEXT_ALIGN, 1, (double[]){value});
+}
+static void recording_setGlobalCompositeOperationEnum(CanvasRenderingContext2D *this, CanvasCompositeOperation value)
+{
+    CANVAS_STATS_CALL(SET_GLOBAL_COMPOSITE_OPERATION_ENUM);
+    if (!state_keywordChanged(this->private.state.globalCompositeOperation, value, (COMPOSITE_LUMINOSITY + 1)))
+        return;
+    this->private.state.globalCompositeOperation = value;
+    context2d_record(this, OP_SET_GLOBAL_COMPOSITE_OPERATION, 1, (double[]){value});
+}
+static void recording_setFillColor(CanvasRenderingContext2D *this, uint32_t rgba)
+{
+    CANVAS_STATS_CALL(SET_FILL_COLOR);
+    CanvasState *state = &this->private.state;
+    if (state_updateColor(&state->fillColor, &state->fillIsColor, state->fillStyle, state->fillStyleRequested, rgba))
+        context2d_record(this, OP_SET_FILL_COLOR, 1, (double[]){rgba});
+}
+static void recording_setStrokeColor(CanvasRenderingContext2D *this, uint32_t rgba)
+{
+    CANVAS_STATS_CALL(SET_STROKE_COLOR);
+    CanvasState *state = &this->private.state;
+    if (state_updateColor(&state->strokeColor, &state->strokeIsColor, state->strokeStyle, state->strokeStyleRequested, rgba))
+        context2d_record(this, OP_SET_STROKE_COLOR, 1, (double[]){rgba});
+}
+static void recording_save(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(SAVE);
+    state_save(this);
+    context2d_record(this, OP_SAVE, 0, NULL);
+}
+static void recording_restore(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(RESTORE);
+    if (state_restore(this))
+        context2d_record(this, OP_RESTORE, 0, NULL);
+}
+/* End: CanvasRenderingContext2D recording methods */
+
+static void context2d_flush(CanvasRenderingContext2D *this)
+{
+    if (!this->private.commandsLength)
+        return;
+    CANVAS_STATS_CALL(FLUSH);
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        var ctx = Module['canvasContexts'][$0];
+        var b = HEAPF64;
+        var k = Module['canvasKeywords'];
+        var i = $1 >> 3;
+        var end = i + $2;
+        while (i < end)
+        {
+            switch (b[i++])
+            {
+            case 1: ctx.clearRect(b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+            case 2: ctx.fillRect(b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+            case 3: ctx.strokeRect(b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+            case 4: ctx.lineWidth = b[i]; i += 1; break;
+            case 5: ctx.beginPath(); break;
+            case 6: ctx.closePath(); break;
+            case 7: ctx.moveTo(b[i], b[i + 1]); i += 2; break;
+            case 8: ctx.lineTo(b[i], b[i + 1]); i += 2; break;
+            case 9: ctx.bezierCurveTo(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5]); i += 6; break;
+            case 10: ctx.quadraticCurveTo(b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+            case 11: ctx.arc(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4]); i += 5; break;
+            case 12: ctx.arcTo(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4]); i += 5; break;
+            case 13: ctx.ellipse(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5], b[i + 6]); i += 7; break;
+            case 14: ctx.rect(b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+            case 15: ctx.fill(); break;
+            case 16: ctx.stroke(); break;
+            case 17: ctx.clip(); break;
+            case 18: ctx.rotate(b[i]); i += 1; break;
+            case 19: ctx.scale(b[i], b[i + 1]); i += 2; break;
+            case 20: ctx.translate(b[i], b[i + 1]); i += 2; break;
+            case 21: ctx.transform(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5]); i += 6; break;
+            case 22: ctx.setTransform(b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5]); i += 6; break;
+            case 23: ctx.resetTransform(); break;
+            case 24: ctx.globalAlpha = b[i]; i += 1; break;
+            case 25: ctx.save(); break;
+            case 26: ctx.restore(); break;
+            case 27: ctx.lineCap = k[0][b[i]]; i += 1; break;
+            case 28: ctx.lineJoin = k[1][b[i]]; i += 1; break;
+            case 29: ctx.textAlign = k[2][b[i]]; i += 1; break;
+            case 30: ctx.globalCompositeOperation = k[3][b[i]]; i += 1; break;
+            case 31: ctx.fillStyle = Module['canvasColor'](b[i]); i += 1; break;
+            case 32: ctx.strokeStyle = Module['canvasColor'](b[i]); i += 1; break;
+            case 33: ctx.fill(Module['canvasPaths'][b[i]]); i += 1; break;
+            case 34: ctx.stroke(Module['canvasPaths'][b[i]]); i += 1; break;
+            case 35: ctx.clip(Module['canvasPaths'][b[i]]); i += 1; break;
+            }
+        }
+    },
+           this->private.canvas->private.handle, this->private.commands, this->private.commandsLength);
+    this->private.commandsLength = 0;
+    for (size_t i = 0; i < this->private.pathHandlesLength; i++)
+    {
+        int handle = this->private.pathHandles[i];
+        if (!--pathPending[handle] && pathReleased[handle])
+        {
+            pathReleased[handle] = 0;
+            path2d_release(handle);
+        }
+    }
+    this->private.pathHandlesLength = 0;
+}
+static void context2d_beginRecording(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(BEGIN_RECORDING);
+    if (this->private.recording)
+        return;
+    this->private.recording = 1;
+    this->clearRect = recording_clearRect;
+    this->fillRect = recording_fillRect;
+    this->strokeRect = recording_strokeRect;
+    this->setLineWidth = recording_setLineWidth;
+    this->beginPath = recording_beginPath;
+    this->closePath = recording_closePath;
+    this->moveTo = recording_moveTo;
+    this->lineTo = recording_lineTo;
+    this->bezierCurveTo = recording_bezierCurveTo;
+    this->quadraticCurveTo = recording_quadraticCurveTo;
+    this->arc = recording_arc;
+    this->arcTo = recording_arcTo;
+    this->ellipse = recording_ellipse;
+    this->rect = recording_rect;
+    this->fill = recording_fill;
+    this->stroke = recording_stroke;
+    this->clip = recording_clip;
+    this->fillPath = recording_fillPath;
+    this->strokePath = recording_strokePath;
+    this->clipPath = recording_clipPath;
+    this->rotate = recording_rotate;
+    this->scale = recording_scale;
+    this->translate = recording_translate;
+    this->transform = recording_transform;
+    this->setTransform = recording_setTransform;
+    this->resetTransform = recording_resetTransform;
+    this->setGlobalAlpha = recording_setGlobalAlpha;
+    this->setLineCapEnum = recording_setLineCapEnum;
+    this->setLineJoinEnum = recording_setLineJoinEnum;
+    this->setTextAlignEnum = recording_setTextAlignEnum;
+    this->setGlobalCompositeOperationEnum = recording_setGlobalCompositeOperationEnum;
+    this->setFillColor = recording_setFillColor;
+    this->setStrokeColor = recording_setStrokeColor;
+    this->save = recording_save;
+    this->restore = recording_restore;
+}
+static void context2d_endRecording(CanvasRenderingContext2D *this)
+{
+    CANVAS_STATS_CALL(END_RECORDING);
+    if (!this->private.recording)
+        return;
+    context2d_flush(this);
+    this->private.recording = 0;
+    this->clearRect = context2d_clearRect;
+    this->fillRect = context2d_fillRect;
+    this->strokeRect = context2d_strokeRect;
+    this->setLineWidth = context2d_setLineWidth;
+    this->beginPath = context2d_beginPath;
+    this->closePath = context2d_closePath;
+    this->moveTo = context2d_moveTo;
+    this->lineTo = context2d_lineTo;
+    this->bezierCurveTo = context2d_bezierCurveTo;
+    this->quadraticCurveTo = context2d_quadraticCurveTo;
+    this->arc = context2d_arc;
+    this->arcTo = context2d_arcTo;
+    this->ellipse = context2d_ellipse;
+    this->rect = context2d_rect;
+    this->fill = context2d_fill;
+    this->stroke = context2d_stroke;
+    this->clip = context2d_clip;
+    this->fillPath = context2d_fillPath;
+    this->strokePath = context2d_strokePath;
+    this->clipPath = context2d_clipPath;
+    this->rotate = context2d_rotate;
+    this->scale = context2d_scale;
+    this->translate = context2d_translate;
+    this->transform = context2d_transform;
+    this->setTransform = context2d_setTransform;
+    this->resetTransform = context2d_resetTransform;
+    this->setGlobalAlpha = context2d_setGlobalAlpha;
+    this->setLineCapEnum = context2d_setLineCapEnum;
+    this->setLineJoinEnum = context2d_setLineJoinEnum;
+    this->setTextAlignEnum = context2d_setTextAlignEnum;
+    this->setGlobalCompositeOperationEnum = context2d_setGlobalCompositeOperationEnum;
+    this->setFillColor = context2d_setFillColor;
+    this->setStrokeColor = context2d_setStrokeColor;
+    this->save = context2d_save;
+    this->restore = context2d_restore;
+}
+
 static CanvasRenderingContext2D *createContext(HTMLCanvasElement *canvas, char *contextType)
 {
     if (strcmp(contextType, "2d") != 0)
         return NULL;
+    registerKeywords();
+    registerColorCache();
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        Module['canvasContexts'][$0] = Module['canvasElements'][$0].getContext('2d');
+    },
+           canvas->private.handle);
     CanvasRenderingContext2D *ctx = (CanvasRenderingContext2D *)malloc(sizeof(CanvasRenderingContext2D));
     /* Begin: set pseudo-private fields */
     ctx->private.canvas = canvas;
     strcpy(ctx->private.contextType, contextType); // string field is a static length, no need to allocate
-    ctx->private.font = NULL;
-    ctx->private.textAlign = NULL;
-    ctx->private.fillStyle = NULL;
-    ctx->private.strokeStyle = NULL;
-    ctx->private.lineCap = NULL;
-    ctx->private.lineJoin = NULL;
-    ctx->private.globalCompositeOperation = NULL;
+    ctx->private.stateStack = NULL;
+    ctx->private.stateStackLength = 0;
+    ctx->private.stateStackCapacity = 0;
+    ctx->private.commands = NULL;
+    ctx->private.commandsLength = 0;
+    ctx->private.commandsCapacity = 0;
+    ctx->private.recording = 0;
+    ctx->private.path = (CanvasPath *)calloc(1, sizeof(CanvasPath));
+    ctx->private.hitEdges = (CanvasEdgeList *)calloc(1, sizeof(CanvasEdgeList));
+    ctx->private.quads = NULL;
+    ctx->private.quadsCapacity = 0;
+    CANVAS_STATS_ALLOCATIONS(3);
+    ctx->private.renderer = NULL;
+    ctx->private.trace = NULL;
+    ctx->private.pathHandles = NULL;
+    ctx->private.pathHandlesLength = 0;
+    ctx->private.pathHandlesCapacity = 0;
+    context2d_pullState(ctx);
     /* End: set pseudo-private fields */
     ctx->clearRect = context2d_clearRect;
     ctx->fillRect = context2d_fillRect;
     ctx->strokeRect = context2d_strokeRect;
+    ctx->clearRects = context2d_clearRects;
+    ctx->fillRects = context2d_fillRects;
+    ctx->strokeRects = context2d_strokeRects;
+    ctx->fillRectsColored = context2d_fillRectsColored;
+    ctx->fillRectsTransformed = context2d_fillRectsTransformed;
+    ctx->putImageData = context2d_putImageData;
+    ctx->getImageData = context2d_getImageData;
+    ctx->putImageDataDirty = context2d_putImageDataDirty;
     ctx->fillText = context2d_fillText;
     ctx->strokeText = context2d_strokeText;
     ctx->setLineWidth = context2d_setLineWidth;
     ctx->getLineWidth = context2d_getLineWidth;
     ctx->setLineCap = context2d_setLineCap;
     ctx->getLineCap = context2d_getLineCap;
+    ctx->setLineCapEnum = context2d_setLineCapEnum;
+    ctx->getLineCapEnum = context2d_getLineCapEnum;
     ctx->setLineJoin = context2d_setLineJoin;
     ctx->getLineJoin = context2d_getLineJoin;
+    ctx->setLineJoinEnum = context2d_setLineJoinEnum;
+    ctx->getLineJoinEnum = context2d_getLineJoinEnum;
     ctx->setFont = context2d_setFont;
     ctx->getFont = context2d_getFont;
     ctx->setTextAlign = context2d_setTextAlign;
     ctx->getTextAlign = context2d_getTextAlign;
+    ctx->setTextAlignEnum = context2d_setTextAlignEnum;
+    ctx->getTextAlignEnum = context2d_getTextAlignEnum;
     ctx->setFillStyle = context2d_setFillStyle;
     ctx->getFillStyle = context2d_getFillStyle;
     ctx->setStrokeStyle = context2d_setStrokeStyle;
     ctx->getStrokeStyle = context2d_getStrokeStyle;
+    ctx->setFillColor = context2d_setFillColor;
+    ctx->setStrokeColor = context2d_setStrokeColor;
     ctx->beginPath = context2d_beginPath;
     ctx->closePath = context2d_closePath;
     ctx->moveTo = context2d_moveTo;
@@ -511,50 +1765,332 @@ static CanvasRenderingContext2D *createContext(HTMLCanvasElement *canvas, char *
     ctx->arcTo = context2d_arcTo;
     ctx->ellipse = context2d_ellipse;
     ctx->rect = context2d_rect;
+    ctx->polyline = context2d_polyline;
+    ctx->polylines = context2d_polylines;
     ctx->fill = context2d_fill;
     ctx->stroke = context2d_stroke;
     ctx->clip = context2d_clip;
     ctx->isPointInPath = context2d_isPointInPath;
+    ctx->isPointInPathFillRule = context2d_isPointInPathFillRule;
     ctx->isPointInStroke = context2d_isPointInStroke;
+    ctx->fillPath = context2d_fillPath;
+    ctx->strokePath = context2d_strokePath;
+    ctx->clipPath = context2d_clipPath;
+    ctx->isPointInPath2D = context2d_isPointInPath2D;
+    ctx->isPointInStroke2D = context2d_isPointInStroke2D;
     ctx->rotate = context2d_rotate;
     ctx->scale = context2d_scale;
     ctx->translate = context2d_translate;
     ctx->transform = context2d_transform;
     ctx->setTransform = context2d_setTransform;
     ctx->resetTransform = context2d_resetTransform;
+    ctx->getTransform = context2d_getTransform;
     ctx->setGlobalAlpha = context2d_setGlobalAlpha;
     ctx->getGlobalAlpha = context2d_getGlobalAlpha;
     ctx->setGlobalCompositeOperation = context2d_setGlobalCompositeOperation;
     ctx->getGlobalCompositeOperation = context2d_getGlobalCompositeOperation;
+    ctx->setGlobalCompositeOperationEnum = context2d_setGlobalCompositeOperationEnum;
+    ctx->getGlobalCompositeOperationEnum = context2d_getGlobalCompositeOperationEnum;
     ctx->save = context2d_save;
     ctx->restore = context2d_restore;
+    ctx->beginRecording = context2d_beginRecording;
+    ctx->endRecording = context2d_endRecording;
+    ctx->flush = context2d_flush;
     ctx->getCanvas = context2d_getCanvas;
     return ctx;
 }
 
+static void canvas_release(HTMLCanvasElement *this)
+{
+    CANVAS_STATS_CALL(FREE_CANVAS);
+    if (this->private.ctx)
+    {
+        context2d_flush(this->private.ctx);
+        if (this->private.ctx->private.stateStack)
+            free(this->private.ctx->private.stateStack);
+        if (this->private.ctx->private.commands)
+            free(this->private.ctx->private.commands);
+        canvasPathFree(this->private.ctx->private.path);
+        free(this->private.ctx->private.path);
+        canvasEdgesFree(this->private.ctx->private.hitEdges);
+        free(this->private.ctx->private.hitEdges);
+        free(this->private.ctx->private.quads);
+        free(this->private.ctx->private.pathHandles);
+        free(this->private.ctx);
+    }
+    CANVAS_STATS_CROSSING();
+    EM_ASM({
+        Module['canvasElements'][$0] = null;
+        Module['canvasContexts'][$0] = null;
+    },
+           this->private.handle);
+    free(this->private.id);
+    free(this);
+}
+#else
+HTMLCanvasElement *createCanvas(char *id)
+{
+    return createSoftwareCanvas(id, 300, 150);
+}
+#endif
+
 void freeCanvas(HTMLCanvasElement *canvas)
 {
     if (canvas)
     {
-        free(canvas->private.id);
-        if (canvas->private.ctx)
+        canvasShapesRelease(canvas);
+        canvas->private.release(canvas);
+    }
+}
+
+/* Begin: ImageData static methods */
+static void imageData_markDirty(ImageData *this, int x, int y, int width, int height)
+{
+    /* clip to the image */
+    int x1 = x < 0 ? 0 : x;
+    int y1 = y < 0 ? 0 : y;
+    int x2 = x + width > this->width ? this->width : x + width;
+    int y2 = y + height > this->height ? this->height : y + height;
+    if (x1 >= x2 || y1 >= y2)
+        return;
+    canvasDamageAdd(this->private.damage, &this->private.damageCount, IMAGE_DATA_MAX_DIRTY_RECTS, this->private.coalescing, x1, y1, x2, y2);
+}
+static void imageData_setDirtyCoalescing(ImageData *this, double factor)
+{
+    this->private.coalescing = factor;
+}
+static void imageData_clearDirty(ImageData *this)
+{
+    this->private.damageCount = 0;
+}
+/* End: ImageData static methods */
+
+ImageData *createImageData(int width, int height)
+{
+    ImageData *image = (ImageData *)malloc(sizeof(ImageData));
+    /* Begin: set pseudo-private fields */
+    image->private.handle = -1; // the JavaScript wrapper is created on first use
+    image->private.damageCount = 0;
+    image->private.coalescing = 1.5;
+    /* End: set pseudo-private fields */
+    image->width = width;
+    image->height = height;
+    image->data = (unsigned char *)calloc((size_t)width * height, 4);
+    CANVAS_STATS_ALLOCATIONS(2);
+    image->markDirty = imageData_markDirty;
+    image->setDirtyCoalescing = imageData_setDirtyCoalescing;
+    image->clearDirty = imageData_clearDirty;
+    return image;
+}
+
+void freeImageData(ImageData *image)
+{
+    if (image)
+    {
+#ifdef __EMSCRIPTEN__
+        if (image->private.handle >= 0)
         {
-            if (canvas->private.ctx->private.font)
-                free(canvas->private.ctx->private.font);
-            if (canvas->private.ctx->private.textAlign)
-                free(canvas->private.ctx->private.textAlign);
-            if (canvas->private.ctx->private.fillStyle)
-                free(canvas->private.ctx->private.fillStyle);
-            if (canvas->private.ctx->private.strokeStyle)
-                free(canvas->private.ctx->private.strokeStyle);
-            if (canvas->private.ctx->private.lineCap)
-                free(canvas->private.ctx->private.lineCap);
-            if (canvas->private.ctx->private.lineJoin)
-                free(canvas->private.ctx->private.lineJoin);
-            if (canvas->private.ctx->private.globalCompositeOperation)
-                free(canvas->private.ctx->private.globalCompositeOperation);
-            free(canvas->private.ctx);
+            CANVAS_STATS_CROSSING();
+            EM_ASM({
+                Module['canvasImages'][$0] = null;
+            },
+                   image->private.handle);
         }
-        free(canvas);
+#endif
+        free(image->data);
+        free(image);
     }
-}
\ No newline at end of file
+}
+
+/* Begin: Path2D static methods */
+static void path2d_append(Path2D *this, int op, int argc, const double *argv)
+{
+    commands_append(&this->private.commands, &this->private.commandsLength, &this->private.commandsCapacity, PATH2D_INITIAL_CAPACITY, op, argc, argv);
+}
+static void path2d_closePath(Path2D *this)
+{
+    path2d_append(this, OP_CLOSE_PATH, 0, NULL);
+}
+static void path2d_moveTo(Path2D *this, double x, double y)
+{
+    path2d_append(this, OP_MOVE_TO, 2, (double[]){x, y});
+}
+static void path2d_lineTo(Path2D *this, double x, double y)
+{
+    path2d_append(this, OP_LINE_TO, 2, (double[]){x, y});
+}
+static void path2d_bezierCurveTo(Path2D *this, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y)
+{
+    path2d_append(this, OP_BEZIER_CURVE_TO, 6, (double[]){cp1x, cp1y, cp2x, cp2y, x, y});
+}
+static void path2d_quadraticCurveTo(Path2D *this, double cpx, double cpy, double x, double y)
+{
+    path2d_append(this, OP_QUADRATIC_CURVE_TO, 4, (double[]){cpx, cpy, x, y});
+}
+static void path2d_arc(Path2D *this, double x, double y, double radius, double startAngle, double endAngle)
+{
+    path2d_append(this, OP_ARC, 5, (double[]){x, y, radius, startAngle, endAngle});
+}
+static void path2d_arcTo(Path2D *this, double x1, double y1, double x2, double y2, double radius)
+{
+    path2d_append(this, OP_ARC_TO, 5, (double[]){x1, y1, x2, y2, radius});
+}
+static void path2d_ellipse(Path2D *this, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle)
+{
+    path2d_append(this, OP_ELLIPSE, 7, (double[]){x, y, radiusX, radiusY, rotation, startAngle, endAngle});
+}
+static void path2d_rect(Path2D *this, double x, double y, double width, double height)
+{
+    path2d_append(this, OP_RECT, 4, (double[]){x, y, width, height});
+}
+static void path2d_polyline(Path2D *this, const float *xy, size_t count, int closed)
+{
+    if (!count)
+        return;
+    path2d_moveTo(this, xy[0], xy[1]);
+    for (size_t i = 1; i < count; i++)
+        path2d_lineTo(this, xy[2 * i], xy[2 * i + 1]);
+    if (closed)
+        path2d_closePath(this);
+}
+/* End: Path2D static methods */
+
+Path2D *createPath2D(void)
+{
+    Path2D *path = (Path2D *)malloc(sizeof(Path2D));
+    /* Begin: set pseudo-private fields */
+    path->private.handle = -1; // the JavaScript Path2D is created on first use
+    path->private.commands = NULL;
+    path->private.commandsLength = 0;
+    path->private.commandsCapacity = 0;
+    path->private.builtLength = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        path->private.hitCaches[i].flattened = (CanvasPath *)calloc(1, sizeof(CanvasPath));
+        path->private.hitCaches[i].transform = canvasIdentityMatrix;
+        path->private.hitCaches[i].length = 0;
+        path->private.hitCaches[i].fillEdges = (CanvasEdgeList *)calloc(1, sizeof(CanvasEdgeList));
+        path->private.hitCaches[i].strokeEdges = (CanvasEdgeList *)calloc(1, sizeof(CanvasEdgeList));
+        canvasPathClear(path->private.hitCaches[i].flattened);
+    }
+    CANVAS_STATS_ALLOCATIONS(6);
+    /* End: set pseudo-private fields */
+    path->closePath = path2d_closePath;
+    path->moveTo = path2d_moveTo;
+    path->lineTo = path2d_lineTo;
+    path->bezierCurveTo = path2d_bezierCurveTo;
+    path->quadraticCurveTo = path2d_quadraticCurveTo;
+    path->arc = path2d_arc;
+    path->arcTo = path2d_arcTo;
+    path->ellipse = path2d_ellipse;
+    path->rect = path2d_rect;
+    path->polyline = path2d_polyline;
+    return path;
+}
+
+void freePath2D(Path2D *path)
+{
+    if (path)
+    {
+#ifdef __EMSCRIPTEN__
+        if (path->private.handle >= 0)
+            path2d_release(path->private.handle);
+#endif
+        free(path->private.commands);
+        for (int i = 0; i < 2; i++)
+        {
+            canvasPathFree(path->private.hitCaches[i].flattened);
+            free(path->private.hitCaches[i].flattened);
+            canvasEdgesFree(path->private.hitCaches[i].fillEdges);
+            free(path->private.hitCaches[i].fillEdges);
+            canvasEdgesFree(path->private.hitCaches[i].strokeEdges);
+            free(path->private.hitCaches[i].strokeEdges);
+        }
+        free(path);
+    }
+}
+
+void tracePath2D(CanvasRenderingContext2D *ctx, Path2D *path)
+{
+    const double *b = path->private.commands;
+    size_t i = 0;
+    while (i < path->private.commandsLength)
+    {
+        switch ((int)b[i++])
+        {
+        case OP_CLOSE_PATH: ctx->closePath(ctx); break;
+        case OP_MOVE_TO: ctx->moveTo(ctx, b[i], b[i + 1]); i += 2; break;
+        case OP_LINE_TO: ctx->lineTo(ctx, b[i], b[i + 1]); i += 2; break;
+        case OP_BEZIER_CURVE_TO: ctx->bezierCurveTo(ctx, b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5]); i += 6; break;
+        case OP_QUADRATIC_CURVE_TO: ctx->quadraticCurveTo(ctx, b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+        case OP_ARC: ctx->arc(ctx, b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4]); i += 5; break;
+        case OP_ARC_TO: ctx->arcTo(ctx, b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4]); i += 5; break;
+        case OP_ELLIPSE: ctx->ellipse(ctx, b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5], b[i + 6]); i += 7; break;
+        case OP_RECT: ctx->rect(ctx, b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+        }
+    }
+}
+
+/** Flattens path with the transform m into the hit cache kept for m, returning its index. */
+static int path2d_flatten(Path2D *path, const CanvasMatrix *m)
+{
+    const CanvasMatrix *id = &canvasIdentityMatrix;
+    int cache = m->a == id->a && m->b == id->b && m->c == id->c && m->d == id->d && m->e == id->e && m->f == id->f ? 0 : 1;
+    CanvasPath *flat = path->private.hitCaches[cache].flattened;
+    const CanvasMatrix *t = &path->private.hitCaches[cache].transform;
+    if (t->a != m->a || t->b != m->b || t->c != m->c || t->d != m->d || t->e != m->e || t->f != m->f)
+    {
+        canvasPathClear(flat);
+        path->private.hitCaches[cache].transform = *m;
+        path->private.hitCaches[cache].length = 0;
+    }
+    /* segments added since the last call are flattened onto the end of what's there */
+    const double *b = path->private.commands;
+    size_t i = path->private.hitCaches[cache].length;
+    while (i < path->private.commandsLength)
+    {
+        switch ((int)b[i++])
+        {
+        case OP_CLOSE_PATH: canvasPathClose(flat); break;
+        case OP_MOVE_TO: canvasPathMoveTo(flat, m, b[i], b[i + 1]); i += 2; break;
+        case OP_LINE_TO: canvasPathLineTo(flat, m, b[i], b[i + 1]); i += 2; break;
+        case OP_BEZIER_CURVE_TO: canvasPathBezierCurveTo(flat, m, b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5]); i += 6; break;
+        case OP_QUADRATIC_CURVE_TO: canvasPathQuadraticCurveTo(flat, m, b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+        case OP_ARC: canvasPathArc(flat, m, b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4]); i += 5; break;
+        case OP_ARC_TO: canvasPathArcTo(flat, m, b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4]); i += 5; break;
+        case OP_ELLIPSE: canvasPathEllipse(flat, m, b[i], b[i + 1], b[i + 2], b[i + 3], b[i + 4], b[i + 5], b[i + 6]); i += 7; break;
+        case OP_RECT: canvasPathRect(flat, m, b[i], b[i + 1], b[i + 2], b[i + 3]); i += 4; break;
+        }
+    }
+    path->private.hitCaches[cache].length = i;
+    return cache;
+}
+
+const CanvasPath *canvasPath2DFlatten(Path2D *path, const CanvasMatrix *m)
+{
+    return path->private.hitCaches[path2d_flatten(path, m)].flattened;
+}
+
+const CanvasEdgeList *canvasPath2DFillEdges(Path2D *path, const CanvasMatrix *m)
+{
+    int cache = path2d_flatten(path, m);
+    canvasEdgesFill(path->private.hitCaches[cache].fillEdges, path->private.hitCaches[cache].flattened);
+    return path->private.hitCaches[cache].fillEdges;
+}
+
+const CanvasEdgeList *canvasPath2DStrokeEdges(Path2D *path, const CanvasState *state)
+{
+    int cache = path2d_flatten(path, &state->transform);
+    canvasEdgesStroke(path->private.hitCaches[cache].strokeEdges, path->private.hitCaches[cache].flattened, state);
+    return path->private.hitCaches[cache].strokeEdges;
+}
+
+int canvasPath2DContains(Path2D *path, const CanvasMatrix *m, double x, double y, CanvasFillRule fillRule)
+{
+    return canvasEdgesContain(canvasPath2DFillEdges(path, m), x, y, fillRule);
+}
+
+int canvasPath2DStrokeContains(Path2D *path, const CanvasState *state, double x, double y)
+{
+    return canvasEdgesContain(canvasPath2DStrokeEdges(path, state), x, y, FILL_RULE_NONZERO);
+}
@@ -0,0 +1,1232 @@
+/**
+ * Retained display lists: recording, replaying and diffing CanvasRenderingContext2D calls.
+ * @file displaylist.c
+ * @author Alex Tyner
+ */
+
+#include "displaylist.h"
+#include "geometry.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** Merging factor for damage rectangles, the default of ImageData.setDirtyCoalescing(). */
+#define DISPLAY_LIST_COALESCING 1.5
+
+struct DisplayState
+{
+    CanvasState base;
+    /** hashes of the fill style, stroke style and every clip in effect */
+    uint64_t fill;
+    uint64_t stroke;
+    uint64_t clip;
+    /** bounding box of the clip region, infinite while nothing is clipped */
+    double clipLeft, clipTop, clipRight, clipBottom;
+};
+
+/** Hash uses: which parts of the state, besides the transform, alpha, composite operation and clip, a drawing call depends on. */
+#define USES_FILL 1
+#define USES_STROKE 2
+#define USES_TEXT 4
+
+static void *grow(void *array, size_t *capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity)
+        return array;
+    size_t newCapacity = *capacity ? *capacity : 64;
+    while (newCapacity < needed)
+        newCapacity *= 2;
+    *capacity = newCapacity;
+    return realloc(array, newCapacity * size);
+}
+
+/* Begin: hashing */
+static uint64_t hash_word(uint64_t h, uint64_t word)
+{
+    h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+static uint64_t hash_double(uint64_t h, double value)
+{
+    uint64_t word;
+    memcpy(&word, &value, sizeof(word));
+    return hash_word(h, word);
+}
+
+static uint64_t hash_bytes(uint64_t h, const void *bytes, size_t length)
+{
+    const unsigned char *p = (const unsigned char *)bytes;
+    uint64_t word;
+    for (; length >= 8; p += 8, length -= 8)
+    {
+        memcpy(&word, p, 8);
+        h = hash_word(h, word);
+    }
+    word = 0;
+    if (length)
+        memcpy(&word, p, length);
+    return hash_word(h, word ^ (uint64_t)length << 56);
+}
+
+static uint64_t hash_string(uint64_t h, const char *value)
+{
+    return hash_bytes(h, value, strlen(value));
+}
+
+static uint64_t hash_path(uint64_t h, const CanvasPath *path)
+{
+    h = hash_bytes(h, path->points, 2 * path->pointsLength * sizeof(double));
+    for (size_t i = 0; i < path->subpathsLength; i++)
+        h = hash_word(hash_word(h, path->subpaths[i].start), path->subpaths[i].closed);
+    return h;
+}
+
+static uint64_t hash_state(const DisplayState *s, int uses)
+{
+    uint64_t h = hash_bytes(0, &s->base.transform, sizeof(CanvasMatrix));
+    h = hash_double(h, s->base.globalAlpha);
+    h = hash_word(h, s->base.globalCompositeOperation);
+    h = hash_word(h, s->clip);
+    if (uses & USES_FILL)
+        h = hash_word(h, s->fill);
+    if (uses & USES_STROKE)
+    {
+        h = hash_word(h, s->stroke);
+        h = hash_double(h, s->base.lineWidth);
+        h = hash_word(h, s->base.lineCap);
+        h = hash_word(h, s->base.lineJoin);
+    }
+    if (uses & USES_TEXT)
+    {
+        h = hash_string(h, s->base.font);
+        h = hash_word(h, s->base.textAlign);
+    }
+    return h;
+}
+/* End: hashing */
+
+/* Begin: recording */
+static DisplayList *display2d_list(CanvasRenderingContext2D *this)
+{
+    return (DisplayList *)((char *)this - offsetof(DisplayList, private.context));
+}
+
+static DisplayState *display2d_state(CanvasRenderingContext2D *this)
+{
+    DisplayList *list = display2d_list(this);
+    return list->private.states + list->private.depth;
+}
+
+static void state_reset(DisplayState *s)
+{
+    memset(s, 0, sizeof(DisplayState));
+    s->base.lineWidth = 1.0;
+    s->base.globalAlpha = 1.0;
+    s->base.lineCap = LINE_CAP_BUTT;
+    s->base.lineJoin = LINE_JOIN_MITER;
+    s->base.textAlign = TEXT_ALIGN_START;
+    s->base.globalCompositeOperation = COMPOSITE_SOURCE_OVER;
+    strcpy(s->base.font, "10px sans-serif");
+    strcpy(s->base.fillStyle, "#000000");
+    strcpy(s->base.strokeStyle, "#000000");
+    s->base.transform = canvasIdentityMatrix;
+    s->fill = s->stroke = hash_string(0, "#000000");
+    s->clipLeft = s->clipTop = -INFINITY;
+    s->clipRight = s->clipBottom = INFINITY;
+}
+
+/** Appends a command with the given arguments and returns it, not yet measured. */
+static DisplayCommand *display2d_append(CanvasRenderingContext2D *this, DisplayOp op, int argc, const double *argv)
+{
+    DisplayList *list = display2d_list(this);
+    list->private.commands = (DisplayCommand *)grow(list->private.commands, &list->private.commandsCapacity, list->private.commandsLength + 1, sizeof(DisplayCommand));
+    DisplayCommand *c = list->private.commands + list->private.commandsLength++;
+    memset(c, 0, sizeof(DisplayCommand));
+    c->op = op;
+    if (argc)
+        memcpy(c->args, argv, argc * sizeof(double));
+    c->data = list->private.dataLength;
+    c->left = c->top = INFINITY;
+    c->right = c->bottom = -INFINITY;
+    return c;
+}
+
+/** Copies length bytes onto the end of the list's data, 8-byte aligned, and returns where they start. */
+static size_t display2d_store(CanvasRenderingContext2D *this, const void *bytes, size_t length)
+{
+    DisplayList *list = display2d_list(this);
+    size_t offset = list->private.dataLength;
+    size_t end = (offset + length + 7) & ~(size_t)7;
+    list->private.data = (unsigned char *)grow(list->private.data, &list->private.dataCapacity, end, 1);
+    memcpy(list->private.data + offset, bytes, length);
+    list->private.dataLength = end;
+    return offset;
+}
+
+static void command_include(DisplayCommand *c, double left, double top, double right, double bottom)
+{
+    c->left = fmin(c->left, left);
+    c->top = fmin(c->top, top);
+    c->right = fmax(c->right, right);
+    c->bottom = fmax(c->bottom, bottom);
+}
+
+static void command_includePoint(DisplayCommand *c, const CanvasMatrix *m, double x, double y)
+{
+    double dx, dy;
+    canvasMatrixApply(m, x, y, &dx, &dy);
+    command_include(c, dx, dy, dx, dy);
+}
+
+static void command_includeRect(DisplayCommand *c, const CanvasMatrix *m, double x, double y, double width, double height)
+{
+    command_includePoint(c, m, x, y);
+    command_includePoint(c, m, x + width, y);
+    command_includePoint(c, m, x + width, y + height);
+    command_includePoint(c, m, x, y + height);
+}
+
+static void command_includeEdges(DisplayCommand *c, const CanvasEdgeList *edges)
+{
+    if (edges->length)
+        command_include(c, edges->left, edges->top, edges->right, edges->bottom);
+}
+
+/**
+ * Includes the outline of path stroked with the current state. Edge lists widen strokes by the
+ * average scale of the transform; under a non-uniform scale the browser's stroke reaches further,
+ * by at most the difference to the largest scale.
+ */
+static void command_includeStroke(CanvasRenderingContext2D *this, DisplayCommand *c, const CanvasPath *path)
+{
+    DisplayState *s = display2d_state(this);
+    CanvasEdgeList *edges = display2d_list(this)->private.edges;
+    canvasEdgesStroke(edges, path, &s->base);
+    if (!edges->length)
+        return;
+    const CanvasMatrix *m = &s->base.transform;
+    double sum = m->a * m->a + m->b * m->b + m->c * m->c + m->d * m->d;
+    double det = m->a * m->d - m->b * m->c;
+    double largest = sqrt((sum + sqrt(fmax(sum * sum - 4.0 * det * det, 0.0))) / 2.0);
+    double margin = s->base.lineWidth / 2.0 * (largest - canvasMatrixScale(m));
+    command_include(c, edges->left - margin, edges->top - margin, edges->right + margin, edges->bottom + margin);
+}
+
+/** Returns the font size in pixels from a CSS font shorthand, or a negative value if there isn't one. */
+static double fontSize(const char *font)
+{
+    for (const char *s = font; *s; s++)
+    {
+        if (!(*s >= '0' && *s <= '9') && *s != '.')
+            continue;
+        char *end;
+        double size = strtod(s, &end);
+        if (strncmp(end, "px", 2) == 0)
+            return size;
+        if (strncmp(end, "pt", 2) == 0)
+            return size * 4.0 / 3.0;
+        if (strncmp(end, "em", 2) == 0 || strncmp(end, "rem", 3) == 0)
+            return size * 16.0;
+        /* a '.' with no digits converts nothing, and is skipped like any other character */
+        s = end > s ? end - 1 : s;
+    }
+    return -1.0;
+}
+
+/**
+ * Includes a generous estimate of the area text covers, as text can't be measured in C: up to two
+ * font sizes above the baseline and one below, and two font sizes per character (or maxWidth) along it.
+ */
+static void command_includeText(CanvasRenderingContext2D *this, DisplayCommand *c, const char *text, double x, double y, double maxWidth, double lineWidth)
+{
+    DisplayState *s = display2d_state(this);
+    double size = fontSize(s->base.font);
+    if (size < 0.0)
+    {
+        command_include(c, -INFINITY, -INFINITY, INFINITY, INFINITY);
+        return;
+    }
+    size_t characters = 0;
+    for (const char *p = text; *p; p++)
+        characters += (*p & 0xC0) != 0x80;
+    double width = 2.0 * size * characters;
+    if (maxWidth >= 0.0 && maxWidth < width)
+        width = maxWidth;
+    /* start and end depend on the text direction, which isn't tracked */
+    double left = x - width, right = x + width;
+    if (s->base.textAlign == TEXT_ALIGN_LEFT)
+        left = x;
+    else if (s->base.textAlign == TEXT_ALIGN_RIGHT)
+        right = x;
+    else if (s->base.textAlign == TEXT_ALIGN_CENTER)
+        left = x - width / 2.0, right = x + width / 2.0;
+    double top = y - 2.0 * size, bottom = y + size;
+    command_includeRect(c, &s->base.transform, left - lineWidth, top - lineWidth, right - left + 2.0 * lineWidth, bottom - top + 2.0 * lineWidth);
+}
+
+/**
+ * Finishes a drawing command: hashes it and limits its bounding box to the clip region, rounded
+ * out by a pixel for anti-aliasing. Composite operations which clear whatever the source doesn't
+ * cover affect the whole clip region.
+ */
+static void display2d_draw(CanvasRenderingContext2D *this, DisplayCommand *c, int uses, uint64_t hash)
+{
+    DisplayState *s = display2d_state(this);
+    c->hash = hash_word(hash_bytes(hash_state(s, uses), c->args, sizeof(c->args)), hash ^ c->op);
+    switch (s->base.globalCompositeOperation)
+    {
+    case COMPOSITE_SOURCE_IN:
+    case COMPOSITE_SOURCE_OUT:
+    case COMPOSITE_DESTINATION_IN:
+    case COMPOSITE_DESTINATION_ATOP:
+    case COMPOSITE_COPY:
+        c->left = c->top = -INFINITY;
+        c->right = c->bottom = INFINITY;
+        break;
+    default:
+        break;
+    }
+    c->left = fmax(c->left, s->clipLeft) - 1.0;
+    c->top = fmax(c->top, s->clipTop) - 1.0;
+    c->right = fmin(c->right, s->clipRight) + 1.0;
+    c->bottom = fmin(c->bottom, s->clipBottom) + 1.0;
+}
+
+static void display2d_clipTo(CanvasRenderingContext2D *this, const CanvasEdgeList *edges, uint64_t hash)
+{
+    DisplayState *s = display2d_state(this);
+    s->clip = hash_word(s->clip, hash);
+    if (!edges->length)
+    {
+        s->clipLeft = s->clipTop = INFINITY;
+        s->clipRight = s->clipBottom = -INFINITY;
+        return;
+    }
+    s->clipLeft = fmax(s->clipLeft, edges->left);
+    s->clipTop = fmax(s->clipTop, edges->top);
+    s->clipRight = fmin(s->clipRight, edges->right);
+    s->clipBottom = fmin(s->clipBottom, edges->bottom);
+}
+
+static void serializeColor(uint32_t rgba, char *buffer)
+{
+    unsigned r = rgba >> 24, g = (rgba >> 16) & 255, b = (rgba >> 8) & 255, a = rgba & 255;
+    if (a == 255)
+        snprintf(buffer, CANVAS_STATE_STRING_CAPACITY, "#%02x%02x%02x", r, g, b);
+    else
+        snprintf(buffer, CANVAS_STATE_STRING_CAPACITY, "rgba(%u, %u, %u, %g)", r, g, b, floor(a / 255.0 * 1000.0 + 0.5) / 1000.0);
+}
+/* End: recording */
+
+/* Begin: CanvasRenderingContext2D display list methods */
+static void display2d_clearRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    double args[] = {x, y, width, height};
+    DisplayCommand *c = display2d_append(this, DISPLAY_CLEAR_RECT, 4, args);
+    command_includeRect(c, &display2d_state(this)->base.transform, x, y, width, height);
+    display2d_draw(this, c, 0, 0);
+}
+static void display2d_fillRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    double args[] = {x, y, width, height};
+    DisplayCommand *c = display2d_append(this, DISPLAY_FILL_RECT, 4, args);
+    command_includeRect(c, &display2d_state(this)->base.transform, x, y, width, height);
+    display2d_draw(this, c, USES_FILL, 0);
+}
+static void display2d_strokeRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    double args[] = {x, y, width, height};
+    DisplayCommand *c = display2d_append(this, DISPLAY_STROKE_RECT, 4, args);
+    CanvasPath *scratch = display2d_list(this)->private.scratch;
+    canvasPathClear(scratch);
+    canvasPathRect(scratch, &display2d_state(this)->base.transform, x, y, width, height);
+    command_includeStroke(this, c, scratch);
+    display2d_draw(this, c, USES_STROKE, 0);
+}
+/** Records one of the batched rectangle calls, whose bulk arguments start with the rectangles. */
+static DisplayCommand *display2d_rects(CanvasRenderingContext2D *this, DisplayOp op, const float *xywh, size_t count, const void *extra, size_t extraLength)
+{
+    double args[] = {(double)count};
+    DisplayCommand *c = display2d_append(this, op, 1, args);
+    display2d_store(this, xywh, 4 * count * sizeof(float));
+    if (extraLength)
+        display2d_store(this, extra, extraLength);
+    const CanvasMatrix *m = &display2d_state(this)->base.transform;
+    if (op == DISPLAY_STROKE_RECTS)
+    {
+        CanvasPath *scratch = display2d_list(this)->private.scratch;
+        canvasPathClear(scratch);
+        for (size_t i = 0; i < count; i++)
+            canvasPathRect(scratch, m, xywh[4 * i], xywh[4 * i + 1], xywh[4 * i + 2], xywh[4 * i + 3]);
+        command_includeStroke(this, c, scratch);
+    }
+    else if (op != DISPLAY_FILL_RECTS_TRANSFORMED)
+        for (size_t i = 0; i < count; i++)
+            command_includeRect(c, m, xywh[4 * i], xywh[4 * i + 1], xywh[4 * i + 2], xywh[4 * i + 3]);
+    return c;
+}
+static void display2d_clearRects(CanvasRenderingContext2D *this, const float *xywh, size_t count)
+{
+    DisplayCommand *c = display2d_rects(this, DISPLAY_CLEAR_RECTS, xywh, count, NULL, 0);
+    display2d_draw(this, c, 0, hash_bytes(0, xywh, 4 * count * sizeof(float)));
+}
+static void display2d_fillRects(CanvasRenderingContext2D *this, const float *xywh, size_t count)
+{
+    DisplayCommand *c = display2d_rects(this, DISPLAY_FILL_RECTS, xywh, count, NULL, 0);
+    display2d_draw(this, c, USES_FILL, hash_bytes(0, xywh, 4 * count * sizeof(float)));
+}
+static void display2d_strokeRects(CanvasRenderingContext2D *this, const float *xywh, size_t count)
+{
+    DisplayCommand *c = display2d_rects(this, DISPLAY_STROKE_RECTS, xywh, count, NULL, 0);
+    display2d_draw(this, c, USES_STROKE, hash_bytes(0, xywh, 4 * count * sizeof(float)));
+}
+static void display2d_fillRectsColored(CanvasRenderingContext2D *this, const float *xywh, const uint32_t *rgba, size_t count)
+{
+    DisplayCommand *c = display2d_rects(this, DISPLAY_FILL_RECTS_COLORED, xywh, count, rgba, count * sizeof(uint32_t));
+    uint64_t hash = hash_bytes(hash_bytes(0, xywh, 4 * count * sizeof(float)), rgba, count * sizeof(uint32_t));
+    display2d_draw(this, c, 0, hash);
+}
+static void display2d_fillRectsTransformed(CanvasRenderingContext2D *this, const float *xywh, const float *matrices, size_t count)
+{
+    DisplayCommand *c = display2d_rects(this, DISPLAY_FILL_RECTS_TRANSFORMED, xywh, count, matrices, matrices ? 6 * count * sizeof(float) : 0);
+    c->args[1] = matrices != NULL;
+    if (count > this->private.quadsCapacity)
+    {
+        this->private.quadsCapacity = count;
+        this->private.quads = (float *)realloc(this->private.quads, 8 * count * sizeof(float));
+    }
+    canvasMatrixApplyRects(&display2d_state(this)->base.transform, xywh, matrices, count, this->private.quads);
+    for (size_t i = 0; i < 4 * count; i++)
+        command_include(c, this->private.quads[2 * i], this->private.quads[2 * i + 1], this->private.quads[2 * i], this->private.quads[2 * i + 1]);
+    uint64_t hash = hash_bytes(0, xywh, 4 * count * sizeof(float));
+    if (matrices)
+        hash = hash_bytes(hash, matrices, 6 * count * sizeof(float));
+    display2d_draw(this, c, USES_FILL, hash);
+}
+static void display2d_putImageData(CanvasRenderingContext2D *this, ImageData *image, int dx, int dy)
+{
+    double args[] = {dx, dy, image->width, image->height};
+    DisplayCommand *c = display2d_append(this, DISPLAY_PUT_IMAGE_DATA, 4, args);
+    c->object = image;
+    c->hash = hash_bytes(hash_word(0, c->op), args, sizeof(args));
+    c->hash = hash_bytes(c->hash, image->data, (size_t)image->width * image->height * 4);
+    /* putImageData() ignores the transform and clip */
+    c->left = dx - 1.0;
+    c->top = dy - 1.0;
+    c->right = dx + image->width + 1.0;
+    c->bottom = dy + image->height + 1.0;
+}
+static void display2d_getImageData(CanvasRenderingContext2D *this, ImageData *dest, int sx, int sy)
+{
+    memset(dest->data, 0, (size_t)dest->width * dest->height * 4);
+}
+static void display2d_putImageDataDirty(CanvasRenderingContext2D *this, ImageData *image, int dx, int dy)
+{
+    display2d_putImageData(this, image, dx, dy);
+    image->private.damageCount = 0;
+}
+static void display2d_text(CanvasRenderingContext2D *this, DisplayOp op, char *text, double x, double y, double maxWidth)
+{
+    double args[] = {x, y, maxWidth};
+    DisplayCommand *c = display2d_append(this, op, 3, args);
+    display2d_store(this, text, strlen(text) + 1);
+    double lineWidth = op == DISPLAY_STROKE_TEXT ? display2d_state(this)->base.lineWidth : 0.0;
+    command_includeText(this, c, text, x, y, maxWidth, lineWidth);
+    display2d_draw(this, c, USES_TEXT | (op == DISPLAY_STROKE_TEXT ? USES_STROKE : USES_FILL), hash_string(0, text));
+}
+static void display2d_fillText(CanvasRenderingContext2D *this, char *text, double x, double y, double maxWidth)
+{
+    display2d_text(this, DISPLAY_FILL_TEXT, text, x, y, maxWidth);
+}
+static void display2d_strokeText(CanvasRenderingContext2D *this, char *text, double x, double y, double maxWidth)
+{
+    display2d_text(this, DISPLAY_STROKE_TEXT, text, x, y, maxWidth);
+}
+static void display2d_setLineWidth(CanvasRenderingContext2D *this, double value)
+{
+    DisplayState *s = display2d_state(this);
+    if (!(value > 0.0 && isfinite(value)) || value == s->base.lineWidth)
+        return;
+    s->base.lineWidth = value;
+    display2d_append(this, DISPLAY_SET_LINE_WIDTH, 1, &value);
+}
+static double display2d_getLineWidth(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.lineWidth;
+}
+static void display2d_setLineCapEnum(CanvasRenderingContext2D *this, CanvasLineCap type)
+{
+    DisplayState *s = display2d_state(this);
+    if ((unsigned)type > LINE_CAP_SQUARE || type == s->base.lineCap)
+        return;
+    s->base.lineCap = type;
+    double args[] = {type};
+    display2d_append(this, DISPLAY_SET_LINE_CAP, 1, args);
+}
+static void display2d_setLineCap(CanvasRenderingContext2D *this, char *type)
+{
+    int index = canvasKeywordIndex(canvasLineCapKeywords, type);
+    if (index >= 0)
+        display2d_setLineCapEnum(this, (CanvasLineCap)index);
+}
+static char *display2d_getLineCap(CanvasRenderingContext2D *this)
+{
+    return (char *)canvasLineCapKeywords[display2d_state(this)->base.lineCap];
+}
+static CanvasLineCap display2d_getLineCapEnum(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.lineCap;
+}
+static void display2d_setLineJoinEnum(CanvasRenderingContext2D *this, CanvasLineJoin type)
+{
+    DisplayState *s = display2d_state(this);
+    if ((unsigned)type > LINE_JOIN_MITER || type == s->base.lineJoin)
+        return;
+    s->base.lineJoin = type;
+    double args[] = {type};
+    display2d_append(this, DISPLAY_SET_LINE_JOIN, 1, args);
+}
+static void display2d_setLineJoin(CanvasRenderingContext2D *this, char *type)
+{
+    int index = canvasKeywordIndex(canvasLineJoinKeywords, type);
+    if (index >= 0)
+        display2d_setLineJoinEnum(this, (CanvasLineJoin)index);
+}
+static char *display2d_getLineJoin(CanvasRenderingContext2D *this)
+{
+    return (char *)canvasLineJoinKeywords[display2d_state(this)->base.lineJoin];
+}
+static CanvasLineJoin display2d_getLineJoinEnum(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.lineJoin;
+}
+static char *display2d_getFont(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.font;
+}
+static void display2d_setFont(CanvasRenderingContext2D *this, char *value)
+{
+    DisplayState *s = display2d_state(this);
+    if (strncmp(value, s->base.font, CANVAS_STATE_STRING_CAPACITY - 1) == 0)
+        return;
+    snprintf(s->base.font, CANVAS_STATE_STRING_CAPACITY, "%s", value);
+    display2d_append(this, DISPLAY_SET_FONT, 0, NULL);
+    display2d_store(this, value, strlen(value) + 1);
+}
+static void display2d_setTextAlignEnum(CanvasRenderingContext2D *this, CanvasTextAlign value)
+{
+    DisplayState *s = display2d_state(this);
+    if ((unsigned)value > TEXT_ALIGN_CENTER || value == s->base.textAlign)
+        return;
+    s->base.textAlign = value;
+    double args[] = {value};
+    display2d_append(this, DISPLAY_SET_TEXT_ALIGN, 1, args);
+}
+static void display2d_setTextAlign(CanvasRenderingContext2D *this, char *value)
+{
+    int index = canvasKeywordIndex(canvasTextAlignKeywords, value);
+    if (index >= 0)
+        display2d_setTextAlignEnum(this, (CanvasTextAlign)index);
+}
+static char *display2d_getTextAlign(CanvasRenderingContext2D *this)
+{
+    return (char *)canvasTextAlignKeywords[display2d_state(this)->base.textAlign];
+}
+static CanvasTextAlign display2d_getTextAlignEnum(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.textAlign;
+}
+static void display2d_setFillStyle(CanvasRenderingContext2D *this, char *value)
+{
+    DisplayState *s = display2d_state(this);
+    snprintf(s->base.fillStyle, CANVAS_STATE_STRING_CAPACITY, "%s", value);
+    s->base.fillIsColor = 0;
+    s->fill = hash_string(0, value);
+    display2d_append(this, DISPLAY_SET_FILL_STYLE, 0, NULL);
+    display2d_store(this, value, strlen(value) + 1);
+}
+static char *display2d_getFillStyle(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.fillStyle;
+}
+static void display2d_setStrokeStyle(CanvasRenderingContext2D *this, char *value)
+{
+    DisplayState *s = display2d_state(this);
+    snprintf(s->base.strokeStyle, CANVAS_STATE_STRING_CAPACITY, "%s", value);
+    s->base.strokeIsColor = 0;
+    s->stroke = hash_string(0, value);
+    display2d_append(this, DISPLAY_SET_STROKE_STYLE, 0, NULL);
+    display2d_store(this, value, strlen(value) + 1);
+}
+static char *display2d_getStrokeStyle(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.strokeStyle;
+}
+static void display2d_setFillColor(CanvasRenderingContext2D *this, uint32_t rgba)
+{
+    DisplayState *s = display2d_state(this);
+    if (s->base.fillIsColor && s->base.fillColor == rgba)
+        return;
+    s->base.fillIsColor = 1;
+    s->base.fillColor = rgba;
+    serializeColor(rgba, s->base.fillStyle);
+    s->fill = hash_string(0, s->base.fillStyle);
+    double args[] = {rgba};
+    display2d_append(this, DISPLAY_SET_FILL_COLOR, 1, args);
+}
+static void display2d_setStrokeColor(CanvasRenderingContext2D *this, uint32_t rgba)
+{
+    DisplayState *s = display2d_state(this);
+    if (s->base.strokeIsColor && s->base.strokeColor == rgba)
+        return;
+    s->base.strokeIsColor = 1;
+    s->base.strokeColor = rgba;
+    serializeColor(rgba, s->base.strokeStyle);
+    s->stroke = hash_string(0, s->base.strokeStyle);
+    double args[] = {rgba};
+    display2d_append(this, DISPLAY_SET_STROKE_COLOR, 1, args);
+}
+static void display2d_beginPath(CanvasRenderingContext2D *this)
+{
+    canvasPathClear(this->private.path);
+    display2d_append(this, DISPLAY_BEGIN_PATH, 0, NULL);
+}
+static void display2d_closePath(CanvasRenderingContext2D *this)
+{
+    canvasPathClose(this->private.path);
+    display2d_append(this, DISPLAY_CLOSE_PATH, 0, NULL);
+}
+static void display2d_moveTo(CanvasRenderingContext2D *this, double x, double y)
+{
+    double args[] = {x, y};
+    canvasPathMoveTo(this->private.path, &display2d_state(this)->base.transform, x, y);
+    display2d_append(this, DISPLAY_MOVE_TO, 2, args);
+}
+static void display2d_lineTo(CanvasRenderingContext2D *this, double x, double y)
+{
+    double args[] = {x, y};
+    canvasPathLineTo(this->private.path, &display2d_state(this)->base.transform, x, y);
+    display2d_append(this, DISPLAY_LINE_TO, 2, args);
+}
+static void display2d_bezierCurveTo(CanvasRenderingContext2D *this, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y)
+{
+    double args[] = {cp1x, cp1y, cp2x, cp2y, x, y};
+    canvasPathBezierCurveTo(this->private.path, &display2d_state(this)->base.transform, cp1x, cp1y, cp2x, cp2y, x, y);
+    display2d_append(this, DISPLAY_BEZIER_CURVE_TO, 6, args);
+}
+static void display2d_quadraticCurveTo(CanvasRenderingContext2D *this, double cpx, double cpy, double x, double y)
+{
+    double args[] = {cpx, cpy, x, y};
+    canvasPathQuadraticCurveTo(this->private.path, &display2d_state(this)->base.transform, cpx, cpy, x, y);
+    display2d_append(this, DISPLAY_QUADRATIC_CURVE_TO, 4, args);
+}
+static void display2d_arc(CanvasRenderingContext2D *this, double x, double y, double radius, double startAngle, double endAngle)
+{
+    double args[] = {x, y, radius, startAngle, endAngle};
+    canvasPathArc(this->private.path, &display2d_state(this)->base.transform, x, y, radius, startAngle, endAngle);
+    display2d_append(this, DISPLAY_ARC, 5, args);
+}
+static void display2d_arcTo(CanvasRenderingContext2D *this, double x1, double y1, double x2, double y2, double radius)
+{
+    double args[] = {x1, y1, x2, y2, radius};
+    canvasPathArcTo(this->private.path, &display2d_state(this)->base.transform, x1, y1, x2, y2, radius);
+    display2d_append(this, DISPLAY_ARC_TO, 5, args);
+}
+static void display2d_ellipse(CanvasRenderingContext2D *this, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle)
+{
+    double args[] = {x, y, radiusX, radiusY, rotation, startAngle, endAngle};
+    canvasPathEllipse(this->private.path, &display2d_state(this)->base.transform, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
+    display2d_append(this, DISPLAY_ELLIPSE, 7, args);
+}
+static void display2d_rect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    double args[] = {x, y, width, height};
+    canvasPathRect(this->private.path, &display2d_state(this)->base.transform, x, y, width, height);
+    display2d_append(this, DISPLAY_RECT, 4, args);
+}
+static void display2d_polyline(CanvasRenderingContext2D *this, const float *xy, size_t count, int closed)
+{
+    double args[] = {(double)count, closed};
+    canvasPathPolyline(this->private.path, &display2d_state(this)->base.transform, xy, count, closed);
+    display2d_append(this, DISPLAY_POLYLINE, 2, args);
+    display2d_store(this, xy, 2 * count * sizeof(float));
+}
+static void display2d_polylines(CanvasRenderingContext2D *this, const float *xy, const uint32_t *offsets, size_t polylineCount, int closed)
+{
+    double args[] = {(double)polylineCount, closed};
+    for (size_t i = 0; i < polylineCount; i++)
+        canvasPathPolyline(this->private.path, &display2d_state(this)->base.transform, xy + 2 * offsets[i], offsets[i + 1] - offsets[i], closed);
+    display2d_append(this, DISPLAY_POLYLINES, 2, args);
+    display2d_store(this, offsets, (polylineCount + 1) * sizeof(uint32_t));
+    display2d_store(this, xy, 2 * offsets[polylineCount] * sizeof(float));
+}
+static void display2d_fill(CanvasRenderingContext2D *this)
+{
+    DisplayCommand *c = display2d_append(this, DISPLAY_FILL, 0, NULL);
+    CanvasEdgeList *edges = display2d_list(this)->private.edges;
+    canvasEdgesFill(edges, this->private.path);
+    command_includeEdges(c, edges);
+    display2d_draw(this, c, USES_FILL, hash_path(0, this->private.path));
+}
+static void display2d_stroke(CanvasRenderingContext2D *this)
+{
+    DisplayCommand *c = display2d_append(this, DISPLAY_STROKE, 0, NULL);
+    command_includeStroke(this, c, this->private.path);
+    display2d_draw(this, c, USES_STROKE, hash_path(0, this->private.path));
+}
+static void display2d_clip(CanvasRenderingContext2D *this)
+{
+    CanvasEdgeList *edges = display2d_list(this)->private.edges;
+    canvasEdgesFill(edges, this->private.path);
+    display2d_clipTo(this, edges, hash_path(DISPLAY_CLIP, this->private.path));
+    display2d_append(this, DISPLAY_CLIP, 0, NULL);
+}
+static int display2d_isPointInPathFillRule(CanvasRenderingContext2D *this, double x, double y, CanvasFillRule fillRule)
+{
+    canvasEdgesFill(this->private.hitEdges, this->private.path);
+    return canvasEdgesContain(this->private.hitEdges, x, y, fillRule);
+}
+static int display2d_isPointInPath(CanvasRenderingContext2D *this, double x, double y)
+{
+    return display2d_isPointInPathFillRule(this, x, y, FILL_RULE_NONZERO);
+}
+static int display2d_isPointInStroke(CanvasRenderingContext2D *this, double x, double y)
+{
+    canvasEdgesStroke(this->private.hitEdges, this->private.path, &display2d_state(this)->base);
+    return canvasEdgesContain(this->private.hitEdges, x, y, FILL_RULE_NONZERO);
+}
+static uint64_t hash_path2D(uint64_t h, const Path2D *path)
+{
+    return hash_bytes(h, path->private.commands, path->private.commandsLength * sizeof(double));
+}
+static void display2d_fillPath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    DisplayCommand *c = display2d_append(this, DISPLAY_FILL_PATH, 0, NULL);
+    c->object = path;
+    CanvasEdgeList *edges = display2d_list(this)->private.edges;
+    canvasEdgesFill(edges, canvasPath2DFlatten(path, &display2d_state(this)->base.transform));
+    command_includeEdges(c, edges);
+    display2d_draw(this, c, USES_FILL, hash_path2D(0, path));
+}
+static void display2d_strokePath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    DisplayCommand *c = display2d_append(this, DISPLAY_STROKE_PATH, 0, NULL);
+    c->object = path;
+    command_includeStroke(this, c, canvasPath2DFlatten(path, &display2d_state(this)->base.transform));
+    display2d_draw(this, c, USES_STROKE, hash_path2D(0, path));
+}
+static void display2d_clipPath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    DisplayState *s = display2d_state(this);
+    CanvasEdgeList *edges = display2d_list(this)->private.edges;
+    canvasEdgesFill(edges, canvasPath2DFlatten(path, &s->base.transform));
+    display2d_clipTo(this, edges, hash_path2D(hash_bytes(DISPLAY_CLIP_PATH, &s->base.transform, sizeof(CanvasMatrix)), path));
+    display2d_append(this, DISPLAY_CLIP_PATH, 0, NULL)->object = path;
+}
+static int display2d_isPointInPath2D(CanvasRenderingContext2D *this, Path2D *path, double x, double y, CanvasFillRule fillRule)
+{
+    return canvasPath2DContains(path, &display2d_state(this)->base.transform, x, y, fillRule);
+}
+static int display2d_isPointInStroke2D(CanvasRenderingContext2D *this, Path2D *path, double x, double y)
+{
+    return canvasPath2DStrokeContains(path, &display2d_state(this)->base, x, y);
+}
+static void display2d_rotate(CanvasRenderingContext2D *this, double angle)
+{
+    canvasMatrixMultiply(&display2d_state(this)->base.transform, cos(angle), sin(angle), -sin(angle), cos(angle), 0.0, 0.0);
+    display2d_append(this, DISPLAY_ROTATE, 1, &angle);
+}
+static void display2d_scale(CanvasRenderingContext2D *this, double x, double y)
+{
+    double args[] = {x, y};
+    canvasMatrixMultiply(&display2d_state(this)->base.transform, x, 0.0, 0.0, y, 0.0, 0.0);
+    display2d_append(this, DISPLAY_SCALE, 2, args);
+}
+static void display2d_translate(CanvasRenderingContext2D *this, double x, double y)
+{
+    double args[] = {x, y};
+    canvasMatrixMultiply(&display2d_state(this)->base.transform, 1.0, 0.0, 0.0, 1.0, x, y);
+    display2d_append(this, DISPLAY_TRANSLATE, 2, args);
+}
+static void display2d_transform(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f)
+{
+    double args[] = {a, b, c, d, e, f};
+    canvasMatrixMultiply(&display2d_state(this)->base.transform, a, b, c, d, e, f);
+    display2d_append(this, DISPLAY_TRANSFORM, 6, args);
+}
+static void display2d_setTransform(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f)
+{
+    double args[] = {a, b, c, d, e, f};
+    display2d_state(this)->base.transform = (CanvasMatrix){a, b, c, d, e, f};
+    display2d_append(this, DISPLAY_SET_TRANSFORM, 6, args);
+}
+static void display2d_resetTransform(CanvasRenderingContext2D *this)
+{
+    display2d_state(this)->base.transform = canvasIdentityMatrix;
+    display2d_append(this, DISPLAY_RESET_TRANSFORM, 0, NULL);
+}
+static CanvasMatrix display2d_getTransform(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.transform;
+}
+static void display2d_setGlobalAlpha(CanvasRenderingContext2D *this, double value)
+{
+    DisplayState *s = display2d_state(this);
+    if (!(value >= 0.0 && value <= 1.0) || value == s->base.globalAlpha)
+        return;
+    s->base.globalAlpha = value;
+    display2d_append(this, DISPLAY_SET_GLOBAL_ALPHA, 1, &value);
+}
+static double display2d_getGlobalAlpha(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.globalAlpha;
+}
+static void display2d_setGlobalCompositeOperationEnum(CanvasRenderingContext2D *this, CanvasCompositeOperation value)
+{
+    DisplayState *s = display2d_state(this);
+    if ((unsigned)value > COMPOSITE_LUMINOSITY || value == s->base.globalCompositeOperation)
+        return;
+    s->base.globalCompositeOperation = value;
+    double args[] = {value};
+    display2d_append(this, DISPLAY_SET_GLOBAL_COMPOSITE_OPERATION, 1, args);
+}
+static void display2d_setGlobalCompositeOperation(CanvasRenderingContext2D *this, char *value)
+{
+    int index = canvasKeywordIndex(canvasCompositeOperationKeywords, value);
+    if (index >= 0)
+        display2d_setGlobalCompositeOperationEnum(this, (CanvasCompositeOperation)index);
+}
+static char *display2d_getGlobalCompositeOperation(CanvasRenderingContext2D *this)
+{
+    return (char *)canvasCompositeOperationKeywords[display2d_state(this)->base.globalCompositeOperation];
+}
+static CanvasCompositeOperation display2d_getGlobalCompositeOperationEnum(CanvasRenderingContext2D *this)
+{
+    return display2d_state(this)->base.globalCompositeOperation;
+}
+static void display2d_save(CanvasRenderingContext2D *this)
+{
+    DisplayList *list = display2d_list(this);
+    list->private.states = (DisplayState *)grow(list->private.states, &list->private.statesCapacity, list->private.depth + 2, sizeof(DisplayState));
+    list->private.states[list->private.depth + 1] = list->private.states[list->private.depth];
+    list->private.depth++;
+    display2d_append(this, DISPLAY_SAVE, 0, NULL);
+}
+static void display2d_restore(CanvasRenderingContext2D *this)
+{
+    DisplayList *list = display2d_list(this);
+    if (!list->private.depth)
+        return;
+    list->private.depth--;
+    display2d_append(this, DISPLAY_RESTORE, 0, NULL);
+}
+static void display2d_flush(CanvasRenderingContext2D *this)
+{
+    /* nothing is drawn, so nothing is ever deferred */
+}
+static HTMLCanvasElement *display2d_getCanvas(CanvasRenderingContext2D *this)
+{
+    return NULL;
+}
+/* End: CanvasRenderingContext2D display list methods */
+
+/* Begin: replaying */
+/** Returns non-zero if the command's bounding box meets one of the damage rectangles. */
+static int command_touches(const DisplayCommand *c, const int *damage, int damageCount)
+{
+    for (int i = 0; i < damageCount; i++)
+    {
+        const int *r = damage + 4 * i;
+        if (c->left < r[0] + r[2] && c->right > r[0] && c->top < r[1] + r[3] && c->bottom > r[1])
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Marks the commands replayDamage() must replay: drawing calls touching the damage, the calls
+ * building a path some replayed call uses, and everything that changes state.
+ */
+static void displayList_markLive(DisplayList *this, const int *damage, int damageCount)
+{
+    DisplayCommand *commands = this->private.commands;
+    size_t length = this->private.commandsLength;
+    this->private.live = (unsigned char *)grow(this->private.live, &this->private.liveCapacity, length, 1);
+    int pathUsed = 0;
+    for (size_t i = length; i-- > 0;)
+    {
+        DisplayCommand *c = commands + i;
+        int live;
+        if (c->op < DISPLAY_CLIP)
+            live = command_touches(c, damage, damageCount);
+        else if (c->op < DISPLAY_BEGIN_PATH)
+            live = 1;
+        else
+            live = pathUsed;
+        if (live && (c->op == DISPLAY_FILL || c->op == DISPLAY_STROKE || c->op == DISPLAY_CLIP))
+            pathUsed = 1;
+        if (c->op == DISPLAY_BEGIN_PATH)
+            pathUsed = 0;
+        this->private.live[i] = (unsigned char)live;
+    }
+}
+
+/** Puts the part of image inside the damage rectangles at (dx, dy), leaving its dirty rectangles as they were. */
+static void replay_putImageData(CanvasRenderingContext2D *ctx, ImageData *image, int dx, int dy, const int *damage, int damageCount)
+{
+    if (!damage)
+    {
+        ctx->putImageData(ctx, image, dx, dy);
+        return;
+    }
+    int saved[4 * IMAGE_DATA_MAX_DIRTY_RECTS];
+    int savedCount = image->private.damageCount;
+    memcpy(saved, image->private.damage, sizeof(saved));
+    image->private.damageCount = 0;
+    for (int i = 0; i < damageCount; i++)
+    {
+        const int *r = damage + 4 * i;
+        image->markDirty(image, r[0] - dx, r[1] - dy, r[2], r[3]);
+    }
+    ctx->putImageDataDirty(ctx, image, dx, dy);
+    memcpy(image->private.damage, saved, sizeof(saved));
+    image->private.damageCount = savedCount;
+}
+
+void displayCommandReplay(CanvasRenderingContext2D *ctx, DisplayOp op, const double *args, const unsigned char *data, void *object)
+{
+    const double *a = args;
+    size_t count = (size_t)a[0];
+    switch (op)
+    {
+    case DISPLAY_CLEAR_RECT: ctx->clearRect(ctx, a[0], a[1], a[2], a[3]); break;
+    case DISPLAY_FILL_RECT: ctx->fillRect(ctx, a[0], a[1], a[2], a[3]); break;
+    case DISPLAY_STROKE_RECT: ctx->strokeRect(ctx, a[0], a[1], a[2], a[3]); break;
+    case DISPLAY_CLEAR_RECTS: ctx->clearRects(ctx, (const float *)data, count); break;
+    case DISPLAY_FILL_RECTS: ctx->fillRects(ctx, (const float *)data, count); break;
+    case DISPLAY_STROKE_RECTS: ctx->strokeRects(ctx, (const float *)data, count); break;
+    case DISPLAY_FILL_RECTS_COLORED:
+        ctx->fillRectsColored(ctx, (const float *)data, (const uint32_t *)(data + ((4 * count * sizeof(float) + 7) & ~(size_t)7)), count);
+        break;
+    case DISPLAY_FILL_RECTS_TRANSFORMED:
+        ctx->fillRectsTransformed(ctx, (const float *)data, a[1] ? (const float *)(data + ((4 * count * sizeof(float) + 7) & ~(size_t)7)) : NULL, count);
+        break;
+    case DISPLAY_PUT_IMAGE_DATA: ctx->putImageData(ctx, (ImageData *)object, (int)a[0], (int)a[1]); break;
+    case DISPLAY_FILL_TEXT: ctx->fillText(ctx, (char *)data, a[0], a[1], a[2]); break;
+    case DISPLAY_STROKE_TEXT: ctx->strokeText(ctx, (char *)data, a[0], a[1], a[2]); break;
+    case DISPLAY_FILL: ctx->fill(ctx); break;
+    case DISPLAY_STROKE: ctx->stroke(ctx); break;
+    case DISPLAY_FILL_PATH: ctx->fillPath(ctx, (Path2D *)object); break;
+    case DISPLAY_STROKE_PATH: ctx->strokePath(ctx, (Path2D *)object); break;
+    case DISPLAY_CLIP: ctx->clip(ctx); break;
+    case DISPLAY_CLIP_PATH: ctx->clipPath(ctx, (Path2D *)object); break;
+    case DISPLAY_SET_LINE_WIDTH: ctx->setLineWidth(ctx, a[0]); break;
+    case DISPLAY_SET_LINE_CAP: ctx->setLineCapEnum(ctx, (CanvasLineCap)a[0]); break;
+    case DISPLAY_SET_LINE_JOIN: ctx->setLineJoinEnum(ctx, (CanvasLineJoin)a[0]); break;
+    case DISPLAY_SET_FONT: ctx->setFont(ctx, (char *)data); break;
+    case DISPLAY_SET_TEXT_ALIGN: ctx->setTextAlignEnum(ctx, (CanvasTextAlign)a[0]); break;
+    case DISPLAY_SET_FILL_STYLE: ctx->setFillStyle(ctx, (char *)data); break;
+    case DISPLAY_SET_STROKE_STYLE: ctx->setStrokeStyle(ctx, (char *)data); break;
+    case DISPLAY_SET_FILL_COLOR: ctx->setFillColor(ctx, (uint32_t)a[0]); break;
+    case DISPLAY_SET_STROKE_COLOR: ctx->setStrokeColor(ctx, (uint32_t)a[0]); break;
+    case DISPLAY_SET_GLOBAL_ALPHA: ctx->setGlobalAlpha(ctx, a[0]); break;
+    case DISPLAY_SET_GLOBAL_COMPOSITE_OPERATION: ctx->setGlobalCompositeOperationEnum(ctx, (CanvasCompositeOperation)a[0]); break;
+    case DISPLAY_ROTATE: ctx->rotate(ctx, a[0]); break;
+    case DISPLAY_SCALE: ctx->scale(ctx, a[0], a[1]); break;
+    case DISPLAY_TRANSLATE: ctx->translate(ctx, a[0], a[1]); break;
+    case DISPLAY_TRANSFORM: ctx->transform(ctx, a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case DISPLAY_SET_TRANSFORM: ctx->setTransform(ctx, a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case DISPLAY_RESET_TRANSFORM: ctx->resetTransform(ctx); break;
+    case DISPLAY_SAVE: ctx->save(ctx); break;
+    case DISPLAY_RESTORE: ctx->restore(ctx); break;
+    case DISPLAY_BEGIN_PATH: ctx->beginPath(ctx); break;
+    case DISPLAY_CLOSE_PATH: ctx->closePath(ctx); break;
+    case DISPLAY_MOVE_TO: ctx->moveTo(ctx, a[0], a[1]); break;
+    case DISPLAY_LINE_TO: ctx->lineTo(ctx, a[0], a[1]); break;
+    case DISPLAY_BEZIER_CURVE_TO: ctx->bezierCurveTo(ctx, a[0], a[1], a[2], a[3], a[4], a[5]); break;
+    case DISPLAY_QUADRATIC_CURVE_TO: ctx->quadraticCurveTo(ctx, a[0], a[1], a[2], a[3]); break;
+    case DISPLAY_ARC: ctx->arc(ctx, a[0], a[1], a[2], a[3], a[4]); break;
+    case DISPLAY_ARC_TO: ctx->arcTo(ctx, a[0], a[1], a[2], a[3], a[4]); break;
+    case DISPLAY_ELLIPSE: ctx->ellipse(ctx, a[0], a[1], a[2], a[3], a[4], a[5], a[6]); break;
+    case DISPLAY_RECT: ctx->rect(ctx, a[0], a[1], a[2], a[3]); break;
+    case DISPLAY_POLYLINE: ctx->polyline(ctx, (const float *)data, count, (int)a[1]); break;
+    case DISPLAY_POLYLINES:
+        ctx->polylines(ctx, (const float *)(data + (((count + 1) * sizeof(uint32_t) + 7) & ~(size_t)7)), (const uint32_t *)data, count, (int)a[1]);
+        break;
+    }
+}
+
+/** Replays the list on ctx, or with damage, only the commands marked live, never restoring past the states it saved. */
+static void displayList_run(DisplayList *this, CanvasRenderingContext2D *ctx, const int *damage, int damageCount)
+{
+    size_t depth = 0;
+    for (size_t i = 0; i < this->private.commandsLength; i++)
+    {
+        const DisplayCommand *c = this->private.commands + i;
+        if (damage && !this->private.live[i])
+            continue;
+        if (c->op == DISPLAY_SAVE)
+            depth++;
+        else if (c->op == DISPLAY_RESTORE)
+            depth--;
+        if (c->op == DISPLAY_PUT_IMAGE_DATA)
+            replay_putImageData(ctx, (ImageData *)c->object, (int)c->args[0], (int)c->args[1], damage, damageCount);
+        else
+            displayCommandReplay(ctx, c->op, c->args, this->private.data + c->data, c->object);
+    }
+    /* the list's own save() calls are always balanced when replaying damage, so the caller's restore() pops the right state */
+    if (damage)
+        for (; depth; depth--)
+            ctx->restore(ctx);
+}
+/* End: replaying */
+
+/* Begin: DisplayList static methods */
+static CanvasRenderingContext2D *displayList_getContext(DisplayList *this)
+{
+    return &this->private.context;
+}
+static void displayList_clear(DisplayList *this)
+{
+    this->private.commandsLength = 0;
+    this->private.dataLength = 0;
+    this->private.depth = 0;
+    state_reset(this->private.states);
+    canvasPathClear(this->private.context.private.path);
+}
+static void displayList_replay(DisplayList *this, CanvasRenderingContext2D *ctx)
+{
+    displayList_run(this, ctx, NULL, 0);
+}
+
+typedef struct DisplayItem
+{
+    uint64_t hash;
+    size_t index;
+} DisplayItem;
+
+static int item_compare(const void *a, const void *b)
+{
+    const DisplayItem *x = (const DisplayItem *)a, *y = (const DisplayItem *)b;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static void damage_add(int *damage, int *count, int width, int height, const DisplayCommand *c)
+{
+    int x1 = c->left < 0.0 ? 0 : c->left > width ? width : (int)floor(c->left);
+    int y1 = c->top < 0.0 ? 0 : c->top > height ? height : (int)floor(c->top);
+    int x2 = c->right > width ? width : c->right < 0.0 ? 0 : (int)ceil(c->right);
+    int y2 = c->bottom > height ? height : c->bottom < 0.0 ? 0 : (int)ceil(c->bottom);
+    if (x1 < x2 && y1 < y2)
+        canvasDamageAdd(damage, count, DISPLAY_LIST_MAX_DAMAGE_RECTS, DISPLAY_LIST_COALESCING, x1, y1, x2, y2);
+}
+
+static int displayList_diff(DisplayList *this, DisplayList *previous, int width, int height, int *damage)
+{
+    int count = 0;
+    if (!previous)
+    {
+        if (width > 0 && height > 0)
+        {
+            damage[0] = damage[1] = 0;
+            damage[2] = width;
+            damage[3] = height;
+            count = 1;
+        }
+        return count;
+    }
+    /* the previous list's drawing calls, sorted by hash and then by position */
+    DisplayCommand *old = previous->private.commands;
+    size_t oldLength = previous->private.commandsLength;
+    DisplayItem *items = (DisplayItem *)malloc((oldLength + 1) * sizeof(DisplayItem));
+    unsigned char *matched = (unsigned char *)calloc(oldLength + 1, 1);
+    size_t itemsLength = 0;
+    for (size_t i = 0; i < oldLength; i++)
+        if (old[i].op < DISPLAY_CLIP)
+            items[itemsLength++] = (DisplayItem){old[i].hash, i};
+    qsort(items, itemsLength, sizeof(DisplayItem), item_compare);
+    /*
+     * Match each drawing call with the first unmatched one of the same hash after the last match,
+     * so matched calls are drawn in the same order in both lists. Pixels outside the unmatched
+     * calls' bounding boxes are then drawn by the same calls in the same order either way.
+     */
+    size_t last = 0;
+    int any = 0;
+    for (size_t i = 0; i < this->private.commandsLength; i++)
+    {
+        const DisplayCommand *c = this->private.commands + i;
+        if (c->op >= DISPLAY_CLIP)
+            continue;
+        size_t lo = 0, hi = itemsLength;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (items[mid].hash < c->hash || (items[mid].hash == c->hash && (any && items[mid].index <= last)))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < itemsLength && items[lo].hash == c->hash)
+        {
+            matched[items[lo].index] = 1;
+            last = items[lo].index;
+            any = 1;
+        }
+        else
+            damage_add(damage, &count, width, height, c);
+    }
+    for (size_t i = 0; i < oldLength; i++)
+        if (old[i].op < DISPLAY_CLIP && !matched[i])
+            damage_add(damage, &count, width, height, old + i);
+    free(items);
+    free(matched);
+    return count;
+}
+static void displayList_replayDamage(DisplayList *this, CanvasRenderingContext2D *ctx, const int *damage, int damageCount)
+{
+    if (damageCount <= 0)
+        return;
+    displayList_markLive(this, damage, damageCount);
+    ctx->save(ctx);
+    ctx->resetTransform(ctx);
+    ctx->beginPath(ctx);
+    for (int i = 0; i < damageCount; i++)
+        ctx->rect(ctx, damage[4 * i], damage[4 * i + 1], damage[4 * i + 2], damage[4 * i + 3]);
+    ctx->clip(ctx);
+    for (int i = 0; i < damageCount; i++)
+        ctx->clearRect(ctx, damage[4 * i], damage[4 * i + 1], damage[4 * i + 2], damage[4 * i + 3]);
+    /* start from the state recording started from */
+    ctx->beginPath(ctx);
+    ctx->setLineWidth(ctx, 1.0);
+    ctx->setLineCapEnum(ctx, LINE_CAP_BUTT);
+    ctx->setLineJoinEnum(ctx, LINE_JOIN_MITER);
+    ctx->setTextAlignEnum(ctx, TEXT_ALIGN_START);
+    ctx->setFont(ctx, "10px sans-serif");
+    ctx->setFillColor(ctx, 0x000000FF);
+    ctx->setStrokeColor(ctx, 0x000000FF);
+    ctx->setGlobalAlpha(ctx, 1.0);
+    ctx->setGlobalCompositeOperationEnum(ctx, COMPOSITE_SOURCE_OVER);
+    displayList_run(this, ctx, damage, damageCount);
+    ctx->restore(ctx);
+}
+/* End: DisplayList static methods */
+
+DisplayList *createDisplayList(void)
+{
+    DisplayList *list = (DisplayList *)calloc(1, sizeof(DisplayList));
+    CanvasRenderingContext2D *ctx = &list->private.context;
+    /* Begin: set pseudo-private fields */
+    list->private.states = (DisplayState *)grow(NULL, &list->private.statesCapacity, 1, sizeof(DisplayState));
+    list->private.scratch = (CanvasPath *)calloc(1, sizeof(CanvasPath));
+    list->private.edges = (CanvasEdgeList *)calloc(1, sizeof(CanvasEdgeList));
+    strcpy(ctx->private.contextType, "2d");
+    ctx->private.path = (CanvasPath *)calloc(1, sizeof(CanvasPath));
+    ctx->private.hitEdges = (CanvasEdgeList *)calloc(1, sizeof(CanvasEdgeList));
+    state_reset(list->private.states);
+    /* End: set pseudo-private fields */
+    ctx->clearRect = display2d_clearRect;
+    ctx->fillRect = display2d_fillRect;
+    ctx->strokeRect = display2d_strokeRect;
+    ctx->clearRects = display2d_clearRects;
+    ctx->fillRects = display2d_fillRects;
+    ctx->strokeRects = display2d_strokeRects;
+    ctx->fillRectsColored = display2d_fillRectsColored;
+    ctx->fillRectsTransformed = display2d_fillRectsTransformed;
+    ctx->putImageData = display2d_putImageData;
+    ctx->getImageData = display2d_getImageData;
+    ctx->putImageDataDirty = display2d_putImageDataDirty;
+    ctx->fillText = display2d_fillText;
+    ctx->strokeText = display2d_strokeText;
+    ctx->setLineWidth = display2d_setLineWidth;
+    ctx->getLineWidth = display2d_getLineWidth;
+    ctx->setLineCap = display2d_setLineCap;
+    ctx->getLineCap = display2d_getLineCap;
+    ctx->setLineCapEnum = display2d_setLineCapEnum;
+    ctx->getLineCapEnum = display2d_getLineCapEnum;
+    ctx->setLineJoin = display2d_setLineJoin;
+    ctx->getLineJoin = display2d_getLineJoin;
+    ctx->setLineJoinEnum = display2d_setLineJoinEnum;
+    ctx->getLineJoinEnum = display2d_getLineJoinEnum;
+    ctx->setFont = display2d_setFont;
+    ctx->getFont = display2d_getFont;
+    ctx->setTextAlign = display2d_setTextAlign;
+    ctx->getTextAlign = display2d_getTextAlign;
+    ctx->setTextAlignEnum = display2d_setTextAlignEnum;
+    ctx->getTextAlignEnum = display2d_getTextAlignEnum;
+    ctx->setFillStyle = display2d_setFillStyle;
+    ctx->getFillStyle = display2d_getFillStyle;
+    ctx->setStrokeStyle = display2d_setStrokeStyle;
+    ctx->getStrokeStyle = display2d_getStrokeStyle;
+    ctx->setFillColor = display2d_setFillColor;
+    ctx->setStrokeColor = display2d_setStrokeColor;
+    ctx->beginPath = display2d_beginPath;
+    ctx->closePath = display2d_closePath;
+    ctx->moveTo = display2d_moveTo;
+    ctx->lineTo = display2d_lineTo;
+    ctx->bezierCurveTo = display2d_bezierCurveTo;
+    ctx->quadraticCurveTo = display2d_quadraticCurveTo;
+    ctx->arc = display2d_arc;
+    ctx->arcTo = display2d_arcTo;
+    ctx->ellipse = display2d_ellipse;
+    ctx->rect = display2d_rect;
+    ctx->polyline = display2d_polyline;
+    ctx->polylines = display2d_polylines;
+    ctx->fill = display2d_fill;
+    ctx->stroke = display2d_stroke;
+    ctx->clip = display2d_clip;
+    ctx->isPointInPath = display2d_isPointInPath;
+    ctx->isPointInPathFillRule = display2d_isPointInPathFillRule;
+    ctx->isPointInStroke = display2d_isPointInStroke;
+    ctx->fillPath = display2d_fillPath;
+    ctx->strokePath = display2d_strokePath;
+    ctx->clipPath = display2d_clipPath;
+    ctx->isPointInPath2D = display2d_isPointInPath2D;
+    ctx->isPointInStroke2D = display2d_isPointInStroke2D;
+    ctx->rotate = display2d_rotate;
+    ctx->scale = display2d_scale;
+    ctx->translate = display2d_translate;
+    ctx->transform = display2d_transform;
+    ctx->setTransform = display2d_setTransform;
+    ctx->resetTransform = display2d_resetTransform;
+    ctx->getTransform = display2d_getTransform;
+    ctx->setGlobalAlpha = display2d_setGlobalAlpha;
+    ctx->getGlobalAlpha = display2d_getGlobalAlpha;
+    ctx->setGlobalCompositeOperation = display2d_setGlobalCompositeOperation;
+    ctx->getGlobalCompositeOperation = display2d_getGlobalCompositeOperation;
+    ctx->setGlobalCompositeOperationEnum = display2d_setGlobalCompositeOperationEnum;
+    ctx->getGlobalCompositeOperationEnum = display2d_getGlobalCompositeOperationEnum;
+    ctx->save = display2d_save;
+    ctx->restore = display2d_restore;
+    ctx->beginRecording = display2d_flush;
+    ctx->endRecording = display2d_flush;
+    ctx->flush = display2d_flush;
+    ctx->getCanvas = display2d_getCanvas;
+    list->getContext = displayList_getContext;
+    list->clear = displayList_clear;
+    list->replay = displayList_replay;
+    list->diff = displayList_diff;
+    list->replayDamage = displayList_replayDamage;
+    return list;
+}
+
+void freeDisplayList(DisplayList *list)
+{
+    CanvasRenderingContext2D *ctx = &list->private.context;
+    canvasPathFree(ctx->private.path);
+    free(ctx->private.path);
+    canvasEdgesFree(ctx->private.hitEdges);
+    free(ctx->private.hitEdges);
+    free(ctx->private.quads);
+    canvasPathFree(list->private.scratch);
+    free(list->private.scratch);
+    canvasEdgesFree(list->private.edges);
+    free(list->private.edges);
+    free(list->private.commands);
+    free(list->private.data);
+    free(list->private.states);
+    free(list->private.live);
+    free(list);
+}
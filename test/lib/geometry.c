@@ -0,0 +1,619 @@
+/**
+ * Flattened path geometry and hit testing, shared by the DOM and software backends.
+ * @file geometry.c
+ * @author Alex Tyner
+ */
+
+#include "geometry.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(PIXELS_NO_SIMD)
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define GEOMETRY_SIMD128
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GEOMETRY_SSE2
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+const CanvasMatrix canvasIdentityMatrix = {1.0, 0.0, 0.0, 1.0, 0.0, 0.0};
+
+/** Source of path revisions, so that no two path states ever share one. */
+static unsigned long lastRevision;
+
+static void *grow(void *array, size_t *capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity)
+        return array;
+    size_t newCapacity = *capacity ? *capacity : 64;
+    while (newCapacity < needed)
+        newCapacity *= 2;
+    *capacity = newCapacity;
+    CANVAS_STATS_ALLOCATIONS(1);
+    return realloc(array, newCapacity * size);
+}
+
+/* Begin: transforms */
+void canvasMatrixApply(const CanvasMatrix *m, double x, double y, double *dx, double *dy)
+{
+    *dx = m->a * x + m->c * y + m->e;
+    *dy = m->b * x + m->d * y + m->f;
+}
+
+void canvasMatrixMultiply(CanvasMatrix *m, double a, double b, double c, double d, double e, double f)
+{
+    CanvasMatrix r;
+    r.a = m->a * a + m->c * b;
+    r.b = m->b * a + m->d * b;
+    r.c = m->a * c + m->c * d;
+    r.d = m->b * c + m->d * d;
+    r.e = m->a * e + m->c * f + m->e;
+    r.f = m->b * e + m->d * f + m->f;
+    *m = r;
+}
+
+int canvasMatrixInvert(const CanvasMatrix *m, CanvasMatrix *inverse)
+{
+    double det = m->a * m->d - m->b * m->c;
+    if (det == 0.0 || !isfinite(det))
+        return 0;
+    inverse->a = m->d / det;
+    inverse->b = -m->b / det;
+    inverse->c = -m->c / det;
+    inverse->d = m->a / det;
+    inverse->e = (m->c * m->f - m->d * m->e) / det;
+    inverse->f = (m->b * m->e - m->a * m->f) / det;
+    return 1;
+}
+
+double canvasMatrixScale(const CanvasMatrix *m)
+{
+    return sqrt(fabs(m->a * m->d - m->b * m->c));
+}
+
+/*
+ * Points are interleaved (x0, y0, x1, y1, ...), so one 4-lane vector holds two of them. Multiplying
+ * it by (a, d, a, d), and the same vector with x and y swapped by (c, b, c, b), gives both products
+ * of each output coordinate in its own lane. The scalar code sums the products in the same order,
+ * so every implementation rounds identically.
+ */
+void canvasMatrixApplyPoints(const CanvasMatrix *m, const float *src, float *dst, size_t count)
+{
+    float a = (float)m->a, b = (float)m->b, c = (float)m->c, d = (float)m->d, e = (float)m->e, f = (float)m->f;
+    size_t i = 0;
+#if defined(GEOMETRY_SIMD128)
+    v128_t diagonal = wasm_f32x4_make(a, d, a, d);
+    v128_t skew = wasm_f32x4_make(c, b, c, b);
+    v128_t offset = wasm_f32x4_make(e, f, e, f);
+    for (; i + 2 <= count; i += 2)
+    {
+        v128_t xy = wasm_v128_load(src + 2 * i);
+        v128_t yx = wasm_i32x4_shuffle(xy, xy, 1, 0, 3, 2);
+        v128_t r = wasm_f32x4_add(wasm_f32x4_add(wasm_f32x4_mul(xy, diagonal), wasm_f32x4_mul(yx, skew)), offset);
+        wasm_v128_store(dst + 2 * i, r);
+    }
+#elif defined(GEOMETRY_SSE2)
+    __m128 diagonal = _mm_setr_ps(a, d, a, d);
+    __m128 skew = _mm_setr_ps(c, b, c, b);
+    __m128 offset = _mm_setr_ps(e, f, e, f);
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128 xy = _mm_loadu_ps(src + 2 * i);
+        __m128 yx = _mm_shuffle_ps(xy, xy, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xy, diagonal), _mm_mul_ps(yx, skew)), offset);
+        _mm_storeu_ps(dst + 2 * i, r);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float x = src[2 * i], y = src[2 * i + 1];
+        float px = a * x, py = d * y;
+        float sx = c * y, sy = b * x;
+        dst[2 * i] = (px + sx) + e;
+        dst[2 * i + 1] = (py + sy) + f;
+    }
+}
+
+void canvasMatrixApplyRects(const CanvasMatrix *ctm, const float *xywh, const float *matrices, size_t count, float *quads)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        CanvasMatrix m = *ctm;
+        if (matrices)
+        {
+            const float *t = matrices + 6 * i;
+            canvasMatrixMultiply(&m, t[0], t[1], t[2], t[3], t[4], t[5]);
+        }
+        float x = xywh[4 * i], y = xywh[4 * i + 1], w = xywh[4 * i + 2], h = xywh[4 * i + 3];
+        float *q = quads + 8 * i;
+        /* reversing a mirrored rectangle keeps every quad wound the same way */
+        if ((m.a * m.d - m.b * m.c) * w * h < 0.0)
+        {
+            float corners[8] = {x, y, x, y + h, x + w, y + h, x + w, y};
+            memcpy(q, corners, sizeof(corners));
+        }
+        else
+        {
+            float corners[8] = {x, y, x + w, y, x + w, y + h, x, y + h};
+            memcpy(q, corners, sizeof(corners));
+        }
+        canvasMatrixApplyPoints(&m, q, q, 4);
+    }
+}
+/* End: transforms */
+
+/* Begin: damage */
+void canvasDamageAdd(int *damage, int *count, int capacity, double coalescing, int x1, int y1, int x2, int y2)
+{
+    /* merge with every tracked rectangle the heuristic accepts, until no more merges happen */
+    for (int i = 0; i < *count;)
+    {
+        int *r = damage + 4 * i;
+        int ux1 = r[0] < x1 ? r[0] : x1;
+        int uy1 = r[1] < y1 ? r[1] : y1;
+        int ux2 = r[0] + r[2] > x2 ? r[0] + r[2] : x2;
+        int uy2 = r[1] + r[3] > y2 ? r[1] + r[3] : y2;
+        double unionArea = (double)(ux2 - ux1) * (uy2 - uy1);
+        double areas = (double)r[2] * r[3] + (double)(x2 - x1) * (y2 - y1);
+        if (unionArea <= coalescing * areas)
+        {
+            x1 = ux1, y1 = uy1, x2 = ux2, y2 = uy2;
+            memmove(r, r + 4, sizeof(int) * 4 * (--*count - i));
+            i = 0;
+        }
+        else
+            i++;
+    }
+    if (*count == capacity)
+    {
+        /* out of room; grow whichever rectangle grows the least and re-mark it, as it may now overlap others */
+        int best = 0;
+        double bestGrowth = -1.0;
+        for (int i = 0; i < *count; i++)
+        {
+            int *r = damage + 4 * i;
+            int ux1 = r[0] < x1 ? r[0] : x1;
+            int uy1 = r[1] < y1 ? r[1] : y1;
+            int ux2 = r[0] + r[2] > x2 ? r[0] + r[2] : x2;
+            int uy2 = r[1] + r[3] > y2 ? r[1] + r[3] : y2;
+            double growth = (double)(ux2 - ux1) * (uy2 - uy1) - (double)r[2] * r[3];
+            if (bestGrowth < 0.0 || growth < bestGrowth)
+                best = i, bestGrowth = growth;
+        }
+        int *r = damage + 4 * best;
+        int ux1 = r[0] < x1 ? r[0] : x1;
+        int uy1 = r[1] < y1 ? r[1] : y1;
+        int ux2 = r[0] + r[2] > x2 ? r[0] + r[2] : x2;
+        int uy2 = r[1] + r[3] > y2 ? r[1] + r[3] : y2;
+        memmove(r, r + 4, sizeof(int) * 4 * (--*count - best));
+        canvasDamageAdd(damage, count, capacity, coalescing, ux1, uy1, ux2, uy2);
+        return;
+    }
+    int *r = damage + 4 * (*count)++;
+    r[0] = x1;
+    r[1] = y1;
+    r[2] = x2 - x1;
+    r[3] = y2 - y1;
+}
+/* End: damage */
+
+/* Begin: paths */
+void canvasPathClear(CanvasPath *path)
+{
+    path->pointsLength = 0;
+    path->subpathsLength = 0;
+    path->revision = ++lastRevision;
+}
+
+void canvasPathFree(CanvasPath *path)
+{
+    free(path->points);
+    free(path->subpaths);
+}
+
+size_t canvasPathSubpathLength(const CanvasPath *path, size_t i)
+{
+    size_t end = i + 1 < path->subpathsLength ? path->subpaths[i + 1].start : path->pointsLength;
+    return end - path->subpaths[i].start;
+}
+
+int canvasPathCurrentPoint(const CanvasPath *path, double *x, double *y)
+{
+    if (!path->pointsLength)
+        return 0;
+    *x = path->points[2 * path->pointsLength - 2];
+    *y = path->points[2 * path->pointsLength - 1];
+    return 1;
+}
+
+static void path_moveTo(CanvasPath *path, double x, double y)
+{
+    path->subpaths = (CanvasSubpath *)grow(path->subpaths, &path->subpathsCapacity, path->subpathsLength + 1, sizeof(CanvasSubpath));
+    path->subpaths[path->subpathsLength].start = path->pointsLength;
+    path->subpaths[path->subpathsLength].closed = 0;
+    path->subpathsLength++;
+    path->points = (double *)grow(path->points, &path->pointsCapacity, 2 * (path->pointsLength + 1), sizeof(double));
+    path->points[2 * path->pointsLength] = x;
+    path->points[2 * path->pointsLength + 1] = y;
+    path->pointsLength++;
+    path->revision = ++lastRevision;
+}
+
+static void path_lineTo(CanvasPath *path, double x, double y)
+{
+    if (!path->subpathsLength)
+    {
+        path_moveTo(path, x, y);
+        return;
+    }
+    path->points = (double *)grow(path->points, &path->pointsCapacity, 2 * (path->pointsLength + 1), sizeof(double));
+    path->points[2 * path->pointsLength] = x;
+    path->points[2 * path->pointsLength + 1] = y;
+    path->pointsLength++;
+    path->revision = ++lastRevision;
+}
+
+void canvasPathMoveTo(CanvasPath *path, const CanvasMatrix *m, double x, double y)
+{
+    double dx, dy;
+    canvasMatrixApply(m, x, y, &dx, &dy);
+    path_moveTo(path, dx, dy);
+}
+
+void canvasPathLineTo(CanvasPath *path, const CanvasMatrix *m, double x, double y)
+{
+    double dx, dy;
+    canvasMatrixApply(m, x, y, &dx, &dy);
+    path_lineTo(path, dx, dy);
+}
+
+void canvasPathClose(CanvasPath *path)
+{
+    if (!path->subpathsLength)
+        return;
+    CanvasSubpath *subpath = &path->subpaths[path->subpathsLength - 1];
+    subpath->closed = 1;
+    path_moveTo(path, path->points[2 * subpath->start], path->points[2 * subpath->start + 1]);
+}
+
+void canvasPathBezierCurveTo(CanvasPath *path, const CanvasMatrix *m, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y)
+{
+    double x1, y1, x2, y2, x3, y3;
+    canvasMatrixApply(m, cp1x, cp1y, &x1, &y1);
+    canvasMatrixApply(m, cp2x, cp2y, &x2, &y2);
+    canvasMatrixApply(m, x, y, &x3, &y3);
+    if (!path->subpathsLength)
+        path_moveTo(path, x1, y1);
+    double x0 = path->points[2 * path->pointsLength - 2];
+    double y0 = path->points[2 * path->pointsLength - 1];
+    double dd = fmax(hypot(x0 - 2 * x1 + x2, y0 - 2 * y1 + y2), hypot(x1 - 2 * x2 + x3, y1 - 2 * y2 + y3));
+    int n = (int)ceil(sqrt(0.75 * dd / GEOMETRY_TOLERANCE));
+    n = n < 1 ? 1 : n > 1024 ? 1024 : n;
+    for (int i = 1; i <= n; i++)
+    {
+        double t = (double)i / n, u = 1.0 - t;
+        double a = u * u * u, b = 3 * u * u * t, c = 3 * u * t * t, d = t * t * t;
+        path_lineTo(path, a * x0 + b * x1 + c * x2 + d * x3, a * y0 + b * y1 + c * y2 + d * y3);
+    }
+}
+
+void canvasPathQuadraticCurveTo(CanvasPath *path, const CanvasMatrix *m, double cpx, double cpy, double x, double y)
+{
+    double x1, y1, x2, y2;
+    canvasMatrixApply(m, cpx, cpy, &x1, &y1);
+    canvasMatrixApply(m, x, y, &x2, &y2);
+    if (!path->subpathsLength)
+        path_moveTo(path, x1, y1);
+    double x0 = path->points[2 * path->pointsLength - 2];
+    double y0 = path->points[2 * path->pointsLength - 1];
+    double dd = hypot(x0 - 2 * x1 + x2, y0 - 2 * y1 + y2);
+    int n = (int)ceil(sqrt(0.25 * dd / GEOMETRY_TOLERANCE));
+    n = n < 1 ? 1 : n > 1024 ? 1024 : n;
+    for (int i = 1; i <= n; i++)
+    {
+        double t = (double)i / n, u = 1.0 - t;
+        path_lineTo(path, u * u * x0 + 2 * u * t * x1 + t * t * x2, u * u * y0 + 2 * u * t * y1 + t * t * y2);
+    }
+}
+
+/**
+ * Adds an elliptical arc, given in user space, sweeping the signed angle sweep from start. As in the
+ * browser, the arc is connected to the current point with a straight line if there is one.
+ */
+static void path_ellipse(CanvasPath *path, const CanvasMatrix *m, double x, double y, double radiusX, double radiusY, double rotation, double start, double sweep)
+{
+    double radius = fmax(radiusX, radiusY) * canvasMatrixScale(m);
+    double step = radius > GEOMETRY_TOLERANCE ? 2.0 * acos(1.0 - GEOMETRY_TOLERANCE / radius) : M_PI / 2.0;
+    int n = (int)ceil(fabs(sweep) / step);
+    n = n < 1 ? 1 : n > 4096 ? 4096 : n;
+    double cosRotation = cos(rotation), sinRotation = sin(rotation);
+    for (int i = 0; i <= n; i++)
+    {
+        double angle = start + sweep * i / n;
+        double ex = radiusX * cos(angle), ey = radiusY * sin(angle);
+        double dx, dy;
+        canvasMatrixApply(m, x + ex * cosRotation - ey * sinRotation, y + ex * sinRotation + ey * cosRotation, &dx, &dy);
+        if (i == 0 && !path->subpathsLength)
+            path_moveTo(path, dx, dy);
+        else
+            path_lineTo(path, dx, dy);
+    }
+}
+
+/** Returns the signed angle swept clockwise from startAngle to endAngle, as arc() and ellipse() draw it. */
+static double clockwiseSweep(double startAngle, double endAngle)
+{
+    if (endAngle - startAngle >= 2.0 * M_PI)
+        return 2.0 * M_PI;
+    double sweep = fmod(endAngle - startAngle, 2.0 * M_PI);
+    return sweep < 0.0 ? sweep + 2.0 * M_PI : sweep;
+}
+
+void canvasPathArc(CanvasPath *path, const CanvasMatrix *m, double x, double y, double radius, double startAngle, double endAngle)
+{
+    if (radius < 0.0)
+        return;
+    path_ellipse(path, m, x, y, radius, radius, 0.0, startAngle, clockwiseSweep(startAngle, endAngle));
+}
+
+void canvasPathArcTo(CanvasPath *path, const CanvasMatrix *m, double x1, double y1, double x2, double y2, double radius)
+{
+    CanvasMatrix inverse;
+    double x0, y0;
+    if (radius < 0.0)
+        return;
+    if (!path->subpathsLength)
+        canvasPathMoveTo(path, m, x1, y1);
+    if (!canvasMatrixInvert(m, &inverse))
+        return;
+    canvasMatrixApply(&inverse, path->points[2 * path->pointsLength - 2], path->points[2 * path->pointsLength - 1], &x0, &y0);
+    double dx0 = x0 - x1, dy0 = y0 - y1, dx1 = x2 - x1, dy1 = y2 - y1;
+    double length0 = hypot(dx0, dy0), length1 = hypot(dx1, dy1);
+    double cross = dx0 * dy1 - dy0 * dx1;
+    if (length0 == 0.0 || length1 == 0.0 || radius == 0.0 || fabs(cross) < 1e-12 * length0 * length1)
+    {
+        canvasPathLineTo(path, m, x1, y1);
+        return;
+    }
+    dx0 /= length0, dy0 /= length0, dx1 /= length1, dy1 /= length1;
+    double angle = acos(fmax(-1.0, fmin(1.0, dx0 * dx1 + dy0 * dy1)));
+    double tangent = radius / tan(angle / 2.0);
+    double bx = dx0 + dx1, by = dy0 + dy1, bisector = hypot(bx, by);
+    double centerDistance = radius / sin(angle / 2.0);
+    double cx = x1 + bx / bisector * centerDistance, cy = y1 + by / bisector * centerDistance;
+    double tx0 = x1 + dx0 * tangent, ty0 = y1 + dy0 * tangent;
+    double tx1 = x1 + dx1 * tangent, ty1 = y1 + dy1 * tangent;
+    double start = atan2(ty0 - cy, tx0 - cx), sweep = atan2(ty1 - cy, tx1 - cx) - start;
+    if (sweep > M_PI)
+        sweep -= 2.0 * M_PI;
+    else if (sweep < -M_PI)
+        sweep += 2.0 * M_PI;
+    canvasPathLineTo(path, m, tx0, ty0);
+    path_ellipse(path, m, cx, cy, radius, radius, 0.0, start, sweep);
+}
+
+void canvasPathEllipse(CanvasPath *path, const CanvasMatrix *m, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle)
+{
+    if (radiusX < 0.0 || radiusY < 0.0)
+        return;
+    path_ellipse(path, m, x, y, radiusX, radiusY, rotation, startAngle, clockwiseSweep(startAngle, endAngle));
+}
+
+void canvasPathRect(CanvasPath *path, const CanvasMatrix *m, double x, double y, double width, double height)
+{
+    canvasPathMoveTo(path, m, x, y);
+    canvasPathLineTo(path, m, x + width, y);
+    canvasPathLineTo(path, m, x + width, y + height);
+    canvasPathLineTo(path, m, x, y + height);
+    canvasPathClose(path);
+}
+
+void canvasPathPolyline(CanvasPath *path, const CanvasMatrix *m, const float *xy, size_t count, int closed)
+{
+    if (!count)
+        return;
+    canvasPathMoveTo(path, m, xy[0], xy[1]);
+    for (size_t i = 1; i < count; i++)
+        canvasPathLineTo(path, m, xy[2 * i], xy[2 * i + 1]);
+    if (closed)
+        canvasPathClose(path);
+}
+/* End: paths */
+
+/* Begin: edges */
+static void edges_add(CanvasEdgeList *list, double x0, double y0, double x1, double y1, int sign)
+{
+    if (y0 == y1 || !isfinite(x0 + y0 + x1 + y1))
+        return;
+    list->edges = (CanvasEdge *)grow(list->edges, &list->capacity, list->length + 1, sizeof(CanvasEdge));
+    CanvasEdge *e = &list->edges[list->length++];
+    if (y0 < y1)
+        *e = (CanvasEdge){x0, y0, x1, y1, sign};
+    else
+        *e = (CanvasEdge){x1, y1, x0, y0, -sign};
+    list->left = fmin(list->left, fmin(x0, x1));
+    list->right = fmax(list->right, fmax(x0, x1));
+    list->top = fmin(list->top, e->y0);
+    list->bottom = fmax(list->bottom, e->y1);
+}
+
+static void edges_reset(CanvasEdgeList *list, const CanvasPath *path, int stroked)
+{
+    list->length = 0;
+    list->left = list->top = INFINITY;
+    list->right = list->bottom = -INFINITY;
+    list->revision = path->revision;
+    list->stroked = stroked;
+}
+
+/** Adds the edges of a closed polygon, oriented so that every polygon added this way winds the same way. */
+static void edges_addPolygon(CanvasEdgeList *list, const double *points, int count)
+{
+    double area = 0.0;
+    for (int i = 0; i < count; i++)
+    {
+        int j = (i + 1) % count;
+        area += points[2 * i] * points[2 * j + 1] - points[2 * j] * points[2 * i + 1];
+    }
+    int sign = area < 0.0 ? -1 : 1;
+    for (int i = 0; i < count; i++)
+    {
+        int j = (i + 1) % count;
+        edges_add(list, points[2 * i], points[2 * i + 1], points[2 * j], points[2 * j + 1], sign);
+    }
+}
+
+static void edges_addCircle(CanvasEdgeList *list, double x, double y, double radius)
+{
+    double points[2 * 128];
+    int n = radius > GEOMETRY_TOLERANCE ? (int)ceil(M_PI / acos(1.0 - GEOMETRY_TOLERANCE / radius)) : 4;
+    n = n < 4 ? 4 : n > 128 ? 128 : n;
+    for (int i = 0; i < n; i++)
+    {
+        points[2 * i] = x + radius * cos(2.0 * M_PI * i / n);
+        points[2 * i + 1] = y + radius * sin(2.0 * M_PI * i / n);
+    }
+    edges_addPolygon(list, points, n);
+}
+
+static void edges_addJoin(CanvasEdgeList *list, double x, double y, double dx0, double dy0, double dx1, double dy1, double halfWidth, CanvasLineJoin join)
+{
+    double cross = dx0 * dy1 - dy0 * dx1;
+    double dot = dx0 * dx1 + dy0 * dy1;
+    if (fabs(cross) < 1e-12 && dot > 0.0)
+        return;
+    if (join == LINE_JOIN_ROUND)
+    {
+        edges_addCircle(list, x, y, halfWidth);
+        return;
+    }
+    /* only the outside of the turn needs filling in */
+    double side = cross > 0.0 ? -halfWidth : halfWidth;
+    double nx0 = -dy0 * side, ny0 = dx0 * side;
+    double nx1 = -dy1 * side, ny1 = dx1 * side;
+    if (join == LINE_JOIN_MITER)
+    {
+        double ux = nx0 + nx1, uy = ny0 + ny1;
+        double length = hypot(ux, uy);
+        if (length > 0.0)
+        {
+            ux /= length, uy /= length;
+            double cosHalf = (ux * nx0 + uy * ny0) / halfWidth;
+            if (cosHalf > 0.0 && 1.0 / cosHalf <= GEOMETRY_MITER_LIMIT)
+            {
+                double miter = halfWidth / cosHalf;
+                double points[] = {x, y, x + nx0, y + ny0, x + ux * miter, y + uy * miter, x + nx1, y + ny1};
+                edges_addPolygon(list, points, 4);
+                return;
+            }
+        }
+    }
+    double points[] = {x, y, x + nx0, y + ny0, x + nx1, y + ny1};
+    edges_addPolygon(list, points, 3);
+}
+
+void canvasEdgesFill(CanvasEdgeList *list, const CanvasPath *path)
+{
+    if (list->revision == path->revision && !list->stroked)
+        return;
+    edges_reset(list, path, 0);
+    for (size_t i = 0; i < path->subpathsLength; i++)
+    {
+        const double *p = path->points + 2 * path->subpaths[i].start;
+        size_t n = canvasPathSubpathLength(path, i);
+        for (size_t j = 0; j < n; j++)
+        {
+            size_t k = (j + 1) % n;
+            edges_add(list, p[2 * j], p[2 * j + 1], p[2 * k], p[2 * k + 1], 1);
+        }
+    }
+}
+
+void canvasEdgesStroke(CanvasEdgeList *list, const CanvasPath *path, const CanvasState *state)
+{
+    double halfWidth = state->lineWidth * canvasMatrixScale(&state->transform) / 2.0;
+    if (list->revision == path->revision && list->stroked && list->halfWidth == halfWidth &&
+        list->lineCap == state->lineCap && list->lineJoin == state->lineJoin)
+        return;
+    edges_reset(list, path, 1);
+    list->halfWidth = halfWidth;
+    list->lineCap = state->lineCap;
+    list->lineJoin = state->lineJoin;
+    if (!(halfWidth > 0.0))
+        return;
+    for (size_t i = 0; i < path->subpathsLength; i++)
+    {
+        const double *p = path->points + 2 * path->subpaths[i].start;
+        size_t length = canvasPathSubpathLength(path, i);
+        int closed = path->subpaths[i].closed;
+        /* drop repeated points, which have no direction */
+        size_t n = 0;
+        list->vertices = (size_t *)grow(list->vertices, &list->verticesCapacity, length, sizeof(size_t));
+        size_t *vertices = list->vertices;
+        for (size_t j = 0; j < length; j++)
+            if (n == 0 || p[2 * j] != p[2 * vertices[n - 1]] || p[2 * j + 1] != p[2 * vertices[n - 1] + 1])
+                vertices[n++] = j;
+        if (closed && n > 1 && p[2 * vertices[0]] == p[2 * vertices[n - 1]] && p[2 * vertices[0] + 1] == p[2 * vertices[n - 1] + 1])
+            n--;
+        if (n < 2)
+            continue;
+        size_t segments = closed ? n : n - 1;
+        for (size_t j = 0; j < segments; j++)
+        {
+            double ax = p[2 * vertices[j]], ay = p[2 * vertices[j] + 1];
+            double bx = p[2 * vertices[(j + 1) % n]], by = p[2 * vertices[(j + 1) % n] + 1];
+            double length = hypot(bx - ax, by - ay);
+            double dx = (bx - ax) / length, dy = (by - ay) / length;
+            if (!closed && state->lineCap == LINE_CAP_SQUARE)
+            {
+                if (j == 0)
+                    ax -= dx * halfWidth, ay -= dy * halfWidth;
+                if (j == segments - 1)
+                    bx += dx * halfWidth, by += dy * halfWidth;
+            }
+            double nx = -dy * halfWidth, ny = dx * halfWidth;
+            double quad[] = {ax + nx, ay + ny, bx + nx, by + ny, bx - nx, by - ny, ax - nx, ay - ny};
+            edges_addPolygon(list, quad, 4);
+        }
+        for (size_t j = closed ? 0 : 1; j < (closed ? n : n - 1); j++)
+        {
+            size_t previous = vertices[(j + n - 1) % n], vertex = vertices[j], next = vertices[(j + 1) % n];
+            double x = p[2 * vertex], y = p[2 * vertex + 1];
+            double dx0 = x - p[2 * previous], dy0 = y - p[2 * previous + 1];
+            double dx1 = p[2 * next] - x, dy1 = p[2 * next + 1] - y;
+            double length0 = hypot(dx0, dy0), length1 = hypot(dx1, dy1);
+            edges_addJoin(list, x, y, dx0 / length0, dy0 / length0, dx1 / length1, dy1 / length1, halfWidth, state->lineJoin);
+        }
+        if (!closed && state->lineCap == LINE_CAP_ROUND)
+        {
+            edges_addCircle(list, p[2 * vertices[0]], p[2 * vertices[0] + 1], halfWidth);
+            edges_addCircle(list, p[2 * vertices[n - 1]], p[2 * vertices[n - 1] + 1], halfWidth);
+        }
+    }
+}
+
+int canvasEdgesContain(const CanvasEdgeList *list, double x, double y, CanvasFillRule fillRule)
+{
+    if (x < list->left || x > list->right || y < list->top || y >= list->bottom)
+        return 0;
+    int winding = 0;
+    for (size_t i = 0; i < list->length; i++)
+    {
+        const CanvasEdge *e = &list->edges[i];
+        if (e->y0 <= y && y < e->y1 && e->x0 + (y - e->y0) * (e->x1 - e->x0) / (e->y1 - e->y0) > x)
+            winding += e->direction;
+    }
+    return fillRule == FILL_RULE_EVENODD ? winding & 1 : winding != 0;
+}
+
+void canvasEdgesFree(CanvasEdgeList *list)
+{
+    free(list->edges);
+    free(list->vertices);
+}
+/* End: edges */
@@ -0,0 +1,146 @@
+/**
+ * Path geometry shared by the backends: transforms, paths flattened to line segments in device
+ * space, and the polygon edges of filled and stroked areas. The software backend rasterizes these
+ * edges; DOM contexts keep the same geometry alongside the browser's so isPointInPath() and
+ * isPointInStroke() can be answered without calling into JavaScript.
+ * @brief Flattened path geometry and hit testing
+ * @file geometry.h
+ * @author Alex Tyner
+ */
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "canvas.h"
+
+/** Maximum distance, in device pixels, between a curve and the line segments approximating it. */
+#define GEOMETRY_TOLERANCE 0.25
+/** Longest miter, relative to half the line width, drawn before a miter join falls back to a bevel. */
+#define GEOMETRY_MITER_LIMIT 10.0
+
+extern const CanvasMatrix canvasIdentityMatrix;
+
+void canvasMatrixApply(const CanvasMatrix *m, double x, double y, double *dx, double *dy);
+/** Post-multiplies m by the given matrix, as CanvasRenderingContext2D.transform() does. */
+void canvasMatrixMultiply(CanvasMatrix *m, double a, double b, double c, double d, double e, double f);
+/** Stores the inverse of m in inverse and returns non-zero, or returns zero if m can't be inverted. */
+int canvasMatrixInvert(const CanvasMatrix *m, CanvasMatrix *inverse);
+/** Average factor by which m scales lengths. */
+double canvasMatrixScale(const CanvasMatrix *m);
+/**
+ * Transforms count (x, y) float pairs from src by m into dst, which may be src. Two points are
+ * transformed at a time with wasm SIMD128 or SSE2 unless PIXELS_NO_SIMD is defined, as for the
+ * pixel kernels; every implementation gives identical results.
+ */
+void canvasMatrixApplyPoints(const CanvasMatrix *m, const float *src, float *dst, size_t count);
+/**
+ * Stores the device space corners of count (x, y, width, height) rectangles in quads, 8 floats
+ * each. Rectangle i is transformed by ctm multiplied by the 6 floats (a, b, c, d, e, f) at
+ * matrices + 6 * i, or by ctm alone if matrices is NULL. All quads wind the same way, so
+ * overlapping ones unite under the nonzero rule.
+ */
+void canvasMatrixApplyRects(const CanvasMatrix *ctm, const float *xywh, const float *matrices, size_t count, float *quads);
+
+/**
+ * Adds the rectangle from (x1, y1) up to (x2, y2) to the count rectangles in damage, stored as
+ * (x, y, width, height). It is merged with every tracked rectangle whose bounding box with it has
+ * at most coalescing times their combined area. Once capacity rectangles are tracked, it is merged
+ * into whichever grows the least instead. ImageData.markDirty() and DisplayList diff() use this.
+ */
+void canvasDamageAdd(int *damage, int *count, int capacity, double coalescing, int x1, int y1, int x2, int y2);
+
+typedef struct CanvasSubpath
+{
+    size_t start;
+    int closed;
+} CanvasSubpath;
+
+/**
+ * A path flattened to line segments in device space. The path functions below take their
+ * coordinates in user space along with the transform to apply, just like the context methods.
+ */
+struct CanvasPath
+{
+    double *points;
+    size_t pointsLength;
+    size_t pointsCapacity;
+    CanvasSubpath *subpaths;
+    size_t subpathsLength;
+    size_t subpathsCapacity;
+    /** changes whenever the path does, and is never shared with another path */
+    unsigned long revision;
+};
+
+void canvasPathClear(CanvasPath *path);
+void canvasPathFree(CanvasPath *path);
+/** Number of points in subpath i of path. */
+size_t canvasPathSubpathLength(const CanvasPath *path, size_t i);
+/** Returns non-zero and stores the last point, in device space, if path has one. */
+int canvasPathCurrentPoint(const CanvasPath *path, double *x, double *y);
+void canvasPathMoveTo(CanvasPath *path, const CanvasMatrix *m, double x, double y);
+void canvasPathLineTo(CanvasPath *path, const CanvasMatrix *m, double x, double y);
+/** Closes the current subpath and, as in the browser, starts a new one at its first point. */
+void canvasPathClose(CanvasPath *path);
+void canvasPathBezierCurveTo(CanvasPath *path, const CanvasMatrix *m, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y);
+void canvasPathQuadraticCurveTo(CanvasPath *path, const CanvasMatrix *m, double cpx, double cpy, double x, double y);
+void canvasPathArc(CanvasPath *path, const CanvasMatrix *m, double x, double y, double radius, double startAngle, double endAngle);
+void canvasPathArcTo(CanvasPath *path, const CanvasMatrix *m, double x1, double y1, double x2, double y2, double radius);
+void canvasPathEllipse(CanvasPath *path, const CanvasMatrix *m, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle);
+void canvasPathRect(CanvasPath *path, const CanvasMatrix *m, double x, double y, double width, double height);
+/** Adds a polyline through count (x, y) float pairs, closed if closed is non-zero. */
+void canvasPathPolyline(CanvasPath *path, const CanvasMatrix *m, const float *xy, size_t count, int closed);
+
+/** A non-horizontal polygon edge with y0 < y1; direction is +1 if the polygon runs downward along it. */
+typedef struct CanvasEdge
+{
+    double x0, y0, x1, y1;
+    int direction;
+} CanvasEdge;
+
+/**
+ * The edges bounding a filled or stroked area, with their bounding box. Lists remember what they
+ * were built from, so building the same list from an unchanged path again costs nothing.
+ */
+struct CanvasEdgeList
+{
+    CanvasEdge *edges;
+    size_t length;
+    size_t capacity;
+    double left, top, right, bottom;
+    /* what the edges were last built from */
+    unsigned long revision;
+    int stroked;
+    double halfWidth;
+    CanvasLineCap lineCap;
+    CanvasLineJoin lineJoin;
+    /* scratch space for the vertices of each subpath stroked, kept between rebuilds */
+    size_t *vertices;
+    size_t verticesCapacity;
+};
+
+/** Collects the edges of the area filled by path; every subpath is implicitly closed. */
+void canvasEdgesFill(CanvasEdgeList *list, const CanvasPath *path);
+/**
+ * Collects the edges of the area covered by stroking path with the line width, cap and join of
+ * state, the width scaled by the average scale of state's transform. The pieces of the outline all
+ * wind the same way, so they unite under the nonzero rule.
+ */
+void canvasEdgesStroke(CanvasEdgeList *list, const CanvasPath *path, const CanvasState *state);
+/** Returns non-zero if the device space point (x, y) lies within the edges, rejecting points outside their bounding box first. */
+int canvasEdgesContain(const CanvasEdgeList *list, double x, double y, CanvasFillRule fillRule);
+void canvasEdgesFree(CanvasEdgeList *list);
+
+/**
+ * Flattens path with the transform m, caching the result in the Path2D until either changes.
+ * These are defined with the rest of Path2D in canvas.c.
+ */
+const CanvasPath *canvasPath2DFlatten(Path2D *path, const CanvasMatrix *m);
+/** Returns the edges of path filled with the transform m, cached in the Path2D apart from its stroke. */
+const CanvasEdgeList *canvasPath2DFillEdges(Path2D *path, const CanvasMatrix *m);
+/** Returns the edges of path stroked as state describes, cached until the path, width, cap or join change. */
+const CanvasEdgeList *canvasPath2DStrokeEdges(Path2D *path, const CanvasState *state);
+/** Returns non-zero if the device space point (x, y) lies within path filled with the transform m. */
+int canvasPath2DContains(Path2D *path, const CanvasMatrix *m, double x, double y, CanvasFillRule fillRule);
+/** Returns non-zero if the device space point (x, y) lies within path stroked as state describes. */
+int canvasPath2DStrokeContains(Path2D *path, const CanvasState *state, double x, double y);
+
+#endif
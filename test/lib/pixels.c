@@ -0,0 +1,474 @@
+/**
+ * Vectorized RGBA span kernels, with scalar fallbacks.
+ * @file pixels.c
+ * @author Alex Tyner
+ */
+
+#include "pixels.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(PIXELS_NO_SIMD)
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define PIXELS_SIMD128
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define PIXELS_AVX2
+#define PIXELS_SSE2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PIXELS_SSE2
+#endif
+
+#if defined(PIXELS_SIMD128)
+const char *const pixelsImplementation = "simd128";
+#elif defined(PIXELS_AVX2)
+const char *const pixelsImplementation = "avx2";
+#elif defined(PIXELS_SSE2)
+const char *const pixelsImplementation = "sse2";
+#else
+const char *const pixelsImplementation = "scalar";
+#endif
+
+/* Begin: scalar kernels, which also finish the spans left over by the vector kernels */
+/** Divides by 255, rounding to nearest, for any value up to 255 * 255 + 255. */
+static unsigned div255(unsigned value)
+{
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+static void scalar_fillSpan(unsigned char *dst, const unsigned char rgba[4], size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        memcpy(dst + 4 * i, rgba, 4);
+}
+
+/** Blends the premultiplied pixel s, its opacity scaled by k, over the pixel d. */
+static void scalar_blend(unsigned char *d, const unsigned char *s, unsigned k)
+{
+    unsigned sa = div255(s[3] * k);
+    d[0] = div255(s[0] * k) + div255(d[0] * (255 - sa));
+    d[1] = div255(s[1] * k) + div255(d[1] * (255 - sa));
+    d[2] = div255(s[2] * k) + div255(d[2] * (255 - sa));
+    d[3] = sa + div255(d[3] * (255 - sa));
+}
+
+static void scalar_sourceOver(unsigned char *dst, const unsigned char *src, unsigned alpha, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        scalar_blend(dst + 4 * i, src + 4 * i, alpha);
+}
+
+static void scalar_sourceOverMask(unsigned char *dst, const unsigned char rgba[4], const unsigned char *mask, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        if (mask[i])
+            scalar_blend(dst + 4 * i, rgba, mask[i]);
+}
+
+static void scalar_premultiply(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char *s = src + 4 * i;
+        unsigned char *d = dst + 4 * i;
+        unsigned a = s[3];
+        d[0] = div255(s[0] * a);
+        d[1] = div255(s[1] * a);
+        d[2] = div255(s[2] * a);
+        d[3] = a;
+    }
+}
+
+static void scalar_unpremultiply(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char *s = src + 4 * i;
+        unsigned char *d = dst + 4 * i;
+        unsigned a = s[3];
+        for (int c = 0; c < 3; c++)
+        {
+            unsigned value = a ? (s[c] * 255 + a / 2) / a : 0;
+            d[c] = value > 255 ? 255 : value;
+        }
+        d[3] = a;
+    }
+}
+/* End: scalar kernels */
+
+#if defined(PIXELS_SIMD128) || defined(PIXELS_SSE2)
+/** Packs a color into four 16-bit lanes, red lowest, matching pixels widened from memory. */
+static int64_t widen(const unsigned char rgba[4])
+{
+    return (int64_t)rgba[0] | (int64_t)rgba[1] << 16 | (int64_t)rgba[2] << 32 | (int64_t)rgba[3] << 48;
+}
+
+/** Replicates each mask byte across the four channels of its pixel. */
+#define SPREAD(m) ((int)((uint32_t)(m)*0x01010101u))
+#endif
+
+#if defined(PIXELS_SSE2)
+/* Begin: SSE2 kernels, which blend two pixels per vector of 16-bit lanes */
+static __m128i sse2_div255(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+static __m128i sse2_blend(__m128i d, __m128i s, __m128i k)
+{
+    s = sse2_div255(_mm_mullo_epi16(s, k));
+    __m128i sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), sa);
+    return _mm_add_epi16(s, sse2_div255(_mm_mullo_epi16(d, inverse)));
+}
+
+static size_t sse2_sourceOverMask(unsigned char *dst, const unsigned char rgba[4], const unsigned char *mask, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i color = _mm_set1_epi64x(widen(rgba));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32_t m;
+        memcpy(&m, mask + i, 4);
+        if (!m)
+            continue;
+        __m128i k = _mm_set_epi32(SPREAD(mask[i + 3]), SPREAD(mask[i + 2]), SPREAD(mask[i + 1]), SPREAD(mask[i]));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + 4 * i));
+        __m128i lo = sse2_blend(_mm_unpacklo_epi8(d, zero), color, _mm_unpacklo_epi8(k, zero));
+        __m128i hi = sse2_blend(_mm_unpackhi_epi8(d, zero), color, _mm_unpackhi_epi8(k, zero));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+static size_t sse2_sourceOver(unsigned char *dst, const unsigned char *src, unsigned alpha, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i k = _mm_set1_epi16((short)alpha);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + 4 * i));
+        __m128i lo = sse2_blend(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), k);
+        __m128i hi = sse2_blend(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), k);
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+static __m128i sse2_premultiplyLanes(__m128i s)
+{
+    /* alpha is multiplied by 255, which leaves it unchanged */
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m128i k = _mm_or_si128(a, _mm_set1_epi64x((int64_t)255 << 48));
+    return sse2_div255(_mm_mullo_epi16(s, k));
+}
+
+static size_t sse2_premultiply(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        __m128i lo = sse2_premultiplyLanes(_mm_unpacklo_epi8(s, zero));
+        __m128i hi = sse2_premultiplyLanes(_mm_unpackhi_epi8(s, zero));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+    }
+    return i;
+}
+
+/** Unpremultiplies one pixel held in four 32-bit lanes. The float division is exact after truncation. */
+static __m128i sse2_unpremultiplyPixel(__m128i s)
+{
+    const __m128 alphaLane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    __m128i ai = _mm_shuffle_epi32(s, 0xFF);
+    __m128 a = _mm_cvtepi32_ps(ai);
+    __m128 n = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(255.0f)), _mm_cvtepi32_ps(_mm_srli_epi32(ai, 1)));
+    __m128 q = _mm_min_ps(_mm_div_ps(n, a), _mm_set1_ps(255.0f));
+    q = _mm_and_ps(q, _mm_cmpneq_ps(a, _mm_setzero_ps()));
+    q = _mm_or_ps(_mm_andnot_ps(alphaLane, q), _mm_and_ps(alphaLane, a));
+    return _mm_cvttps_epi32(q);
+}
+
+static size_t sse2_unpremultiply(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+        __m128i lo = _mm_unpacklo_epi8(s, zero);
+        __m128i hi = _mm_unpackhi_epi8(s, zero);
+        __m128i p0 = sse2_unpremultiplyPixel(_mm_unpacklo_epi16(lo, zero));
+        __m128i p1 = sse2_unpremultiplyPixel(_mm_unpackhi_epi16(lo, zero));
+        __m128i p2 = sse2_unpremultiplyPixel(_mm_unpacklo_epi16(hi, zero));
+        __m128i p3 = sse2_unpremultiplyPixel(_mm_unpackhi_epi16(hi, zero));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3)));
+    }
+    return i;
+}
+/* End: SSE2 kernels */
+#endif
+
+#if defined(PIXELS_AVX2)
+/* Begin: AVX2 kernels, which blend four pixels per vector; lanes are unpacked and packed in place */
+static __m256i avx2_div255(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+static __m256i avx2_blend(__m256i d, __m256i s, __m256i k)
+{
+    s = avx2_div255(_mm256_mullo_epi16(s, k));
+    __m256i sa = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), sa);
+    return _mm256_add_epi16(s, avx2_div255(_mm256_mullo_epi16(d, inverse)));
+}
+
+static size_t avx2_sourceOverMask(unsigned char *dst, const unsigned char rgba[4], const unsigned char *mask, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i color = _mm256_set1_epi64x(widen(rgba));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint64_t m;
+        memcpy(&m, mask + i, 8);
+        if (!m)
+            continue;
+        __m256i k = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(mask + i))), _mm256_set1_epi32(0x01010101));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + 4 * i));
+        __m256i lo = avx2_blend(_mm256_unpacklo_epi8(d, zero), color, _mm256_unpacklo_epi8(k, zero));
+        __m256i hi = avx2_blend(_mm256_unpackhi_epi8(d, zero), color, _mm256_unpackhi_epi8(k, zero));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i), _mm256_packus_epi16(lo, hi));
+    }
+    return i + sse2_sourceOverMask(dst + 4 * i, rgba, mask + i, count - i);
+}
+
+static size_t avx2_sourceOver(unsigned char *dst, const unsigned char *src, unsigned alpha, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i k = _mm256_set1_epi16((short)alpha);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + 4 * i));
+        __m256i lo = avx2_blend(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), k);
+        __m256i hi = avx2_blend(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), k);
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i), _mm256_packus_epi16(lo, hi));
+    }
+    return i + sse2_sourceOver(dst + 4 * i, src + 4 * i, alpha, count - i);
+}
+
+static __m256i avx2_premultiplyLanes(__m256i s)
+{
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m256i k = _mm256_or_si256(a, _mm256_set1_epi64x((int64_t)255 << 48));
+    return avx2_div255(_mm256_mullo_epi16(s, k));
+}
+
+static size_t avx2_premultiply(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+        __m256i lo = avx2_premultiplyLanes(_mm256_unpacklo_epi8(s, zero));
+        __m256i hi = avx2_premultiplyLanes(_mm256_unpackhi_epi8(s, zero));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i), _mm256_packus_epi16(lo, hi));
+    }
+    return i + sse2_premultiply(dst + 4 * i, src + 4 * i, count - i);
+}
+/* End: AVX2 kernels */
+#endif
+
+#if defined(PIXELS_SIMD128)
+/* Begin: wasm SIMD128 kernels, which blend two pixels per vector of 16-bit lanes */
+static v128_t simd128_div255(v128_t x)
+{
+    x = wasm_i16x8_add(x, wasm_i16x8_splat(128));
+    return wasm_u16x8_shr(wasm_i16x8_add(x, wasm_u16x8_shr(x, 8)), 8);
+}
+
+static v128_t simd128_blend(v128_t d, v128_t s, v128_t k)
+{
+    s = simd128_div255(wasm_i16x8_mul(s, k));
+    v128_t sa = wasm_i16x8_shuffle(s, s, 3, 3, 3, 3, 7, 7, 7, 7);
+    v128_t inverse = wasm_i16x8_sub(wasm_i16x8_splat(255), sa);
+    return wasm_i16x8_add(s, simd128_div255(wasm_i16x8_mul(d, inverse)));
+}
+
+static size_t simd128_sourceOverMask(unsigned char *dst, const unsigned char rgba[4], const unsigned char *mask, size_t count)
+{
+    const v128_t color = wasm_i64x2_splat(widen(rgba));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32_t m;
+        memcpy(&m, mask + i, 4);
+        if (!m)
+            continue;
+        v128_t k = wasm_i32x4_make(SPREAD(mask[i]), SPREAD(mask[i + 1]), SPREAD(mask[i + 2]), SPREAD(mask[i + 3]));
+        v128_t d = wasm_v128_load(dst + 4 * i);
+        v128_t lo = simd128_blend(wasm_u16x8_extend_low_u8x16(d), color, wasm_u16x8_extend_low_u8x16(k));
+        v128_t hi = simd128_blend(wasm_u16x8_extend_high_u8x16(d), color, wasm_u16x8_extend_high_u8x16(k));
+        wasm_v128_store(dst + 4 * i, wasm_u8x16_narrow_i16x8(lo, hi));
+    }
+    return i;
+}
+
+static size_t simd128_sourceOver(unsigned char *dst, const unsigned char *src, unsigned alpha, size_t count)
+{
+    const v128_t k = wasm_i16x8_splat((short)alpha);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        v128_t s = wasm_v128_load(src + 4 * i);
+        v128_t d = wasm_v128_load(dst + 4 * i);
+        v128_t lo = simd128_blend(wasm_u16x8_extend_low_u8x16(d), wasm_u16x8_extend_low_u8x16(s), k);
+        v128_t hi = simd128_blend(wasm_u16x8_extend_high_u8x16(d), wasm_u16x8_extend_high_u8x16(s), k);
+        wasm_v128_store(dst + 4 * i, wasm_u8x16_narrow_i16x8(lo, hi));
+    }
+    return i;
+}
+
+static v128_t simd128_premultiplyLanes(v128_t s)
+{
+    /* alpha is multiplied by 255, which leaves it unchanged */
+    v128_t a = wasm_i16x8_shuffle(s, s, 3, 3, 3, 3, 7, 7, 7, 7);
+    v128_t k = wasm_v128_or(a, wasm_i64x2_splat((int64_t)255 << 48));
+    return simd128_div255(wasm_i16x8_mul(s, k));
+}
+
+static size_t simd128_premultiply(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        v128_t s = wasm_v128_load(src + 4 * i);
+        v128_t lo = simd128_premultiplyLanes(wasm_u16x8_extend_low_u8x16(s));
+        v128_t hi = simd128_premultiplyLanes(wasm_u16x8_extend_high_u8x16(s));
+        wasm_v128_store(dst + 4 * i, wasm_u8x16_narrow_i16x8(lo, hi));
+    }
+    return i;
+}
+
+/** Unpremultiplies one pixel held in four 32-bit lanes. The float division is exact after truncation. */
+static v128_t simd128_unpremultiplyPixel(v128_t s)
+{
+    const v128_t alphaLane = wasm_i32x4_make(0, 0, 0, -1);
+    v128_t ai = wasm_i32x4_shuffle(s, s, 3, 3, 3, 3);
+    v128_t a = wasm_f32x4_convert_i32x4(ai);
+    v128_t n = wasm_f32x4_add(wasm_f32x4_mul(wasm_f32x4_convert_i32x4(s), wasm_f32x4_splat(255.0f)), wasm_f32x4_convert_i32x4(wasm_u32x4_shr(ai, 1)));
+    v128_t q = wasm_f32x4_min(wasm_f32x4_div(n, a), wasm_f32x4_splat(255.0f));
+    q = wasm_v128_and(q, wasm_f32x4_ne(a, wasm_f32x4_splat(0.0f)));
+    return wasm_v128_bitselect(ai, wasm_i32x4_trunc_sat_f32x4(q), alphaLane);
+}
+
+static size_t simd128_unpremultiply(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        v128_t s = wasm_v128_load(src + 4 * i);
+        v128_t lo = wasm_u16x8_extend_low_u8x16(s);
+        v128_t hi = wasm_u16x8_extend_high_u8x16(s);
+        v128_t p0 = simd128_unpremultiplyPixel(wasm_u32x4_extend_low_u16x8(lo));
+        v128_t p1 = simd128_unpremultiplyPixel(wasm_u32x4_extend_high_u16x8(lo));
+        v128_t p2 = simd128_unpremultiplyPixel(wasm_u32x4_extend_low_u16x8(hi));
+        v128_t p3 = simd128_unpremultiplyPixel(wasm_u32x4_extend_high_u16x8(hi));
+        wasm_v128_store(dst + 4 * i, wasm_u8x16_narrow_i16x8(wasm_i16x8_narrow_i32x4(p0, p1), wasm_i16x8_narrow_i32x4(p2, p3)));
+    }
+    return i;
+}
+/* End: wasm SIMD128 kernels */
+#endif
+
+/* Begin: dispatch, each vector kernel returning how many pixels it handled */
+void pixelsFillSpan(unsigned char *dst, const unsigned char rgba[4], size_t count)
+{
+    size_t i = 0;
+#if defined(PIXELS_SIMD128)
+    uint32_t pixel;
+    memcpy(&pixel, rgba, 4);
+    const v128_t v = wasm_i32x4_splat((int)pixel);
+    for (; i + 4 <= count; i += 4)
+        wasm_v128_store(dst + 4 * i, v);
+#elif defined(PIXELS_AVX2)
+    uint32_t pixel;
+    memcpy(&pixel, rgba, 4);
+    const __m256i v = _mm256_set1_epi32((int)pixel);
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i), v);
+#elif defined(PIXELS_SSE2)
+    uint32_t pixel;
+    memcpy(&pixel, rgba, 4);
+    const __m128i v = _mm_set1_epi32((int)pixel);
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), v);
+#endif
+    scalar_fillSpan(dst + 4 * i, rgba, count - i);
+}
+
+void pixelsSourceOver(unsigned char *dst, const unsigned char *src, unsigned alpha, size_t count)
+{
+    size_t i = 0;
+    if (alpha == 0)
+        return;
+#if defined(PIXELS_SIMD128)
+    i = simd128_sourceOver(dst, src, alpha, count);
+#elif defined(PIXELS_AVX2)
+    i = avx2_sourceOver(dst, src, alpha, count);
+#elif defined(PIXELS_SSE2)
+    i = sse2_sourceOver(dst, src, alpha, count);
+#endif
+    scalar_sourceOver(dst + 4 * i, src + 4 * i, alpha, count - i);
+}
+
+void pixelsSourceOverMask(unsigned char *dst, const unsigned char rgba[4], const unsigned char *mask, size_t count)
+{
+    size_t i = 0;
+#if defined(PIXELS_SIMD128)
+    i = simd128_sourceOverMask(dst, rgba, mask, count);
+#elif defined(PIXELS_AVX2)
+    i = avx2_sourceOverMask(dst, rgba, mask, count);
+#elif defined(PIXELS_SSE2)
+    i = sse2_sourceOverMask(dst, rgba, mask, count);
+#endif
+    scalar_sourceOverMask(dst + 4 * i, rgba, mask + i, count - i);
+}
+
+void pixelsPremultiply(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    size_t i = 0;
+#if defined(PIXELS_SIMD128)
+    i = simd128_premultiply(dst, src, count);
+#elif defined(PIXELS_AVX2)
+    i = avx2_premultiply(dst, src, count);
+#elif defined(PIXELS_SSE2)
+    i = sse2_premultiply(dst, src, count);
+#endif
+    scalar_premultiply(dst + 4 * i, src + 4 * i, count - i);
+}
+
+void pixelsUnpremultiply(unsigned char *dst, const unsigned char *src, size_t count)
+{
+    size_t i = 0;
+#if defined(PIXELS_SIMD128)
+    i = simd128_unpremultiply(dst, src, count);
+#elif defined(PIXELS_SSE2)
+    i = sse2_unpremultiply(dst, src, count);
+#endif
+    scalar_unpremultiply(dst + 4 * i, src + 4 * i, count - i);
+}
+/* End: dispatch */
@@ -0,0 +1,1111 @@
+/**
+ * Software rendering backend for HTMLCanvasElement and CanvasRenderingContext2D,
+ * drawing into an in-memory RGBA framebuffer with a scanline rasterizer.
+ * @file raster.c
+ * @author Alex Tyner
+ */
+
+#include "raster.h"
+#include "pixels.h"
+#include "geometry.h"
+#include "shapes.h"
+#include <math.h>
+#include <stdio.h>
+
+/** Vertical samples taken per pixel row; horizontal coverage is computed exactly. */
+#define SUBSAMPLES 4
+
+/** Coverage of the clip region, one byte per pixel. Shared by saved states, so reference counted. */
+typedef struct ClipMask
+{
+    int references;
+    unsigned char coverage[];
+} ClipMask;
+
+/** Drawing state saved and restored by save() and restore(). */
+typedef struct RasterState
+{
+    CanvasState base;
+    uint32_t fill;
+    uint32_t stroke;
+    ClipMask *clip;
+} RasterState;
+
+typedef struct Crossing
+{
+    double x;
+    int direction;
+} Crossing;
+
+struct SoftwareRenderer
+{
+    RasterState state;
+    RasterState *stack;
+    size_t stackLength;
+    size_t stackCapacity;
+    CanvasPath path;
+    CanvasPath scratch;
+    CanvasEdgeList edges;
+    Crossing *crossings;
+    size_t crossingsCapacity;
+    size_t *active;
+    size_t activeCapacity;
+    float *coverage;
+    unsigned char *weights;
+    int coverageWidth;
+};
+
+/** Paint applied to the coverage of one row of pixels by rasterize(). */
+typedef void (*RowPainter)(CanvasRenderingContext2D *this, int y, int x0, int x1, const float *coverage, const void *paint);
+
+/** Premultiplied color and composite operation for paintColor(). */
+typedef struct ColorPaint
+{
+    unsigned r, g, b, a;
+    CanvasCompositeOperation op;
+} ColorPaint;
+
+static void *grow(void *array, size_t *capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity)
+        return array;
+    size_t newCapacity = *capacity ? *capacity : 64;
+    while (newCapacity < needed)
+        newCapacity *= 2;
+    *capacity = newCapacity;
+    return realloc(array, newCapacity * size);
+}
+
+static unsigned div255(unsigned value)
+{
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+/* Begin: colors */
+static const struct
+{
+    const char *name;
+    uint32_t rgba;
+} namedColors[] = {
+    {"transparent", 0x00000000}, {"black", 0x000000FF}, {"white", 0xFFFFFFFF}, {"red", 0xFF0000FF},
+    {"green", 0x008000FF}, {"blue", 0x0000FFFF}, {"yellow", 0xFFFF00FF}, {"cyan", 0x00FFFFFF},
+    {"aqua", 0x00FFFFFF}, {"magenta", 0xFF00FFFF}, {"fuchsia", 0xFF00FFFF}, {"gray", 0x808080FF},
+    {"grey", 0x808080FF}, {"silver", 0xC0C0C0FF}, {"maroon", 0x800000FF}, {"olive", 0x808000FF},
+    {"lime", 0x00FF00FF}, {"teal", 0x008080FF}, {"navy", 0x000080FF}, {"purple", 0x800080FF},
+    {"orange", 0xFFA500FF}};
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/** Parses the arguments of rgb()/rgba(), which may be separated by commas, spaces or a slash. */
+static int parseColorFunction(const char *args, uint32_t *rgba)
+{
+    double channels[4] = {0.0, 0.0, 0.0, 1.0};
+    int count = 0;
+    const char *s = args;
+    while (count < 4)
+    {
+        while (*s == ' ' || *s == ',' || *s == '/')
+            s++;
+        if (*s == ')')
+            break;
+        char *end;
+        double value = strtod(s, &end);
+        if (end == s)
+            return 0;
+        s = end;
+        if (*s == '%')
+        {
+            value = count < 3 ? value * 2.55 : value / 100.0;
+            s++;
+        }
+        channels[count++] = value;
+    }
+    while (*s == ' ')
+        s++;
+    if (count < 3 || *s != ')')
+        return 0;
+    uint32_t result = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        double value = i < 3 ? channels[i] : channels[i] * 255.0;
+        value = value < 0.0 ? 0.0 : value > 255.0 ? 255.0 : value;
+        result = (result << 8) | (uint32_t)(value + 0.5);
+    }
+    *rgba = result;
+    return 1;
+}
+
+/** Parses a CSS color into a packed 0xRRGGBBAA value. Returns zero if the color isn't understood. */
+static int parseColor(const char *value, uint32_t *rgba)
+{
+    char color[64];
+    size_t length = strlen(value);
+    while (length && value[length - 1] == ' ')
+        length--;
+    while (length && *value == ' ')
+        value++, length--;
+    if (length == 0 || length >= sizeof(color))
+        return 0;
+    for (size_t i = 0; i < length; i++)
+        color[i] = (value[i] >= 'A' && value[i] <= 'Z') ? value[i] - 'A' + 'a' : value[i];
+    color[length] = '\0';
+    if (color[0] == '#')
+    {
+        int digits[8];
+        for (size_t i = 1; i < length; i++)
+            if ((digits[i - 1] = hexDigit(color[i])) < 0)
+                return 0;
+        switch (length - 1)
+        {
+        case 3:
+        case 4:
+            *rgba = 0xFF;
+            for (size_t i = 0; i < length - 1; i++)
+                *rgba = (i == 0 ? 0 : *rgba << 8) | (digits[i] * 17);
+            if (length - 1 == 3)
+                *rgba = (*rgba << 8) | 0xFF;
+            return 1;
+        case 6:
+        case 8:
+            *rgba = 0;
+            for (size_t i = 0; i < length - 1; i++)
+                *rgba = (*rgba << 4) | digits[i];
+            if (length - 1 == 6)
+                *rgba = (*rgba << 8) | 0xFF;
+            return 1;
+        }
+        return 0;
+    }
+    if (strncmp(color, "rgba(", 5) == 0)
+        return parseColorFunction(color + 5, rgba);
+    if (strncmp(color, "rgb(", 4) == 0)
+        return parseColorFunction(color + 4, rgba);
+    for (size_t i = 0; i < sizeof(namedColors) / sizeof(*namedColors); i++)
+        if (strcmp(color, namedColors[i].name) == 0)
+        {
+            *rgba = namedColors[i].rgba;
+            return 1;
+        }
+    return 0;
+}
+
+/** Writes a color as browsers serialize fillStyle and strokeStyle. */
+static void serializeColor(uint32_t rgba, char *buffer)
+{
+    unsigned r = rgba >> 24, g = (rgba >> 16) & 255, b = (rgba >> 8) & 255, a = rgba & 255;
+    if (a == 255)
+        snprintf(buffer, CANVAS_STATE_STRING_CAPACITY, "#%02x%02x%02x", r, g, b);
+    else
+    {
+        /* as browsers do, use the shortest of two or three decimals which maps back to the same byte */
+        double alpha = floor(a / 255.0 * 100.0 + 0.5) / 100.0;
+        if ((unsigned)(alpha * 255.0 + 0.5) != a)
+            alpha = floor(a / 255.0 * 1000.0 + 0.5) / 1000.0;
+        snprintf(buffer, CANVAS_STATE_STRING_CAPACITY, "rgba(%u, %u, %u, %g)", r, g, b, alpha);
+    }
+}
+/* End: colors */
+
+/* Begin: rasterization */
+static int compareEdges(const void *a, const void *b)
+{
+    double y0 = ((const CanvasEdge *)a)->y0, y1 = ((const CanvasEdge *)b)->y0;
+    return y0 < y1 ? -1 : y0 > y1;
+}
+
+/** Adds coverage weight for the horizontal span [xa, xb), with fractional coverage at either end. */
+static void accumulateSpan(float *coverage, int width, double xa, double xb, float weight)
+{
+    if (xa < 0.0)
+        xa = 0.0;
+    if (xb > width)
+        xb = width;
+    if (xa >= xb)
+        return;
+    int ia = (int)xa, ib = (int)xb;
+    if (ia == ib)
+    {
+        coverage[ia] += (float)(xb - xa) * weight;
+        return;
+    }
+    coverage[ia] += (float)(ia + 1 - xa) * weight;
+    for (int i = ia + 1; i < ib; i++)
+        coverage[i] += weight;
+    if (ib < width)
+        coverage[ib] += (float)(xb - ib) * weight;
+}
+
+/**
+ * Scan converts the collected edges with the nonzero or even-odd rule, handing the anti-aliased
+ * coverage of each row touched to paint. Sorting the edges leaves them valid for reuse.
+ */
+static void rasterize(CanvasRenderingContext2D *this, int evenOdd, RowPainter painter, const void *paint)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    SoftwareSurface *surface = this->private.canvas->private.surface;
+    CanvasEdgeList *edges = &r->edges;
+    if (!edges->length)
+        return;
+    if (r->coverageWidth < surface->width + 1)
+    {
+        r->coverage = (float *)realloc(r->coverage, (surface->width + 1) * sizeof(float));
+        r->weights = (unsigned char *)realloc(r->weights, surface->width + 1);
+        r->coverageWidth = surface->width + 1;
+    }
+    qsort(edges->edges, edges->length, sizeof(CanvasEdge), compareEdges);
+    int yStart = (int)floor(edges->top);
+    int yEnd = (int)ceil(edges->bottom);
+    yStart = yStart < 0 ? 0 : yStart;
+    yEnd = yEnd > surface->height ? surface->height : yEnd;
+    size_t next = 0, activeLength = 0;
+    while (next < edges->length && edges->edges[next].y1 <= yStart)
+        next++;
+    for (int y = yStart; y < yEnd; y++)
+    {
+        /* retire edges which ended above this row and take on those starting within it */
+        size_t kept = 0;
+        for (size_t i = 0; i < activeLength; i++)
+            if (edges->edges[r->active[i]].y1 > y)
+                r->active[kept++] = r->active[i];
+        activeLength = kept;
+        while (next < edges->length && edges->edges[next].y0 < y + 1)
+        {
+            if (edges->edges[next].y1 > y)
+            {
+                r->active = (size_t *)grow(r->active, &r->activeCapacity, activeLength + 1, sizeof(size_t));
+                r->active[activeLength++] = next;
+            }
+            next++;
+        }
+        if (!activeLength)
+            continue;
+        double left = surface->width, right = 0.0;
+        for (size_t i = 0; i < activeLength; i++)
+        {
+            const CanvasEdge *e = &edges->edges[r->active[i]];
+            left = fmin(left, fmin(e->x0, e->x1));
+            right = fmax(right, fmax(e->x0, e->x1));
+        }
+        int x0 = left < 0.0 ? 0 : (int)left;
+        int x1 = right >= surface->width ? surface->width : (int)right + 1;
+        if (x0 >= x1)
+            continue;
+        memset(r->coverage + x0, 0, (x1 - x0 + 1) * sizeof(float));
+        r->crossings = (Crossing *)grow(r->crossings, &r->crossingsCapacity, activeLength, sizeof(Crossing));
+        for (int s = 0; s < SUBSAMPLES; s++)
+        {
+            double sy = y + (s + 0.5) / SUBSAMPLES;
+            size_t count = 0;
+            for (size_t i = 0; i < activeLength; i++)
+            {
+                const CanvasEdge *e = &edges->edges[r->active[i]];
+                if (e->y0 > sy || e->y1 <= sy)
+                    continue;
+                Crossing c = {e->x0 + (sy - e->y0) * (e->x1 - e->x0) / (e->y1 - e->y0), e->direction};
+                size_t j = count++;
+                for (; j > 0 && r->crossings[j - 1].x > c.x; j--)
+                    r->crossings[j] = r->crossings[j - 1];
+                r->crossings[j] = c;
+            }
+            int winding = 0;
+            double spanStart = 0.0;
+            for (size_t i = 0; i < count; i++)
+            {
+                int wasInside = evenOdd ? winding & 1 : winding != 0;
+                winding += r->crossings[i].direction;
+                int inside = evenOdd ? winding & 1 : winding != 0;
+                if (!wasInside && inside)
+                    spanStart = r->crossings[i].x;
+                else if (wasInside && !inside)
+                    accumulateSpan(r->coverage, surface->width, spanStart, r->crossings[i].x, 1.0f / SUBSAMPLES);
+            }
+        }
+        painter(this, y, x0, x1, r->coverage, paint);
+    }
+}
+
+static unsigned rowWeight(float coverage, const unsigned char *clip, int x, double alpha)
+{
+    if (coverage <= 0.0f)
+        return 0;
+    if (coverage > 1.0f)
+        coverage = 1.0f;
+    double weight = coverage * alpha * 255.0;
+    if (clip)
+        weight = weight * clip[x] / 255.0;
+    return (unsigned)(weight + 0.5);
+}
+
+static void paintColor(CanvasRenderingContext2D *this, int y, int x0, int x1, const float *coverage, const void *paint)
+{
+    const ColorPaint *p = (const ColorPaint *)paint;
+    SoftwareRenderer *r = this->private.renderer;
+    SoftwareSurface *surface = this->private.canvas->private.surface;
+    ClipMask *clip = r->state.clip;
+    const unsigned char *clipRow = clip ? clip->coverage + (size_t)y * surface->width : NULL;
+    double alpha = r->state.base.globalAlpha;
+    unsigned char *d = surface->pixels + ((size_t)y * surface->width) * 4;
+    if (p->op != COMPOSITE_COPY && p->op != COMPOSITE_DESTINATION_OUT)
+    {
+        const unsigned char color[4] = {p->r, p->g, p->b, p->a};
+        unsigned char *weights = r->weights;
+        for (int x = x0; x < x1; x++)
+            weights[x] = rowWeight(coverage[x], clipRow, x, alpha);
+        if (p->a < 255)
+        {
+            pixelsSourceOverMask(d + 4 * x0, color, weights + x0, x1 - x0);
+            return;
+        }
+        /* opaque runs of a solid color simply overwrite the pixels */
+        int x = x0;
+        while (x < x1)
+        {
+            int start = x;
+            int full = weights[x] == 255;
+            while (x < x1 && (weights[x] == 255) == full)
+                x++;
+            if (full)
+                pixelsFillSpan(d + 4 * start, color, x - start);
+            else
+                pixelsSourceOverMask(d + 4 * start, color, weights + start, x - start);
+        }
+        return;
+    }
+    for (int x = x0; x < x1; x++)
+    {
+        /* "copy" scales the source by the clip rather than the coverage, which it replaces the destination with */
+        unsigned k = p->op == COMPOSITE_COPY ? rowWeight(coverage[x], NULL, x, alpha) : rowWeight(coverage[x], clipRow, x, alpha);
+        if (p->op == COMPOSITE_COPY && clipRow)
+            k = div255(k * clipRow[x]);
+        if (!k)
+            continue;
+        unsigned char *px = d + 4 * x;
+        unsigned sr = div255(p->r * k), sg = div255(p->g * k), sb = div255(p->b * k), sa = div255(p->a * k);
+        if (p->op == COMPOSITE_COPY)
+        {
+            /* renderer_paintEdges() has already cleared the clip region, so the source is added to what's left */
+            px[0] += sr;
+            px[1] += sg;
+            px[2] += sb;
+            px[3] += sa;
+        }
+        else
+        {
+            px[0] = div255(px[0] * (255 - sa));
+            px[1] = div255(px[1] * (255 - sa));
+            px[2] = div255(px[2] * (255 - sa));
+            px[3] = div255(px[3] * (255 - sa));
+        }
+    }
+}
+
+static void paintClear(CanvasRenderingContext2D *this, int y, int x0, int x1, const float *coverage, const void *paint)
+{
+    SoftwareSurface *surface = this->private.canvas->private.surface;
+    ClipMask *clip = this->private.renderer->state.clip;
+    const unsigned char *clipRow = clip ? clip->coverage + (size_t)y * surface->width : NULL;
+    unsigned char *d = surface->pixels + ((size_t)y * surface->width) * 4;
+    for (int x = x0; x < x1; x++)
+    {
+        unsigned k = rowWeight(coverage[x], clipRow, x, 1.0);
+        for (int c = 0; k && c < 4; c++)
+            d[4 * x + c] = div255(d[4 * x + c] * (255 - k));
+    }
+}
+
+static void paintClip(CanvasRenderingContext2D *this, int y, int x0, int x1, const float *coverage, const void *paint)
+{
+    SoftwareSurface *surface = this->private.canvas->private.surface;
+    ClipMask *clip = this->private.renderer->state.clip;
+    const unsigned char *clipRow = clip ? clip->coverage + (size_t)y * surface->width : NULL;
+    unsigned char *mask = ((ClipMask *)paint)->coverage + (size_t)y * surface->width;
+    for (int x = x0; x < x1; x++)
+        mask[x] = rowWeight(coverage[x], clipRow, x, 1.0);
+}
+
+/** Clears the whole clip region, or the whole surface if there's no clip, as "copy" does outside the shape drawn. */
+static void renderer_clearClip(CanvasRenderingContext2D *this)
+{
+    SoftwareSurface *surface = this->private.canvas->private.surface;
+    ClipMask *clip = this->private.renderer->state.clip;
+    if (!clip)
+    {
+        memset(surface->pixels, 0, (size_t)surface->width * surface->height * 4);
+        return;
+    }
+    unsigned char *d = surface->pixels;
+    for (size_t i = 0; i < (size_t)surface->width * surface->height; i++, d += 4)
+    {
+        unsigned k = clip->coverage[i];
+        for (int c = 0; k && c < 4; c++)
+            d[c] = div255(d[c] * (255 - k));
+    }
+}
+
+static void renderer_paintEdges(CanvasRenderingContext2D *this, uint32_t rgba)
+{
+    unsigned a = rgba & 255;
+    ColorPaint paint = {div255((rgba >> 24) * a), div255(((rgba >> 16) & 255) * a), div255(((rgba >> 8) & 255) * a), a,
+                        this->private.renderer->state.base.globalCompositeOperation};
+    if (paint.op == COMPOSITE_COPY)
+        renderer_clearClip(this);
+    rasterize(this, 0, paintColor, &paint);
+}
+/* End: rasterization */
+
+/* Begin: drawing state */
+static void clip_release(ClipMask *clip)
+{
+    if (clip && --clip->references == 0)
+        free(clip);
+}
+
+static void renderer_resetState(SoftwareRenderer *r)
+{
+    while (r->stackLength)
+        clip_release(r->stack[--r->stackLength].clip);
+    clip_release(r->state.clip);
+    CanvasState *base = &r->state.base;
+    memset(base, 0, sizeof(CanvasState));
+    base->lineWidth = 1.0;
+    base->globalAlpha = 1.0;
+    base->lineCap = LINE_CAP_BUTT;
+    base->lineJoin = LINE_JOIN_MITER;
+    base->textAlign = TEXT_ALIGN_START;
+    base->globalCompositeOperation = COMPOSITE_SOURCE_OVER;
+    strcpy(base->font, "10px sans-serif");
+    base->transform = canvasIdentityMatrix;
+    r->state.fill = 0x000000FF;
+    r->state.stroke = 0x000000FF;
+    r->state.clip = NULL;
+    serializeColor(r->state.fill, base->fillStyle);
+    serializeColor(r->state.stroke, base->strokeStyle);
+    canvasPathClear(&r->path);
+}
+/* End: drawing state */
+
+/* Begin: CanvasRenderingContext2D software methods */
+static void software2d_clearRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathClear(&r->scratch);
+    canvasPathRect(&r->scratch, &r->state.base.transform, x, y, width, height);
+    canvasEdgesFill(&r->edges, &r->scratch);
+    rasterize(this, 0, paintClear, NULL);
+}
+static void software2d_fillRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathClear(&r->scratch);
+    canvasPathRect(&r->scratch, &r->state.base.transform, x, y, width, height);
+    canvasEdgesFill(&r->edges, &r->scratch);
+    renderer_paintEdges(this, r->state.fill);
+}
+static void software2d_strokeRect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathClear(&r->scratch);
+    canvasPathRect(&r->scratch, &r->state.base.transform, x, y, width, height);
+    canvasEdgesStroke(&r->edges, &r->scratch, &r->state.base);
+    renderer_paintEdges(this, r->state.stroke);
+}
+static void software2d_clearRects(CanvasRenderingContext2D *this, const float *xywh, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        software2d_clearRect(this, xywh[4 * i], xywh[4 * i + 1], xywh[4 * i + 2], xywh[4 * i + 3]);
+}
+static void software2d_fillRects(CanvasRenderingContext2D *this, const float *xywh, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        software2d_fillRect(this, xywh[4 * i], xywh[4 * i + 1], xywh[4 * i + 2], xywh[4 * i + 3]);
+}
+static void software2d_strokeRects(CanvasRenderingContext2D *this, const float *xywh, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        software2d_strokeRect(this, xywh[4 * i], xywh[4 * i + 1], xywh[4 * i + 2], xywh[4 * i + 3]);
+}
+static void software2d_fillRectsColored(CanvasRenderingContext2D *this, const float *xywh, const uint32_t *rgba, size_t count)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    uint32_t fill = r->state.fill;
+    for (size_t i = 0; i < count; i++)
+    {
+        r->state.fill = rgba[i];
+        software2d_fillRect(this, xywh[4 * i], xywh[4 * i + 1], xywh[4 * i + 2], xywh[4 * i + 3]);
+    }
+    r->state.fill = fill;
+}
+static void software2d_fillRectsTransformed(CanvasRenderingContext2D *this, const float *xywh, const float *matrices, size_t count)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    if (count > this->private.quadsCapacity)
+    {
+        this->private.quadsCapacity = count;
+        this->private.quads = (float *)realloc(this->private.quads, 8 * count * sizeof(float));
+    }
+    canvasMatrixApplyRects(&r->state.base.transform, xywh, matrices, count, this->private.quads);
+    canvasPathClear(&r->scratch);
+    for (size_t i = 0; i < count; i++)
+        canvasPathPolyline(&r->scratch, &canvasIdentityMatrix, this->private.quads + 8 * i, 4, 1);
+    canvasEdgesFill(&r->edges, &r->scratch);
+    renderer_paintEdges(this, r->state.fill);
+}
+static void software2d_putImageRegion(CanvasRenderingContext2D *this, ImageData *image, int dx, int dy, int sx, int sy, int width, int height)
+{
+    SoftwareSurface *surface = this->private.canvas->private.surface;
+    int x0 = sx + dx < 0 ? -dx : sx;
+    int x1 = sx + width + dx > surface->width ? surface->width - dx : sx + width;
+    if (x0 >= x1)
+        return;
+    for (int y = sy; y < sy + height; y++)
+    {
+        if (y + dy < 0 || y + dy >= surface->height)
+            continue;
+        pixelsPremultiply(surface->pixels + ((size_t)(y + dy) * surface->width + x0 + dx) * 4,
+                          image->data + ((size_t)y * image->width + x0) * 4, x1 - x0);
+    }
+}
+static void software2d_putImageData(CanvasRenderingContext2D *this, ImageData *image, int dx, int dy)
+{
+    software2d_putImageRegion(this, image, dx, dy, 0, 0, image->width, image->height);
+}
+static void software2d_getImageData(CanvasRenderingContext2D *this, ImageData *dest, int sx, int sy)
+{
+    SoftwareSurface *surface = this->private.canvas->private.surface;
+    int x0 = sx < 0 ? -sx : 0;
+    int x1 = sx + dest->width > surface->width ? surface->width - sx : dest->width;
+    for (int y = 0; y < dest->height; y++)
+    {
+        unsigned char *d = dest->data + (size_t)y * dest->width * 4;
+        if (y + sy < 0 || y + sy >= surface->height || x0 >= x1)
+        {
+            memset(d, 0, (size_t)dest->width * 4);
+            continue;
+        }
+        memset(d, 0, (size_t)x0 * 4);
+        pixelsUnpremultiply(d + (size_t)x0 * 4, surface->pixels + ((size_t)(y + sy) * surface->width + x0 + sx) * 4, x1 - x0);
+        memset(d + (size_t)x1 * 4, 0, (size_t)(dest->width - x1) * 4);
+    }
+}
+static void software2d_putImageDataDirty(CanvasRenderingContext2D *this, ImageData *image, int dx, int dy)
+{
+    for (int i = 0; i < image->private.damageCount; i++)
+    {
+        const int *rect = image->private.damage + 4 * i;
+        software2d_putImageRegion(this, image, dx, dy, rect[0], rect[1], rect[2], rect[3]);
+    }
+    image->private.damageCount = 0;
+}
+static void software2d_fillText(CanvasRenderingContext2D *this, char *text, double x, double y, double maxWidth)
+{
+    /* the software backend has no font rasterizer */
+}
+static void software2d_strokeText(CanvasRenderingContext2D *this, char *text, double x, double y, double maxWidth)
+{
+    /* the software backend has no font rasterizer */
+}
+static void software2d_setLineWidth(CanvasRenderingContext2D *this, double value)
+{
+    if (value > 0.0 && isfinite(value))
+        this->private.renderer->state.base.lineWidth = value;
+}
+static double software2d_getLineWidth(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.lineWidth;
+}
+static void software2d_setLineCapEnum(CanvasRenderingContext2D *this, CanvasLineCap type)
+{
+    if ((int)type >= 0 && type <= LINE_CAP_SQUARE)
+        this->private.renderer->state.base.lineCap = type;
+}
+static CanvasLineCap software2d_getLineCapEnum(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.lineCap;
+}
+static void software2d_setLineCap(CanvasRenderingContext2D *this, char *type)
+{
+    int index = type ? canvasKeywordIndex(canvasLineCapKeywords, type) : -1;
+    if (index >= 0)
+        software2d_setLineCapEnum(this, (CanvasLineCap)index);
+}
+static char *software2d_getLineCap(CanvasRenderingContext2D *this)
+{
+    return (char *)canvasLineCapKeywords[this->private.renderer->state.base.lineCap];
+}
+static void software2d_setLineJoinEnum(CanvasRenderingContext2D *this, CanvasLineJoin type)
+{
+    if ((int)type >= 0 && type <= LINE_JOIN_MITER)
+        this->private.renderer->state.base.lineJoin = type;
+}
+static CanvasLineJoin software2d_getLineJoinEnum(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.lineJoin;
+}
+static void software2d_setLineJoin(CanvasRenderingContext2D *this, char *type)
+{
+    int index = type ? canvasKeywordIndex(canvasLineJoinKeywords, type) : -1;
+    if (index >= 0)
+        software2d_setLineJoinEnum(this, (CanvasLineJoin)index);
+}
+static char *software2d_getLineJoin(CanvasRenderingContext2D *this)
+{
+    return (char *)canvasLineJoinKeywords[this->private.renderer->state.base.lineJoin];
+}
+static char *software2d_getFont(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.font;
+}
+static void software2d_setFont(CanvasRenderingContext2D *this, char *value)
+{
+    if (value && *value)
+        snprintf(this->private.renderer->state.base.font, CANVAS_STATE_STRING_CAPACITY, "%s", value);
+}
+static void software2d_setTextAlignEnum(CanvasRenderingContext2D *this, CanvasTextAlign value)
+{
+    if ((int)value >= 0 && value <= TEXT_ALIGN_CENTER)
+        this->private.renderer->state.base.textAlign = value;
+}
+static CanvasTextAlign software2d_getTextAlignEnum(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.textAlign;
+}
+static void software2d_setTextAlign(CanvasRenderingContext2D *this, char *value)
+{
+    int index = value ? canvasKeywordIndex(canvasTextAlignKeywords, value) : -1;
+    if (index >= 0)
+        software2d_setTextAlignEnum(this, (CanvasTextAlign)index);
+}
+static char *software2d_getTextAlign(CanvasRenderingContext2D *this)
+{
+    return (char *)canvasTextAlignKeywords[this->private.renderer->state.base.textAlign];
+}
+static void software2d_setFillColor(CanvasRenderingContext2D *this, uint32_t rgba)
+{
+    this->private.renderer->state.fill = rgba;
+    serializeColor(rgba, this->private.renderer->state.base.fillStyle);
+}
+static void software2d_setStrokeColor(CanvasRenderingContext2D *this, uint32_t rgba)
+{
+    this->private.renderer->state.stroke = rgba;
+    serializeColor(rgba, this->private.renderer->state.base.strokeStyle);
+}
+static void software2d_setFillStyle(CanvasRenderingContext2D *this, char *value)
+{
+    uint32_t rgba;
+    if (value && parseColor(value, &rgba))
+        software2d_setFillColor(this, rgba);
+}
+static char *software2d_getFillStyle(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.fillStyle;
+}
+static void software2d_setStrokeStyle(CanvasRenderingContext2D *this, char *value)
+{
+    uint32_t rgba;
+    if (value && parseColor(value, &rgba))
+        software2d_setStrokeColor(this, rgba);
+}
+static char *software2d_getStrokeStyle(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.strokeStyle;
+}
+static void software2d_beginPath(CanvasRenderingContext2D *this)
+{
+    canvasPathClear(&this->private.renderer->path);
+}
+static void software2d_closePath(CanvasRenderingContext2D *this)
+{
+    canvasPathClose(&this->private.renderer->path);
+}
+static void software2d_moveTo(CanvasRenderingContext2D *this, double x, double y)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathMoveTo(&r->path, &r->state.base.transform, x, y);
+}
+static void software2d_lineTo(CanvasRenderingContext2D *this, double x, double y)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathLineTo(&r->path, &r->state.base.transform, x, y);
+}
+static void software2d_bezierCurveTo(CanvasRenderingContext2D *this, double cp1x, double cp1y, double cp2x, double cp2y, double x, double y)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathBezierCurveTo(&r->path, &r->state.base.transform, cp1x, cp1y, cp2x, cp2y, x, y);
+}
+static void software2d_quadraticCurveTo(CanvasRenderingContext2D *this, double cpx, double cpy, double x, double y)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathQuadraticCurveTo(&r->path, &r->state.base.transform, cpx, cpy, x, y);
+}
+static void software2d_arc(CanvasRenderingContext2D *this, double x, double y, double radius, double startAngle, double endAngle)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathArc(&r->path, &r->state.base.transform, x, y, radius, startAngle, endAngle);
+}
+static void software2d_arcTo(CanvasRenderingContext2D *this, double x1, double y1, double x2, double y2, double radius)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathArcTo(&r->path, &r->state.base.transform, x1, y1, x2, y2, radius);
+}
+static void software2d_ellipse(CanvasRenderingContext2D *this, double x, double y, double radiusX, double radiusY, double rotation, double startAngle, double endAngle)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathEllipse(&r->path, &r->state.base.transform, x, y, radiusX, radiusY, rotation, startAngle, endAngle);
+}
+static void software2d_rect(CanvasRenderingContext2D *this, double x, double y, double width, double height)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathRect(&r->path, &r->state.base.transform, x, y, width, height);
+}
+static void software2d_polyline(CanvasRenderingContext2D *this, const float *xy, size_t count, int closed)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasPathPolyline(&r->path, &r->state.base.transform, xy, count, closed);
+}
+static void software2d_polylines(CanvasRenderingContext2D *this, const float *xy, const uint32_t *offsets, size_t polylineCount, int closed)
+{
+    for (size_t i = 0; i < polylineCount; i++)
+        if (offsets[i + 1] > offsets[i])
+            software2d_polyline(this, xy + 2 * offsets[i], offsets[i + 1] - offsets[i], closed);
+}
+static void software2d_fill(CanvasRenderingContext2D *this)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasEdgesFill(&r->edges, &r->path);
+    renderer_paintEdges(this, r->state.fill);
+}
+static void software2d_stroke(CanvasRenderingContext2D *this)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasEdgesStroke(&r->edges, &r->path, &r->state.base);
+    renderer_paintEdges(this, r->state.stroke);
+}
+/** Intersects the clip region with the area within the collected edges. */
+static void renderer_clipEdges(CanvasRenderingContext2D *this)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    SoftwareSurface *surface = this->private.canvas->private.surface;
+    size_t size = (size_t)surface->width * surface->height;
+    ClipMask *clip = (ClipMask *)calloc(1, sizeof(ClipMask) + size);
+    clip->references = 1;
+    rasterize(this, 0, paintClip, clip);
+    clip_release(r->state.clip);
+    r->state.clip = clip;
+}
+static void software2d_clip(CanvasRenderingContext2D *this)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasEdgesFill(&r->edges, &r->path);
+    renderer_clipEdges(this);
+}
+static int software2d_isPointInPathFillRule(CanvasRenderingContext2D *this, double x, double y, CanvasFillRule fillRule)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasEdgesFill(&r->edges, &r->path);
+    return canvasEdgesContain(&r->edges, x, y, fillRule);
+}
+static int software2d_isPointInPath(CanvasRenderingContext2D *this, double x, double y)
+{
+    return software2d_isPointInPathFillRule(this, x, y, FILL_RULE_NONZERO);
+}
+static int software2d_isPointInStroke(CanvasRenderingContext2D *this, double x, double y)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasEdgesStroke(&r->edges, &r->path, &r->state.base);
+    return canvasEdgesContain(&r->edges, x, y, FILL_RULE_NONZERO);
+}
+static void software2d_fillPath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasEdgesFill(&r->edges, canvasPath2DFlatten(path, &r->state.base.transform));
+    renderer_paintEdges(this, r->state.fill);
+}
+static void software2d_strokePath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasEdgesStroke(&r->edges, canvasPath2DFlatten(path, &r->state.base.transform), &r->state.base);
+    renderer_paintEdges(this, r->state.stroke);
+}
+static void software2d_clipPath(CanvasRenderingContext2D *this, Path2D *path)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    canvasEdgesFill(&r->edges, canvasPath2DFlatten(path, &r->state.base.transform));
+    renderer_clipEdges(this);
+}
+static int software2d_isPointInPath2D(CanvasRenderingContext2D *this, Path2D *path, double x, double y, CanvasFillRule fillRule)
+{
+    return canvasPath2DContains(path, &this->private.renderer->state.base.transform, x, y, fillRule);
+}
+static int software2d_isPointInStroke2D(CanvasRenderingContext2D *this, Path2D *path, double x, double y)
+{
+    return canvasPath2DStrokeContains(path, &this->private.renderer->state.base, x, y);
+}
+static void software2d_rotate(CanvasRenderingContext2D *this, double angle)
+{
+    canvasMatrixMultiply(&this->private.renderer->state.base.transform, cos(angle), sin(angle), -sin(angle), cos(angle), 0.0, 0.0);
+}
+static void software2d_scale(CanvasRenderingContext2D *this, double x, double y)
+{
+    canvasMatrixMultiply(&this->private.renderer->state.base.transform, x, 0.0, 0.0, y, 0.0, 0.0);
+}
+static void software2d_translate(CanvasRenderingContext2D *this, double x, double y)
+{
+    canvasMatrixMultiply(&this->private.renderer->state.base.transform, 1.0, 0.0, 0.0, 1.0, x, y);
+}
+static void software2d_transform(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f)
+{
+    canvasMatrixMultiply(&this->private.renderer->state.base.transform, a, b, c, d, e, f);
+}
+static void software2d_setTransform(CanvasRenderingContext2D *this, double a, double b, double c, double d, double e, double f)
+{
+    this->private.renderer->state.base.transform = (CanvasMatrix){a, b, c, d, e, f};
+}
+static void software2d_resetTransform(CanvasRenderingContext2D *this)
+{
+    this->private.renderer->state.base.transform = canvasIdentityMatrix;
+}
+static CanvasMatrix software2d_getTransform(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.transform;
+}
+static void software2d_setGlobalAlpha(CanvasRenderingContext2D *this, double value)
+{
+    if (value >= 0.0 && value <= 1.0)
+        this->private.renderer->state.base.globalAlpha = value;
+}
+static double software2d_getGlobalAlpha(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.globalAlpha;
+}
+static void software2d_setGlobalCompositeOperationEnum(CanvasRenderingContext2D *this, CanvasCompositeOperation value)
+{
+    if ((int)value >= 0 && value <= COMPOSITE_LUMINOSITY)
+        this->private.renderer->state.base.globalCompositeOperation = value;
+}
+static CanvasCompositeOperation software2d_getGlobalCompositeOperationEnum(CanvasRenderingContext2D *this)
+{
+    return this->private.renderer->state.base.globalCompositeOperation;
+}
+static void software2d_setGlobalCompositeOperation(CanvasRenderingContext2D *this, char *value)
+{
+    int index = value ? canvasKeywordIndex(canvasCompositeOperationKeywords, value) : -1;
+    if (index >= 0)
+        software2d_setGlobalCompositeOperationEnum(this, (CanvasCompositeOperation)index);
+}
+static char *software2d_getGlobalCompositeOperation(CanvasRenderingContext2D *this)
+{
+    return (char *)canvasCompositeOperationKeywords[this->private.renderer->state.base.globalCompositeOperation];
+}
+static void software2d_save(CanvasRenderingContext2D *this)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    r->stack = (RasterState *)grow(r->stack, &r->stackCapacity, r->stackLength + 1, sizeof(RasterState));
+    r->stack[r->stackLength++] = r->state;
+    if (r->state.clip)
+        r->state.clip->references++;
+}
+static void software2d_restore(CanvasRenderingContext2D *this)
+{
+    SoftwareRenderer *r = this->private.renderer;
+    if (!r->stackLength)
+        return;
+    clip_release(r->state.clip);
+    r->state = r->stack[--r->stackLength];
+}
+static void software2d_flush(CanvasRenderingContext2D *this)
+{
+    /* nothing is ever deferred; the software backend draws immediately */
+}
+static HTMLCanvasElement *software2d_getCanvas(CanvasRenderingContext2D *this)
+{
+    return this->private.canvas;
+}
+/* End: CanvasRenderingContext2D software methods */
+
+static CanvasRenderingContext2D *createSoftwareContext(HTMLCanvasElement *canvas, char *contextType)
+{
+    if (strcmp(contextType, "2d") != 0)
+        return NULL;
+    CanvasRenderingContext2D *ctx = (CanvasRenderingContext2D *)calloc(1, sizeof(CanvasRenderingContext2D));
+    /* Begin: set pseudo-private fields */
+    ctx->private.canvas = canvas;
+    strcpy(ctx->private.contextType, contextType);
+    ctx->private.renderer = (SoftwareRenderer *)calloc(1, sizeof(SoftwareRenderer));
+    renderer_resetState(ctx->private.renderer);
+    /* End: set pseudo-private fields */
+    ctx->clearRect = software2d_clearRect;
+    ctx->fillRect = software2d_fillRect;
+    ctx->strokeRect = software2d_strokeRect;
+    ctx->clearRects = software2d_clearRects;
+    ctx->fillRects = software2d_fillRects;
+    ctx->strokeRects = software2d_strokeRects;
+    ctx->fillRectsColored = software2d_fillRectsColored;
+    ctx->fillRectsTransformed = software2d_fillRectsTransformed;
+    ctx->putImageData = software2d_putImageData;
+    ctx->getImageData = software2d_getImageData;
+    ctx->putImageDataDirty = software2d_putImageDataDirty;
+    ctx->fillText = software2d_fillText;
+    ctx->strokeText = software2d_strokeText;
+    ctx->setLineWidth = software2d_setLineWidth;
+    ctx->getLineWidth = software2d_getLineWidth;
+    ctx->setLineCap = software2d_setLineCap;
+    ctx->getLineCap = software2d_getLineCap;
+    ctx->setLineCapEnum = software2d_setLineCapEnum;
+    ctx->getLineCapEnum = software2d_getLineCapEnum;
+    ctx->setLineJoin = software2d_setLineJoin;
+    ctx->getLineJoin = software2d_getLineJoin;
+    ctx->setLineJoinEnum = software2d_setLineJoinEnum;
+    ctx->getLineJoinEnum = software2d_getLineJoinEnum;
+    ctx->setFont = software2d_setFont;
+    ctx->getFont = software2d_getFont;
+    ctx->setTextAlign = software2d_setTextAlign;
+    ctx->getTextAlign = software2d_getTextAlign;
+    ctx->setTextAlignEnum = software2d_setTextAlignEnum;
+    ctx->getTextAlignEnum = software2d_getTextAlignEnum;
+    ctx->setFillStyle = software2d_setFillStyle;
+    ctx->getFillStyle = software2d_getFillStyle;
+    ctx->setStrokeStyle = software2d_setStrokeStyle;
+    ctx->getStrokeStyle = software2d_getStrokeStyle;
+    ctx->setFillColor = software2d_setFillColor;
+    ctx->setStrokeColor = software2d_setStrokeColor;
+    ctx->beginPath = software2d_beginPath;
+    ctx->closePath = software2d_closePath;
+    ctx->moveTo = software2d_moveTo;
+    ctx->lineTo = software2d_lineTo;
+    ctx->bezierCurveTo = software2d_bezierCurveTo;
+    ctx->quadraticCurveTo = software2d_quadraticCurveTo;
+    ctx->arc = software2d_arc;
+    ctx->arcTo = software2d_arcTo;
+    ctx->ellipse = software2d_ellipse;
+    ctx->rect = software2d_rect;
+    ctx->polyline = software2d_polyline;
+    ctx->polylines = software2d_polylines;
+    ctx->fill = software2d_fill;
+    ctx->stroke = software2d_stroke;
+    ctx->clip = software2d_clip;
+    ctx->isPointInPath = software2d_isPointInPath;
+    ctx->isPointInPathFillRule = software2d_isPointInPathFillRule;
+    ctx->isPointInStroke = software2d_isPointInStroke;
+    ctx->fillPath = software2d_fillPath;
+    ctx->strokePath = software2d_strokePath;
+    ctx->clipPath = software2d_clipPath;
+    ctx->isPointInPath2D = software2d_isPointInPath2D;
+    ctx->isPointInStroke2D = software2d_isPointInStroke2D;
+    ctx->rotate = software2d_rotate;
+    ctx->scale = software2d_scale;
+    ctx->translate = software2d_translate;
+    ctx->transform = software2d_transform;
+    ctx->setTransform = software2d_setTransform;
+    ctx->resetTransform = software2d_resetTransform;
+    ctx->getTransform = software2d_getTransform;
+    ctx->setGlobalAlpha = software2d_setGlobalAlpha;
+    ctx->getGlobalAlpha = software2d_getGlobalAlpha;
+    ctx->setGlobalCompositeOperation = software2d_setGlobalCompositeOperation;
+    ctx->getGlobalCompositeOperation = software2d_getGlobalCompositeOperation;
+    ctx->setGlobalCompositeOperationEnum = software2d_setGlobalCompositeOperationEnum;
+    ctx->getGlobalCompositeOperationEnum = software2d_getGlobalCompositeOperationEnum;
+    ctx->save = software2d_save;
+    ctx->restore = software2d_restore;
+    ctx->beginRecording = software2d_flush;
+    ctx->endRecording = software2d_flush;
+    ctx->flush = software2d_flush;
+    ctx->getCanvas = software2d_getCanvas;
+    return ctx;
+}
+
+/* Begin: HTMLCanvasElement software methods */
+static int softwareCanvas_getWidth(HTMLCanvasElement *this)
+{
+    return this->private.surface->width;
+}
+static int softwareCanvas_getHeight(HTMLCanvasElement *this)
+{
+    return this->private.surface->height;
+}
+/** Reallocates the pixels cleared and, as in the browser, resets the context's state. */
+static void softwareCanvas_resize(HTMLCanvasElement *this, int width, int height)
+{
+    SoftwareSurface *surface = this->private.surface;
+    surface->width = width;
+    surface->height = height;
+    free(surface->pixels);
+    surface->pixels = (unsigned char *)calloc((size_t)width * height, 4);
+    if (this->private.ctx)
+        renderer_resetState(this->private.ctx->private.renderer);
+}
+static void softwareCanvas_setWidth(HTMLCanvasElement *this, int width)
+{
+    softwareCanvas_resize(this, width < 0 ? 300 : width, this->private.surface->height);
+}
+static void softwareCanvas_setHeight(HTMLCanvasElement *this, int height)
+{
+    softwareCanvas_resize(this, this->private.surface->width, height < 0 ? 150 : height);
+}
+static CanvasRenderingContext2D *softwareCanvas_getContext(HTMLCanvasElement *this, char *contextType)
+{
+    if (!this->private.ctx)
+        this->private.ctx = createSoftwareContext(this, contextType);
+    return this->private.ctx;
+}
+static void softwareCanvas_release(HTMLCanvasElement *this)
+{
+    if (this->private.ctx)
+    {
+        SoftwareRenderer *r = this->private.ctx->private.renderer;
+        while (r->stackLength)
+            clip_release(r->stack[--r->stackLength].clip);
+        clip_release(r->state.clip);
+        free(r->stack);
+        canvasPathFree(&r->path);
+        canvasPathFree(&r->scratch);
+        canvasEdgesFree(&r->edges);
+        free(r->crossings);
+        free(r->active);
+        free(r->coverage);
+        free(r->weights);
+        free(r);
+        free(this->private.ctx->private.quads);
+        free(this->private.ctx);
+    }
+    free(this->private.surface->pixels);
+    free(this->private.surface);
+    free(this->private.id);
+    free(this);
+}
+/* End: HTMLCanvasElement software methods */
+
+HTMLCanvasElement *createSoftwareCanvas(char *id, int width, int height)
+{
+    HTMLCanvasElement *c = (HTMLCanvasElement *)malloc(sizeof(HTMLCanvasElement));
+    /* Begin: set pseudo-private fields */
+    c->private.id = (char *)malloc(strlen(id) + 1);
+    strcpy(c->private.id, id);
+    c->private.handle = -1; // there is no DOM element
+    c->private.ctx = NULL;
+    c->private.surface = (SoftwareSurface *)malloc(sizeof(SoftwareSurface));
+    c->private.surface->width = width;
+    c->private.surface->height = height;
+    c->private.surface->pixels = (unsigned char *)calloc((size_t)width * height, 4);
+    c->private.release = softwareCanvas_release;
+    /* End: set pseudo-private fields */
+    c->getWidth = softwareCanvas_getWidth;
+    c->getHeight = softwareCanvas_getHeight;
+    c->setHeight = softwareCanvas_setHeight;
+    c->setWidth = softwareCanvas_setWidth;
+    c->getContext = softwareCanvas_getContext;
+    canvasShapesAttach(c);
+    return c;
+}
+
+SoftwareSurface *getSoftwareSurface(HTMLCanvasElement *canvas)
+{
+    return canvas->private.surface;
+}
@@ -6,31 +6,196 @@
  */
 
 #include "window.h"
+#include <emscripten/html5.h>
+#include <string.h>
+
+/* Begin: frame loop */
+static void histogram_add(FrameHistogram *histogram, double milliseconds)
+{
+    int bucket = (int)(milliseconds / WINDOW_FRAME_BUCKET_WIDTH);
+    if (bucket >= WINDOW_FRAME_BUCKETS)
+        bucket = WINDOW_FRAME_BUCKETS - 1;
+    if (bucket < 0)
+        bucket = 0;
+    if (histogram->length == WINDOW_FRAME_HISTORY)
+        histogram->counts[histogram->samples[histogram->next]]--;
+    else
+        histogram->length++;
+    histogram->samples[histogram->next] = (uint8_t)bucket;
+    histogram->counts[bucket]++;
+    histogram->next = (histogram->next + 1) % WINDOW_FRAME_HISTORY;
+}
+
+/** Returns the upper edge of the bucket holding the given fraction of the durations, or 0 if there are none. */
+static double histogram_percentile(const FrameHistogram *histogram, double fraction)
+{
+    int rank = (int)(fraction * histogram->length + 0.999), seen = 0;
+    for (int i = 0; i < WINDOW_FRAME_BUCKETS && histogram->length; i++)
+        if ((seen += histogram->counts[i]) >= rank)
+            return (i + 1) * WINDOW_FRAME_BUCKET_WIDTH;
+    return 0.0;
+}
+
+/**
+ * Draws a frame of the loop numbered loop, unless that loop has ended. Frames driven by the
+ * throttling timer are neither paced, skipped nor counted in the frame times. Returns non-zero if
+ * the loop goes on.
+ */
+static int window_frame(double time, int loop, int throttled)
+{
+    if (!current || current->private.loop != loop)
+        return 0;
+    double last = current->private.lastTime;
+    if (!throttled && last && time - last < current->private.interval - 1.0)
+        return 1;
+    if (!throttled && current->private.skipNext)
+    {
+        current->private.skipNext = 0;
+        current->private.skippedLast = 1;
+        current->private.skipped++;
+        return 1;
+    }
+    FrameInfo frame = {time, last ? time - last : 0.0, current->private.interval, current->private.frames, current->private.degrade, throttled};
+    if (last && !throttled)
+    {
+        int missed = (int)(frame.delta / frame.budget + 0.5) - 1 - current->private.skippedLast;
+        if (missed > 0)
+            current->private.dropped += missed;
+        histogram_add(&current->private.frameTimes, frame.delta);
+    }
+    current->private.skippedLast = 0;
+    current->private.lastTime = time;
+    double start = emscripten_get_now();
+    int again = current->private.callback(&frame, current->private.user);
+    double work = emscripten_get_now() - start;
+    /* the callback may have stopped the loop, started another or freed the window */
+    if (!current || current->private.loop != loop)
+        return 0;
+    current->private.frames++;
+    histogram_add(&current->private.workTimes, work);
+    if (work > frame.budget)
+    {
+        current->private.underBudget = 0;
+        if (++current->private.overBudget >= 2 && current->private.degrade < WINDOW_MAX_DEGRADE)
+        {
+            current->private.degrade++;
+            current->private.overBudget = 0;
+        }
+        current->private.skipNext = current->private.skipping;
+    }
+    else
+    {
+        current->private.overBudget = 0;
+        if (work >= frame.budget / 2)
+            current->private.underBudget = 0;
+        else if (++current->private.underBudget >= WINDOW_DEGRADE_RECOVERY && current->private.degrade > 0)
+        {
+            current->private.degrade--;
+            current->private.underBudget = 0;
+        }
+    }
+    if (!again)
+    {
+        current->private.running = 0;
+        current->private.loop++;
+    }
+    return again;
+}
+
+static EM_BOOL window_animationFrame(double time, void *loop)
+{
+    return window_frame(time, (int)(intptr_t)loop, 0) ? EM_TRUE : EM_FALSE;
+}
+
+static void window_throttledFrame(void *loop)
+{
+    if (window_frame(emscripten_get_now(), (int)(intptr_t)loop, 1))
+        emscripten_async_call(window_throttledFrame, loop, (int)(1000.0 / current->private.throttledRate));
+}
+
+static int window_isThrottled()
+{
+    return (current->private.throttle != THROTTLE_NONE && !current->private.visible) ||
+           (current->private.throttle == THROTTLE_HIDDEN_OR_BLURRED && !current->private.focused);
+}
+
+/**
+ * Ends the animation frames or timer driving the running loop, if any, and drives it again as the
+ * window's visibility, focus and throttling call for: by animation frames, by a timer at the
+ * throttled rate, or not at all while paused.
+ */
+static void window_scheduleFrames()
+{
+    if (!current->private.running)
+        return;
+    void *loop = (void *)(intptr_t)++current->private.loop;
+    /* the first frame after switching has a delta of 0, rather than the time spent throttled */
+    current->private.lastTime = 0.0;
+    if (!window_isThrottled())
+        emscripten_request_animation_frame_loop(window_animationFrame, loop);
+    else if (current->private.throttledRate > 0)
+        emscripten_async_call(window_throttledFrame, loop, (int)(1000.0 / current->private.throttledRate));
+}
+
+static EM_BOOL window_visibilityChanged(int eventType, const EmscriptenVisibilityChangeEvent *event, void *user)
+{
+    if (current)
+    {
+        int throttled = window_isThrottled();
+        current->private.visible = !event->hidden;
+        if (throttled != window_isThrottled())
+            window_scheduleFrames();
+    }
+    return EM_FALSE;
+}
+
+static EM_BOOL window_focusChanged(int eventType, const EmscriptenFocusEvent *event, void *user)
+{
+    if (current)
+    {
+        int throttled = window_isThrottled();
+        current->private.focused = eventType == EMSCRIPTEN_EVENT_FOCUS;
+        if (throttled != window_isThrottled())
+            window_scheduleFrames();
+    }
+    return EM_FALSE;
+}
+/* End: frame loop */
+
+static EM_BOOL window_resized(int eventType, const EmscriptenUiEvent *event, void *user)
+{
+    if (current && (current->private.innerHeight != event->windowInnerHeight || current->private.innerWidth != event->windowInnerWidth ||
+                    current->private.outerHeight != event->windowOuterHeight || current->private.outerWidth != event->windowOuterWidth))
+    {
+        current->private.innerHeight = event->windowInnerHeight;
+        current->private.innerWidth = event->windowInnerWidth;
+        current->private.outerHeight = event->windowOuterHeight;
+        current->private.outerWidth = event->windowOuterWidth;
+        current->private.sizeGeneration++;
+    }
+    return EM_FALSE;
+}
 
 /* Begin: HTMLWindow static methods */
 static int window_getInnerHeight()
 {
-    return EM_ASM_INT({
-        return window.innerHeight;
-    });
+    return current->private.innerHeight;
 }
 static int window_getInnerWidth()
 {
-    return EM_ASM_INT({
-        return window.innerWidth;
-    });
+    return current->private.innerWidth;
 }
 static int window_getOuterHeight()
 {
-    return EM_ASM_INT({
-        return window.outerHeight;
-    });
+    return current->private.outerHeight;
 }
 static int window_getOuterWidth()
 {
-    return EM_ASM_INT({
-        return window.outerWidth;
-    });
+    return current->private.outerWidth;
+}
+static unsigned int window_getSizeGeneration()
+{
+    return current->private.sizeGeneration;
 }
 static void window_blur()
 {
@@ -38,23 +203,118 @@ static void window_blur()
         window.blur();
     });
 }
+static void window_stopFrameLoop()
+{
+    current->private.running = 0;
+    current->private.loop++;
+}
+static void window_startFrameLoop(FrameCallback callback, void *user)
+{
+    current->private.callback = callback;
+    current->private.user = user;
+    current->private.lastTime = 0.0;
+    current->private.skipNext = 0;
+    current->private.skippedLast = 0;
+    current->private.degrade = 0;
+    current->private.overBudget = 0;
+    current->private.underBudget = 0;
+    current->private.frames = 0;
+    current->private.dropped = 0;
+    current->private.skipped = 0;
+    memset(&current->private.frameTimes, 0, sizeof(FrameHistogram));
+    memset(&current->private.workTimes, 0, sizeof(FrameHistogram));
+    current->private.running = 1;
+    window_scheduleFrames();
+}
+static void window_setFrameRate(double framesPerSecond)
+{
+    if (framesPerSecond > 0)
+        current->private.interval = 1000.0 / framesPerSecond;
+}
+static void window_setFrameSkipping(int enabled)
+{
+    current->private.skipping = enabled;
+}
+static void window_getFrameStats(FrameStats *stats)
+{
+    stats->frameP50 = histogram_percentile(&current->private.frameTimes, 0.50);
+    stats->frameP95 = histogram_percentile(&current->private.frameTimes, 0.95);
+    stats->frameP99 = histogram_percentile(&current->private.frameTimes, 0.99);
+    stats->workP50 = histogram_percentile(&current->private.workTimes, 0.50);
+    stats->workP95 = histogram_percentile(&current->private.workTimes, 0.95);
+    stats->workP99 = histogram_percentile(&current->private.workTimes, 0.99);
+    stats->frames = current->private.frames;
+    stats->dropped = current->private.dropped;
+    stats->skipped = current->private.skipped;
+}
+static int window_isVisible()
+{
+    return current->private.visible;
+}
+static int window_hasFocus()
+{
+    return current->private.focused;
+}
+static void window_setThrottling(WindowThrottle when, double framesPerSecond)
+{
+    current->private.throttle = when;
+    current->private.throttledRate = framesPerSecond > 0 ? framesPerSecond : 0.0;
+    window_scheduleFrames();
+}
 /* End: HTMLWindow static methods */
 
 HTMLWindow *Window()
 {
     if (!current)
     {
-        current = (HTMLWindow *)malloc(sizeof(HTMLWindow));
+        current = (HTMLWindow *)calloc(1, sizeof(HTMLWindow));
+        /* Begin: set pseudo-private fields */
+        current->private.interval = 1000.0 / WINDOW_DEFAULT_FRAME_RATE;
+        EmscriptenVisibilityChangeEvent visibility;
+        current->private.visible = emscripten_get_visibility_status(&visibility) != EMSCRIPTEN_RESULT_SUCCESS || !visibility.hidden;
+        current->private.focused = EM_ASM_INT({
+            return document.hasFocus() ? 1 : 0;
+        });
+        EM_ASM({
+            HEAP32[$0 >> 2] = window.innerHeight;
+            HEAP32[$1 >> 2] = window.innerWidth;
+            HEAP32[$2 >> 2] = window.outerHeight;
+            HEAP32[$3 >> 2] = window.outerWidth;
+        },
+               &current->private.innerHeight, &current->private.innerWidth, &current->private.outerHeight, &current->private.outerWidth);
+        /* End: set pseudo-private fields */
+        emscripten_set_resize_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, EM_FALSE, window_resized);
+        emscripten_set_visibilitychange_callback(NULL, EM_FALSE, window_visibilityChanged);
+        emscripten_set_focus_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, EM_FALSE, window_focusChanged);
+        emscripten_set_blur_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, EM_FALSE, window_focusChanged);
         current->getInnerHeight = window_getInnerHeight;
         current->getInnerWidth = window_getInnerWidth;
         current->getOuterHeight = window_getOuterHeight;
         current->getOuterWidth = window_getOuterWidth;
+        current->getSizeGeneration = window_getSizeGeneration;
         current->blur = window_blur;
+        current->startFrameLoop = window_startFrameLoop;
+        current->stopFrameLoop = window_stopFrameLoop;
+        current->setFrameRate = window_setFrameRate;
+        current->setFrameSkipping = window_setFrameSkipping;
+        current->getFrameStats = window_getFrameStats;
+        current->isVisible = window_isVisible;
+        current->hasFocus = window_hasFocus;
+        current->setThrottling = window_setThrottling;
     }
     return current;
 }
 
 void freeWindow(HTMLWindow *window)
 {
+    /* a pending animation frame or timer finds no window and ends the loop */
+    if (window == current)
+    {
+        emscripten_set_visibilitychange_callback(NULL, EM_FALSE, NULL);
+        emscripten_set_focus_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, EM_FALSE, NULL);
+        emscripten_set_blur_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, EM_FALSE, NULL);
+        emscripten_set_resize_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, EM_FALSE, NULL);
+        current = NULL;
+    }
     free(window);
 }
\ No newline at end of file
@@ -9,9 +9,98 @@
 #define WINDOW_H
 
 #include <emscripten.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 typedef struct HTMLWindow HTMLWindow;
+typedef struct FrameInfo FrameInfo;
+typedef struct FrameStats FrameStats;
+typedef struct FrameHistogram FrameHistogram;
+
+/** Frame rate the frame loop targets until setFrameRate() is called. */
+#define WINDOW_DEFAULT_FRAME_RATE 60.0
+
+/** Number of recent frames the percentiles of FrameStats are taken over. */
+#define WINDOW_FRAME_HISTORY 120
+
+/** Number of buckets, each WINDOW_FRAME_BUCKET_WIDTH milliseconds wide, in a FrameHistogram. */
+#define WINDOW_FRAME_BUCKETS 256
+#define WINDOW_FRAME_BUCKET_WIDTH 0.25
+
+/** Highest degrade level handed to the frame callback. */
+#define WINDOW_MAX_DEGRADE 3
+
+/**
+ * Number of frames in a row which must take under half the budget before the degrade level is
+ * lowered again. Two frames in a row over budget raise it.
+ */
+#define WINDOW_DEGRADE_RECOVERY 120
+
+/** When the frame loop is throttled, as set by setThrottling(). */
+typedef enum WindowThrottle
+{
+    /** never; the browser alone decides, and usually stops animation frames in hidden tabs */
+    THROTTLE_NONE,
+    /** while the page is hidden, as in a background tab or a minimized window */
+    THROTTLE_HIDDEN,
+    /** while the page is hidden or the window doesn't have focus */
+    THROTTLE_HIDDEN_OR_BLURRED
+} WindowThrottle;
+
+/** Describes the animation frame a FrameCallback is drawing. */
+struct FrameInfo
+{
+    /** the requestAnimationFrame() timestamp, in milliseconds */
+    double time;
+    /** milliseconds since the previous frame the callback drew, or 0 for the first */
+    double delta;
+    /** milliseconds the callback should finish within: one frame at the target frame rate */
+    double budget;
+    /** number of frames the callback has drawn before this one */
+    unsigned long frame;
+    /**
+     * 0 normally, and up to WINDOW_MAX_DEGRADE while recent frames have gone over budget. Draw
+     * less at higher levels, such as fewer particles or no shadows, to get back under it.
+     */
+    int degrade;
+    /** non-zero if the frame is drawn at the throttled rate (see setThrottling()) */
+    int throttled;
+};
+
+/**
+ * Called on each animation frame of the frame loop. Return non-zero to be called again on the
+ * next one, or 0 to stop the loop.
+ */
+typedef int (*FrameCallback)(const FrameInfo *frame, void *user);
+
+/** Rolling histogram of the last WINDOW_FRAME_HISTORY durations, in milliseconds. */
+struct FrameHistogram
+{
+    uint16_t counts[WINDOW_FRAME_BUCKETS];
+    /** the bucket of each duration, oldest first from next once full */
+    uint8_t samples[WINDOW_FRAME_HISTORY];
+    int next;
+    int length;
+};
+
+/** Timing of the frame loop, as filled in by getFrameStats(). */
+struct FrameStats
+{
+    /** percentiles of the milliseconds between frames drawn, over recent frames */
+    double frameP50;
+    double frameP95;
+    double frameP99;
+    /** percentiles of the milliseconds spent in the callback, over recent frames */
+    double workP50;
+    double workP95;
+    double workP99;
+    /** frames drawn since the loop was started */
+    unsigned long frames;
+    /** frames at the target frame rate which went by without one being drawn */
+    unsigned long dropped;
+    /** frames left out on purpose to catch up after a callback went over budget */
+    unsigned long skipped;
+};
 
 /** The active HTMLWindow. This field facilitates the Singleton design pattern. */
 static HTMLWindow *current;
@@ -33,16 +122,112 @@ static HTMLWindow *current;
  *     HTMLCanvasElement *canvas = createCanvas("bigCanvas"); // not big yet
  *     canvas->setHeight(canvas, Window()->getInnerHeight());
  *     canvas->setWidth(canvas, Window()->getInnerWidth());
+ *     unsigned int size = Window()->getSizeGeneration();
+ *     // each frame
+ *     if (Window()->getSizeGeneration() != size)
+ *     {
+ *         size = Window()->getSizeGeneration();
+ *         canvas->setHeight(canvas, Window()->getInnerHeight());
+ *         canvas->setWidth(canvas, Window()->getInnerWidth());
+ *     }
  *     freeCanvas(canvas);
  *     freeWindow(Window());
+ *
+ * It also drives a frame loop, calling back into C on each animation frame and keeping track of
+ * how long frames take:
+ *
+ *     static int drawFrame(const FrameInfo *frame, void *user)
+ *     {
+ *         CanvasRenderingContext2D *ctx = (CanvasRenderingContext2D *)user;
+ *         drawScene(ctx, frame->delta, frame->degrade);
+ *         return 1;
+ *     }
+ *     Window()->startFrameLoop(drawFrame, ctx);
  */
 struct HTMLWindow
 {
+    /**
+     * This anonymous struct encapsulates fields of the HTMLWindow struct intended to be private:
+     * the state of the frame loop, and the size, visibility and focus of the window.
+     */
+    struct
+    {
+        FrameCallback callback;
+        void *user;
+        int running;
+        /** incremented whenever the loop is started or stopped, so stale animation frames end */
+        int loop;
+        double interval;
+        int skipping;
+        /** the timestamp of the last frame drawn, or 0 before the first */
+        double lastTime;
+        int skipNext;
+        int skippedLast;
+        int degrade;
+        int overBudget;
+        int underBudget;
+        unsigned long frames;
+        unsigned long dropped;
+        unsigned long skipped;
+        FrameHistogram frameTimes;
+        FrameHistogram workTimes;
+        /** kept up to date by resize, visibilitychange, focus and blur listeners */
+        int innerHeight;
+        int innerWidth;
+        int outerHeight;
+        int outerWidth;
+        unsigned int sizeGeneration;
+        int visible;
+        int focused;
+        WindowThrottle throttle;
+        double throttledRate;
+    } private;
+    /*
+     * The window's dimensions are read once, when the HTMLWindow is created, and then kept up to
+     * date by a resize listener, so these don't call into JavaScript or make the browser lay out
+     * the page, and can be called every frame.
+     */
     int (*getInnerHeight)();
     int (*getInnerWidth)();
     int (*getOuterHeight)();
     int (*getOuterWidth)();
+    /**
+     * Returns a number which changes whenever the window's dimensions do. Compare it with the
+     * number from the previous frame to resize a canvas only when the window was resized.
+     */
+    unsigned int (*getSizeGeneration)();
     void (*blur)();
+    /**
+     * Calls callback on each animation frame, through requestAnimationFrame(), until it returns 0
+     * or stopFrameLoop() is called. Only one loop runs at a time; starting another replaces it.
+     * Frames come at most at the frame rate set by setFrameRate().
+     */
+    void (*startFrameLoop)(FrameCallback callback, void *user);
+    void (*stopFrameLoop)();
+    /**
+     * Sets the frame rate the loop targets, 60 by default. Animation frames which come sooner
+     * than that are left out, so 30 draws every other frame on a 60 Hz display. The frame budget
+     * is one frame at this rate.
+     */
+    void (*setFrameRate)(double framesPerSecond);
+    /**
+     * If enabled is non-zero, the frame after one whose callback went over budget is left out,
+     * giving the browser time to catch up instead of falling further behind. Off by default.
+     */
+    void (*setFrameSkipping)(int enabled);
+    /** Fills in stats with the timing of the frame loop so far. */
+    void (*getFrameStats)(FrameStats *stats);
+    /** Returns non-zero unless the page is hidden, as document.visibilityState tells. */
+    int (*isVisible)();
+    /** Returns non-zero if the window has focus. */
+    int (*hasFocus)();
+    /**
+     * Throttles the frame loop while the window is in the state when describes: frames are
+     * then drawn by a timer at framesPerSecond instead of by animation frames, or not at all if
+     * framesPerSecond is 0. The loop goes back to animation frames as soon as the window is
+     * visible or focused again. THROTTLE_NONE, the default, turns throttling off.
+     */
+    void (*setThrottling)(WindowThrottle when, double framesPerSecond);
 };
 
 /**
@@ -57,6 +242,7 @@ struct HTMLWindow
  */
 HTMLWindow *Window();
 
+/** Stops the frame loop, if running, and frees the HTMLWindow. */
 void freeWindow(HTMLWindow *window);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,323 @@
+/**
+ * Microbenchmarks: the cost of a single call of each CanvasRenderingContext2D method, and of
+ * creating and freeing a canvas, through the DOM backend against the JavaScript stand-ins of
+ * node/stub_canvas.js. Results are printed as JSON, one entry per benchmark.
+ *
+ *     node build/bench.js [name-filter]
+ *
+ * Each benchmark runs with a growing number of iterations until one run lasts at least
+ * BENCH_MIN_MS; the earlier runs double as warm-up. Since the stand-ins do no drawing, the times
+ * are the library's own work plus the cost of crossing into JavaScript, which is what a change to
+ * the library can affect. Setters alternate between two values, so the calls aren't skipped as
+ * redundant, and calls that extend the current path begin a new one every 256 calls.
+ * @file bench.c
+ * @author Alex Tyner
+ */
+#include <emscripten.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "canvas.h"
+#include "node/bench_stats.h"
+
+#define BENCH_MIN_MS 20.0
+#define BENCH_MAX_ITERATIONS (1 << 24)
+#define BENCH_BATCH 64
+#define BENCH_IMAGE_SIZE 64
+
+/** A benchmark runs n calls of what it measures, with i counting them. */
+typedef struct Benchmark
+{
+    const char *name;
+    void (*run)(CanvasRenderingContext2D *ctx, int n);
+} Benchmark;
+
+static float rects[4 * BENCH_BATCH];
+static float matrices[6 * BENCH_BATCH];
+static uint32_t colors[BENCH_BATCH];
+static float points[2 * BENCH_BATCH];
+static ImageData *image;
+static Path2D *star;
+
+#define BENCHMARK(id, setup, call, teardown)                       \
+    static void bench_##id(CanvasRenderingContext2D *ctx, int n) \
+    {                                                              \
+        setup;                                                     \
+        for (int i = 0; i < n; i++)                                \
+        {                                                          \
+            call;                                                  \
+        }                                                          \
+        teardown;                                                  \
+    }
+#define NOTHING ((void)0)
+#define NEW_PATH_EVERY_256 ((i & 255) == 0 ? ctx->beginPath(ctx) : (void)0)
+#define FLUSH_EVERY_1024 ((i & 1023) == 1023 ? ctx->flush(ctx) : (void)0)
+#define RECT_PATH (ctx->beginPath(ctx), ctx->rect(ctx, 8, 8, 48, 48))
+
+/* Begin: Rectangles */
+BENCHMARK(clearRect, NOTHING, ctx->clearRect(ctx, i & 63, 0, 8, 8), NOTHING)
+BENCHMARK(fillRect, NOTHING, ctx->fillRect(ctx, i & 63, 0, 8, 8), NOTHING)
+BENCHMARK(strokeRect, NOTHING, ctx->strokeRect(ctx, i & 63, 0, 8, 8), NOTHING)
+BENCHMARK(clearRects, NOTHING, ctx->clearRects(ctx, rects, BENCH_BATCH), NOTHING)
+BENCHMARK(fillRects, NOTHING, ctx->fillRects(ctx, rects, BENCH_BATCH), NOTHING)
+BENCHMARK(strokeRects, NOTHING, ctx->strokeRects(ctx, rects, BENCH_BATCH), NOTHING)
+BENCHMARK(fillRectsColored, NOTHING, ctx->fillRectsColored(ctx, rects, colors, BENCH_BATCH), NOTHING)
+BENCHMARK(fillRectsTransformed, NOTHING, ctx->fillRectsTransformed(ctx, rects, matrices, BENCH_BATCH), NOTHING)
+/* End: Rectangles */
+
+/* Begin: Pixels */
+BENCHMARK(putImageData, NOTHING, ctx->putImageData(ctx, image, i & 63, 0), NOTHING)
+BENCHMARK(putImageDataDirty, NOTHING, (image->markDirty(image, i & 31, 8, 16, 16), ctx->putImageDataDirty(ctx, image, 0, 0)), NOTHING)
+BENCHMARK(getImageData, NOTHING, ctx->getImageData(ctx, image, i & 63, 0), NOTHING)
+/* End: Pixels */
+
+/* Begin: Text */
+BENCHMARK(fillText, NOTHING, ctx->fillText(ctx, "Hello, world", i & 63, 20, -1), NOTHING)
+BENCHMARK(strokeText, NOTHING, ctx->strokeText(ctx, "Hello, world", i & 63, 20, -1), NOTHING)
+/* End: Text */
+
+/* Begin: Setters */
+BENCHMARK(setLineWidth, NOTHING, ctx->setLineWidth(ctx, 1 + (i & 1)), NOTHING)
+BENCHMARK(setLineCap, NOTHING, ctx->setLineCap(ctx, i & 1 ? "round" : "butt"), NOTHING)
+BENCHMARK(setLineCapEnum, NOTHING, ctx->setLineCapEnum(ctx, i & 1 ? LINE_CAP_ROUND : LINE_CAP_BUTT), NOTHING)
+BENCHMARK(setLineJoin, NOTHING, ctx->setLineJoin(ctx, i & 1 ? "round" : "miter"), NOTHING)
+BENCHMARK(setLineJoinEnum, NOTHING, ctx->setLineJoinEnum(ctx, i & 1 ? LINE_JOIN_ROUND : LINE_JOIN_MITER), NOTHING)
+BENCHMARK(setFont, NOTHING, ctx->setFont(ctx, i & 1 ? "12px sans-serif" : "14px serif"), NOTHING)
+BENCHMARK(setTextAlign, NOTHING, ctx->setTextAlign(ctx, i & 1 ? "center" : "start"), NOTHING)
+BENCHMARK(setTextAlignEnum, NOTHING, ctx->setTextAlignEnum(ctx, i & 1 ? TEXT_ALIGN_CENTER : TEXT_ALIGN_START), NOTHING)
+BENCHMARK(setFillStyle, NOTHING, ctx->setFillStyle(ctx, i & 1 ? "#ff0000" : "#00ff00"), NOTHING)
+BENCHMARK(setStrokeStyle, NOTHING, ctx->setStrokeStyle(ctx, i & 1 ? "#ff0000" : "#00ff00"), NOTHING)
+BENCHMARK(setFillColor, NOTHING, ctx->setFillColor(ctx, i & 1 ? 0xFF0000FF : 0x00FF00FF), NOTHING)
+BENCHMARK(setStrokeColor, NOTHING, ctx->setStrokeColor(ctx, i & 1 ? 0xFF0000FF : 0x00FF00FF), NOTHING)
+BENCHMARK(setGlobalAlpha, NOTHING, ctx->setGlobalAlpha(ctx, i & 1 ? 0.5 : 1), NOTHING)
+BENCHMARK(setGlobalCompositeOperation, NOTHING, ctx->setGlobalCompositeOperation(ctx, i & 1 ? "multiply" : "source-over"), NOTHING)
+BENCHMARK(setGlobalCompositeOperationEnum, NOTHING, ctx->setGlobalCompositeOperationEnum(ctx, i & 1 ? COMPOSITE_MULTIPLY : COMPOSITE_SOURCE_OVER), NOTHING)
+/* End: Setters */
+
+/* Begin: Getters */
+BENCHMARK(getLineWidth, NOTHING, ctx->getLineWidth(ctx), NOTHING)
+BENCHMARK(getLineCap, NOTHING, ctx->getLineCap(ctx), NOTHING)
+BENCHMARK(getLineCapEnum, NOTHING, ctx->getLineCapEnum(ctx), NOTHING)
+BENCHMARK(getLineJoin, NOTHING, ctx->getLineJoin(ctx), NOTHING)
+BENCHMARK(getLineJoinEnum, NOTHING, ctx->getLineJoinEnum(ctx), NOTHING)
+BENCHMARK(getFont, NOTHING, ctx->getFont(ctx), NOTHING)
+BENCHMARK(getTextAlign, NOTHING, ctx->getTextAlign(ctx), NOTHING)
+BENCHMARK(getTextAlignEnum, NOTHING, ctx->getTextAlignEnum(ctx), NOTHING)
+BENCHMARK(getFillStyle, NOTHING, ctx->getFillStyle(ctx), NOTHING)
+BENCHMARK(getStrokeStyle, NOTHING, ctx->getStrokeStyle(ctx), NOTHING)
+BENCHMARK(getGlobalAlpha, NOTHING, ctx->getGlobalAlpha(ctx), NOTHING)
+BENCHMARK(getGlobalCompositeOperation, NOTHING, ctx->getGlobalCompositeOperation(ctx), NOTHING)
+BENCHMARK(getGlobalCompositeOperationEnum, NOTHING, ctx->getGlobalCompositeOperationEnum(ctx), NOTHING)
+BENCHMARK(getTransform, NOTHING, ctx->getTransform(ctx), NOTHING)
+BENCHMARK(getCanvas, NOTHING, ctx->getCanvas(ctx), NOTHING)
+/* End: Getters */
+
+/* Begin: Paths */
+BENCHMARK(beginPath, NOTHING, ctx->beginPath(ctx), NOTHING)
+BENCHMARK(closePath, NOTHING, (NEW_PATH_EVERY_256, ctx->closePath(ctx)), NOTHING)
+BENCHMARK(moveTo, NOTHING, (NEW_PATH_EVERY_256, ctx->moveTo(ctx, i & 63, 8)), NOTHING)
+BENCHMARK(lineTo, NOTHING, (NEW_PATH_EVERY_256, ctx->lineTo(ctx, i & 63, 8)), NOTHING)
+BENCHMARK(bezierCurveTo, NOTHING, (NEW_PATH_EVERY_256, ctx->bezierCurveTo(ctx, 0, 0, 16, 32, i & 63, 8)), NOTHING)
+BENCHMARK(quadraticCurveTo, NOTHING, (NEW_PATH_EVERY_256, ctx->quadraticCurveTo(ctx, 16, 32, i & 63, 8)), NOTHING)
+BENCHMARK(arc, NOTHING, (NEW_PATH_EVERY_256, ctx->arc(ctx, 32, 32, 16, 0, 1 + (i & 3))), NOTHING)
+BENCHMARK(arcTo, NOTHING, (NEW_PATH_EVERY_256, ctx->arcTo(ctx, 48, 0, 48, 48, 8)), NOTHING)
+BENCHMARK(ellipse, NOTHING, (NEW_PATH_EVERY_256, ctx->ellipse(ctx, 32, 32, 16, 8, 0.5, 0, 1 + (i & 3))), NOTHING)
+BENCHMARK(rect, NOTHING, (NEW_PATH_EVERY_256, ctx->rect(ctx, i & 63, 0, 8, 8)), NOTHING)
+BENCHMARK(polyline, NOTHING, (NEW_PATH_EVERY_256, ctx->polyline(ctx, points, BENCH_BATCH, 0)), NOTHING)
+BENCHMARK(fill, RECT_PATH, ctx->fill(ctx), NOTHING)
+BENCHMARK(stroke, RECT_PATH, ctx->stroke(ctx), NOTHING)
+BENCHMARK(clip, (ctx->save(ctx), RECT_PATH), ctx->clip(ctx), ctx->restore(ctx))
+BENCHMARK(isPointInPath, RECT_PATH, ctx->isPointInPath(ctx, i & 63, 32), NOTHING)
+BENCHMARK(isPointInPathFillRule, RECT_PATH, ctx->isPointInPathFillRule(ctx, i & 63, 32, FILL_RULE_EVENODD), NOTHING)
+BENCHMARK(isPointInStroke, RECT_PATH, ctx->isPointInStroke(ctx, i & 63, 8), NOTHING)
+BENCHMARK(fillPath, NOTHING, ctx->fillPath(ctx, star), NOTHING)
+BENCHMARK(strokePath, NOTHING, ctx->strokePath(ctx, star), NOTHING)
+BENCHMARK(clipPath, ctx->save(ctx), ctx->clipPath(ctx, star), ctx->restore(ctx))
+BENCHMARK(isPointInPath2D, NOTHING, ctx->isPointInPath2D(ctx, star, i & 63, 32, FILL_RULE_NONZERO), NOTHING)
+BENCHMARK(isPointInStroke2D, NOTHING, ctx->isPointInStroke2D(ctx, star, i & 63, 32), NOTHING)
+/* End: Paths */
+
+/* Begin: Transforms and state */
+BENCHMARK(rotate, NOTHING, ctx->rotate(ctx, i & 1 ? 0.5 : -0.5), NOTHING)
+BENCHMARK(scale, NOTHING, ctx->scale(ctx, i & 1 ? 2 : 0.5, i & 1 ? 2 : 0.5), NOTHING)
+BENCHMARK(translate, NOTHING, ctx->translate(ctx, i & 1 ? 8 : -8, 0), NOTHING)
+BENCHMARK(transform, NOTHING, ctx->transform(ctx, 1, 0, 0, 1, i & 1 ? 8 : -8, 0), NOTHING)
+BENCHMARK(setTransform, NOTHING, ctx->setTransform(ctx, 1, 0, 0, 1, i & 63, 0), NOTHING)
+BENCHMARK(resetTransform, NOTHING, ctx->resetTransform(ctx), NOTHING)
+BENCHMARK(save_restore, NOTHING, (ctx->save(ctx), ctx->restore(ctx)), NOTHING)
+/* End: Transforms and state */
+
+/* Begin: Recording mode */
+BENCHMARK(fillRect_recording, ctx->beginRecording(ctx), (ctx->fillRect(ctx, i & 63, 0, 8, 8), FLUSH_EVERY_1024), ctx->endRecording(ctx))
+BENCHMARK(lineTo_recording, ctx->beginRecording(ctx), (NEW_PATH_EVERY_256, ctx->lineTo(ctx, i & 63, 8), FLUSH_EVERY_1024), ctx->endRecording(ctx))
+BENCHMARK(setFillColor_recording, ctx->beginRecording(ctx), (ctx->setFillColor(ctx, i & 1 ? 0xFF0000FF : 0x00FF00FF), FLUSH_EVERY_1024), ctx->endRecording(ctx))
+BENCHMARK(flush_recording, ctx->beginRecording(ctx), (ctx->fillRect(ctx, i & 63, 0, 8, 8), ctx->flush(ctx)), ctx->endRecording(ctx))
+/* End: Recording mode */
+
+/* Begin: Canvases */
+BENCHMARK(createCanvas_freeCanvas, NOTHING, freeCanvas(createCanvas("bench-temporary")), NOTHING)
+BENCHMARK(createCanvas_getContext_freeCanvas, HTMLCanvasElement *canvas, (canvas = createCanvas("bench-temporary"), canvas->getContext(canvas, "2d"), freeCanvas(canvas)), NOTHING)
+BENCHMARK(getWidth, HTMLCanvasElement *canvas = ctx->getCanvas(ctx), canvas->getWidth(canvas), NOTHING)
+BENCHMARK(setWidth, HTMLCanvasElement *canvas = ctx->getCanvas(ctx), canvas->setWidth(canvas, 256 + (i & 1)), canvas->setWidth(canvas, 256))
+/* End: Canvases */
+
+#define ENTRY(id, name) {name, bench_##id}
+static const Benchmark benchmarks[] = {
+    ENTRY(clearRect, "clearRect"),
+    ENTRY(fillRect, "fillRect"),
+    ENTRY(strokeRect, "strokeRect"),
+    ENTRY(clearRects, "clearRects[64]"),
+    ENTRY(fillRects, "fillRects[64]"),
+    ENTRY(strokeRects, "strokeRects[64]"),
+    ENTRY(fillRectsColored, "fillRectsColored[64]"),
+    ENTRY(fillRectsTransformed, "fillRectsTransformed[64]"),
+    ENTRY(putImageData, "putImageData[64x64]"),
+    ENTRY(putImageDataDirty, "putImageDataDirty[16x16]"),
+    ENTRY(getImageData, "getImageData[64x64]"),
+    ENTRY(fillText, "fillText"),
+    ENTRY(strokeText, "strokeText"),
+    ENTRY(setLineWidth, "setLineWidth"),
+    ENTRY(setLineCap, "setLineCap"),
+    ENTRY(setLineCapEnum, "setLineCapEnum"),
+    ENTRY(setLineJoin, "setLineJoin"),
+    ENTRY(setLineJoinEnum, "setLineJoinEnum"),
+    ENTRY(setFont, "setFont"),
+    ENTRY(setTextAlign, "setTextAlign"),
+    ENTRY(setTextAlignEnum, "setTextAlignEnum"),
+    ENTRY(setFillStyle, "setFillStyle"),
+    ENTRY(setStrokeStyle, "setStrokeStyle"),
+    ENTRY(setFillColor, "setFillColor"),
+    ENTRY(setStrokeColor, "setStrokeColor"),
+    ENTRY(setGlobalAlpha, "setGlobalAlpha"),
+    ENTRY(setGlobalCompositeOperation, "setGlobalCompositeOperation"),
+    ENTRY(setGlobalCompositeOperationEnum, "setGlobalCompositeOperationEnum"),
+    ENTRY(getLineWidth, "getLineWidth"),
+    ENTRY(getLineCap, "getLineCap"),
+    ENTRY(getLineCapEnum, "getLineCapEnum"),
+    ENTRY(getLineJoin, "getLineJoin"),
+    ENTRY(getLineJoinEnum, "getLineJoinEnum"),
+    ENTRY(getFont, "getFont"),
+    ENTRY(getTextAlign, "getTextAlign"),
+    ENTRY(getTextAlignEnum, "getTextAlignEnum"),
+    ENTRY(getFillStyle, "getFillStyle"),
+    ENTRY(getStrokeStyle, "getStrokeStyle"),
+    ENTRY(getGlobalAlpha, "getGlobalAlpha"),
+    ENTRY(getGlobalCompositeOperation, "getGlobalCompositeOperation"),
+    ENTRY(getGlobalCompositeOperationEnum, "getGlobalCompositeOperationEnum"),
+    ENTRY(getTransform, "getTransform"),
+    ENTRY(getCanvas, "getCanvas"),
+    ENTRY(beginPath, "beginPath"),
+    ENTRY(closePath, "closePath"),
+    ENTRY(moveTo, "moveTo"),
+    ENTRY(lineTo, "lineTo"),
+    ENTRY(bezierCurveTo, "bezierCurveTo"),
+    ENTRY(quadraticCurveTo, "quadraticCurveTo"),
+    ENTRY(arc, "arc"),
+    ENTRY(arcTo, "arcTo"),
+    ENTRY(ellipse, "ellipse"),
+    ENTRY(rect, "rect"),
+    ENTRY(polyline, "polyline[64]"),
+    ENTRY(fill, "fill"),
+    ENTRY(stroke, "stroke"),
+    ENTRY(clip, "clip"),
+    ENTRY(isPointInPath, "isPointInPath"),
+    ENTRY(isPointInPathFillRule, "isPointInPathFillRule"),
+    ENTRY(isPointInStroke, "isPointInStroke"),
+    ENTRY(fillPath, "fillPath"),
+    ENTRY(strokePath, "strokePath"),
+    ENTRY(clipPath, "clipPath"),
+    ENTRY(isPointInPath2D, "isPointInPath2D"),
+    ENTRY(isPointInStroke2D, "isPointInStroke2D"),
+    ENTRY(rotate, "rotate"),
+    ENTRY(scale, "scale"),
+    ENTRY(translate, "translate"),
+    ENTRY(transform, "transform"),
+    ENTRY(setTransform, "setTransform"),
+    ENTRY(resetTransform, "resetTransform"),
+    ENTRY(save_restore, "save+restore"),
+    ENTRY(fillRect_recording, "fillRect (recording)"),
+    ENTRY(lineTo_recording, "lineTo (recording)"),
+    ENTRY(setFillColor_recording, "setFillColor (recording)"),
+    ENTRY(flush_recording, "fillRect+flush (recording)"),
+    ENTRY(createCanvas_freeCanvas, "createCanvas+freeCanvas"),
+    ENTRY(createCanvas_getContext_freeCanvas, "createCanvas+getContext+freeCanvas"),
+    ENTRY(getWidth, "getWidth"),
+    ENTRY(setWidth, "setWidth"),
+};
+
+static void prepare(void)
+{
+    for (int i = 0; i < BENCH_BATCH; i++)
+    {
+        rects[4 * i] = (float)(i % 8 * 32);
+        rects[4 * i + 1] = (float)(i / 8 * 32);
+        rects[4 * i + 2] = rects[4 * i + 3] = 24;
+        float angle = (float)i / BENCH_BATCH * 6.2831853f;
+        float *m = matrices + 6 * i;
+        m[0] = m[3] = cosf(angle);
+        m[1] = sinf(angle);
+        m[2] = -m[1];
+        m[4] = m[5] = 128;
+        colors[i] = 0x10204000u * (uint32_t)i | 0xFF;
+        points[2 * i] = (float)(i * 4);
+        points[2 * i + 1] = (float)(32 + 24 * sinf(i * 0.3f));
+    }
+    image = createImageData(BENCH_IMAGE_SIZE, BENCH_IMAGE_SIZE);
+    star = createPath2D();
+    for (int i = 0; i < 10; i++)
+    {
+        double radius = i & 1 ? 12 : 30, angle = i * 3.14159265358979323846 / 5;
+        if (i == 0)
+            star->moveTo(star, 32 + radius * sin(angle), 32 - radius * cos(angle));
+        else
+            star->lineTo(star, 32 + radius * sin(angle), 32 - radius * cos(angle));
+    }
+    star->closePath(star);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = argc > 1 ? argv[1] : "";
+    prepare();
+    HTMLCanvasElement *canvas = createCanvas("bench");
+    canvas->setWidth(canvas, 256);
+    canvas->setHeight(canvas, 256);
+    CanvasRenderingContext2D *ctx = canvas->getContext(canvas, "2d");
+    /* the first draw hands the star to JavaScript, which every later one skips */
+    ctx->fillPath(ctx, star);
+    printf("{\n  \"library\": \"wasm-canvas\",\n  \"unit\": \"ns\",\n  \"benchmarks\": [");
+    const char *separator = "";
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++)
+    {
+        if (!strstr(benchmarks[b].name, filter))
+            continue;
+        int n = 16;
+        double elapsed, crossings, calls, bytes;
+        for (;;)
+        {
+            /* every benchmark starts from the same state, and leaves nothing behind */
+            ctx->save(ctx);
+            ctx->beginPath(ctx);
+            benchResetStats();
+            double start = emscripten_get_now();
+            benchmarks[b].run(ctx, n);
+            elapsed = emscripten_get_now() - start;
+            crossings = benchStat(BENCH_CROSSINGS);
+            calls = benchStat(BENCH_JS_CALLS);
+            bytes = benchStat(BENCH_BYTES);
+            ctx->restore(ctx);
+            if (elapsed >= BENCH_MIN_MS || n >= BENCH_MAX_ITERATIONS)
+                break;
+            n *= 4;
+        }
+        printf("%s\n    {\"name\": \"%s\", \"iterations\": %d, \"nsPerCall\": %.2f, \"crossingsPerCall\": %.3f, \"jsCallsPerCall\": %.3f, \"bytesPerCall\": %.1f}",
+               separator, benchmarks[b].name, n, elapsed * 1e6 / n,
+               crossings / n, calls / n, bytes / n);
+        separator = ",";
+    }
+    printf("\n  ]\n}\n");
+    freeCanvas(canvas);
+    freePath2D(star);
+    freeImageData(image);
+    return 0;
+}
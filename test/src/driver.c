@@ -2,6 +2,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include "canvas.h"
+#include "raster.h"
+#include "pixels.h"
+#include "displaylist.h"
+#include "displayfile.h"
+#include "trace.h"
 #include "window.h"
 
 static void log(char *msg)
@@ -46,6 +51,33 @@ static void assertStringEquals(char *testID, char *expected, char *actual)
     free(msg);
 }
 
+typedef struct MemorySink
+{
+    unsigned char *bytes;
+    size_t length;
+} MemorySink;
+
+static int writeToMemory(void *user, const void *bytes, size_t length)
+{
+    MemorySink *sink = (MemorySink *)user;
+    sink->bytes = (unsigned char *)realloc(sink->bytes, sink->length + length);
+    memcpy(sink->bytes + sink->length, bytes, length);
+    sink->length += length;
+    return 1;
+}
+
+static int countFrames(const FrameInfo *frame, void *user)
+{
+    if (frame->frame < 3)
+        return 1;
+    FrameStats stats;
+    Window()->getFrameStats(&stats);
+    assertEquals("HTMLWindow.startFrameLoop()", 3, (int)stats.frames);
+    assertEquals("HTMLWindow.getFrameStats()", 1, stats.frameP50 > 0 && stats.frameP50 <= stats.frameP99);
+    freeWindow(Window());
+    return 0;
+}
+
 int main(void)
 {
     log("Creating an HTMLCanvasElement 'canvas' with id='test'.");
@@ -70,6 +102,10 @@ int main(void)
     // test Window.getInnerWidth()
     snprintf(buf, 32, "Window().getInnerWidth(): %d", Window()->getInnerWidth());
     log(buf);
+    // test Window.getSizeGeneration(), unchanged until the window is resized
+    assertEquals("Window().getSizeGeneration()", 0, (int)Window()->getSizeGeneration());
+    // test Window.isVisible()
+    assertEquals("Window().isVisible()", 1, Window()->isVisible());
 
     log("Getting drawing context 'ctx' of type '2d' from canvas 'canvas'.");
     CanvasRenderingContext2D *ctx = canvas->getContext(canvas, "2d");
@@ -83,6 +119,66 @@ int main(void)
     // test CanvasRenderingContext2D.strokeRect()
     ctx->strokeRect(ctx, 10, 10, 75, 75);
     assertEquals("CanvasRenderingContext2D.strokeRect()", 0, 0);
+    // test CanvasRenderingContext2D.fillRects()
+    float rects[] = {60, 0, 10, 10, 75, 0, 10, 10, 90, 0, 10, 10};
+    ctx->fillRects(ctx, rects, 3);
+    assertEquals("CanvasRenderingContext2D.fillRects()", 0, 0);
+    // test CanvasRenderingContext2D.fillRectsColored()
+    uint32_t colors[] = {0xFF0000FF, 0x00FF00FF, 0x0000FFFF};
+    ctx->fillRectsColored(ctx, rects, colors, 3);
+    assertStringEquals("CanvasRenderingContext2D.fillRectsColored()", "#000000", ctx->getFillStyle(ctx)); // fill style left unchanged
+    // test CanvasRenderingContext2D.polyline()
+    float triangle[] = {150, 150, 200, 150, 175, 110};
+    ctx->beginPath(ctx);
+    ctx->polyline(ctx, triangle, 3, 1);
+    assertEquals("CanvasRenderingContext2D.polyline()", 1, ctx->isPointInPath(ctx, 175, 140));
+    // test CanvasRenderingContext2D.polylines()
+    float squares[] = {0, 0, 10, 0, 10, 10, 0, 10, 20, 20, 30, 20, 30, 30, 20, 30};
+    uint32_t offsets[] = {0, 4, 8};
+    ctx->beginPath(ctx);
+    ctx->polylines(ctx, squares, offsets, 2, 1);
+    assertEquals("CanvasRenderingContext2D.polylines()", 1, ctx->isPointInPath(ctx, 25, 25));
+    // test CanvasRenderingContext2D.isPointInPathFillRule()
+    ctx->beginPath(ctx);
+    ctx->rect(ctx, 0, 0, 40, 40);
+    ctx->rect(ctx, 10, 10, 20, 20);
+    assertEquals("CanvasRenderingContext2D.isPointInPathFillRule()", 0, ctx->isPointInPathFillRule(ctx, 20, 20, FILL_RULE_EVENODD));
+    // test CanvasRenderingContext2D.isPointInPath() with a transform
+    ctx->save(ctx);
+    ctx->translate(ctx, 100, 0);
+    ctx->beginPath(ctx);
+    ctx->arc(ctx, 20, 20, 10, 0, 2 * 3.14159265);
+    ctx->restore(ctx);
+    assertEquals("CanvasRenderingContext2D.isPointInPath() transformed", 1, ctx->isPointInPath(ctx, 120, 20));
+    // test CanvasRenderingContext2D.getTransform()
+    ctx->save(ctx);
+    ctx->translate(ctx, 30, 40);
+    ctx->scale(ctx, 2, 2);
+    assertEquals("CanvasRenderingContext2D.getTransform()", 40, (int)ctx->getTransform(ctx).f);
+    ctx->restore(ctx);
+    assertEquals("CanvasRenderingContext2D.getTransform() restored", 1, (int)ctx->getTransform(ctx).a);
+    // test CanvasRenderingContext2D.fillRectsTransformed()
+    float sprites[] = {-5, -5, 10, 10, -5, -5, 10, 10};
+    float spriteTransforms[] = {0.8f, 0.6f, -0.6f, 0.8f, 200, 20, 1, 0, 0, -1, 220, 20};
+    ctx->fillRectsTransformed(ctx, sprites, spriteTransforms, 2);
+    assertEquals("CanvasRenderingContext2D.fillRectsTransformed()", 1, ctx->isPointInPath(ctx, 120, 20)); // current path left untouched
+    assertEquals("CanvasRenderingContext2D.fillRectsTransformed() identity restored", 0, (int)ctx->getTransform(ctx).e);
+    // test CanvasRenderingContext2D.putImageData()
+    ImageData *image = createImageData(2, 2);
+    memset(image->data, 255, 2 * 2 * 4);
+    ctx->putImageData(ctx, image, 290, 140);
+    // test CanvasRenderingContext2D.getImageData()
+    memset(image->data, 0, 2 * 2 * 4);
+    ctx->getImageData(ctx, image, 290, 140);
+    assertEquals("CanvasRenderingContext2D.putImageData()/getImageData()", 255, image->data[4 * 3 + 3]);
+    // test ImageData.markDirty()
+    image->markDirty(image, 0, 0, 1, 1);
+    image->markDirty(image, 1, 0, 1, 1);
+    assertEquals("ImageData.markDirty()", 1, image->private.damageCount); // adjacent pixels coalesce
+    // test CanvasRenderingContext2D.putImageDataDirty()
+    ctx->putImageDataDirty(ctx, image, 290, 140);
+    assertEquals("CanvasRenderingContext2D.putImageDataDirty()", 0, image->private.damageCount);
+    freeImageData(image);
     // test CanvasRenderingContext2D.fillText()
     ctx->fillText(ctx, "fillText()", 100, 24, -1);
     ctx->fillText(ctx, "fillText()", 100, 48, 16);
@@ -118,8 +214,221 @@ int main(void)
     // test CanvasRenderingContext2D.setTextAlign()
     ctx->setTextAlign(ctx, "left");
     assertStringEquals("CanvasRenderingContext2D.setTextAlign()", "left", ctx->getTextAlign(ctx));
+    // test CanvasRenderingContext2D.setLineCapEnum()
+    ctx->setLineCapEnum(ctx, LINE_CAP_SQUARE);
+    assertStringEquals("CanvasRenderingContext2D.setLineCapEnum()", "square", ctx->getLineCap(ctx));
+    // test CanvasRenderingContext2D.getLineCapEnum()
+    ctx->setLineCap(ctx, "round");
+    assertEquals("CanvasRenderingContext2D.getLineCapEnum()", LINE_CAP_ROUND, ctx->getLineCapEnum(ctx));
+    // test CanvasRenderingContext2D.setGlobalCompositeOperationEnum()
+    ctx->setGlobalCompositeOperationEnum(ctx, COMPOSITE_MULTIPLY);
+    assertStringEquals("CanvasRenderingContext2D.setGlobalCompositeOperationEnum()", "multiply", ctx->getGlobalCompositeOperation(ctx));
+    ctx->setGlobalCompositeOperationEnum(ctx, COMPOSITE_SOURCE_OVER);
+    // test CanvasRenderingContext2D.setFillColor()
+    ctx->setFillColor(ctx, 0xFF0000FF);
+    assertStringEquals("CanvasRenderingContext2D.setFillColor()", "#ff0000", ctx->getFillStyle(ctx));
+    // test CanvasRenderingContext2D.setStrokeColor()
+    ctx->setStrokeColor(ctx, 0x00FF00FF);
+    assertStringEquals("CanvasRenderingContext2D.setStrokeColor()", "#00ff00", ctx->getStrokeStyle(ctx));
+
+    // test CanvasRenderingContext2D.beginRecording()
+    ctx->beginRecording(ctx);
+    ctx->setLineWidth(ctx, 4.0);
+    ctx->fillRect(ctx, 0, 100, 50, 50);
+    assertEquals("CanvasRenderingContext2D.beginRecording()", 40, ctx->getLineWidth(ctx) * 10); // answered from the shadow state
+    // test CanvasRenderingContext2D.endRecording()
+    ctx->setLineWidth(ctx, 2.0);
+    ctx->endRecording(ctx);
+    assertEquals("CanvasRenderingContext2D.endRecording()", 20, ctx->getLineWidth(ctx) * 10);
+
+    // test CanvasRenderingContext2D.isPointInPath2D()
+    Path2D *wedge = createPath2D();
+    wedge->moveTo(wedge, 0, 0);
+    wedge->lineTo(wedge, 40, 0);
+    wedge->lineTo(wedge, 0, 40);
+    wedge->closePath(wedge);
+    assertEquals("CanvasRenderingContext2D.isPointInPath2D()", 1, ctx->isPointInPath2D(ctx, wedge, 10, 10, FILL_RULE_NONZERO));
+    // test Path2D segments added after first use
+    wedge->rect(wedge, 100, 100, 10, 10);
+    assertEquals("Path2D.rect() after use", 1, ctx->isPointInPath2D(ctx, wedge, 105, 105, FILL_RULE_NONZERO));
+    // test CanvasRenderingContext2D.fillPath() while recording
+    ctx->beginRecording(ctx);
+    ctx->fillPath(ctx, wedge);
+    ctx->endRecording(ctx);
+    // test Path2D changed and freed while draws of it are recorded
+    ctx->save(ctx);
+    ctx->resetTransform(ctx);
+    ctx->clearRect(ctx, 0, 0, 60, 20);
+    ctx->setFillColor(ctx, 0xFF0000FF);
+    ctx->setStrokeColor(ctx, 0xFF0000FF);
+    Path2D *recorded = createPath2D();
+    recorded->rect(recorded, 0, 0, 10, 10);
+    ctx->beginRecording(ctx);
+    ctx->fillPath(ctx, recorded);
+    recorded->rect(recorded, 20, 0, 10, 10);
+    ctx->strokePath(ctx, recorded);
+    freePath2D(recorded);
+    Path2D *reused = createPath2D();
+    reused->rect(reused, 40, 0, 10, 10);
+    ctx->fillPath(ctx, reused);
+    ctx->endRecording(ctx);
+    ImageData *recordedPixel = createImageData(1, 1);
+    ctx->getImageData(ctx, recordedPixel, 5, 5);
+    assertEquals("Path2D recorded before a change", 255, recordedPixel->data[3]);
+    ctx->getImageData(ctx, recordedPixel, 25, 5);
+    assertEquals("Path2D change not drawn by an earlier recorded fill", 0, recordedPixel->data[3]);
+    ctx->getImageData(ctx, recordedPixel, 45, 5);
+    assertEquals("Path2D created after one freed while recording", 255, recordedPixel->data[3]);
+    freeImageData(recordedPixel);
+    freePath2D(reused);
+    ctx->restore(ctx);
+    // test HTMLCanvasElement.addShape() and getShapeAt()
+    CanvasMatrix moved = {1, 0, 0, 1, 200, 0};
+    int lower = canvas->addShape(canvas, wedge, NULL, FILL_RULE_NONZERO, 0);
+    int upper = canvas->addShape(canvas, wedge, &moved, FILL_RULE_NONZERO, 0);
+    assertEquals("HTMLCanvasElement.getShapeAt()", lower, canvas->getShapeAt(canvas, 10, 10));
+    canvas->updateShape(canvas, upper, &(CanvasMatrix){1, 0, 0, 1, 0, 0});
+    assertEquals("HTMLCanvasElement.updateShape()", upper, canvas->getShapeAt(canvas, 10, 10));
+    // test HTMLCanvasElement.removeShape()
+    canvas->removeShape(canvas, upper);
+    int shapeHits[2];
+    assertEquals("HTMLCanvasElement.removeShape()", 1, (int)canvas->getShapesAt(canvas, 10, 10, shapeHits, 2));
+    canvas->removeShape(canvas, lower);
+    freePath2D(wedge);
+
+    // test createSoftwareCanvas()
+    HTMLCanvasElement *software = createSoftwareCanvas("software", 64, 64);
+    CanvasRenderingContext2D *softwareCtx = software->getContext(software, "2d");
+    // test HTMLCanvasElement.addShape() after querying no shapes
+    Path2D *square = createPath2D();
+    square->rect(square, 0, 0, 10, 10);
+    assertEquals("HTMLCanvasElement.getShapeAt() with no shapes", -1, software->getShapeAt(software, 5, 5));
+    int squareId = software->addShape(software, square, NULL, FILL_RULE_NONZERO, 0);
+    assertEquals("HTMLCanvasElement.addShape() after a query", squareId, software->getShapeAt(software, 5, 5));
+    software->removeShape(software, squareId);
+    // test a stroked shape's hit tests interleaved with ones on a context under another transform
+    int outlineId = software->addShape(software, square, NULL, FILL_RULE_NONZERO, 4);
+    softwareCtx->setTransform(softwareCtx, 2, 0, 0, 2, 0, 0);
+    assertEquals("HTMLCanvasElement.getShapeAt() on the stroke only", outlineId, software->getShapeAt(software, 11, 5));
+    assertEquals("CanvasRenderingContext2D.isPointInPath2D() between shape hit tests", 1, softwareCtx->isPointInPath2D(softwareCtx, square, 15, 15, FILL_RULE_NONZERO));
+    assertEquals("HTMLCanvasElement.getShapeAt() past the stroke", -1, software->getShapeAt(software, 13, 5));
+    softwareCtx->resetTransform(softwareCtx);
+    software->removeShape(software, outlineId);
+    freePath2D(square);
+    softwareCtx->setFillStyle(softwareCtx, "red");
+    softwareCtx->fillRect(softwareCtx, 8, 8, 16, 16);
+    ImageData *softwarePixels = createImageData(1, 1);
+    softwareCtx->getImageData(softwareCtx, softwarePixels, 12, 12);
+    assertEquals("createSoftwareCanvas(): fillRect()", 255, softwarePixels->data[0] & softwarePixels->data[3]);
+    // test software "copy" compositing, which clears everything outside the shape
+    softwareCtx->setGlobalCompositeOperation(softwareCtx, "copy");
+    softwareCtx->fillRect(softwareCtx, 32, 32, 8, 8);
+    softwareCtx->getImageData(softwareCtx, softwarePixels, 12, 12);
+    assertEquals("createSoftwareCanvas(): copy outside the shape", 0, softwarePixels->data[3]);
+    softwareCtx->getImageData(softwareCtx, softwarePixels, 36, 36);
+    assertEquals("createSoftwareCanvas(): copy inside the shape", 255, softwarePixels->data[3]);
+    softwareCtx->setGlobalCompositeOperation(softwareCtx, "source-over");
+    // test software CanvasRenderingContext2D.clip()
+    softwareCtx->beginPath(softwareCtx);
+    softwareCtx->rect(softwareCtx, 32, 32, 8, 8);
+    softwareCtx->clip(softwareCtx);
+    softwareCtx->fillRect(softwareCtx, 0, 0, 64, 64);
+    softwareCtx->getImageData(softwareCtx, softwarePixels, 48, 48);
+    assertEquals("createSoftwareCanvas(): clip()", 0, softwarePixels->data[3]);
+    freeCanvas(software);
+    // test DisplayList.replay()
+    software = createSoftwareCanvas("software", 64, 64);
+    softwareCtx = software->getContext(software, "2d");
+    DisplayList *frames[2] = {createDisplayList(), createDisplayList()};
+    CanvasRenderingContext2D *recorder = frames[0]->getContext(frames[0]);
+    recorder->setFillColor(recorder, 0x0000FFFF);
+    recorder->fillRect(recorder, 0, 0, 16, 16);
+    recorder->fillRect(recorder, 40, 40, 16, 16);
+    assertStringEquals("DisplayList.getContext()", "#0000ff", recorder->getFillStyle(recorder));
+    frames[0]->replay(frames[0], softwareCtx);
+    softwareCtx->getImageData(softwareCtx, softwarePixels, 44, 44);
+    assertEquals("DisplayList.replay()", 255, softwarePixels->data[2]);
+    // test DisplayList.diff()
+    recorder = frames[1]->getContext(frames[1]);
+    recorder->setFillColor(recorder, 0x0000FFFF);
+    recorder->fillRect(recorder, 0, 0, 16, 16);
+    recorder->fillRect(recorder, 44, 40, 16, 16);
+    int damage[4 * DISPLAY_LIST_MAX_DAMAGE_RECTS];
+    int damageCount = frames[1]->diff(frames[1], frames[0], 64, 64, damage);
+    assertEquals("DisplayList.diff()", 1, damageCount == 1 && damage[0] <= 40 && damage[0] + damage[2] >= 60 && damage[1] + damage[3] < 64);
+    // test DisplayList.replayDamage()
+    frames[1]->replayDamage(frames[1], softwareCtx, damage, damageCount);
+    softwareCtx->getImageData(softwareCtx, softwarePixels, 42, 44);
+    assertEquals("DisplayList.replayDamage()", 0, softwarePixels->data[3]);
+    softwareCtx->getImageData(softwareCtx, softwarePixels, 58, 44);
+    assertEquals("DisplayList.replayDamage() redrawn", 255, softwarePixels->data[2]);
+    // test DisplayList text damage with a '.' in the font before any size, which can't be estimated
+    DisplayList *text = createDisplayList(), *noText = createDisplayList();
+    CanvasRenderingContext2D *textRecorder = text->getContext(text);
+    textRecorder->setFont(textRecorder, "x-large \"Foo.Bar\"");
+    textRecorder->fillText(textRecorder, "Hello", 4, 20, -1);
+    damageCount = text->diff(text, noText, 256, 256, damage);
+    assertEquals("DisplayList.diff() text with no font size", 1, damageCount == 1 && damage[0] == 0 && damage[1] == 0 && damage[2] == 256 && damage[3] == 256);
+    // test DisplayList text damage with a size starting with a '.'
+    text->clear(text);
+    textRecorder->setFont(textRecorder, "bold .5em serif");
+    textRecorder->fillText(textRecorder, "Hello", 4, 20, -1);
+    damageCount = text->diff(text, noText, 256, 256, damage);
+    assertEquals("DisplayList.diff() text with a '.5em' font size", 1, damageCount == 1 && damage[2] < 256 && damage[3] < 256);
+    freeDisplayList(text);
+    freeDisplayList(noText);
+    // test DisplayFileWriter.writeFrame() and DisplayFilePlayer.playFrame()
+    MemorySink file = {NULL, 0};
+    DisplayFileWriter *writer = createDisplayFileWriter(writeToMemory, &file, 64, 64);
+    writer->writeFrame(writer, frames[0]);
+    writer->writeFrame(writer, frames[1]);
+    freeDisplayFileWriter(writer);
+    DisplayFilePlayer *player = createDisplayFilePlayer(file.bytes, file.length);
+    assertEquals("createDisplayFilePlayer()", 64, player ? player->width : 0);
+    softwareCtx->clearRect(softwareCtx, 0, 0, 64, 64);
+    player->playFrame(player, softwareCtx);
+    assertEquals("DisplayFilePlayer.playFrame()", 1, player->playFrame(player, softwareCtx));
+    softwareCtx->getImageData(softwareCtx, softwarePixels, 58, 44);
+    assertEquals("DisplayFilePlayer.playFrame() drawn", 255, softwarePixels->data[2]);
+    assertEquals("DisplayFilePlayer.playFrame() at the end", 0, player->playFrame(player, softwareCtx));
+    freeDisplayFilePlayer(player);
+    free(file.bytes);
+    // test CanvasTrace.attach(), markFrame() and writeJSON()
+    CanvasTrace *trace = createCanvasTrace(0);
+    void (*untracedFillRect)(CanvasRenderingContext2D *, double, double, double, double) = softwareCtx->fillRect;
+    assertEquals("CanvasTrace.attach()", 1, trace->attach(trace, softwareCtx));
+    softwareCtx->fillRect(softwareCtx, 0, 0, 8, 8);
+    softwareCtx->fillRect(softwareCtx, 8, 0, 8, 8);
+    trace->markFrame(trace);
+    MemorySink json = {NULL, 0};
+    assertEquals("CanvasTrace.writeJSON()", 1, trace->writeJSON(trace, writeToMemory, &json) && writeToMemory(&json, "", 1));
+    assertEquals("CanvasTrace.writeJSON() merged calls", 1, strstr((char *)json.bytes, "\"name\":\"fill\"") != NULL && strstr((char *)json.bytes, "\"calls\":2") != NULL);
+    assertEquals("CanvasTrace.writeJSON() frame", 1, strstr((char *)json.bytes, "\"name\":\"frame\"") != NULL);
+    trace->detach(trace, softwareCtx);
+    assertEquals("CanvasTrace.detach()", 1, softwareCtx->fillRect == untracedFillRect);
+    free(json.bytes);
+    freeCanvasTrace(trace);
+    freeDisplayList(frames[0]);
+    freeDisplayList(frames[1]);
+    freeImageData(softwarePixels);
+    freeCanvas(software);
+    // test pixelsPremultiply() and pixelsUnpremultiply()
+    unsigned char pixels[4 * 5] = {255, 128, 0, 128, 10, 20, 30, 0, 200, 100, 50, 255, 1, 2, 3, 4, 90, 60, 30, 51};
+    unsigned char roundTrip[4 * 5];
+    pixelsPremultiply(roundTrip, pixels, 5);
+    assertEquals("pixelsPremultiply()", 64, roundTrip[1]);
+    pixelsUnpremultiply(roundTrip, roundTrip, 5);
+    assertEquals("pixelsUnpremultiply()", 0, memcmp(roundTrip + 8, pixels + 8, 4));
+    // test pixelsSourceOverMask()
+    const unsigned char opaqueRed[4] = {255, 0, 0, 255};
+    const unsigned char coverage[5] = {255, 0, 255, 255, 255};
+    pixelsFillSpan(roundTrip, pixels + 8, 5);
+    pixelsSourceOverMask(roundTrip, opaqueRed, coverage, 5);
+    assertEquals("pixelsSourceOverMask()", 255 + 200, roundTrip[0] + roundTrip[4]);
 
     freeCanvas(canvas);
     freeWindow(Window());
+    // test HTMLWindow.startFrameLoop(), finished by countFrames() a few frames from now
+    Window()->startFrameLoop(countFrames, NULL);
     return 0;
 }
\ No newline at end of file
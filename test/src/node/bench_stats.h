@@ -0,0 +1,30 @@
+/**
+ * Counters kept by stub_canvas.js, read from the benchmark programs run under Node. The functions
+ * are EM_JS functions rather than EM_ASM blocks, so reading the counters isn't counted as a
+ * crossing itself.
+ * @file bench_stats.h
+ * @author Alex Tyner
+ */
+#ifndef BENCH_STATS_H
+#define BENCH_STATS_H
+
+#include <emscripten.h>
+
+/** Which counter benchStat() reads. */
+#define BENCH_CROSSINGS 0
+#define BENCH_JS_CALLS 1
+#define BENCH_BYTES 2
+
+/** Returns a counter's value since benchResetStats() was last called. */
+EM_JS(double, benchStat, (int which), {
+    var stats = Module['benchStats'];
+    return which == 0 ? stats.crossings : which == 1 ? stats.calls : stats.bytes;
+});
+
+/** Zeroes every counter. */
+EM_JS(void, benchResetStats, (void), {
+    var stats = Module['benchStats'];
+    stats.crossings = stats.calls = stats.bytes = 0;
+});
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * Stand-ins for the DOM canvas API, so the library's DOM backend runs under Node without a browser
+ * or GPU. Linked with --pre-js by the benchmark builds in test/Makefile. Nothing is drawn: contexts
+ * only keep the state the library reads back, and count what's done to them.
+ *
+ * Module['benchStats'] counts, since it was last reset:
+ *   crossings - calls from wasm into JavaScript, one per EM_ASM block run
+ *   calls     - methods called and properties assigned on contexts and paths
+ *   bytes     - bytes marshaled across: 8 per numeric argument of a crossing, the UTF-8 bytes of
+ *               strings converted either way, and pixels copied out of getImageData(); buffers
+ *               JavaScript reads in place from the wasm heap aren't counted
+ *
+ * Crossings are counted by wrapping the EM_ASM functions in ASM_CONSTS, so the builds using this
+ * file must not be run through the closure compiler.
+ */
+var benchStats = Module['benchStats'] = {crossings : 0, calls : 0, bytes : 0};
+
+function StubPath2D()
+{
+}
+['closePath', 'moveTo', 'lineTo', 'bezierCurveTo', 'quadraticCurveTo', 'arc', 'arcTo', 'ellipse', 'rect', 'addPath'].forEach(function(name) {
+    StubPath2D.prototype[name] = function() {
+        benchStats.calls++;
+    };
+});
+
+function StubImageData(data, width, height)
+{
+    if (typeof data === 'number')
+    {
+        height = width;
+        width = data;
+        data = new Uint8ClampedArray(width * height * 4);
+    }
+    this.data = data;
+    this.width = width;
+    this.height = height;
+}
+
+var stubDefaults = {
+    fillStyle : '#000000',
+    strokeStyle : '#000000',
+    lineWidth : 1,
+    lineCap : 'butt',
+    lineJoin : 'miter',
+    font : '10px sans-serif',
+    textAlign : 'start',
+    globalAlpha : 1,
+    globalCompositeOperation : 'source-over'
+};
+
+function StubContext2D(canvas)
+{
+    this.canvas = canvas;
+    this.reset();
+}
+StubContext2D.prototype.reset = function() {
+    this.state = Object.assign({}, stubDefaults);
+    this.stack = [];
+};
+Object.keys(stubDefaults).forEach(function(name) {
+    Object.defineProperty(StubContext2D.prototype, name, {
+        get : function() {
+            return this.state[name];
+        },
+        set : function(value) {
+            benchStats.calls++;
+            this.state[name] = value;
+        }
+    });
+});
+['clearRect', 'fillRect', 'strokeRect', 'beginPath', 'closePath', 'moveTo', 'lineTo', 'bezierCurveTo', 'quadraticCurveTo', 'arc', 'arcTo',
+ 'ellipse', 'rect', 'fill', 'stroke', 'clip', 'fillText', 'strokeText', 'rotate', 'scale', 'translate', 'transform', 'setTransform',
+ 'resetTransform', 'putImageData', 'drawImage']
+    .forEach(function(name) {
+        StubContext2D.prototype[name] = function() {
+            benchStats.calls++;
+        };
+    });
+StubContext2D.prototype.save = function() {
+    benchStats.calls++;
+    this.stack.push(Object.assign({}, this.state));
+};
+StubContext2D.prototype.restore = function() {
+    benchStats.calls++;
+    if (this.stack.length)
+        this.state = this.stack.pop();
+};
+StubContext2D.prototype.getImageData = function(x, y, width, height) {
+    benchStats.calls++;
+    benchStats.bytes += width * height * 4;
+    return new StubImageData(width, height);
+};
+StubContext2D.prototype.isPointInPath = StubContext2D.prototype.isPointInStroke = function() {
+    benchStats.calls++;
+    return false;
+};
+StubContext2D.prototype.measureText = function(text) {
+    benchStats.calls++;
+    return {width : 0};
+};
+
+function StubCanvas()
+{
+    this.attributes = {};
+    this.size = {width : 300, height : 150};
+    this.context = null;
+}
+['width', 'height'].forEach(function(name) {
+    Object.defineProperty(StubCanvas.prototype, name, {
+        get : function() {
+            return this.size[name];
+        },
+        set : function(value) {
+            this.size[name] = value >>> 0;
+            /* as in a browser, resizing resets the context's state */
+            if (this.context)
+                this.context.reset();
+        }
+    });
+});
+StubCanvas.prototype.getContext = function(type) {
+    if (type !== '2d')
+        return null;
+    return this.context || (this.context = new StubContext2D(this));
+};
+StubCanvas.prototype.setAttribute = function(name, value) {
+    this.attributes[name] = String(value);
+};
+
+var stubElements = {};
+globalThis.document = {
+    getElementById : function(id) {
+        return stubElements[id] || null;
+    },
+    createElement : function(tag) {
+        return new StubCanvas();
+    },
+    body : {
+        appendChild : function(element) {
+            stubElements[element.attributes['id']] = element;
+        }
+    }
+};
+globalThis.window = {
+    innerWidth : 1280,
+    innerHeight : 720,
+    outerWidth : 1280,
+    outerHeight : 800,
+    blur : function() {},
+    addEventListener : function() {},
+    removeEventListener : function() {}
+};
+globalThis.Path2D = StubPath2D;
+globalThis.ImageData = StubImageData;
+
+Module['preRun'] = [].concat(Module['preRun'] || [], function() {
+    for (var code in ASM_CONSTS)
+        (function(code, run) {
+            ASM_CONSTS[code] = function() {
+                benchStats.crossings++;
+                benchStats.bytes += 8 * arguments.length;
+                return run.apply(this, arguments);
+            };
+        })(code, ASM_CONSTS[code]);
+    /* only the conversions the program links in exist */
+    if (typeof UTF8ToString === 'function')
+    {
+        var toString = UTF8ToString;
+        UTF8ToString = function(ptr, maxBytesToRead) {
+            var string = toString(ptr, maxBytesToRead);
+            benchStats.bytes += Buffer.byteLength(string) + 1;
+            return string;
+        };
+    }
+    if (typeof stringToUTF8 === 'function')
+    {
+        var toUTF8 = stringToUTF8;
+        stringToUTF8 = function(string, outPtr, maxBytesToWrite) {
+            var written = toUTF8(string, outPtr, maxBytesToWrite);
+            benchStats.bytes += (written === undefined ? Buffer.byteLength(string) : written) + 1;
+            return written;
+        };
+    }
+});
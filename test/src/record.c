@@ -0,0 +1,123 @@
+/**
+ * Records the frames of a sample application into a display file, as a trace for the replay
+ * benchmark. An application records its own frames the same way: it draws each frame into a
+ * DisplayList, writes the list, and replays it on its canvas.
+ *
+ *     node build/record.js scene.wcdl [frames]
+ *
+ * @file record.c
+ * @author Alex Tyner
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "canvas.h"
+#include "displaylist.h"
+#include "displayfile.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define SCENE_WIDTH 640
+#define SCENE_HEIGHT 480
+#define TILES_ACROSS 32
+#define TILES_DOWN 8
+#define CHART_POINTS 256
+#define SPRITES 48
+
+/** A dashboard-like frame: a grid of status tiles, a line chart, gauges, labels and spinning sprites. */
+static void drawFrame(CanvasRenderingContext2D *ctx, Path2D *icon, int frame)
+{
+    ctx->setFillColor(ctx, 0x202830FF);
+    ctx->fillRect(ctx, 0, 0, SCENE_WIDTH, SCENE_HEIGHT);
+    float tiles[4 * TILES_ACROSS * TILES_DOWN];
+    uint32_t colors[TILES_ACROSS * TILES_DOWN];
+    for (int i = 0; i < TILES_ACROSS * TILES_DOWN; i++)
+    {
+        tiles[4 * i] = 8 + (i % TILES_ACROSS) * 19;
+        tiles[4 * i + 1] = 8 + (i / TILES_ACROSS) * 19;
+        tiles[4 * i + 2] = tiles[4 * i + 3] = 16;
+        /* a few tiles change state each frame */
+        colors[i] = (i * 7 + frame / 4) % 13 == 0 ? 0xE04040FF : 0x40C060FF;
+    }
+    ctx->fillRectsColored(ctx, tiles, colors, TILES_ACROSS * TILES_DOWN);
+    float chart[2 * CHART_POINTS];
+    for (int i = 0; i < CHART_POINTS; i++)
+    {
+        chart[2 * i] = 8 + i * 2.4f;
+        chart[2 * i + 1] = (float)(300 - 60 * sin((i + frame) * 0.08) - 20 * sin((i + frame) * 0.31));
+    }
+    ctx->setLineWidth(ctx, 2);
+    ctx->setStrokeColor(ctx, 0x60A0FFFF);
+    ctx->beginPath(ctx);
+    ctx->polyline(ctx, chart, CHART_POINTS, 0);
+    ctx->stroke(ctx);
+    ctx->setLineWidth(ctx, 8);
+    ctx->setLineCap(ctx, "round");
+    for (int i = 0; i < 4; i++)
+    {
+        double level = 0.5 + 0.45 * sin(frame * 0.05 + i);
+        ctx->beginPath(ctx);
+        ctx->arc(ctx, 80 + i * 150, 420, 40, 0.75 * M_PI, 0.75 * M_PI + level * 1.5 * M_PI);
+        ctx->stroke(ctx);
+    }
+    ctx->setLineCap(ctx, "butt");
+    ctx->setFont(ctx, "12px sans-serif");
+    ctx->setFillStyle(ctx, "#e0e0e0");
+    char label[32];
+    for (int i = 0; i < 4; i++)
+    {
+        snprintf(label, sizeof(label), "Gauge %d: %d%%", i + 1, (int)(50 + 45 * sin(frame * 0.05 + i)));
+        ctx->fillText(ctx, label, 40 + i * 150, 475, -1);
+    }
+    for (int i = 0; i < SPRITES; i++)
+    {
+        ctx->save(ctx);
+        ctx->translate(ctx, 40 + (i % 12) * 50, 200 + (i / 12) * 20);
+        ctx->rotate(ctx, frame * 0.1 + i);
+        ctx->setFillColor(ctx, 0xFFC040FF);
+        ctx->fillPath(ctx, icon);
+        ctx->restore(ctx);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: record scene.wcdl [frames]\n");
+        return 2;
+    }
+    int frames = argc > 2 ? atoi(argv[2]) : 120;
+    FILE *file = fopen(argv[1], "wb");
+    if (!file)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    Path2D *icon = createPath2D();
+    icon->moveTo(icon, -6, -6);
+    icon->lineTo(icon, 6, 0);
+    icon->lineTo(icon, -6, 6);
+    icon->closePath(icon);
+    DisplayList *list = createDisplayList();
+    DisplayFileWriter *writer = createDisplayFileWriter(displayFileSinkStdio, file, SCENE_WIDTH, SCENE_HEIGHT);
+    int written = 1;
+    for (int frame = 0; frame < frames && written; frame++)
+    {
+        list->clear(list);
+        drawFrame(list->getContext(list), icon, frame);
+        written = writer->writeFrame(writer, list);
+    }
+    freeDisplayFileWriter(writer);
+    freeDisplayList(list);
+    freePath2D(icon);
+    if (fclose(file) != 0 || !written)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    printf("recorded %d frames of %dx%d into %s\n", frames, SCENE_WIDTH, SCENE_HEIGHT, argv[1]);
+    return 0;
+}
@@ -0,0 +1,124 @@
+/**
+ * Replay benchmark: drives the frames of a display file through the DOM backend, against the
+ * JavaScript stand-ins of node/stub_canvas.js, and reports the cost of each frame. The same trace
+ * gives the same calls on every run, so results can be compared across versions of the library.
+ *
+ *     node build/replay.js scene.wcdl [repeats]
+ *
+ * Frames are decoded into display lists up front, so only the library's own work is timed. They are
+ * replayed once in immediate mode and once in recording mode, flushing after each frame.
+ * @file replay.c
+ * @author Alex Tyner
+ */
+#include <emscripten.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "canvas.h"
+#include "displaylist.h"
+#include "displayfile.h"
+#include "node/bench_stats.h"
+
+static unsigned char *readFile(const char *path, size_t *length)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    *length = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    /* malloc() keeps the bytes 8-byte aligned, as the player needs */
+    unsigned char *bytes = (unsigned char *)malloc(*length ? *length : 1);
+    if (fread(bytes, 1, *length, file) != *length)
+    {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(file);
+    return bytes;
+}
+
+static void playAll(CanvasRenderingContext2D *ctx, DisplayList **frames, int frameCount, int width, int height, int recording)
+{
+    for (int i = 0; i < frameCount; i++)
+    {
+        ctx->save(ctx);
+        ctx->clearRect(ctx, 0, 0, width, height);
+        frames[i]->replay(frames[i], ctx);
+        ctx->restore(ctx);
+        if (recording)
+            ctx->flush(ctx);
+    }
+}
+
+static void benchmark(const char *mode, CanvasRenderingContext2D *ctx, DisplayList **frames, int frameCount, int width, int height, int repeats)
+{
+    int recording = mode[0] == 'r';
+    if (recording)
+        ctx->beginRecording(ctx);
+    /* one untimed pass, so JavaScript caches and compiled code are warm */
+    playAll(ctx, frames, frameCount, width, height, recording);
+    double calls = 0;
+    for (int i = 0; i < frameCount; i++)
+        calls += frames[i]->private.commandsLength + 3;
+    calls *= repeats;
+    benchResetStats();
+    double start = emscripten_get_now();
+    for (int r = 0; r < repeats; r++)
+        playAll(ctx, frames, frameCount, width, height, recording);
+    double elapsed = emscripten_get_now() - start;
+    double played = (double)frameCount * repeats;
+    printf("%-9s %d frames x %d: %.0f calls/s, %.3f ms/frame; per frame %.1f calls, %.1f crossings, %.0f bytes marshaled, %.1f JS calls\n",
+           mode, frameCount, repeats, calls / (elapsed / 1000.0), elapsed / played,
+           calls / played, benchStat(BENCH_CROSSINGS) / played, benchStat(BENCH_BYTES) / played, benchStat(BENCH_JS_CALLS) / played);
+    if (recording)
+        ctx->endRecording(ctx);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: replay scene.wcdl [repeats]\n");
+        return 2;
+    }
+    int repeats = argc > 2 ? atoi(argv[2]) : 10;
+    size_t length;
+    unsigned char *bytes = readFile(argv[1], &length);
+    DisplayFilePlayer *player = bytes ? createDisplayFilePlayer(bytes, length) : NULL;
+    if (!player)
+    {
+        fprintf(stderr, "%s: not a version %d display file\n", argv[1], DISPLAY_FILE_VERSION);
+        return 1;
+    }
+    DisplayList **frames = NULL;
+    int frameCount = 0, result;
+    for (;;)
+    {
+        frames = (DisplayList **)realloc(frames, (frameCount + 1) * sizeof(DisplayList *));
+        frames[frameCount] = createDisplayList();
+        result = player->playFrame(player, frames[frameCount]->getContext(frames[frameCount]));
+        if (result <= 0)
+            break;
+        frameCount++;
+    }
+    freeDisplayList(frames[frameCount]);
+    if (result < 0)
+        fprintf(stderr, "%s: malformed after frame %d, replaying the frames before\n", argv[1], frameCount);
+    HTMLCanvasElement *canvas = createCanvas("replay");
+    canvas->setWidth(canvas, player->width);
+    canvas->setHeight(canvas, player->height);
+    CanvasRenderingContext2D *ctx = canvas->getContext(canvas, "2d");
+    if (frameCount && repeats > 0)
+    {
+        benchmark("immediate", ctx, frames, frameCount, player->width, player->height, repeats);
+        benchmark("recording", ctx, frames, frameCount, player->width, player->height, repeats);
+    }
+    for (int i = 0; i < frameCount; i++)
+        freeDisplayList(frames[i]);
+    free(frames);
+    freeCanvas(canvas);
+    /* the lists referenced the player's paths and images, so it goes last */
+    freeDisplayFilePlayer(player);
+    free(bytes);
+    return result < 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * Native player for display files: maps a capture into memory and plays its frames back on a
+ * software canvas, timing each one.
+ *
+ *     playback [-r repeats] [-o last.pam] capture.wcdl
+ *
+ * Prints one line per frame played with the time it took, then the minimum, median and maximum.
+ * With -r, the whole file is played that many times over. With -o, the last frame is saved as a
+ * PAM image.
+ * @file playback.c
+ * @author Alex Tyner
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include "displayfile.h"
+#include "raster.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static int compareTimes(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int writePam(const char *path, const ImageData *image)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return 0;
+    size_t pixels = (size_t)image->width * image->height;
+    fprintf(file, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", image->width, image->height);
+    int written = fwrite(image->data, 4, pixels, file) == pixels;
+    return fclose(file) == 0 && written;
+}
+
+int main(int argc, char **argv)
+{
+    int repeats = 1;
+    const char *output = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "r:o:")) != -1)
+    {
+        if (option == 'r')
+            repeats = atoi(optarg);
+        else if (option == 'o')
+            output = optarg;
+        else
+            break;
+    }
+    if (option != -1 || optind != argc - 1 || repeats < 1)
+    {
+        fprintf(stderr, "usage: %s [-r repeats] [-o last.pam] capture.wcdl\n", argv[0]);
+        return 2;
+    }
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0 || info.st_size == 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    size_t length = (size_t)info.st_size;
+    void *bytes = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (bytes == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    DisplayFilePlayer *player = createDisplayFilePlayer(bytes, length);
+    if (!player)
+    {
+        fprintf(stderr, "%s: not a version %d display file\n", argv[optind], DISPLAY_FILE_VERSION);
+        return 1;
+    }
+    HTMLCanvasElement *canvas = createSoftwareCanvas("playback", player->width, player->height);
+    CanvasRenderingContext2D *ctx = canvas->getContext(canvas, "2d");
+    /* the last frame drawn, read back after each frame, outside the timing */
+    ImageData *last = output ? createImageData(player->width, player->height) : NULL;
+    double *times = NULL;
+    size_t count = 0, capacity = 0;
+    int status = 0;
+    for (int pass = 0; pass < repeats && !status; pass++)
+    {
+        player->rewind(player);
+        for (;;)
+        {
+            double start = now();
+            ctx->save(ctx);
+            ctx->clearRect(ctx, 0, 0, player->width, player->height);
+            int result = player->playFrame(player, ctx);
+            ctx->restore(ctx);
+            double elapsed = now() - start;
+            if (result < 0)
+            {
+                fprintf(stderr, "%s: malformed after frame %zu\n", argv[optind], count);
+                status = 1;
+            }
+            if (result <= 0)
+                break;
+            if (count == capacity)
+            {
+                capacity = capacity ? 2 * capacity : 256;
+                times = (double *)realloc(times, capacity * sizeof(double));
+            }
+            times[count++] = elapsed;
+            printf("frame %zu: %.3f ms\n", count, elapsed);
+            if (last)
+                ctx->getImageData(ctx, last, 0, 0);
+        }
+    }
+    if (count)
+    {
+        qsort(times, count, sizeof(double), compareTimes);
+        printf("%zu frames at %dx%d: min %.3f ms, median %.3f ms, max %.3f ms\n", count, player->width, player->height,
+               times[0], times[count / 2], times[count - 1]);
+    }
+    if (last && !writePam(output, last))
+    {
+        perror(output);
+        status = 1;
+    }
+    if (last)
+        freeImageData(last);
+    free(times);
+    freeCanvas(canvas);
+    freeDisplayFilePlayer(player);
+    munmap(bytes, length);
+    return status;
+}